@@ -11,6 +11,8 @@
 
 #include "stdafx.h"
 #include "D3D12HelloTriangle.h"
+#include "cpu/MeshOptimizer.h"
+#include "cpu/SceneGeometry.h"
 
 #include <stdexcept>
 
@@ -24,12 +26,22 @@
 
 #include "Windowsx.h"
 
-D3D12HelloTriangle::D3D12HelloTriangle(UINT width, UINT height, std::wstring name) :
+static_assert(sizeof(cpu_rt::Vertex) == 28 && offsetof(cpu_rt::Vertex, color) == 12,
+	"The shared scene geometry must have the layout of D3D12HelloTriangle::Vertex");
+// The boxes of the procedural geometry are read in place from the primitives
+static_assert(offsetof(cpu_rt::ProceduralPrimitive, bounds) % D3D12_RAYTRACING_AABB_BYTE_ALIGNMENT == 0 &&
+	sizeof(cpu_rt::ProceduralPrimitive) % D3D12_RAYTRACING_AABB_BYTE_ALIGNMENT == 0 &&
+	sizeof(cpu_rt::Aabb) == sizeof(D3D12_RAYTRACING_AABB),
+	"The bounds of cpu_rt::ProceduralPrimitive must have the layout of D3D12_RAYTRACING_AABB");
+
+D3D12HelloTriangle::D3D12HelloTriangle(UINT width, UINT height, std::wstring name, bool procedural, const cpu_rt::RebuildPolicy& rebuildPolicy) :
 	DXSample(width, height, name),
 	m_frameIndex(0),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
-	m_rtvDescriptorSize(0)
+	m_rtvDescriptorSize(0),
+	m_procedural(procedural),
+	m_rebuildPolicy(rebuildPolicy)
 {
 }
 
@@ -260,6 +272,13 @@ void D3D12HelloTriangle::LoadAssets()
 
 		// Create Cube Buffer
 		CreateCubeVB();
+
+		// The rasterization keeps the triangles of the procedural primitives
+		if (m_procedural)
+		{
+			CreatePrimitiveBuffer({cpu_rt::CreateProceduralCube()}, m_cubePrimitiveBuffer);
+			CreatePrimitiveBuffer({cpu_rt::CreateProceduralGroundPlane()}, m_planePrimitiveBuffer);
+		}
 	}
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
@@ -284,6 +303,7 @@ void D3D12HelloTriangle::OnUpdate()
 
 	m_time++;
 	m_instances[0].second = XMMatrixRotationAxis({ 0.f, 1.f, 0.f }, static_cast<float>(m_time) / 50.0f) * XMMatrixTranslation(0.f, 0.1f * cosf(m_time / 20.f), 0.f);
+	cpu_rt::AnimateHelloTriangleScene(m_topLevelModel, m_time);
 
 	UpdateCameraBuffer();
 }
@@ -353,13 +373,15 @@ void D3D12HelloTriangle::PopulateCommandList()
 		//m_commandList->DrawIndexedInstanced(12, 1, 0, 0, 0);
 
 		m_commandList->IASetVertexBuffers(0, 1, &m_cubeBufferView);
-		m_commandList->DrawInstanced(6 * 6, 1, 0, 0);
+		m_commandList->IASetIndexBuffer(&m_cubeIndexBufferView);
+		m_commandList->DrawIndexedInstanced(m_cubeIndexCount, 1, 0, 0, 0);
 
 		m_commandList->IASetVertexBuffers(0, 1, &m_planeBufferView);
-		m_commandList->DrawInstanced(6, 1, 0, 0);
+		m_commandList->IASetIndexBuffer(&m_planeIndexBufferView);
+		m_commandList->DrawIndexedInstanced(m_planeIndexCount, 1, 0, 0, 0);
 	}
 	else {
-		CreateTopLevelAS(m_instances, true);
+		UpdateTopLevelAS();
 		/*const float clearColor[] = { 0.6f, 0.8f, 0.4f, 1.0f };
 		m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);*/
 		// Bind the descriptor heap giving access to the top-level acceleration
@@ -478,6 +500,17 @@ AccelerationStructureBuffers D3D12HelloTriangle::CreateBottomLevelAS(std::vector
 		}
 	}
 
+	return BuildBottomLevelAS(bottomLevelAS);
+}
+
+AccelerationStructureBuffers D3D12HelloTriangle::CreateProceduralBottomLevelAS(std::pair<ComPtr<ID3D12Resource>, uint32_t> primitiveBuffer) {
+	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
+	// The boxes are the bounds of the primitives, strided by their size
+	bottomLevelAS.AddAabbBuffer(primitiveBuffer.first.Get(), offsetof(cpu_rt::ProceduralPrimitive, bounds), primitiveBuffer.second, sizeof(cpu_rt::ProceduralPrimitive));
+	return BuildBottomLevelAS(bottomLevelAS);
+}
+
+AccelerationStructureBuffers D3D12HelloTriangle::BuildBottomLevelAS(nv_helpers_dx12::BottomLevelASGenerator& bottomLevelAS) {
 	// The AS build requires some scratch space to store temporary information.
 	// The amount of scratch memory is dependent on the scene complexity.
 	UINT64 scratchSizeInBytes = 0;
@@ -504,7 +537,7 @@ AccelerationStructureBuffers D3D12HelloTriangle::CreateBottomLevelAS(std::vector
 // AS itself
 void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, bool updateOnly)
 { 
-	if (!updateOnly) {
+	if (!m_topLevelASBuffers.pResult) {
 		for (size_t i = 0; i < instances.size(); i++)
 		{
 			m_topLevelASGenerator.AddInstance(instances[i].first.Get(), instances[i].second, static_cast<UINT>(i), static_cast<UINT>(2 * i) /*2 hit groups per instance*/);
@@ -516,16 +549,43 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3
 		m_topLevelASBuffers.pResult = nv_helpers_dx12::CreateBuffer(m_device.Get(), resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
 		m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(m_device.Get(), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
 	}
+	else {
+		// The generator keeps the transforms it was given: bring those of the
+		// moved instances up to date, for the refits and the rebuilds alike
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			m_topLevelASGenerator.SetInstanceTransform(static_cast<UINT>(i), instances[i].second);
+		}
+	}
 
 	m_topLevelASGenerator.Generate(m_commandList.Get(), m_topLevelASBuffers.pScratch.Get(), m_topLevelASBuffers.pResult.Get(), m_topLevelASBuffers.pInstanceDesc.Get(), updateOnly, m_topLevelASBuffers.pResult.Get());
 }
 
+// Refit the top-level AS to the animated instances, or rebuild it in place when
+// the CPU hierarchy of the same instances was rebuilt by the rebuild policy,
+// once its SAH cost decayed or after enough refits. The buffers were allocated
+// with ALLOW_UPDATE, which the rebuild keeps
+void D3D12HelloTriangle::UpdateTopLevelAS()
+{
+	const uint32_t buildCount = m_topLevelModel.GetTopLevel().GetStats().buildCount;
+	CreateTopLevelAS(m_instances, buildCount == m_topLevelBuildCount);
+	m_topLevelBuildCount = buildCount;
+}
+
 // Combine the BLAS and TLAS builds to construct the entire acceleration
 // structure required to raytrace the scene
 void D3D12HelloTriangle::CreateAccelerationStructures()
 {
-	AccelerationStructureBuffers cubeBottomLevelBuffers = CreateBottomLevelAS({ {m_CubeBuffer.Get(), 6 * 6} });
-	AccelerationStructureBuffers planeBottomLevelBuffers = CreateBottomLevelAS({{m_planeBuffer.Get(), 6} });
+	AccelerationStructureBuffers cubeBottomLevelBuffers;
+	AccelerationStructureBuffers planeBottomLevelBuffers;
+	if (m_procedural) {
+		cubeBottomLevelBuffers = CreateProceduralBottomLevelAS({ m_cubePrimitiveBuffer, 1 });
+		planeBottomLevelBuffers = CreateProceduralBottomLevelAS({ m_planePrimitiveBuffer, 1 });
+	}
+	else {
+		cubeBottomLevelBuffers = CreateBottomLevelAS({ {m_CubeBuffer.Get(), m_cubeVertexCount} }, { {m_cubeIndexBuffer.Get(), m_cubeIndexCount} });
+		planeBottomLevelBuffers = CreateBottomLevelAS({ {m_planeBuffer.Get(), m_planeVertexCount} }, { {m_planeIndexBuffer.Get(), m_planeIndexCount} });
+	}
 
 	m_instances = {
 		{cubeBottomLevelBuffers.pResult, XMMatrixTranslation(0, 0, 0)},
@@ -534,6 +594,12 @@ void D3D12HelloTriangle::CreateAccelerationStructures()
 
 	CreateTopLevelAS(m_instances);
 
+	// The GPU builds are never asynchronous: a rebuild of the model swapped in
+	// later only delays the one of the GPU
+	m_topLevelModel = m_procedural ? cpu_rt::CreateProceduralHelloTriangleScene() : cpu_rt::CreateHelloTriangleScene();
+	m_topLevelModel.SetRebuildPolicy(m_rebuildPolicy);
+	m_topLevelBuildCount = m_topLevelModel.GetTopLevel().GetStats().buildCount;
+
 	m_commandList->Close();
 	ID3D12CommandList *ppCommandLists[] = {m_commandList.Get()}; m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
 	m_fenceValue++;
@@ -590,11 +656,13 @@ void D3D12HelloTriangle::CreateRaytracingPipeline()
 	m_missLibrary = nv_helpers_dx12::CompileShaderLibrary(L"res/shaders/Miss.hlsl");
 	m_hitLibrary = nv_helpers_dx12::CompileShaderLibrary(L"res/shaders/Hit.hlsl");
 	m_shadowLibrary = nv_helpers_dx12::CompileShaderLibrary(L"res/shaders/ShadowRay.hlsl");
+	m_proceduralLibrary = nv_helpers_dx12::CompileShaderLibrary(L"res/shaders/Procedural.hlsl");
 
 	pipeline.AddLibrary(m_rayGenLibrary.Get(), {L"RayGen"});
 	pipeline.AddLibrary(m_missLibrary.Get(), {L"Miss"});
 	pipeline.AddLibrary(m_hitLibrary.Get(), { L"ClosestHit", L"CubeClosestHit", L"PlaneClosestHit" });
 	pipeline.AddLibrary(m_shadowLibrary.Get(), { L"ShadowClosestHit", L"ShadowMiss" });
+	pipeline.AddLibrary(m_proceduralLibrary.Get(), { L"ProceduralIntersection" });
 
 	// To be used, each DX12 shader needs a root signature defining which
 	// parameters and buffers will be accessed.
@@ -607,11 +675,17 @@ void D3D12HelloTriangle::CreateRaytracingPipeline()
 	pipeline.AddHitGroup(L"CubeHitGroup", L"CubeClosestHit");
 	pipeline.AddHitGroup(L"PlaneHitGroup", L"PlaneClosestHit");
 	pipeline.AddHitGroup(L"ShadowHitGroup", L"ShadowClosestHit");
+	// The procedural primitives are intersected by ProceduralIntersection,
+	// which reports the attributes of triangles: their hit groups keep the
+	// closest hit shaders of the triangle meshes
+	pipeline.AddHitGroup(L"ProceduralCubeHitGroup", L"CubeClosestHit", L"", L"ProceduralIntersection");
+	pipeline.AddHitGroup(L"ProceduralPlaneHitGroup", L"PlaneClosestHit", L"", L"ProceduralIntersection");
+	pipeline.AddHitGroup(L"ProceduralShadowHitGroup", L"ShadowClosestHit", L"", L"ProceduralIntersection");
 
 	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get(), {L"RayGen"}); 
-	pipeline.AddRootSignatureAssociation(m_shadowSignature.Get(), { L"ShadowHitGroup" });
+	pipeline.AddRootSignatureAssociation(m_shadowSignature.Get(), { L"ShadowHitGroup", L"ProceduralShadowHitGroup" });
 	pipeline.AddRootSignatureAssociation(m_missSignature.Get(), { L"Miss", L"ShadowMiss" });
-	pipeline.AddRootSignatureAssociation(m_hitSignature.Get(), { L"HitGroup", L"CubeHitGroup", L"PlaneHitGroup", });
+	pipeline.AddRootSignatureAssociation(m_hitSignature.Get(), { L"HitGroup", L"CubeHitGroup", L"PlaneHitGroup", L"ProceduralCubeHitGroup", L"ProceduralPlaneHitGroup" });
 
 	pipeline.SetMaxPayloadSize(4 * sizeof(float)); 
 	pipeline.SetMaxAttributeSize(2 * sizeof(float)); 
@@ -692,10 +766,23 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
 	m_sbtHelper.AddMissProgram(L"Miss", {}); 
 	m_sbtHelper.AddMissProgram(L"ShadowMiss", {});
 	
-	m_sbtHelper.AddHitGroup(L"CubeHitGroup", {});
-	m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
+	if (m_procedural) {
+		// Two hit groups per instance, as for the triangles. The primitives are
+		// bound to t0 for the intersection shader, t1 is unused and the heap
+		// gives the plane access to the top-level AS for its shadow rays
+		auto cubePrimitives = reinterpret_cast<void*>(m_cubePrimitiveBuffer->GetGPUVirtualAddress());
+		auto planePrimitives = reinterpret_cast<void*>(m_planePrimitiveBuffer->GetGPUVirtualAddress());
+		m_sbtHelper.AddHitGroup(L"ProceduralCubeHitGroup", { cubePrimitives, nullptr, heapPointer });
+		m_sbtHelper.AddHitGroup(L"ProceduralShadowHitGroup", { cubePrimitives, nullptr, heapPointer });
+		m_sbtHelper.AddHitGroup(L"ProceduralPlaneHitGroup", { planePrimitives, nullptr, heapPointer });
+		m_sbtHelper.AddHitGroup(L"ProceduralShadowHitGroup", { planePrimitives, nullptr, heapPointer });
+	}
+	else {
+		m_sbtHelper.AddHitGroup(L"CubeHitGroup", {});
+		m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
 
-	m_sbtHelper.AddHitGroup(L"PlaneHitGroup", { heapPointer });
+		m_sbtHelper.AddHitGroup(L"PlaneHitGroup", { heapPointer });
+	}
 
 	uint32_t sbtSize = m_sbtHelper.ComputeSBTSize();  
 	m_sbtStorage = nv_helpers_dx12::CreateBuffer( m_device.Get(), sbtSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
@@ -821,17 +908,18 @@ void D3D12HelloTriangle::CreateTetrahoidVB() {
 	m_indexBufferView.SizeInBytes = indexBufferSize;
 }
 
-void D3D12HelloTriangle::CreatePlaneVB() {
-	// Define the geometry for a plane. 
-	Vertex planeVertices[] = {
-		{{-1.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 0 
-		{{-1.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 1 
-		{{01.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 2 
-		{{01.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 2 
-		{{-1.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 1 
-		{{01.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}} // 4 
-	};
-	const UINT planeBufferSize = sizeof(planeVertices);
+void D3D12HelloTriangle::CreateMeshBuffers(std::vector<cpu_rt::Vertex> vertices, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW& vertexBufferView, UINT& vertexCount, ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW& indexBufferView, UINT& indexCount) {
+	// Weld the duplicated vertices and order the triangles for the
+	// post-transform cache, as the CPU renderer does. The indices stay 32-bit
+	// whatever the vertex count, as the bottom-level builds of
+	// BottomLevelASGenerator only take R32_UINT indices, and the raster path
+	// shares their buffer
+	std::vector<uint32_t> indices;
+	cpu_rt::OptimizeMesh(vertices, indices);
+	vertexCount = static_cast<UINT>(vertices.size());
+	indexCount = static_cast<UINT>(indices.size());
+	const UINT vertexBufferSize = vertexCount * sizeof(Vertex);
+	const UINT indexBufferSize = indexCount * sizeof(UINT);
 
 	// Note: using upload heaps to transfer static data like vert buffers is not 
 	// recommended. Every time the GPU needs it, the upload heap will be 
@@ -839,93 +927,54 @@ void D3D12HelloTriangle::CreatePlaneVB() {
 	// used here for code simplicity and because there are very few verts to 
 	// actually transfer. 
 	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(planeBufferSize);
-	ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_planeBuffer))); 
-
-	// Copy the triangle data to the vertex buffer. 
-	UINT8* pVertexDataBegin;
+	CD3DX12_RESOURCE_DESC vertexResource = CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize);
+	ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &vertexResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&vertexBuffer)));
+	CD3DX12_RESOURCE_DESC indexResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
+	ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &indexResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&indexBuffer)));
+
+	// Copy the vertices and indices to the buffers. We do not intend to read
+	// from these resources on the CPU. 
+	UINT8* pDataBegin;
 	CD3DX12_RANGE readRange(0, 0);
-
-	// We do not intend to read from this resource on the CPU. 
-	ThrowIfFailed(m_planeBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, planeVertices, sizeof(planeVertices));
-	m_planeBuffer->Unmap(0, nullptr);
-
-	// Initialize the vertex buffer view. 
-	m_planeBufferView.BufferLocation = m_planeBuffer->GetGPUVirtualAddress();
-	m_planeBufferView.StrideInBytes = sizeof(Vertex);
-	m_planeBufferView.SizeInBytes = planeBufferSize;
+	ThrowIfFailed(vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pDataBegin)));
+	memcpy(pDataBegin, vertices.data(), vertexBufferSize);
+	vertexBuffer->Unmap(0, nullptr);
+	ThrowIfFailed(indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pDataBegin)));
+	memcpy(pDataBegin, indices.data(), indexBufferSize);
+	indexBuffer->Unmap(0, nullptr);
+
+	// Initialize the buffer views. 
+	vertexBufferView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
+	vertexBufferView.StrideInBytes = sizeof(Vertex);
+	vertexBufferView.SizeInBytes = vertexBufferSize;
+	indexBufferView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+	indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+	indexBufferView.SizeInBytes = indexBufferSize;
 }
 
-void D3D12HelloTriangle::CreateCubeVB() {
-	// Define the geometry for a cube. 
-	Vertex cubeVertices[] = {
-		{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-
-		{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-
-		{{-0.5f,  -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, 0.5f, -0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, 0.5f, -0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, 0.5f,  0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-
-		{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-
-		{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-
-		{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-		{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
-	};
-	const UINT cubeBufferSize = sizeof(cubeVertices);
-
-	// Note: using upload heaps to transfer static data like vert buffers is not 
-	// recommended. Every time the GPU needs it, the upload heap will be 
-	// marshalled over. Please read up on Default Heap usage. An upload heap is 
-	// used here for code simplicity and because there are very few verts to 
-	// actually transfer. 
+void D3D12HelloTriangle::CreatePrimitiveBuffer(const std::vector<cpu_rt::ProceduralPrimitive>& primitives, ComPtr<ID3D12Resource>& primitiveBuffer) {
+	// Uploaded once and read in place by the AS builds and the intersection
+	// shader, like the vertex buffers
+	const UINT primitiveBufferSize = static_cast<UINT>(primitives.size() * sizeof(cpu_rt::ProceduralPrimitive));
 	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(cubeBufferSize);
-	ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_CubeBuffer)));
+	CD3DX12_RESOURCE_DESC primitiveResource = CD3DX12_RESOURCE_DESC::Buffer(primitiveBufferSize);
+	ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &primitiveResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&primitiveBuffer)));
 
-	// Copy the triangle data to the vertex buffer. 
-	UINT8* pVertexDataBegin;
+	UINT8* pDataBegin;
 	CD3DX12_RANGE readRange(0, 0);
+	ThrowIfFailed(primitiveBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pDataBegin)));
+	memcpy(pDataBegin, primitives.data(), primitiveBufferSize);
+	primitiveBuffer->Unmap(0, nullptr);
+}
 
-	// We do not intend to read from this resource on the CPU. 
-	ThrowIfFailed(m_CubeBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, cubeVertices, sizeof(cubeVertices));
-	m_CubeBuffer->Unmap(0, nullptr);
+void D3D12HelloTriangle::CreatePlaneVB() {
+	// The geometry for a plane is shared with the CPU renderer
+	CreateMeshBuffers({std::begin(cpu_rt::kPlaneVertices), std::end(cpu_rt::kPlaneVertices)}, m_planeBuffer, m_planeBufferView, m_planeVertexCount, m_planeIndexBuffer, m_planeIndexBufferView, m_planeIndexCount);
+}
 
-	// Initialize the vertex buffer view. 
-	m_cubeBufferView.BufferLocation = m_CubeBuffer->GetGPUVirtualAddress();
-	m_cubeBufferView.StrideInBytes = sizeof(Vertex);
-	m_cubeBufferView.SizeInBytes = cubeBufferSize;
+void D3D12HelloTriangle::CreateCubeVB() {
+	// The geometry for a cube is shared with the CPU renderer
+	CreateMeshBuffers({std::begin(cpu_rt::kCubeVertices), std::end(cpu_rt::kCubeVertices)}, m_CubeBuffer, m_cubeBufferView, m_cubeVertexCount, m_cubeIndexBuffer, m_cubeIndexBufferView, m_cubeIndexCount);
 }
 
 void D3D12HelloTriangle::CreateGlobalConstantBuffer()
@@ -12,6 +12,9 @@
 #pragma once
 
 #include "DXSample.h"
+#include "cpu/Common.h"
+#include "cpu/Procedural.h"
+#include "cpu/Scene.h"
 
 #include <dxcapi.h>
 #include <vector>
@@ -28,6 +31,11 @@ using namespace DirectX;
 // An example of this can be found in the class method: OnDestroy().
 using Microsoft::WRL::ComPtr;
 
+namespace nv_helpers_dx12
+{
+class BottomLevelASGenerator;
+}
+
 struct AccelerationStructureBuffers
 {
 	ComPtr<ID3D12Resource> pScratch; // Scratch memory for AS builder
@@ -38,7 +46,13 @@ struct AccelerationStructureBuffers
 class D3D12HelloTriangle : public DXSample
 {
 public:
-	D3D12HelloTriangle(UINT width, UINT height, std::wstring name);
+	/// With procedural set, the raytraced cube and plane are one procedural
+	/// primitive each instead of triangles, as with the -procedural option of
+	/// the CPU renderer. The rebuild policy chooses when the animated top-level
+	/// acceleration structure is rebuilt rather than refitted, as with the
+	/// -rebuild and -rebuildAge options of the CPU renderer
+	D3D12HelloTriangle(UINT width, UINT height, std::wstring name, bool procedural = false,
+		const cpu_rt::RebuildPolicy& rebuildPolicy = {});
 
 	virtual void OnInit();
 	virtual void OnUpdate();
@@ -90,8 +104,15 @@ private:
 	/// \param vVertexBuffers : pair of buffer and vertex count
 	/// \return AccelerationStructureBuffers for TLAS
 	AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers = {});
+	/// Create the acceleration structure of procedural primitives, intersected
+	/// by ProceduralIntersection
+	/// \param primitiveBuffer : buffer of CreatePrimitiveBuffer and its primitive count
+	AccelerationStructureBuffers CreateProceduralBottomLevelAS(std::pair<ComPtr<ID3D12Resource>, uint32_t> primitiveBuffer);
+	/// Allocate the buffers of a bottom-level acceleration structure and build it
+	AccelerationStructureBuffers BuildBottomLevelAS(nv_helpers_dx12::BottomLevelASGenerator& bottomLevelAS);
 	/// Create the main acceleration structure that holds
-	/// all instances of the scene
+	/// all instances of the scene, or refit it, or rebuild it in place once
+	/// it exists
 	/// \param instances : pair of BLAS and transform
 	void CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, bool updateOnly = false);
 	/// Create all acceleration structures, bottom and top
@@ -146,14 +167,25 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_tetrahoidBufferView;
 	void CreateTetrahoidVB();
 
+	// Indexed vertex buffers of a mesh, once optimized by cpu_rt::OptimizeMesh
+	void CreateMeshBuffers(std::vector<cpu_rt::Vertex> vertices, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW& vertexBufferView, UINT& vertexCount, ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW& indexBufferView, UINT& indexCount);
+
 	// Plane
 	ComPtr<ID3D12Resource> m_planeBuffer;
 	D3D12_VERTEX_BUFFER_VIEW m_planeBufferView;
+	UINT m_planeVertexCount = 0;
+	ComPtr<ID3D12Resource> m_planeIndexBuffer;
+	D3D12_INDEX_BUFFER_VIEW m_planeIndexBufferView;
+	UINT m_planeIndexCount = 0;
 	void CreatePlaneVB();
 
 	// Cube
 	ComPtr<ID3D12Resource> m_CubeBuffer;
 	D3D12_VERTEX_BUFFER_VIEW m_cubeBufferView;
+	UINT m_cubeVertexCount = 0;
+	ComPtr<ID3D12Resource> m_cubeIndexBuffer;
+	D3D12_INDEX_BUFFER_VIEW m_cubeIndexBufferView;
+	UINT m_cubeIndexCount = 0;
 	void CreateCubeVB();
 
 	void CreateGlobalConstantBuffer();
@@ -169,7 +201,23 @@ private:
 	ComPtr<IDxcBlob> m_shadowLibrary;
 	ComPtr<ID3D12RootSignature> m_shadowSignature;
 
+	// Procedural primitives, in the layout of cpu_rt::ProceduralPrimitive. The
+	// buffers are read by ProceduralIntersection and hold the boxes of the
+	// bottom-level acceleration structures
+	bool m_procedural;
+	ComPtr<IDxcBlob> m_proceduralLibrary;
+	ComPtr<ID3D12Resource> m_cubePrimitiveBuffer;
+	ComPtr<ID3D12Resource> m_planePrimitiveBuffer;
+	void CreatePrimitiveBuffer(const std::vector<cpu_rt::ProceduralPrimitive>& primitives, ComPtr<ID3D12Resource>& primitiveBuffer);
+
 	// #DXR Extra - Refitting
 	uint32_t m_time = 0;
+	// The driver does not report the quality of the top-level acceleration
+	// structure, so the CPU hierarchy of the same instances, animated along,
+	// applies the rebuild policy: the GPU one is rebuilt whenever it was
+	void UpdateTopLevelAS();
+	cpu_rt::Scene m_topLevelModel;
+	cpu_rt::RebuildPolicy m_rebuildPolicy;
+	uint32_t m_topLevelBuildCount = 0;
 };
 
@@ -11,6 +11,10 @@
 
 #include "stdafx.h"
 #include "D3D12HelloTriangle.h"
+#include "cpu/CommandLine.h"
+#include "cpu/Headless.h"
+
+#include <cstdio>
 
 // add this to run program with nvidia graphics card
 extern "C" {
@@ -20,6 +24,38 @@ extern "C" {
 _Use_decl_annotations_
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
-	D3D12HelloTriangle sample(1280, 720, L"D3D12 Hello Triangle");
+	// The CPU renderer takes narrow arguments, as on the platforms without D3D12
+	std::vector<std::string> args;
+	{
+		int argc;
+		LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		for (int i = 0; i < argc; ++i)
+		{
+			int size = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+			std::string arg(size > 0 ? size - 1 : 0, '\0');
+			WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, &arg[0], size, nullptr, nullptr);
+			args.push_back(arg);
+		}
+		LocalFree(argv);
+	}
+
+	// Headless rendering on the CPU, without creating a window nor a device.
+	// Reports are printed to the console the program was started from
+	if (cpu_rt::IsHeadlessRequested(args))
+	{
+		if (AttachConsole(ATTACH_PARENT_PROCESS))
+		{
+			FILE* stream;
+			freopen_s(&stream, "CONOUT$", "w", stdout);
+			freopen_s(&stream, "CONOUT$", "w", stderr);
+		}
+		return cpu_rt::RunHeadless(args);
+	}
+
+	cpu_rt::RebuildPolicy rebuildPolicy;
+	rebuildPolicy.maxSahInflation = cpu_rt::GetOption(args, "rebuild", 0.f);
+	rebuildPolicy.maxRefits = cpu_rt::GetOption(args, "rebuildAge", 0u);
+	rebuildPolicy.asynchronous = cpu_rt::HasOption(args, "asyncRebuild");
+	D3D12HelloTriangle sample(1280, 720, L"D3D12 Hello Triangle", cpu_rt::HasOption(args, "procedural"), rebuildPolicy);
 	return Win32Application::Run(&sample, hInstance, nCmdShow);
 }
@@ -0,0 +1,2520 @@
+#include "Benchmarks.h"
+#include "BvhCache.h"
+#include "CacheCounters.h"
+#include "CommandLine.h"
+#include "InstanceMerging.h"
+#include "MemoryUsage.h"
+#include "MengerSponge.h"
+#include "MeshImport.h"
+#include "MeshOptimizer.h"
+#include "Parallel.h"
+#include "QuadLeaves.h"
+#include "RayPacket.h"
+#include "RayStream.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "SceneGeometry.h"
+#include "Shaders.h"
+#include "TopLevelBvh.h"
+#include "TriangleBlock.h"
+#include "WideBvh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+using Clock = std::chrono::high_resolution_clock;
+
+double SecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Indexed triangle soup used as benchmark input
+struct BenchmarkMesh
+{
+	std::string name;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	uint32_t TriangleCount() const { return static_cast<uint32_t>((indices.empty() ? vertices.size() : indices.size()) / 3); }
+};
+
+BenchmarkMesh CreateCubeMesh()
+{
+	BenchmarkMesh mesh;
+	mesh.name = "cube";
+	mesh.vertices.assign(std::begin(kCubeVertices), std::end(kCubeVertices));
+	return mesh;
+}
+
+BenchmarkMesh CreateMengerMesh(uint32_t level)
+{
+	BenchmarkMesh mesh;
+	mesh.name = "menger" + std::to_string(level);
+	GenerateMengerSponge(static_cast<int32_t>(level), -1.f, mesh.vertices, mesh.indices);
+	return mesh;
+}
+
+/// Cube and Menger sponges of the levels given by -levels
+std::vector<uint32_t> GetMengerLevels(const std::vector<std::string>& args, const std::vector<uint32_t>& defaultLevels)
+{
+	return GetListOption(args, "levels", defaultLevels);
+}
+
+void AddToBvh(Bvh& bvh, const BenchmarkMesh& mesh)
+{
+	bvh.AddVertexBuffer(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), sizeof(Vertex),
+	                    mesh.indices.empty() ? nullptr : mesh.indices.data(), static_cast<uint32_t>(mesh.indices.size()));
+}
+
+/// Rays from random points on a sphere enclosing the bounds toward random
+/// points inside them, so that most rays hit some geometry
+std::vector<RayDesc> GenerateRays(const Aabb& bounds, uint32_t count, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::normal_distribution<float> normal;
+
+	const glm::vec3 center = bounds.Center();
+	const float radius = glm::length(bounds.Extent());
+	std::vector<RayDesc> rays(count);
+	for (RayDesc& ray : rays)
+	{
+		glm::vec3 onSphere(normal(rng), normal(rng), normal(rng));
+		onSphere = center + radius * glm::normalize(onSphere + glm::vec3(1e-6f));
+		const glm::vec3 target = bounds.min + glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * bounds.Extent();
+		ray.Origin = onSphere;
+		ray.Direction = glm::normalize(target - onSphere);
+		ray.TMin = 0.f;
+		ray.TMax = 1e30f;
+	}
+	return rays;
+}
+
+// -bench bvh [-levels 0-4] [-bins 16] [-leaf 4] [-rays 1000000]
+// Binned SAH build of the cube and of Menger sponges: build time, node count,
+// SAH cost, and single-threaded closest-hit and any-hit query throughput
+int BenchBvh(const std::vector<std::string>& args)
+{
+	BvhBuildSettings settings;
+	settings.binCount = GetOption(args, "bins", settings.binCount);
+	settings.maxLeafSize = GetOption(args, "leaf", settings.maxLeafSize);
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	std::vector<BenchmarkMesh> meshes;
+	std::printf("%-10s %10s %10s %10s %10s %10s %6s %8s %8s %10s %10s\n", "scene", "triangles", "build ms", "Mtris/s",
+	            "nodes", "leaves", "depth", "SAH", "B/tri", "closest", "any");
+
+	auto run = [&](const BenchmarkMesh& mesh) {
+		Bvh bvh;
+		AddToBvh(bvh, mesh);
+		bvh.Build(settings);
+		const BvhStats& stats = bvh.GetStats();
+
+		const std::vector<RayDesc> rays = GenerateRays(bvh.GetBounds(), rayCount, 1);
+		auto start = Clock::now();
+		uint32_t hits = 0;
+		for (const RayDesc& ray : rays)
+		{
+			TriangleHit hit;
+			hits += bvh.Intersect(ray, hit) ? 1 : 0;
+		}
+		const double closestSeconds = SecondsSince(start);
+		start = Clock::now();
+		for (const RayDesc& ray : rays)
+		{
+			hits += bvh.Occluded(ray) ? 1 : 0;
+		}
+		const double anySeconds = SecondsSince(start);
+
+		std::printf("%-10s %10u %10.2f %10.2f %10u %10u %6u %8.2f %8.1f %10.2f %10.2f\n", mesh.name.c_str(),
+		            stats.triangleCount, stats.buildSeconds * 1000.0, stats.triangleCount / stats.buildSeconds * 1e-6,
+		            stats.nodeCount, stats.leafCount, stats.maxDepth, stats.sahCost,
+		            double(stats.memoryInBytes) / stats.triangleCount, rayCount / closestSeconds * 1e-6,
+		            rayCount / anySeconds * 1e-6);
+		return hits;
+	};
+
+	run(CreateCubeMesh());
+	for (uint32_t level : GetMengerLevels(args, {0, 1, 2, 3, 4}))
+	{
+		run(CreateMengerMesh(level));
+	}
+	std::printf("(closest and any: Mrays/s on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench tlas [-instances 100000] [-animated 4] [-frames 100] [-rays 1000000]
+// Top-level hierarchy over a grid of cube instances, a few of which move
+// every frame: cost of the per-frame refit against a full rebuild, and
+// closest-hit throughput through both levels
+int BenchTopLevel(const std::vector<std::string>& args)
+{
+	const uint32_t instanceCount = std::max(GetOption(args, "instances", 100000u), 1u);
+	const uint32_t animatedCount = std::min(GetOption(args, "animated", 4u), instanceCount);
+	const uint32_t frameCount = std::max(GetOption(args, "frames", 100u), 1u);
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	std::vector<Bvh> bottomLevels(1);
+	AddToBvh(bottomLevels[0], CreateCubeMesh());
+	bottomLevels[0].Build();
+	const std::vector<InstanceGroup> groups;
+
+	// Cubes of size 0.5 on a grid with a spacing of 1
+	const uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(double(instanceCount))));
+	std::vector<glm::mat4> transforms(instanceCount);
+	TopLevelBvh topLevel;
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		const glm::vec3 position(float(i % side), float(i / side % side), float(i / (side * side)));
+		transforms[i] = glm::translate(glm::mat4(1.f), position) * glm::scale(glm::mat4(1.f), glm::vec3(0.5f));
+		topLevel.AddInstance(0, transforms[i], i, 0);
+	}
+	topLevel.Update(bottomLevels, groups);
+
+	// The animated instances are spread over the grid and oscillate around
+	// their position, as the cube of OnUpdate
+	const uint32_t animatedStride = instanceCount / std::max(animatedCount, 1u);
+	auto animate = [&](uint32_t frame) {
+		for (uint32_t a = 0; a < animatedCount; a++)
+		{
+			const uint32_t i = a * animatedStride;
+			const glm::mat4 rotation = glm::rotate(glm::mat4(1.f), frame / 50.f, glm::vec3(0.f, 1.f, 0.f));
+			const glm::mat4 translation = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.1f * std::cos(frame / 20.f), 0.f));
+			topLevel.SetInstanceTransform(i, translation * transforms[i] * rotation);
+		}
+	};
+
+	double refitSeconds = 0.0, buildSeconds = 0.0;
+	uint32_t refittedNodes = 0;
+	for (uint32_t frame = 1; frame <= frameCount; frame++)
+	{
+		animate(frame);
+		auto start = Clock::now();
+		topLevel.Update(bottomLevels, groups);
+		refitSeconds += SecondsSince(start);
+		refittedNodes += topLevel.GetStats().refittedNodes;
+	}
+	const uint32_t buildFrames = std::min(frameCount, 10u);
+	for (uint32_t frame = 1; frame <= buildFrames; frame++)
+	{
+		animate(frame);
+		auto start = Clock::now();
+		topLevel.Build(bottomLevels, groups);
+		buildSeconds += SecondsSince(start);
+	}
+
+	Aabb bounds;
+	bounds.min = topLevel.GetNodes()[0].boundsMin;
+	bounds.max = topLevel.GetNodes()[0].boundsMax;
+	const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 1);
+	auto start = Clock::now();
+	uint32_t hits = 0;
+	for (const RayDesc& ray : rays)
+	{
+		HitRecord hit;
+		hits += topLevel.Intersect(ray, bottomLevels, groups, hit) ? 1 : 0;
+	}
+	const double traceSeconds = SecondsSince(start);
+
+	std::printf("%u instances, %u animated, %u top-level nodes\n", instanceCount, animatedCount,
+	            topLevel.GetStats().nodeCount);
+	std::printf("%-12s %14s %14s\n", "update", "us/frame", "nodes/frame");
+	std::printf("%-12s %14.2f %14.1f\n", "refit", refitSeconds / frameCount * 1e6, double(refittedNodes) / frameCount);
+	std::printf("%-12s %14.2f %14u\n", "rebuild", buildSeconds / buildFrames * 1e6, topLevel.GetStats().nodeCount);
+	std::printf("closest hit: %.2f Mrays/s on one thread, %u hits\n", rayCount / traceSeconds * 1e-6, hits);
+	return EXIT_SUCCESS;
+}
+
+/// Time closest-hit and any-hit queries of a hierarchy over a set of rays, in
+/// Mrays/s
+template <typename Hierarchy>
+void MeasureQueries(const Hierarchy& hierarchy, const std::vector<RayDesc>& rays, double& closest, double& any,
+                    uint32_t& hits)
+{
+	auto start = Clock::now();
+	for (const RayDesc& ray : rays)
+	{
+		TriangleHit hit;
+		hits += hierarchy.Intersect(ray, hit) ? 1 : 0;
+	}
+	closest = rays.size() / SecondsSince(start) * 1e-6;
+	start = Clock::now();
+	for (const RayDesc& ray : rays)
+	{
+		hits += hierarchy.Occluded(ray) ? 1 : 0;
+	}
+	any = rays.size() / SecondsSince(start) * 1e-6;
+}
+
+// -bench lbvh [-levels 3,4] [-threads 1,2,4,8,16,32,64] [-rays 1000000]
+// Binned SAH against the parallel linear builder with 30 and 63-bit Morton
+// codes, with and without treelet restructuring: build time, SAH cost and
+// single-threaded query throughput. Then the build time of the linear builder
+// for each thread count
+int BenchLbvh(const std::vector<std::string>& args)
+{
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+	const std::vector<uint32_t> threadCounts = GetListOption(args, "threads", {1, 2, 4, 8, 16, 32, 64});
+
+	struct Builder
+	{
+		const char* name;
+		BvhBuildSettings settings;
+	};
+	std::vector<Builder> builders(4);
+	builders[0].name = "SAH";
+	builders[1].name = "LBVH30";
+	builders[1].settings.algorithm = BvhBuildAlgorithm::Lbvh;
+	builders[2].name = "LBVH63";
+	builders[2].settings.algorithm = BvhBuildAlgorithm::Lbvh;
+	builders[2].settings.mortonBits = 63;
+	builders[3].name = "LBVH30+T";
+	builders[3].settings.algorithm = BvhBuildAlgorithm::Lbvh;
+	builders[3].settings.optimizeTreelets = true;
+
+	std::printf("hardware threads: %u\n", GetDefaultThreadCount());
+	std::printf("%-10s %-9s %10s %10s %10s %10s %6s %8s %10s %10s\n", "scene", "builder", "triangles", "build ms",
+	            "Mtris/s", "nodes", "depth", "SAH", "closest", "any");
+	for (uint32_t level : GetMengerLevels(args, {3, 4}))
+	{
+		const BenchmarkMesh mesh = CreateMengerMesh(level);
+		Bvh geometry;
+		AddToBvh(geometry, mesh);
+		std::vector<RayDesc> rays;
+		uint32_t referenceHits = 0;
+		for (const Builder& builder : builders)
+		{
+			Bvh bvh = geometry;
+			bvh.Build(builder.settings);
+			const BvhStats& stats = bvh.GetStats();
+			if (rays.empty())
+				rays = GenerateRays(bvh.GetBounds(), rayCount, 1);
+
+			double closest, any;
+			uint32_t hits = 0;
+			MeasureQueries(bvh, rays, closest, any, hits);
+			if (&builder == &builders[0])
+				referenceHits = hits;
+			else if (hits != referenceHits)
+				std::printf("warning: %s hit count differs (%u, %u)\n", builder.name, hits, referenceHits);
+
+			std::printf("%-10s %-9s %10u %10.2f %10.2f %10u %6u %8.2f %10.2f %10.2f\n", mesh.name.c_str(), builder.name,
+			            stats.triangleCount, stats.buildSeconds * 1000.0, stats.triangleCount / stats.buildSeconds * 1e-6,
+			            stats.nodeCount, stats.maxDepth, stats.sahCost, closest, any);
+		}
+
+		for (uint32_t threadCount : threadCounts)
+		{
+			BvhBuildSettings settings = builders[1].settings;
+			settings.threadCount = threadCount;
+			// Best of 3 builds, as short builds are sensitive to the first
+			// touch of the memory
+			double best = 1e30;
+			for (int run = 0; run < 3; run++)
+			{
+				Bvh bvh = geometry;
+				bvh.Build(settings);
+				best = std::min(best, bvh.GetStats().buildSeconds);
+			}
+			std::printf("%-10s %-9s %10u %10.2f %10.2f   (%u threads)\n", mesh.name.c_str(), builders[1].name,
+			            mesh.TriangleCount(), best * 1000.0,
+			            mesh.TriangleCount() / best * 1e-6, threadCount);
+		}
+	}
+	std::printf("(closest and any: Mrays/s on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench sbvh [-levels 2-4] [-budgets 10,30,100] [-rays 1000000]
+// Object splits against spatial splits with reference budgets given in %, on
+// Menger sponges standing on a ground plane 10 times wider and crossed by long
+// diagonal slivers, whose boxes overlap most of the sponge: build time,
+// references, SAH cost and single-threaded query throughput over the sponge
+int BenchSbvh(const std::vector<std::string>& args)
+{
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+	const std::vector<uint32_t> budgets = GetListOption(args, "budgets", {10, 30, 100});
+
+	BenchmarkMesh plane;
+	const auto addVertex = [&plane](const glm::vec3& position) {
+		plane.vertices.push_back({{position.x, position.y, position.z}, {1.f, 1.f, 1.f, 1.f}});
+	};
+	for (const Vertex& vertex : kPlaneVertices)
+	{
+		addVertex(glm::vec3(10.f, 1.f, 10.f) * glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+	}
+	// Slivers across the diagonals of the sponge, a tenth of its size wide
+	static const uint32_t kSliverCount = 8;
+	for (uint32_t i = 0; i < kSliverCount; i++)
+	{
+		const float angle = float(i) / kSliverCount * glm::pi<float>();
+		const glm::vec3 direction(std::cos(angle), 0.f, std::sin(angle));
+		addVertex(-1.5f * direction + glm::vec3(0.f, -1.f, 0.f));
+		addVertex(1.5f * direction + glm::vec3(0.f, 1.f, 0.f));
+		addVertex(1.5f * direction + glm::vec3(0.f, 1.1f, 0.f));
+	}
+
+	std::printf("%-10s %-9s %10s %10s %10s %10s %6s %8s %10s %10s\n", "scene", "builder", "triangles", "build ms",
+	            "references", "nodes", "depth", "SAH", "closest", "any");
+	for (uint32_t level : GetMengerLevels(args, {2, 3, 4}))
+	{
+		const BenchmarkMesh mesh = CreateMengerMesh(level);
+		Bvh geometry;
+		AddToBvh(geometry, mesh);
+		AddToBvh(geometry, plane);
+		Bvh sponge;
+		AddToBvh(sponge, mesh);
+		sponge.Build();
+		const std::vector<RayDesc> rays = GenerateRays(sponge.GetBounds(), rayCount, 1);
+
+		uint32_t referenceHits = 0;
+		for (size_t i = 0; i <= budgets.size(); i++)
+		{
+			BvhBuildSettings settings;
+			char name[32] = "SAH";
+			if (i > 0)
+			{
+				settings.algorithm = BvhBuildAlgorithm::SpatialSplitSah;
+				settings.spatialSplitBudget = budgets[i - 1] / 100.f;
+				std::snprintf(name, sizeof(name), "SBVH%u%%", budgets[i - 1]);
+			}
+			Bvh bvh = geometry;
+			bvh.Build(settings);
+			const BvhStats& stats = bvh.GetStats();
+
+			double closest, any;
+			uint32_t hits = 0;
+			MeasureQueries(bvh, rays, closest, any, hits);
+			if (i == 0)
+				referenceHits = hits;
+			else if (hits != referenceHits)
+				std::printf("warning: %s hit count differs (%u, %u)\n", name, hits, referenceHits);
+
+			std::printf("%-10s %-9s %10u %10.2f %10u %10u %6u %8.2f %10.2f %10.2f\n", mesh.name.c_str(), name,
+			            stats.triangleCount, stats.buildSeconds * 1000.0, stats.referenceCount, stats.nodeCount,
+			            stats.maxDepth, stats.sahCost, closest, any);
+		}
+	}
+	std::printf("(closest and any: Mrays/s on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+/// Busy work of the scheduler benchmark, which the compiler cannot remove
+uint32_t SpinWork(uint32_t iterations, uint32_t seed)
+{
+	uint32_t x = seed | 1;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	return x;
+}
+
+/// Binary fork/join tree over [begin, end): one task per leaf
+void ForkJoin(TaskScheduler& scheduler, uint32_t begin, uint32_t end, uint32_t iterations, std::vector<uint32_t>& results)
+{
+	if (end - begin == 1)
+	{
+		results[begin] = SpinWork(iterations, begin);
+		return;
+	}
+	const uint32_t middle = begin + (end - begin) / 2;
+	TaskGroup group(scheduler);
+	group.Run([&scheduler, middle, end, iterations, &results]() { ForkJoin(scheduler, middle, end, iterations, results); });
+	ForkJoin(scheduler, begin, middle, iterations, results);
+	group.Wait();
+}
+
+// -bench tasks [-threads 1,2,4,8,16,32,64] [-work 1,10,100,1000] [-total 200]
+// Scaling of the task scheduler with tasks of 1 us to 1 ms of busy work, as a
+// parallel loop of one task per iteration and as a binary fork/join tree: wall
+// time for -total ms of work, and speedup over the same schedule on 1 thread
+int BenchTasks(const std::vector<std::string>& args)
+{
+	const std::vector<uint32_t> threadCounts = GetListOption(args, "threads", {1, 2, 4, 8, 16, 32, 64});
+	const std::vector<uint32_t> workMicroseconds = GetListOption(args, "work", {1, 10, 100, 1000});
+	const double totalMilliseconds = GetOption(args, "total", 200u);
+
+	// Calibrate the busy loop
+	static const uint32_t kCalibrationIterations = 1 << 24;
+	auto start = Clock::now();
+	const volatile uint32_t calibration = SpinWork(kCalibrationIterations, 1);
+	const double iterationsPerMicrosecond = kCalibrationIterations / (SecondsSince(start) * 1e6);
+
+	(void)calibration;
+	std::printf("hardware threads: %u, %.0f iterations per us\n", GetDefaultThreadCount(), iterationsPerMicrosecond);
+	std::printf("%8s %8s %8s %12s %8s %12s %8s\n", "work us", "tasks", "threads", "loop ms", "speedup", "fork/join ms",
+	            "speedup");
+	for (uint32_t work : workMicroseconds)
+	{
+		const uint32_t iterations = static_cast<uint32_t>(work * iterationsPerMicrosecond);
+		const uint32_t taskCount = std::max(static_cast<uint32_t>(totalMilliseconds * 1000.0 / std::max(work, 1u)), 1u);
+		std::vector<uint32_t> results(taskCount);
+		double loopBase = 0.0, forkJoinBase = 0.0;
+		for (uint32_t threadCount : threadCounts)
+		{
+			// The schedulers are started outside of the measurements
+			TaskScheduler& scheduler = TaskScheduler::Get(threadCount);
+
+			start = Clock::now();
+			ParallelFor(taskCount, 1,
+			            [&](uint32_t begin, uint32_t) { results[begin] = SpinWork(iterations, begin); },
+			            threadCount);
+			const double loop = SecondsSince(start);
+
+			start = Clock::now();
+			ForkJoin(scheduler, 0, taskCount, iterations, results);
+			const double forkJoin = SecondsSince(start);
+
+			if (loopBase == 0.0)
+			{
+				loopBase = loop;
+				forkJoinBase = forkJoin;
+			}
+			std::printf("%8u %8u %8u %12.2f %8.2f %12.2f %8.2f\n", work, taskCount, threadCount, loop * 1000.0,
+			            loopBase / loop, forkJoin * 1000.0, forkJoinBase / forkJoin);
+		}
+	}
+	std::printf("(speedup over the first thread count)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench wide [-levels 3-5] [-rays 1000000]
+// Binary, 4-wide and 8-wide traversal of SAH hierarchies on the cube/plane
+// scene and on Menger sponges, in Mrays/s on one core. The wide hierarchies
+// are collapsed from binary ones built to fill their triangle blocks
+int BenchWideBvh(const std::vector<std::string>& args)
+{
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	std::printf("child box tests: %s, triangle blocks: %s / %s\n", GetWideBvhInstructionSet(),
+	            GetTriangleBlockInstructionSet(4), GetTriangleBlockInstructionSet(8));
+	std::printf("%-10s %10s %8s %8s %8s %10s %10s %10s %10s %10s %10s\n", "scene", "triangles", "B/tri2", "B/tri4",
+	            "B/tri8", "closest2", "closest4", "closest8", "any2", "any4", "any8");
+
+	BvhBuildSettings blockSettings[2];
+	blockSettings[0].leafBlockSize = 4;
+	blockSettings[1].maxLeafSize = blockSettings[1].leafBlockSize = 8;
+
+	// geometry holds the triangles of the scene, not built yet
+	auto run = [&](const std::string& name, Bvh& geometry) {
+		Bvh bvh = geometry;
+		bvh.Build();
+		Bvh4 bvh4;
+		Bvh8 bvh8;
+		geometry.Build(blockSettings[0]);
+		bvh4.Build(geometry);
+		geometry.Build(blockSettings[1]);
+		bvh8.Build(geometry);
+
+		const std::vector<RayDesc> rays = GenerateRays(bvh.GetBounds(), rayCount, 1);
+		double closest[3], any[3];
+		uint32_t hits[3] = {};
+		MeasureQueries(bvh, rays, closest[0], any[0], hits[0]);
+		MeasureQueries(bvh4, rays, closest[1], any[1], hits[1]);
+		MeasureQueries(bvh8, rays, closest[2], any[2], hits[2]);
+		if (hits[1] != hits[0] || hits[2] != hits[0])
+		{
+			std::printf("warning: %s hit counts differ (%u, %u, %u)\n", name.c_str(), hits[0], hits[1], hits[2]);
+		}
+
+		const double triangles = bvh.GetStats().triangleCount;
+		std::printf("%-10s %10u %8.1f %8.1f %8.1f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", name.c_str(),
+		            bvh.GetStats().triangleCount, bvh.GetStats().memoryInBytes / triangles,
+		            bvh4.GetMemoryInBytes() / triangles, bvh8.GetMemoryInBytes() / triangles, closest[0], closest[1],
+		            closest[2], any[0], any[1], any[2]);
+	};
+
+	{
+		// Both meshes of the sample in one hierarchy, as two geometries
+		Bvh bvh;
+		AddToBvh(bvh, CreateCubeMesh());
+		bvh.AddVertexBuffer(kPlaneVertices, static_cast<uint32_t>(std::end(kPlaneVertices) - std::begin(kPlaneVertices)), sizeof(Vertex));
+		run("cube+plane", bvh);
+	}
+	for (uint32_t level : GetMengerLevels(args, {3, 4, 5}))
+	{
+		Bvh bvh;
+		AddToBvh(bvh, CreateMengerMesh(level));
+		run("menger" + std::to_string(level), bvh);
+	}
+	std::printf("(closest and any: Mrays/s on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench quantized [-levels 4-6] [-rays 1000000]
+// Full-precision and quantized nodes of the BVH4 and BVH8 hierarchies on
+// Menger sponges: bytes per triangle (nodes and triangle blocks) and
+// single-threaded closest-hit and any-hit throughput in Mrays/s
+int BenchQuantizedBvh(const std::vector<std::string>& args)
+{
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	std::printf("%-10s %10s %-6s %-10s %10s %10s %10s %10s\n", "scene", "triangles", "width", "nodes", "B/tri",
+	            "node B/tri", "closest", "any");
+
+	auto run = [&](const std::string& name, Bvh& geometry, auto& hierarchy, uint32_t width) {
+		BvhBuildSettings settings;
+		settings.maxLeafSize = settings.leafBlockSize = width;
+		geometry.Build(settings);
+		const std::vector<RayDesc> rays = GenerateRays(geometry.GetBounds(), rayCount, 1);
+		const double triangles = geometry.GetStats().triangleCount;
+
+		uint32_t referenceHits = 0;
+		for (WideBvhNodeFormat format : {WideBvhNodeFormat::Full, WideBvhNodeFormat::Quantized})
+		{
+			hierarchy.Build(geometry, format);
+			const size_t blockBytes = hierarchy.GetTriangleBlocks().size() * sizeof(hierarchy.GetTriangleBlocks()[0]);
+			double closest, any;
+			uint32_t hits = 0;
+			MeasureQueries(hierarchy, rays, closest, any, hits);
+			const bool quantized = format == WideBvhNodeFormat::Quantized;
+			std::printf("%-10s %10u %-6u %-10s %10.1f %10.1f %10.2f %10.2f\n", name.c_str(),
+			            geometry.GetStats().triangleCount, width, quantized ? "quantized" : "full",
+			            hierarchy.GetMemoryInBytes() / triangles, (hierarchy.GetMemoryInBytes() - blockBytes) / triangles,
+			            closest, any);
+			if (quantized && hits != referenceHits)
+			{
+				std::printf("warning: %s hit counts differ (%u, %u)\n", name.c_str(), referenceHits, hits);
+			}
+			referenceHits = hits;
+		}
+	};
+
+	for (uint32_t level : GetMengerLevels(args, {4, 5, 6}))
+	{
+		const std::string name = "menger" + std::to_string(level);
+		Bvh geometry;
+		AddToBvh(geometry, CreateMengerMesh(level));
+		Bvh4 bvh4;
+		run(name, geometry, bvh4, 4);
+		bvh4 = Bvh4();
+		Bvh8 bvh8;
+		run(name, geometry, bvh8, 8);
+	}
+	std::printf("(closest and any: Mrays/s on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench triangles [-triangles 4096] [-rays 2000]
+// Ray-triangle kernels on random triangles: scalar Moller-Trumbore, scalar
+// watertight, and the 4-wide and 8-wide SIMD watertight tests of the triangle
+// blocks, in ns per ray-triangle test on one core. The SIMD kernels must find
+// the hits of the scalar watertight test
+int BenchTriangles(const std::vector<std::string>& args)
+{
+	const uint32_t triangleCount = std::max(GetOption(args, "triangles", 4096u) / 8 * 8, 8u);
+	const uint32_t rayCount = GetOption(args, "rays", 2000u);
+
+	// Small triangles scattered in the unit cube, so that about one ray in a
+	// hundred hits each of them
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<BvhTriangle> triangles(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3 center(uniform(rng), uniform(rng), uniform(rng));
+		auto corner = [&]() { return center + 0.2f * (glm::vec3(uniform(rng), uniform(rng), uniform(rng)) - 0.5f); };
+		triangles[i] = {corner(), corner(), corner(), i, 0};
+	}
+	Aabb bounds;
+	bounds.Extend(glm::vec3(0.f));
+	bounds.Extend(glm::vec3(1.f));
+	const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 2);
+
+	std::vector<TriangleBlock<4>> blocks4;
+	std::vector<TriangleBlock<8>> blocks8;
+	PackTriangleBlocks(triangles.data(), triangleCount, blocks4);
+	PackTriangleBlocks(triangles.data(), triangleCount, blocks8);
+
+	const double testCount = double(triangleCount) * rayCount;
+	std::printf("%-22s %10s %10s\n", "kernel", "ns/test", "hits");
+	auto report = [&](const char* name, Clock::time_point start, uint64_t hits) {
+		std::printf("%-22s %10.3f %10llu\n", name, SecondsSince(start) / testCount * 1e9,
+		            static_cast<unsigned long long>(hits));
+	};
+
+	// Each test gets the full interval, so every hit is counted
+	uint64_t hits = 0;
+	auto start = Clock::now();
+	for (const RayDesc& ray : rays)
+	{
+		for (const BvhTriangle& triangle : triangles)
+		{
+			float t;
+			Attributes attrib;
+			hits += IntersectTriangle(ray.Origin, ray.Direction, ray.TMin, ray.TMax, triangle.v0, triangle.v1,
+			                          triangle.v2, t, attrib) ? 1 : 0;
+		}
+	}
+	report("Moller-Trumbore", start, hits);
+
+	hits = 0;
+	start = Clock::now();
+	for (const RayDesc& ray : rays)
+	{
+		const WatertightRay watertightRay(ray.Origin, ray.Direction);
+		for (const BvhTriangle& triangle : triangles)
+		{
+			float t;
+			Attributes attrib;
+			hits += IntersectTriangleWatertight(watertightRay, ray.TMin, ray.TMax, triangle.v0, triangle.v1,
+			                                    triangle.v2, t, attrib) ? 1 : 0;
+		}
+	}
+	report("watertight", start, hits);
+
+	// Blocks report their closest hit only, so the SIMD kernels are checked
+	// against the number of groups of 4 and 8 triangles hit by the scalar test
+	uint64_t expectedBlockHits[2] = {};
+	for (const RayDesc& ray : rays)
+	{
+		const WatertightRay watertightRay(ray.Origin, ray.Direction);
+		uint32_t groupHits[2] = {};
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			const BvhTriangle& triangle = triangles[i];
+			float t;
+			Attributes attrib;
+			const uint32_t hit = IntersectTriangleWatertight(watertightRay, ray.TMin, ray.TMax, triangle.v0,
+			                                                 triangle.v1, triangle.v2, t, attrib) ? 1 : 0;
+			groupHits[0] |= hit;
+			groupHits[1] |= hit;
+			if (i % 4 == 3)
+			{
+				expectedBlockHits[0] += groupHits[0];
+				groupHits[0] = 0;
+			}
+			if (i % 8 == 7)
+			{
+				expectedBlockHits[1] += groupHits[1];
+				groupHits[1] = 0;
+			}
+		}
+	}
+
+	auto measureBlocks = [&](const char* name, const auto& blocks, uint64_t expectedHits) {
+		uint64_t blockHits = 0;
+		const auto blockStart = Clock::now();
+		for (const RayDesc& ray : rays)
+		{
+			const WatertightRay watertightRay(ray.Origin, ray.Direction);
+			for (const auto& block : blocks)
+			{
+				float t;
+				Attributes attrib;
+				blockHits += IntersectTriangleBlock(block, watertightRay, ray.TMin, ray.TMax, t, attrib) >= 0 ? 1 : 0;
+			}
+		}
+		report(name, blockStart, blockHits);
+		if (blockHits != expectedHits)
+		{
+			std::printf("warning: %s hit %llu blocks, the scalar test %llu\n", name,
+			            static_cast<unsigned long long>(blockHits), static_cast<unsigned long long>(expectedHits));
+		}
+	};
+	measureBlocks(("watertight x4 " + std::string(GetTriangleBlockInstructionSet(4))).c_str(), blocks4,
+	              expectedBlockHits[0]);
+	measureBlocks(("watertight x8 " + std::string(GetTriangleBlockInstructionSet(8))).c_str(), blocks8,
+	              expectedBlockHits[1]);
+	std::printf("(hits: triangles hit by the scalar kernels, blocks hit by the SIMD ones)\n");
+	return EXIT_SUCCESS;
+}
+
+/// The sample scene, optionally with a Menger sponge in place of the cube, at
+/// the first animation frame
+Scene CreateBenchmarkScene(const BenchmarkMesh* replacementCube)
+{
+	if (!replacementCube)
+	{
+		Scene scene = CreateHelloTriangleScene();
+		AnimateHelloTriangleScene(scene, 1);
+		return scene;
+	}
+	Scene scene;
+	Mesh cube;
+	cube.vertices = replacementCube->vertices;
+	cube.indices = replacementCube->indices;
+	Mesh plane;
+	plane.vertices.assign(std::begin(kPlaneVertices), std::end(kPlaneVertices));
+	scene.AddInstance(scene.AddMesh(std::move(cube)), glm::mat4(1.f), 0, 0,
+	                  kVisibleInstanceMask | kShadowCasterInstanceMask);
+	scene.AddInstance(scene.AddMesh(std::move(plane)), glm::mat4(1.f), 1, 2, kVisibleInstanceMask);
+	AnimateHelloTriangleScene(scene, 1);
+	return scene;
+}
+
+// -bench packets [-width 1280] [-height 720] [-levels 3] [-repeat 3]
+// Primary visibility of the sample frame, with the cube or a Menger sponge:
+// single rays against 8x8 and 16x16 packets on one thread
+int BenchPackets(const std::vector<std::string>& args)
+{
+	const uint32_t width = std::max(GetOption(args, "width", 1280u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 720u), 1u);
+	const uint32_t repeat = std::max(GetOption(args, "repeat", 3u), 1u);
+	const glm::uvec2 dims(width, height);
+	const Camera camera = CreateHelloTriangleCamera(width, height);
+	const double rayCount = double(width) * height * repeat;
+
+	std::printf("%-10s %8s %10s %10s %8s %10s %10s %10s\n", "scene", "packet", "Mrays/s", "speedup", "culled%",
+	            "fallback%", "visits/pkt", "mismatches");
+
+	auto run = [&](const std::string& name, const Scene& scene) {
+		std::vector<PrimaryHit> reference(size_t(width) * height);
+		auto start = Clock::now();
+		for (uint32_t r = 0; r < repeat; r++)
+		{
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					PrimaryHit& result = reference[size_t(y) * width + x];
+					result.found = scene.Intersect(GenerateCameraRay(camera, glm::uvec2(x, y), dims), result.hit);
+				}
+			}
+		}
+		const double singleRate = rayCount / SecondsSince(start);
+		std::printf("%-10s %8s %10.2f %10s %8s %10s %10s %10s\n", name.c_str(), "1x1", singleRate * 1e-6, "1.00", "-",
+		            "-", "-", "-");
+
+		RayPacket packet;
+		for (uint32_t packetSize : {8u, 16u})
+		{
+			PacketStats stats;
+			uint32_t mismatches = 0;
+			start = Clock::now();
+			for (uint32_t r = 0; r < repeat; r++)
+			{
+				for (uint32_t y0 = 0; y0 < height; y0 += packetSize)
+				{
+					for (uint32_t x0 = 0; x0 < width; x0 += packetSize)
+					{
+						const uint32_t x1 = std::min(x0 + packetSize, width), y1 = std::min(y0 + packetSize, height);
+						packet.size = 0;
+						for (uint32_t y = y0; y < y1; y++)
+						{
+							for (uint32_t x = x0; x < x1; x++)
+							{
+								const RayDesc ray = GenerateCameraRay(camera, glm::uvec2(x, y), dims);
+								packet.origin = ray.Origin;
+								packet.tMin = ray.TMin;
+								packet.directions[packet.size] = ray.Direction;
+								packet.tMax[packet.size++] = ray.TMax;
+							}
+						}
+						IntersectPacket(scene, packet, PacketSettings(), &stats);
+						if (r > 0)
+							continue;
+						uint32_t i = 0;
+						for (uint32_t y = y0; y < y1; y++)
+						{
+							for (uint32_t x = x0; x < x1; x++, i++)
+							{
+								const PrimaryHit& expected = reference[size_t(y) * width + x];
+								if (packet.found[i] != expected.found ||
+								    (expected.found && (packet.hits[i].instanceIndex != expected.hit.instanceIndex ||
+								                        packet.hits[i].primitiveIndex != expected.hit.primitiveIndex)))
+									mismatches++;
+							}
+						}
+					}
+				}
+			}
+			const double rate = rayCount / SecondsSince(start);
+			const double tests = double(stats.nodeVisits + stats.culledNodes);
+			std::printf("%-10s %8s %10.2f %10.2f %8.1f %10.2f %10.1f %10u\n", name.c_str(),
+			            (std::to_string(packetSize) + "x" + std::to_string(packetSize)).c_str(), rate * 1e-6,
+			            rate / singleRate, 100.0 * stats.culledNodes / std::max(tests, 1.0),
+			            100.0 * stats.singleRayFallbacks / rayCount, tests / stats.packetCount, mismatches);
+		}
+	};
+
+	run("cube", CreateBenchmarkScene(nullptr));
+	for (uint32_t level : GetMengerLevels(args, {3}))
+	{
+		const BenchmarkMesh mesh = CreateMengerMesh(level);
+		run(mesh.name, CreateBenchmarkScene(&mesh));
+	}
+	std::printf("(Mrays/s of primary visibility on one thread, mismatches against single rays)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench shadows [-width 1280] [-height 720] [-levels 3] [-batch 0] [-shuffle] [-repeat 3]
+// Shadow rays of PlaneClosestHit for the primary hits of the sample frame,
+// with the cube or a Menger sponge: traced inline in pixel order as closest
+// hit queries against all the instances (RAY_FLAG_NONE and a 0xFF mask, the
+// baseline), inline with the flags and mask of PlaneClosestHit, and as
+// deferred streams of any-hit queries, unsorted and sorted. -batch splits the
+// streams in batches of that many rays, 0 for one stream per frame. -shuffle
+// randomizes the order in which the rays are generated, as for incoherent
+// secondary rays
+int BenchShadows(const std::vector<std::string>& args)
+{
+	const uint32_t width = std::max(GetOption(args, "width", 1280u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 720u), 1u);
+	const uint32_t batchSize = GetOption(args, "batch", 0u);
+	const uint32_t repeat = std::max(GetOption(args, "repeat", 3u), 1u);
+	const bool shuffle = HasOption(args, "shuffle");
+	const Camera camera = CreateHelloTriangleCamera(width, height);
+
+	std::printf("%-10s %10s %-16s %10s %10s %10s\n", "scene", "rays", "mode", "Mrays/s", "speedup", "mismatches");
+
+	auto run = [&](const std::string& name, const Scene& scene) {
+		// Shadow rays of the primary hits on the plane, as built by
+		// PlaneClosestHit, in pixel order
+		const glm::vec3 lightPos = glm::vec3(2, 2, -2);
+		std::vector<RayDesc> rays;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const RayDesc primary = GenerateCameraRay(camera, glm::uvec2(x, y), glm::uvec2(width, height));
+				HitRecord hit;
+				if (!scene.Intersect(primary, hit) || hit.instanceIndex != 1)
+					continue;
+				RayDesc ray;
+				ray.Origin = primary.Origin + hit.t * primary.Direction;
+				ray.Direction = glm::normalize(lightPos - ray.Origin);
+				ray.TMin = 0.01f;
+				ray.TMax = 100000;
+				rays.push_back(ray);
+			}
+		}
+		if (shuffle)
+		{
+			std::shuffle(rays.begin(), rays.end(), std::mt19937(1));
+		}
+		const double rayCount = double(rays.size()) * repeat;
+
+		// Shadowed if the closest hit selects ShadowClosestHit, that is if it
+		// is on the cube: the plane has no shadow hit group
+		std::vector<uint8_t> reference(rays.size());
+		auto start = Clock::now();
+		for (uint32_t r = 0; r < repeat; r++)
+		{
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				HitRecord hit;
+				reference[i] = scene.Intersect(rays[i], hit) && hit.instanceIndex == 0;
+			}
+		}
+		const double inlineRate = rayCount / SecondsSince(start);
+		std::printf("%-10s %10zu %-16s %10.2f %10.2f %10s\n", name.c_str(), rays.size(), "inline", inlineRate * 1e-6,
+		            1.0, "-");
+
+		// Any hit ends the search, and the plane is masked out
+		const uint32_t shadowFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER;
+		uint32_t flagMismatches = 0;
+		start = Clock::now();
+		for (uint32_t r = 0; r < repeat; r++)
+		{
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				HitRecord hit;
+				const bool shadowed = scene.Intersect(rays[i], hit, shadowFlags, kShadowCasterInstanceMask);
+				flagMismatches += (r == 0 && shadowed != (reference[i] != 0)) ? 1 : 0;
+			}
+		}
+		const double flagsRate = rayCount / SecondsSince(start);
+		std::printf("%-10s %10zu %-16s %10.2f %10.2f %10u\n", name.c_str(), rays.size(), "inline flags",
+		            flagsRate * 1e-6, flagsRate / inlineRate, flagMismatches);
+
+		for (bool sort : {false, true})
+		{
+			RayStreamSettings settings;
+			settings.sort = sort;
+			OcclusionRayStream stream;
+			uint32_t mismatches = 0;
+			start = Clock::now();
+			for (uint32_t r = 0; r < repeat; r++)
+			{
+				const size_t batch = batchSize > 0 ? batchSize : std::max<size_t>(rays.size(), 1);
+				for (size_t first = 0; first < rays.size(); first += batch)
+				{
+					const size_t last = std::min(first + batch, rays.size());
+					stream.Clear();
+					for (size_t i = first; i < last; i++)
+					{
+						stream.Add(rays[i], shadowFlags, kShadowCasterInstanceMask);
+					}
+					stream.Trace(scene, settings);
+					for (size_t i = first; i < last; i++)
+					{
+						HitRecord hit;
+						const bool shadowed = stream.NextResult(hit);
+						mismatches += (r == 0 && shadowed != (reference[i] != 0)) ? 1 : 0;
+					}
+				}
+			}
+			const double rate = rayCount / SecondsSince(start);
+			std::printf("%-10s %10zu %-16s %10.2f %10.2f %10u\n", name.c_str(), rays.size(),
+			            sort ? "deferred sorted" : "deferred", rate * 1e-6, rate / inlineRate, mismatches);
+		}
+	};
+
+	run("cube", CreateBenchmarkScene(nullptr));
+	for (uint32_t level : GetMengerLevels(args, {3}))
+	{
+		const BenchmarkMesh mesh = CreateMengerMesh(level);
+		run(mesh.name, CreateBenchmarkScene(&mesh));
+	}
+	std::printf("(Mrays/s of shadow rays on one thread, sorting included)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench bvhcache [-levels 3,4] [-dir bvhcache] [-rays 100000]
+// Persistent BVH cache: time to hash the geometry into a key, to build, to
+// save and to map the saved hierarchy back, then query throughput of the built
+// and of the mapped hierarchies, which must find the same hits
+int BenchBvhCache(const std::vector<std::string>& args)
+{
+	const uint32_t rayCount = GetOption(args, "rays", 100000u);
+	const BvhCache cache(GetOption(args, "dir", std::string("bvhcache")));
+	const BvhBuildSettings settings;
+
+	std::printf("%-10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "scene", "triangles", "key ms", "build ms", "save ms",
+	            "load ms", "file MB", "built", "mapped");
+	for (uint32_t level : GetMengerLevels(args, {3, 4}))
+	{
+		const BenchmarkMesh mesh = CreateMengerMesh(level);
+		auto start = Clock::now();
+		BvhCacheKey key(settings);
+		key.AddVertexBuffer(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), sizeof(Vertex),
+		                    mesh.indices.empty() ? nullptr : mesh.indices.data(),
+		                    static_cast<uint32_t>(mesh.indices.size()));
+		const double keySeconds = SecondsSince(start);
+
+		Bvh built;
+		AddToBvh(built, mesh);
+		built.Build(settings);
+		start = Clock::now();
+		if (!cache.Save(key, built))
+		{
+			std::printf("cannot write %s\n", cache.GetFileName(key).c_str());
+			return EXIT_FAILURE;
+		}
+		const double saveSeconds = SecondsSince(start);
+
+		start = Clock::now();
+		Bvh mapped;
+		if (!cache.Load(key, mapped))
+		{
+			std::printf("cannot load %s\n", cache.GetFileName(key).c_str());
+			return EXIT_FAILURE;
+		}
+		const double loadSeconds = SecondsSince(start);
+		const double fileBytes = double(MappedFile(cache.GetFileName(key)).GetSize());
+
+		const std::vector<RayDesc> rays = GenerateRays(built.GetBounds(), rayCount, 1);
+		double builtClosest, builtAny, mappedClosest, mappedAny;
+		uint32_t builtHits = 0, mappedHits = 0;
+		MeasureQueries(built, rays, builtClosest, builtAny, builtHits);
+		MeasureQueries(mapped, rays, mappedClosest, mappedAny, mappedHits);
+		if (mappedHits != builtHits)
+			std::printf("warning: the mapped hierarchy hit count differs (%u, %u)\n", mappedHits, builtHits);
+
+		std::printf("%-10s %10u %10.2f %10.2f %10.2f %10.3f %10.2f %10.2f %10.2f\n", mesh.name.c_str(),
+		            built.GetStats().triangleCount, keySeconds * 1000.0, built.GetStats().buildSeconds * 1000.0,
+		            saveSeconds * 1000.0, loadSeconds * 1000.0, fileBytes / (1 << 20), builtClosest, mappedClosest);
+	}
+	std::printf("(built and mapped: closest-hit Mrays/s on one thread; a cached load costs key + load)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench scenefile [-levels 4] [-copies 8] [-file bench.scene] [-cache <dir>]
+// Scene file of copies of a Menger sponge, each a mesh of its own: time to
+// write it, to map it, and to read its vertex and index streams in place
+// against reading them into vectors. With -cache, then the time to create the
+// scene with the bottom levels mapped from a BVH cache, which a first load
+// fills
+int BenchSceneFile(const std::vector<std::string>& args)
+{
+	const uint32_t level = GetOption(args, "levels", 4u);
+	const uint32_t copyCount = std::max(GetOption(args, "copies", 8u), 1u);
+	const std::string fileName = GetOption(args, "file", std::string("bench.scene"));
+	const std::string cacheDirectory = GetOption(args, "cache", std::string());
+
+	const BenchmarkMesh mesh = CreateMengerMesh(level);
+	auto start = Clock::now();
+	{
+		SceneFileWriter writer(fileName);
+		for (uint32_t i = 0; i < copyCount; i++)
+		{
+			const uint32_t meshIndex = writer.AddMesh(mesh.vertices, mesh.indices);
+			writer.AddInstance(meshIndex, glm::translate(glm::mat4(1.f), glm::vec3(1.5f * i, 0.f, 0.f)), i, 0);
+		}
+		writer.Close();
+	}
+	const double writeSeconds = SecondsSince(start);
+
+	start = Clock::now();
+	const SceneFile file(fileName);
+	const double mapSeconds = SecondsSince(start);
+	const double gigabytes = file.GetSize() / double(1 << 30);
+
+	// Sum the coordinates and indices, so that every page is read
+	double checksum = 0.0;
+	start = Clock::now();
+	for (uint32_t i = 0; i < file.GetMeshCount(); i++)
+	{
+		const Mesh fileMesh = file.GetMesh(i);
+		for (const Vertex& vertex : fileMesh.GetVertices())
+		{
+			checksum += vertex.position[0] + vertex.position[1] + vertex.position[2];
+		}
+		for (uint32_t index : fileMesh.GetIndices())
+		{
+			checksum += index;
+		}
+	}
+	const double mappedSeconds = SecondsSince(start);
+
+	// Same through buffered reads into vectors, one mesh at a time
+	double readChecksum = 0.0;
+	start = Clock::now();
+	{
+		std::ifstream stream(fileName, std::ios::binary);
+		for (uint32_t i = 0; i < file.GetMeshCount(); i++)
+		{
+			const SceneFileMesh& record = file.GetMeshRecord(i);
+			std::vector<Vertex> vertices(record.vertexCount);
+			std::vector<uint32_t> indices(record.indexCount);
+			stream.seekg(record.vertexOffset);
+			stream.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+			stream.seekg(record.indexOffset);
+			stream.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(uint32_t));
+			for (const Vertex& vertex : vertices)
+			{
+				readChecksum += vertex.position[0] + vertex.position[1] + vertex.position[2];
+			}
+			for (uint32_t index : indices)
+			{
+				readChecksum += index;
+			}
+		}
+	}
+	const double readSeconds = SecondsSince(start);
+	if (readChecksum != checksum)
+		std::printf("warning: the streams read differ from the mapped ones\n");
+
+	std::printf("%s: %u x %s, %u triangles, %.2f GB\n", fileName.c_str(), copyCount, mesh.name.c_str(),
+	            copyCount * mesh.TriangleCount(), gigabytes);
+	std::printf("%-28s %10s %10s\n", "", "ms", "GB/s");
+	std::printf("%-28s %10.2f %10.2f\n", "write", writeSeconds * 1000.0, gigabytes / writeSeconds);
+	std::printf("%-28s %10.3f %10s\n", "map and check", mapSeconds * 1000.0, "");
+	std::printf("%-28s %10.2f %10.2f\n", "read streams in place", mappedSeconds * 1000.0, gigabytes / mappedSeconds);
+	std::printf("%-28s %10.2f %10.2f\n", "read streams into vectors", readSeconds * 1000.0, gigabytes / readSeconds);
+
+	if (!cacheDirectory.empty())
+	{
+		const BvhCache cache(cacheDirectory);
+		LoadScene(file, &cache);
+		start = Clock::now();
+		const Scene scene = LoadScene(file, &cache);
+		std::printf("%-28s %10.2f %10s\n", "scene with cached BVHs", SecondsSince(start) * 1000.0, "");
+	}
+	std::printf("(the file was just written, so its pages are likely in the system cache)\n");
+	return EXIT_SUCCESS;
+}
+
+/// Write copies of a mesh side by side as an OBJ file, with the vertices of
+/// each triangle of their own as many exporters do, until it reaches a size.
+/// Then the same mesh, welded, as a binary PLY file
+void WriteImportBenchmarkFiles(const BenchmarkMesh& mesh, uint64_t objBytes, const std::string& objFileName,
+                               const std::string& plyFileName)
+{
+	std::ofstream objFile(objFileName, std::ios::binary);
+	std::string text;
+	uint64_t vertexCount = 0;
+	for (uint32_t copy = 0; static_cast<uint64_t>(objFile.tellp()) < objBytes; copy++)
+	{
+		text.clear();
+		char line[96];
+		for (uint32_t index : mesh.indices)
+		{
+			const float* position = mesh.vertices[index].position;
+			text.append(line, std::snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", position[0] + 1.5f * copy,
+			                                position[1], position[2]));
+		}
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			const unsigned long long first = vertexCount + i + 1;
+			text.append(line, std::snprintf(line, sizeof(line), "f %llu %llu %llu\n", first, first + 1, first + 2));
+		}
+		vertexCount += mesh.indices.size();
+		objFile.write(text.data(), static_cast<std::streamsize>(text.size()));
+	}
+	objFile.close();
+
+	const Mesh welded = ImportMesh(objFileName);
+	std::ofstream plyFile(plyFileName, std::ios::binary);
+	plyFile << "ply\nformat binary_little_endian 1.0\nelement vertex " << welded.vertices.size()
+	        << "\nproperty float x\nproperty float y\nproperty float z\nelement face " << welded.TriangleCount()
+	        << "\nproperty list uchar uint vertex_indices\nend_header\n";
+	for (const Vertex& vertex : welded.vertices)
+	{
+		plyFile.write(reinterpret_cast<const char*>(vertex.position), sizeof(vertex.position));
+	}
+	for (size_t i = 0; i < welded.indices.size(); i += 3)
+	{
+		const uint8_t cornerCount = 3;
+		plyFile.write(reinterpret_cast<const char*>(&cornerCount), 1);
+		plyFile.write(reinterpret_cast<const char*>(&welded.indices[i]), 3 * sizeof(uint32_t));
+	}
+}
+
+// -bench import [-size 256] [-levels 3] [-threads 1,2,4,8,16] [-dir .]
+// OBJ and binary PLY importers on copies of a Menger sponge, the OBJ file
+// being about -size MB: parse and weld times, throughput and peak memory for
+// each thread count. Both files must give the same mesh
+int BenchImport(const std::vector<std::string>& args)
+{
+	const uint64_t objBytes = uint64_t(std::max(GetOption(args, "size", 256u), 1u)) << 20;
+	const uint32_t level = GetOption(args, "levels", 3u);
+	const std::vector<uint32_t> threadCounts = GetListOption(args, "threads", {1, 2, 4, 8, 16});
+	const std::string directory = GetOption(args, "dir", std::string("."));
+	const std::string objFileName = directory + "/import_bench.obj";
+	const std::string plyFileName = directory + "/import_bench.ply";
+
+	const auto writeStart = Clock::now();
+	WriteImportBenchmarkFiles(CreateMengerMesh(level), objBytes, objFileName, plyFileName);
+	std::printf("wrote %s and %s in %.1f s\n", objFileName.c_str(), plyFileName.c_str(), SecondsSince(writeStart));
+
+	std::printf("%-4s %8s %10s %10s %10s %10s %12s %12s %12s %10s\n", "file", "threads", "MB", "parse ms", "weld ms",
+	            "MB/s", "vertices in", "vertices", "triangles", "peak MB");
+	Mesh reference;
+	for (const std::string& fileName : {objFileName, plyFileName})
+	{
+		for (uint32_t threadCount : threadCounts)
+		{
+			MeshImportStats stats;
+			Mesh mesh = ImportMesh(fileName, &stats, threadCount);
+			const double seconds = stats.parseSeconds + stats.weldSeconds;
+			std::printf("%-4s %8u %10.1f %10.1f %10.1f %10.1f %12u %12u %12u %10.1f\n",
+			            fileName.substr(fileName.size() - 3).c_str(), threadCount, stats.fileBytes / double(1 << 20),
+			            stats.parseSeconds * 1000.0, stats.weldSeconds * 1000.0,
+			            stats.fileBytes / double(1 << 20) / seconds, stats.fileVertexCount, stats.vertexCount,
+			            stats.triangleCount, stats.peakMemoryBytes / double(1 << 20));
+			if (reference.vertices.empty())
+				reference = std::move(mesh);
+			else if (mesh.indices != reference.indices || mesh.vertices.size() != reference.vertices.size() ||
+			         std::memcmp(mesh.vertices.data(), reference.vertices.data(),
+			                     mesh.vertices.size() * sizeof(Vertex)) != 0)
+				std::printf("warning: the mesh differs from the first import\n");
+		}
+	}
+	std::printf("(peak MB: of the process so far, the pages of the mapped file included)\n");
+	std::remove(objFileName.c_str());
+	std::remove(plyFileName.c_str());
+	return EXIT_SUCCESS;
+}
+
+// -bench menger [-levels 3-5] [-threads 0] [-maxOriginal 5]
+// Port of the original Menger sponge generator against the parallel one,
+// with and without the internal faces: time, triangles and memory of the
+// output. The original runs up to -maxOriginal, its lists of cubes taking
+// several times the memory of the output. Outputs that do not fit in memory
+// are reported as such, the unculled level 6 taking about 50 GB
+int BenchMenger(const std::vector<std::string>& args)
+{
+	const uint32_t threadCount = GetOption(args, "threads", 0u);
+	const uint32_t maxOriginalLevel = GetOption(args, "maxOriginal", 5u);
+
+	std::printf("%u threads\n", TaskScheduler::Get(threadCount).GetThreadCount());
+	std::printf("%-6s %-16s %10s %12s %12s %10s\n", "level", "generator", "ms", "triangles", "vertices", "MB");
+	for (uint32_t level : GetMengerLevels(args, {3, 4, 5}))
+	{
+		auto report = [level](const char* name, Clock::time_point start, const std::vector<Vertex>& vertices,
+		                      const std::vector<uint32_t>& indices) {
+			const double seconds = SecondsSince(start);
+			std::printf("%-6u %-16s %10.2f %12zu %12zu %10.1f\n", level, name, seconds * 1000.0, indices.size() / 3,
+			            vertices.size(),
+			            (vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t)) / double(1 << 20));
+		};
+		if (level <= maxOriginalLevel)
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			const auto start = Clock::now();
+			GenerateMengerSponge(static_cast<int32_t>(level), -1.f, vertices, indices);
+			report("original", start, vertices, indices);
+		}
+		for (bool cullInternalFaces : {false, true})
+		{
+			MengerSpongeSettings settings;
+			settings.level = static_cast<int32_t>(level);
+			settings.cullInternalFaces = cullInternalFaces;
+			settings.threadCount = threadCount;
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			const auto start = Clock::now();
+			try
+			{
+				GenerateMengerSponge(settings, vertices, indices);
+			}
+			catch (const std::length_error&)
+			{
+				std::printf("%-6u %-16s (more vertices than 32-bit indices address)\n", level,
+				            cullInternalFaces ? "parallel culled" : "parallel");
+				continue;
+			}
+			catch (const std::bad_alloc&)
+			{
+				std::printf("%-6u %-16s (out of memory)\n", level, cullInternalFaces ? "parallel culled" : "parallel");
+				continue;
+			}
+			report(cullInternalFaces ? "parallel culled" : "parallel", start, vertices, indices);
+		}
+	}
+	std::printf("(peak memory of the process: %.1f MB)\n", GetPeakMemoryUsage() / double(1 << 20));
+	return EXIT_SUCCESS;
+}
+
+/// Add the groups of a Menger sponge built from instances of a cube: the
+/// group of each level holds 20 copies of the previous level, scaled by 1/3.
+/// Returns the group of the last level, or kNoInstanceGroup at level 0, when
+/// the sponge is the cube mesh itself
+uint32_t AddMengerSpongeGroups(Scene& scene, uint32_t cubeMesh, uint32_t level)
+{
+	uint32_t previous = kNoInstanceGroup;
+	for (uint32_t l = 1; l <= level; l++)
+	{
+		const uint32_t group = scene.AddGroup();
+		for (int x = 0; x < 3; x++)
+		{
+			for (int y = 0; y < 3; y++)
+			{
+				for (int z = 0; z < 3; z++)
+				{
+					// Sub-cubes with two or three centered coordinates are removed
+					if ((x == 1) + (y == 1) + (z == 1) >= 2)
+						continue;
+					const glm::mat4 transform =
+					    glm::translate(glm::mat4(1.f), glm::vec3(x - 1.f, y - 1.f, z - 1.f) / 3.f) *
+					    glm::scale(glm::mat4(1.f), glm::vec3(1.f / 3.f));
+					if (previous == kNoInstanceGroup)
+						scene.AddGroupMesh(group, cubeMesh, transform);
+					else
+						scene.AddGroupChild(group, previous, transform);
+				}
+			}
+		}
+		previous = group;
+	}
+	return previous;
+}
+
+// -bench nested [-levels 1-8] [-maxFlat 4] [-rays 200000]
+// Menger sponges as nested instance groups of a single cube against the
+// flattened mesh of the same triangles: memory of the geometry and the
+// hierarchies, and closest-hit throughput. Flattened meshes are built up to
+// -maxFlat, the level 5 mesh and its hierarchy taking several GB
+int BenchNested(const std::vector<std::string>& args)
+{
+	const uint32_t maxFlatLevel = GetOption(args, "maxFlat", 4u);
+	const uint32_t rayCount = GetOption(args, "rays", 200000u);
+
+	// Same rays for both, toward the unit cube of the sponges
+	Aabb bounds;
+	bounds.min = glm::vec3(-0.5f);
+	bounds.max = glm::vec3(0.5f);
+	const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 1);
+	auto measure = [&](const Scene& scene, uint32_t& hits) {
+		hits = 0;
+		const auto start = Clock::now();
+		for (const RayDesc& ray : rays)
+		{
+			HitRecord hit;
+			hits += scene.Intersect(ray, hit) ? 1 : 0;
+		}
+		return rayCount / SecondsSince(start) * 1e-6;
+	};
+	auto meshBytes = [](const Scene& scene) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < scene.GetMeshes().size(); i++)
+		{
+			const Mesh& mesh = scene.GetMeshes()[i];
+			bytes += mesh.GetVertices().size() * sizeof(Vertex) + mesh.GetIndices().size() * sizeof(uint32_t) +
+			         scene.GetBottomLevels()[i].GetStats().memoryInBytes;
+		}
+		for (const InstanceGroup& group : scene.GetGroups())
+		{
+			bytes += group.GetMemorySize();
+		}
+		return bytes;
+	};
+
+	std::printf("%-6s %-10s %14s %12s %10s %10s %10s\n", "level", "geometry", "triangles", "MB", "build ms", "Mrays/s",
+	            "hits");
+	for (uint32_t level : GetMengerLevels(args, {1, 2, 3, 4, 5, 6, 7, 8}))
+	{
+		const uint64_t triangleCount = 12 * static_cast<uint64_t>(std::pow(20.0, level));
+		uint32_t flatHits = 0;
+		if (level <= maxFlatLevel)
+		{
+			const auto start = Clock::now();
+			Scene scene;
+			Mesh mesh;
+			MengerSpongeSettings settings;
+			settings.level = static_cast<int32_t>(level);
+			settings.cullInternalFaces = false;
+			GenerateMengerSponge(settings, mesh.vertices, mesh.indices);
+			scene.AddInstance(scene.AddMesh(std::move(mesh)), glm::mat4(1.f), 0, 0);
+			scene.UpdateTopLevel();
+			const double buildSeconds = SecondsSince(start);
+			const double mraysPerSecond = measure(scene, flatHits);
+			std::printf("%-6u %-10s %14llu %12.2f %10.2f %10.2f %10u\n", level, "flattened",
+			            static_cast<unsigned long long>(triangleCount), meshBytes(scene) / double(1 << 20),
+			            buildSeconds * 1000.0, mraysPerSecond, flatHits);
+		}
+
+		const auto start = Clock::now();
+		Scene scene;
+		Mesh cube;
+		GenerateMengerSponge(0, -1.f, cube.vertices, cube.indices);
+		const uint32_t cubeMesh = scene.AddMesh(std::move(cube));
+		const uint32_t sponge = AddMengerSpongeGroups(scene, cubeMesh, level);
+		if (sponge == kNoInstanceGroup)
+			scene.AddInstance(cubeMesh, glm::mat4(1.f), 0, 0);
+		else
+			scene.AddGroupInstance(sponge, glm::mat4(1.f), 0, 0);
+		scene.UpdateTopLevel();
+		const double buildSeconds = SecondsSince(start);
+		uint32_t hits;
+		const double mraysPerSecond = measure(scene, hits);
+		std::printf("%-6u %-10s %14llu %12.4f %10.2f %10.2f %10u\n", level, "nested",
+		            static_cast<unsigned long long>(triangleCount), meshBytes(scene) / double(1 << 20),
+		            buildSeconds * 1000.0, mraysPerSecond, hits);
+		if (level <= maxFlatLevel && hits != flatHits)
+			std::printf("warning: nested hit count differs from the flattened mesh (%u, %u)\n", hits, flatHits);
+	}
+	std::printf("(Mrays/s: closest hit on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench procedural [-segments 64] [-field 1000] [-rays 1000000]
+// Analytic procedural primitives against their tessellation, each in its own
+// hierarchy: a sphere against a UV sphere of -segments longitudes, the box
+// against the 12 triangles of the cube, a quad and a bounded plane against 2
+// triangles, and a field of -field spheres against as many UV spheres of
+// -segments / 4 longitudes. Memory of the hierarchy and of the primitives or
+// triangles, and single-threaded closest-hit throughput
+int BenchProcedural(const std::vector<std::string>& args)
+{
+	const uint32_t segments = std::max(GetOption(args, "segments", 64u), 4u);
+	const uint32_t fieldCount = std::max(GetOption(args, "field", 1000u), 1u);
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	// UV spheres, with rows of segments / 2 latitudes and shared poles
+	auto addUvSphere = [](BenchmarkMesh& mesh, const glm::vec3& center, float radius, uint32_t longitudes) {
+		const uint32_t latitudes = longitudes / 2;
+		const uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+		for (uint32_t j = 0; j <= latitudes; j++)
+		{
+			const float theta = glm::pi<float>() * j / latitudes;
+			for (uint32_t i = 0; i <= longitudes; i++)
+			{
+				const float phi = 2.f * glm::pi<float>() * i / longitudes;
+				const glm::vec3 position = center + radius * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+				                                                       std::sin(theta) * std::sin(phi));
+				mesh.vertices.push_back({{position.x, position.y, position.z}, {1.f, 1.f, 1.f, 1.f}});
+			}
+		}
+		for (uint32_t j = 0; j < latitudes; j++)
+		{
+			for (uint32_t i = 0; i < longitudes; i++)
+			{
+				const uint32_t a = first + j * (longitudes + 1) + i;
+				const uint32_t b = a + longitudes + 1;
+				if (j > 0)
+					mesh.indices.insert(mesh.indices.end(), {a, a + 1, b});
+				if (j + 1 < latitudes)
+					mesh.indices.insert(mesh.indices.end(), {a + 1, b + 1, b});
+			}
+		}
+	};
+	auto addQuad = [](BenchmarkMesh& mesh, const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV) {
+		const glm::vec3 corners[] = {corner, corner + edgeU, corner + edgeU + edgeV, corner + edgeV};
+		for (const uint32_t i : {0, 1, 2, 0, 2, 3})
+		{
+			mesh.vertices.push_back({{corners[i].x, corners[i].y, corners[i].z}, {1.f, 1.f, 1.f, 1.f}});
+		}
+	};
+
+	struct Case
+	{
+		const char* name;
+		std::vector<ProceduralPrimitive> primitives;
+		BenchmarkMesh mesh;
+	};
+	std::vector<Case> cases(5);
+	cases[0].name = "sphere";
+	cases[0].primitives.push_back(CreateProceduralSphere(glm::vec3(0.f), 0.5f));
+	addUvSphere(cases[0].mesh, glm::vec3(0.f), 0.5f, segments);
+	cases[1].name = "box";
+	cases[1].primitives.push_back(CreateProceduralBox(glm::vec3(-0.5f), glm::vec3(0.5f)));
+	cases[1].mesh = CreateCubeMesh();
+	cases[2].name = "quad";
+	cases[2].primitives.push_back(
+	    CreateProceduralQuad(glm::vec3(-0.5f, 0.f, -0.5f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f)));
+	addQuad(cases[2].mesh, glm::vec3(-0.5f, 0.f, -0.5f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+	cases[3].name = "plane";
+	Aabb planeBounds;
+	planeBounds.min = glm::vec3(-0.5f, -0.25f, -0.5f);
+	planeBounds.max = glm::vec3(0.5f, 0.25f, 0.5f);
+	cases[3].primitives.push_back(CreateProceduralPlane(glm::vec3(0.f), glm::vec3(0.f, 1.f, 1.f), planeBounds));
+	addQuad(cases[3].mesh, glm::vec3(-0.5f, 0.25f, -0.25f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, -0.5f, 0.5f));
+	cases[4].name = "field";
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	const float fieldRadius = 0.5f / std::cbrt(static_cast<float>(fieldCount));
+	for (uint32_t i = 0; i < fieldCount; i++)
+	{
+		const glm::vec3 center = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) - glm::vec3(0.5f);
+		const float radius = fieldRadius * (0.5f + uniform(rng));
+		cases[4].primitives.push_back(CreateProceduralSphere(center, radius));
+		addUvSphere(cases[4].mesh, center, radius, std::max(segments / 4, 4u));
+	}
+
+	std::printf("%-8s %-10s %10s %12s %10s %10s %10s\n", "shape", "geometry", "primitives", "KB", "build ms",
+	            "Mrays/s", "hits");
+	for (const Case& benchmarkCase : cases)
+	{
+		Bvh procedural;
+		procedural.AddProceduralGeometry(benchmarkCase.primitives.data(),
+		                                 static_cast<uint32_t>(benchmarkCase.primitives.size()));
+		procedural.Build();
+		Bvh triangles;
+		AddToBvh(triangles, benchmarkCase.mesh);
+		triangles.Build();
+
+		// Same rays for both, toward the bounds of the tessellation
+		const std::vector<RayDesc> rays = GenerateRays(triangles.GetBounds(), rayCount, 1);
+		auto run = [&](const Bvh& bvh, const char* geometry, size_t inputBytes) {
+			uint32_t hits = 0;
+			const auto start = Clock::now();
+			for (const RayDesc& ray : rays)
+			{
+				TriangleHit hit;
+				hits += bvh.Intersect(ray, hit) ? 1 : 0;
+			}
+			const double seconds = SecondsSince(start);
+			const BvhStats& stats = bvh.GetStats();
+			std::printf("%-8s %-10s %10u %12.2f %10.3f %10.2f %10u\n", benchmarkCase.name, geometry, stats.triangleCount,
+			            (stats.memoryInBytes + inputBytes) / 1024.0, stats.buildSeconds * 1000.0,
+			            rayCount / seconds * 1e-6, hits);
+		};
+		run(procedural, "analytic", 0);
+		run(triangles, "triangles",
+		    benchmarkCase.mesh.vertices.size() * sizeof(Vertex) + benchmarkCase.mesh.indices.size() * sizeof(uint32_t));
+	}
+	std::printf("(KB: hierarchy, primitives or triangles, and vertices and indices of the tessellation)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench implicit [-levels 0-10] [-maxMesh 4] [-rays 200000] [-width 640] [-height 360]
+// Menger sponges as a single procedural primitive traced through its nested
+// grids, against their meshes with the internal faces culled, each as the
+// instance of the cube of the sample, with its hit group: memory, build time
+// and closest-hit throughput on one thread by level, the rays whose hit
+// distance or face normal differ from the mesh, and the pixels that differ
+// once both are shaded by FaceClosestHit. Meshes are built up to -maxMesh,
+// the level 5 mesh and its hierarchy taking about 1 GB
+int BenchImplicit(const std::vector<std::string>& args)
+{
+	const uint32_t maxMeshLevel = GetOption(args, "maxMesh", 4u);
+	const uint32_t rayCount = GetOption(args, "rays", 200000u);
+	const uint32_t width = std::max(GetOption(args, "width", 640u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 360u), 1u);
+
+	// Both sponges take the first hit group, lit by the normals of their faces
+	const Camera camera = CreateHelloTriangleCamera(width, height);
+	Pipeline pipeline = CreateHelloTrianglePipeline();
+	pipeline.hitGroups[0] = {FaceClosestHit};
+	Image meshImage(width, height);
+	Image implicitImage(width, height);
+
+	// Same rays for both, toward the unit cube of the sponges
+	Aabb bounds;
+	bounds.min = glm::vec3(-0.5f);
+	bounds.max = glm::vec3(0.5f);
+	const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 1);
+	auto measure = [&](const Scene& scene, uint32_t& hits) {
+		hits = 0;
+		const auto start = Clock::now();
+		for (const RayDesc& ray : rays)
+		{
+			HitRecord hit;
+			hits += scene.Intersect(ray, hit) ? 1 : 0;
+		}
+		return rayCount / SecondsSince(start) * 1e-6;
+	};
+
+	std::printf("%-6s %-10s %14s %12s %10s %10s %10s %10s %8s\n", "level", "geometry", "triangles", "MB", "build ms",
+	            "Mrays/s", "hits", "mismatches", "pixels");
+	for (uint32_t level : GetMengerLevels(args, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}))
+	{
+		// Closest face of the mesh along each ray and its outward normal, a
+		// distance of 0 for misses
+		struct MeshHit
+		{
+			float t;
+			glm::vec3 normal;
+		};
+		std::vector<MeshHit> meshHits;
+		if (level <= maxMeshLevel)
+		{
+			auto start = Clock::now();
+			Scene scene;
+			Mesh mesh;
+			MengerSpongeSettings settings;
+			settings.level = static_cast<int32_t>(level);
+			GenerateMengerSponge(settings, mesh.vertices, mesh.indices);
+			const size_t triangleCount = mesh.indices.size() / 3;
+			const size_t meshBytes = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(uint32_t);
+			scene.AddInstance(scene.AddMesh(std::move(mesh)), glm::mat4(1.f), 0, 0);
+			scene.UpdateTopLevel();
+			const double buildSeconds = SecondsSince(start);
+			uint32_t hits;
+			const double mraysPerSecond = measure(scene, hits);
+			std::printf("%-6u %-10s %14llu %12.4f %10.2f %10.2f %10u %10s %8s\n", level, "triangles",
+			            static_cast<unsigned long long>(triangleCount),
+			            (meshBytes + scene.GetBottomLevels()[0].GetStats().memoryInBytes) / double(1 << 20),
+			            buildSeconds * 1000.0, mraysPerSecond, hits, "-", "-");
+			DispatchRays(pipeline, scene, camera, meshImage);
+
+			const Mesh& sponge = scene.GetMeshes()[0];
+			meshHits.resize(rays.size());
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				HitRecord hit;
+				meshHits[i] = {0.f, glm::vec3(0.f)};
+				if (!scene.Intersect(rays[i], hit))
+					continue;
+				glm::vec3 v[3];
+				for (int corner = 0; corner < 3; corner++)
+				{
+					const float* position = sponge.vertices[sponge.indices[3 * hit.primitiveIndex + corner]].position;
+					v[corner] = glm::vec3(position[0], position[1], position[2]);
+				}
+				// Front faces are clockwise, as in D3D12
+				meshHits[i] = {hit.t, glm::normalize(glm::cross(v[2] - v[0], v[1] - v[0]))};
+			}
+		}
+
+		const auto start = Clock::now();
+		Scene scene;
+		Mesh sponge;
+		sponge.procedurals.push_back(
+		    CreateProceduralMengerSponge(bounds.min, bounds.max, static_cast<int32_t>(level)));
+		scene.AddInstance(scene.AddMesh(std::move(sponge)), glm::mat4(1.f), 0, 0);
+		scene.UpdateTopLevel();
+		const double buildSeconds = SecondsSince(start);
+		uint32_t hits;
+		const double mraysPerSecond = measure(scene, hits);
+
+		// The normals are those the intersection reports to the hit group
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < meshHits.size(); i++)
+		{
+			HitRecord hit;
+			const bool found = scene.Intersect(rays[i], hit);
+			if (found != (meshHits[i].t > 0.f) ||
+			    (found &&
+			     (std::fabs(hit.t - meshHits[i].t) > 1e-5f || glm::dot(hit.attrib.normal, meshHits[i].normal) < 0.999f)))
+				mismatches++;
+		}
+		uint32_t differing = 0;
+		if (!meshHits.empty())
+		{
+			DispatchRays(pipeline, scene, camera, implicitImage);
+			for (uint32_t i = 0; i < width * height; i++)
+			{
+				differing += implicitImage.GetData()[i] != meshImage.GetData()[i];
+			}
+		}
+		const std::string mismatchText = meshHits.empty() ? "-" : std::to_string(mismatches);
+		const std::string pixelText = meshHits.empty() ? "-" : std::to_string(differing);
+		std::printf("%-6u %-10s %14s %12.4f %10.2f %10.2f %10u %10s %8s\n", level, "implicit", "-",
+		            scene.GetBottomLevels()[0].GetStats().memoryInBytes / double(1 << 20), buildSeconds * 1000.0,
+		            mraysPerSecond, hits, mismatchText.c_str(), pixelText.c_str());
+	}
+	std::printf("(Mrays/s: closest hit on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench meshopt [-levels 2-4] [-cache 16] [-rays 1000000]
+// Mesh optimization of the sample cube and plane, and of Menger sponges given
+// as unindexed triangle soups, in their generated order and shuffled: memory
+// of the vertex and index streams, vertices transformed per triangle by a
+// FIFO post-transform cache of -cache vertices (ACMR) when welded only and
+// once the triangles are reordered, overfetch of the vertex cache lines,
+// optimization time, and single-threaded closest-hit throughput before and
+// after
+int BenchMeshOptimizer(const std::vector<std::string>& args)
+{
+	MeshOptimizationSettings settings;
+	settings.cacheSize = std::max(GetOption(args, "cache", settings.cacheSize), 1u);
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	// Unindexed meshes, with the triangles of the sponges as they are generated
+	// and in random order
+	std::vector<BenchmarkMesh> meshes;
+	meshes.push_back(CreateCubeMesh());
+	BenchmarkMesh plane;
+	plane.name = "plane";
+	plane.vertices.assign(std::begin(kPlaneVertices), std::end(kPlaneVertices));
+	meshes.push_back(plane);
+	for (uint32_t level : GetMengerLevels(args, {2, 3, 4}))
+	{
+		BenchmarkMesh sponge;
+		sponge.name = "menger" + std::to_string(level);
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MengerSpongeSettings spongeSettings;
+		spongeSettings.level = static_cast<int32_t>(level);
+		GenerateMengerSponge(spongeSettings, vertices, indices);
+		sponge.vertices.reserve(indices.size());
+		for (uint32_t index : indices)
+		{
+			sponge.vertices.push_back(vertices[index]);
+		}
+		BenchmarkMesh shuffled;
+		shuffled.name = sponge.name + "-shuffled";
+		std::vector<uint32_t> order(sponge.TriangleCount());
+		for (uint32_t i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), std::mt19937(1));
+		shuffled.vertices.reserve(sponge.vertices.size());
+		for (uint32_t triangle : order)
+		{
+			shuffled.vertices.insert(shuffled.vertices.end(), sponge.vertices.begin() + 3 * triangle,
+			                         sponge.vertices.begin() + 3 * triangle + 3);
+		}
+		meshes.push_back(std::move(sponge));
+		meshes.push_back(std::move(shuffled));
+	}
+
+	auto measure = [&](const BenchmarkMesh& mesh, const std::vector<RayDesc>& rays) {
+		Bvh bvh;
+		AddToBvh(bvh, mesh);
+		bvh.Build();
+		const auto start = Clock::now();
+		for (const RayDesc& ray : rays)
+		{
+			TriangleHit hit;
+			bvh.Intersect(ray, hit);
+		}
+		return rays.size() / SecondsSince(start) * 1e-6;
+	};
+
+	std::printf("%-16s %10s %10s %10s %10s %10s %5s %6s %6s %6s %6s %6s %10s %8s %8s\n", "mesh", "triangles",
+	            "vertices", "welded", "KB", "KB after", "index", "ACMR", "welded", "after", "fetch", "after", "ms",
+	            "Mrays/s", "after");
+	for (const BenchmarkMesh& mesh : meshes)
+	{
+		BenchmarkMesh welded = mesh;
+		MeshOptimizationSettings weldSettings = settings;
+		weldSettings.optimizeVertexCache = weldSettings.optimizeVertexFetch = false;
+		const MeshOptimizationStats weldStats = OptimizeMesh(welded.vertices, welded.indices, weldSettings);
+
+		BenchmarkMesh optimized = mesh;
+		const MeshOptimizationStats stats = OptimizeMesh(optimized.vertices, optimized.indices, settings);
+
+		Aabb bounds;
+		for (const Vertex& vertex : mesh.vertices)
+		{
+			bounds.Extend(glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+		}
+		const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 1);
+		const double inputRate = measure(mesh, rays);
+		const double optimizedRate = measure(optimized, rays);
+		std::printf("%-16s %10u %10u %10u %10.1f %10.1f %5u %6.3f %6.3f %6.3f %6.3f %6.3f %10.2f %8.2f %8.2f\n",
+		            mesh.name.c_str(), stats.triangleCount, stats.inputVertexCount, stats.vertexCount,
+		            stats.inputBytes / 1024.0, stats.bytes / 1024.0, 8 * GetIndexSize(stats.vertexCount),
+		            stats.inputAcmr, weldStats.acmr, stats.acmr, stats.inputOverfetch, stats.overfetch,
+		            stats.seconds * 1000.0, inputRate, optimizedRate);
+	}
+	std::printf("(KB of vertices and indices, index bits, ACMR with a FIFO of %u vertices, fetch: overfetch of "
+	            "64-byte lines, ms: optimization, Mrays/s: closest hit on one thread)\n",
+	            settings.cacheSize);
+	return EXIT_SUCCESS;
+}
+
+// -bench vertices [-levels 3,4] [-width 1280] [-height 720] [-repeat 3]
+// Full, RGBA8 and palette vertex formats of Menger sponges colored by
+// position, in place of the cube and shaded by ClosestHit: memory of the
+// vertices, largest position and color errors, pixels differing from the
+// full-format image, best frame time and decode throughput on one thread
+int BenchVertices(const std::vector<std::string>& args)
+{
+	const uint32_t width = std::max(GetOption(args, "width", 1280u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 720u), 1u);
+	const uint32_t repeat = std::max(GetOption(args, "repeat", 3u), 1u);
+
+	const Camera camera = CreateHelloTriangleCamera(width, height);
+	Pipeline pipeline = CreateHelloTrianglePipeline();
+	pipeline.hitGroups[0] = {ClosestHit};
+	Image reference(width, height);
+	Image output(width, height);
+
+	struct Format
+	{
+		const char* name;
+		bool compressed;
+		VertexColorFormat colorFormat;
+	};
+	const Format formats[] = {
+		{"full", false, VertexColorFormat::Rgba8},
+		{"rgba8", true, VertexColorFormat::Rgba8},
+		{"palette", true, VertexColorFormat::Palette},
+	};
+
+	std::printf("%-10s %-8s %10s %10s %6s %12s %10s %8s %10s %12s\n", "mesh", "format", "vertices", "KB", "B/vtx",
+	            "position err", "color err", "pixels", "ms", "Mvertices/s");
+	for (uint32_t level : GetMengerLevels(args, {3, 4}))
+	{
+		// Colors on a coarse grid over the sponge, of a few distinct values and
+		// 8-bit channels, so that they are exact in every format
+		BenchmarkMesh mesh = CreateMengerMesh(level);
+		for (Vertex& vertex : mesh.vertices)
+		{
+			for (int channel = 0; channel < 3; channel++)
+			{
+				vertex.color[channel] = std::floor((vertex.position[channel] + 0.5f) * 7.f + 0.5f) * 36.f / 255.f;
+			}
+		}
+
+		for (const Format& format : formats)
+		{
+			Scene scene;
+			Mesh cube;
+			cube.vertices = mesh.vertices;
+			cube.indices = mesh.indices;
+			if (format.compressed)
+				cube.CompressVertices(format.colorFormat);
+			Mesh plane;
+			plane.vertices.assign(std::begin(kPlaneVertices), std::end(kPlaneVertices));
+			scene.AddInstance(scene.AddMesh(std::move(cube)), glm::mat4(1.f), 0, 0,
+			                  kVisibleInstanceMask | kShadowCasterInstanceMask);
+			scene.AddInstance(scene.AddMesh(std::move(plane)), glm::mat4(1.f), 1, 2, kVisibleInstanceMask);
+			AnimateHelloTriangleScene(scene, 1);
+			const Mesh& sponge = scene.GetMeshes()[0];
+			const uint32_t vertexCount = sponge.GetVertexCount();
+
+			float positionError = 0.f;
+			float colorError = 0.f;
+			for (uint32_t i = 0; i < vertexCount; i++)
+			{
+				const Vertex& vertex = mesh.vertices[i];
+				const glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+				const glm::vec4 color(vertex.color[0], vertex.color[1], vertex.color[2], vertex.color[3]);
+				const glm::vec3 positionDelta = glm::abs(sponge.GetPosition(i) - position);
+				const glm::vec4 colorDelta = glm::abs(sponge.GetColor(i) - color);
+				positionError =
+				    std::max(positionError, std::max(std::max(positionDelta.x, positionDelta.y), positionDelta.z));
+				colorError = std::max(colorError, std::max(std::max(colorDelta.x, colorDelta.y),
+				                                           std::max(colorDelta.z, colorDelta.w)));
+			}
+
+			// The full format comes first and renders the reference
+			DispatchSettings settings;
+			settings.threadCount = 1;
+			Image& image = format.compressed ? output : reference;
+			double best = 1e30;
+			for (uint32_t r = 0; r < repeat; r++)
+			{
+				best = std::min(best, DispatchRays(pipeline, scene, camera, image, settings).seconds);
+			}
+			uint32_t differing = 0;
+			for (uint32_t i = 0; i < width * height; i++)
+			{
+				differing += image.GetData()[i] != reference.GetData()[i];
+			}
+
+			// Decode of every vertex, as ClosestHit fetches them
+			const uint32_t passes = std::max(4000000u / std::max(vertexCount, 1u), 1u);
+			glm::vec4 sum(0.f);
+			const auto start = Clock::now();
+			for (uint32_t pass = 0; pass < passes; pass++)
+			{
+				for (uint32_t i = 0; i < vertexCount; i++)
+				{
+					sum += glm::vec4(sponge.GetPosition(i), 0.f) + sponge.GetColor(i);
+				}
+			}
+			const double decodeRate = double(passes) * vertexCount / SecondsSince(start) * 1e-6;
+			const volatile float checksum = sum.x + sum.y + sum.z + sum.w;
+			(void)checksum;
+
+			const size_t bytes =
+			    format.compressed ? sponge.compressedVertices.GetMemorySize() : vertexCount * sizeof(Vertex);
+			std::printf("%-10s %-8s %10u %10.1f %6.2f %12.3g %10.3g %8u %10.2f %12.1f\n", mesh.name.c_str(),
+			            format.name, vertexCount, bytes / 1024.0, double(bytes) / vertexCount, positionError, colorError,
+			            differing, best * 1000.0, decodeRate);
+		}
+	}
+	std::printf("(KB and bytes per vertex of the vertex streams, errors: largest of a coordinate and of a color "
+	            "channel, pixels: differing from the full format, ms: frame on one thread)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench quads [-levels 2-4] [-leaf 1,4] [-rays 1000000]
+// Quad leaves against triangle leaves on the sample cube and plane and on
+// Menger sponges, for leaves of up to -leaf primitives: quads and the share
+// of parallelograms, nodes, memory, build time, nodes visited and leaf
+// primitives tested per ray, single-threaded closest-hit throughput, and hits
+// that differ from the triangle leaves, with and without back-face culling.
+// Those are ties on shared edges, and rays through the diagonal of a quad,
+// which the triangles of the parallelogram may both miss but its test does not
+int BenchQuads(const std::vector<std::string>& args)
+{
+	const std::vector<uint32_t> leafSizes = GetListOption(args, "leaf", {1, 4});
+	const uint32_t rayCount = GetOption(args, "rays", 1000000u);
+
+	std::vector<BenchmarkMesh> meshes;
+	meshes.push_back(CreateCubeMesh());
+	BenchmarkMesh plane;
+	plane.name = "plane";
+	plane.vertices.assign(std::begin(kPlaneVertices), std::end(kPlaneVertices));
+	meshes.push_back(plane);
+	for (uint32_t level : GetMengerLevels(args, {2, 3, 4}))
+	{
+		meshes.push_back(CreateMengerMesh(level));
+	}
+
+	// Nodes visited and primitives tested by a closest-hit traversal in the
+	// order of Bvh::Traverse
+	auto countTraversal = [](const Bvh& bvh, const RayDesc& rayDesc, uint64_t& nodeCount, uint64_t& testCount) {
+		const ArrayView<BvhNode> nodes = bvh.GetNodes();
+		const ArrayView<BvhTriangle> triangles = bvh.GetTriangles();
+		const ArrayView<BvhQuad> quads = bvh.GetQuads();
+		const TraversalRay ray(rayDesc);
+		float tClosest = ray.tMax;
+		uint32_t stack[kBvhMaxDepth + 1];
+		uint32_t stackSize = 0;
+		float tEntry;
+		if (nodes.empty() || !IntersectAabb(ray, nodes[0].boundsMin, nodes[0].boundsMax, tClosest, tEntry))
+			return;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			const BvhNode& node = nodes[stack[--stackSize]];
+			if (!IntersectAabb(ray, node.boundsMin, node.boundsMax, tClosest, tEntry))
+				continue;
+			nodeCount++;
+			if (node.IsLeaf())
+			{
+				testCount += node.count;
+				for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					float t;
+					Attributes attrib;
+					const bool hit =
+					    bvh.HasQuads()
+					        ? IntersectQuad(ray.origin, ray.direction, ray.tMin, tClosest, quads[i], t, attrib) >= 0
+					        : IntersectTriangle(ray.origin, ray.direction, ray.tMin, tClosest, triangles[i].v0,
+					                            triangles[i].v1, triangles[i].v2, t, attrib);
+					if (hit)
+						tClosest = t;
+				}
+				continue;
+			}
+			const BvhNode& left = nodes[node.leftOrFirst];
+			const BvhNode& right = nodes[node.leftOrFirst + 1];
+			float tLeft, tRight;
+			const bool hitLeft = IntersectAabb(ray, left.boundsMin, left.boundsMax, tClosest, tLeft);
+			const bool hitRight = IntersectAabb(ray, right.boundsMin, right.boundsMax, tClosest, tRight);
+			if (hitLeft && hitRight)
+			{
+				const bool leftFirst = tLeft <= tRight;
+				stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+				stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+			}
+			else if (hitLeft || hitRight)
+			{
+				stack[stackSize++] = hitLeft ? node.leftOrFirst : node.leftOrFirst + 1;
+			}
+		}
+	};
+
+	std::printf("%-10s %4s %10s %10s %6s %10s %10s %9s %9s %8s %8s %6s %6s %6s %6s %8s %8s %6s\n", "mesh", "leaf",
+	            "triangles", "quads", "para%", "nodes", "quad nodes", "KB", "quad KB", "ms", "quad ms", "nodes", "quad",
+	            "tests", "quad", "Mrays/s", "quad", "diffs");
+	for (const BenchmarkMesh& mesh : meshes)
+	{
+		for (uint32_t leafSize : leafSizes)
+		{
+			BvhBuildSettings settings;
+			settings.maxLeafSize = leafSize;
+			Bvh triangles;
+			AddToBvh(triangles, mesh);
+			triangles.Build(settings);
+			Bvh quads;
+			AddToBvh(quads, mesh);
+			settings.quadLeaves = true;
+			quads.Build(settings);
+			uint32_t parallelogramCount = 0;
+			for (const BvhQuad& quad : quads.GetQuads())
+			{
+				parallelogramCount += quad.parallelogram;
+			}
+
+			const std::vector<RayDesc> rays = GenerateRays(triangles.GetBounds(), rayCount, 1);
+			uint64_t nodeCounts[2] = {}, testCounts[2] = {};
+			double rates[2];
+			const Bvh* hierarchies[2] = {&triangles, &quads};
+			for (int h = 0; h < 2; h++)
+			{
+				for (const RayDesc& ray : rays)
+				{
+					countTraversal(*hierarchies[h], ray, nodeCounts[h], testCounts[h]);
+				}
+				const auto start = Clock::now();
+				for (const RayDesc& ray : rays)
+				{
+					TriangleHit hit;
+					hierarchies[h]->Intersect(ray, hit);
+				}
+				rates[h] = rays.size() / SecondsSince(start) * 1e-6;
+			}
+
+			uint32_t differing = 0;
+			for (uint32_t flags : {uint32_t(RAY_FLAG_NONE), uint32_t(RAY_FLAG_CULL_BACK_FACING_TRIANGLES)})
+			{
+				for (const RayDesc& ray : rays)
+				{
+					TriangleHit expected, hit;
+					const bool found = triangles.Intersect(ray, expected, flags);
+					if (found != quads.Intersect(ray, hit, flags))
+						differing++;
+					else if (found && (hit.primitiveIndex != expected.primitiveIndex ||
+					                   std::fabs(hit.t - expected.t) > 1e-5f * expected.t ||
+					                   glm::any(glm::greaterThan(glm::abs(hit.attrib.bary - expected.attrib.bary),
+					                                             glm::vec2(1e-4f)))))
+						differing++;
+				}
+			}
+
+			const BvhStats& triangleStats = triangles.GetStats();
+			const BvhStats& quadStats = quads.GetStats();
+			std::printf("%-10s %4u %10u %10u %6.1f %10u %10u %9.1f %9.1f %8.2f %8.2f %6.2f %6.2f %6.2f %6.2f %8.2f "
+			            "%8.2f %6u\n",
+			            mesh.name.c_str(), leafSize, triangleStats.triangleCount, quadStats.quadCount,
+			            100.0 * parallelogramCount / std::max(quadStats.quadCount, 1u), triangleStats.nodeCount,
+			            quadStats.nodeCount, triangleStats.memoryInBytes / 1024.0, quadStats.memoryInBytes / 1024.0,
+			            triangleStats.buildSeconds * 1000.0, quadStats.buildSeconds * 1000.0,
+			            double(nodeCounts[0]) / rays.size(), double(nodeCounts[1]) / rays.size(),
+			            double(testCounts[0]) / rays.size(), double(testCounts[1]) / rays.size(), rates[0], rates[1],
+			            differing);
+		}
+	}
+	std::printf("(para%%: quads tested as one parallelogram, ms: build, nodes and tests: nodes visited and leaf "
+	            "primitives tested per ray, Mrays/s: closest hit on one thread, diffs: hits differing from the "
+	            "triangle leaves with and without back-face culling)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench merge [-levels 0,1] [-instances 4096] [-animated 4] [-width 640] [-height 360] [-maxMergeAll 2000000]
+// Instance merging on two layouts, a few instances of which are animated and
+// stay instanced. "menger" grids hold randomly rotated and scaled Menger
+// sponges of each level, whose rotated triangles have looser boxes in world
+// space than in the space of their mesh: merging them seldom pays off. "rows"
+// grids hold unrotated rows of 8 small cubes along the diagonal of their
+// box, scaled so that the mostly empty boxes overlap: rays enter many
+// instances without hitting them, where a merged hierarchy bounds the cubes
+// themselves. Each scene is traced as built, with the instances merged where
+// the SAH favours it, and with every static instance merged within the
+// triangle limit of the merged meshes: instances left in the top level,
+// merged meshes, memory of the geometry and the hierarchies, SAH cost
+// including the instance transitions, merge time, single-threaded
+// closest-hit throughput of the primary rays of a view of the grid, and
+// pixels whose hit differs from the instanced scene. The rays are traced in
+// scanline order, as the copies do not share the caches as the instances do:
+// incoherent rays find the merged meshes out of the caches. The differing
+// pixels are rays grazing the silhouette edge of a triangle, within 1e-4 of
+// it in barycentric coordinates, which the rounding of the vertices
+// transformed to world space moves across the ray. Merging every instance
+// copies all the triangles of the scene, and is skipped above -maxMergeAll
+// triangles: the level 2 grid holds 8.6 million, which take 40 s and 1.4 GB
+int BenchMerge(const std::vector<std::string>& args)
+{
+	const uint32_t instanceCount = std::max(GetOption(args, "instances", 4096u), 1u);
+	const uint32_t animatedCount = std::min(GetOption(args, "animated", 4u), instanceCount);
+	const uint32_t width = std::max(GetOption(args, "width", 640u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 360u), 1u);
+	const uint32_t maxMergeAllTriangles = GetOption(args, "maxMergeAll", 2000000u);
+
+	auto memorySize = [](const Scene& scene) {
+		size_t bytes = scene.GetInstances().size() * sizeof(Instance) +
+		               scene.GetTopLevel().GetNodes().size() * sizeof(BvhNode);
+		for (size_t i = 0; i < scene.GetMeshes().size(); i++)
+		{
+			const Mesh& mesh = scene.GetMeshes()[i];
+			bytes += mesh.GetVertices().size() * sizeof(Vertex) + mesh.GetIndices().size() * sizeof(uint32_t) +
+			         scene.GetBottomLevels()[i].GetStats().memoryInBytes;
+		}
+		return bytes;
+	};
+
+	InstanceMergeSettings settings;
+	const uint32_t animatedStride = instanceCount / std::max(animatedCount, 1u);
+	for (uint32_t a = 0; a < animatedCount; a++)
+	{
+		settings.dynamicInstances.push_back(a * animatedStride);
+	}
+	InstanceMergeSettings mergeAllSettings = settings;
+	mergeAllSettings.minCostReduction = -1e9f;
+
+	// Instances on a grid with a spacing of 1, rotated or not, of a size drawn
+	// from [minScale, maxScale]
+	const uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(double(instanceCount))));
+	auto createGrid = [&](const BenchmarkMesh& source, bool rotate, float minScale, float maxScale) {
+		Scene scene;
+		Mesh mesh;
+		mesh.vertices = source.vertices;
+		mesh.indices = source.indices;
+		const uint32_t meshIndex = scene.AddMesh(std::move(mesh));
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			const glm::vec3 position(float(i % side), float(i / side % side), float(i / (side * side)));
+			const glm::vec3 axis = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)) + 0.1f);
+			const float angle = 6.3f * uniform(rng);
+			const glm::mat4 transform =
+			    glm::translate(glm::mat4(1.f), position) *
+			    (rotate ? glm::rotate(glm::mat4(1.f), angle, axis) : glm::mat4(1.f)) *
+			    glm::scale(glm::mat4(1.f), glm::vec3(minScale + (maxScale - minScale) * uniform(rng)));
+			scene.AddInstance(meshIndex, transform, i, 0);
+		}
+		scene.UpdateTopLevel();
+		return scene;
+	};
+
+	// The animated instances are rotated in place, as the cube of OnUpdate
+	auto animate = [&](Scene& scene) {
+		for (uint32_t instanceIndex : settings.dynamicInstances)
+		{
+			const glm::mat4& transform = scene.GetInstances()[instanceIndex].transform;
+			scene.SetInstanceTransform(instanceIndex,
+			                           transform * glm::rotate(glm::mat4(1.f), 0.5f, glm::vec3(0.f, 1.f, 0.f)));
+		}
+		scene.UpdateTopLevel();
+	};
+
+	std::vector<std::pair<std::string, Scene>> layouts;
+	for (uint32_t level : GetMengerLevels(args, {0, 1}))
+	{
+		layouts.emplace_back("menger" + std::to_string(level), createGrid(CreateMengerMesh(level), true, 0.3f, 0.7f));
+	}
+	BenchmarkMesh row = CreateCubeMesh();
+	{
+		const BenchmarkMesh cube = CreateCubeMesh();
+		const uint32_t cubeCount = 8;
+		row.vertices.clear();
+		row.indices.clear();
+		for (uint32_t c = 0; c < cubeCount; c++)
+		{
+			const uint32_t base = static_cast<uint32_t>(row.vertices.size());
+			for (Vertex vertex : cube.vertices)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					vertex.position[axis] = (vertex.position[axis] + c + 0.5f) / cubeCount - 0.5f;
+				}
+				row.vertices.push_back(vertex);
+			}
+			for (uint32_t index : cube.indices)
+			{
+				row.indices.push_back(base + index);
+			}
+		}
+	}
+	layouts.emplace_back("rows", createGrid(row, false, 1.5f, 3.5f));
+
+	std::printf("%-8s %-10s %10s %8s %8s %10s %8s %10s %10s %8s\n", "scene", "instances", "top level", "merged",
+	            "MB", "SAH", "merge ms", "Mrays/s", "hits", "pixels");
+	for (const auto& layout : layouts)
+	{
+		// A view of the whole grid from outside one of its corners
+		const Aabb bounds = {layout.second.GetTopLevel().GetNodes()[0].boundsMin,
+		                     layout.second.GetTopLevel().GetNodes()[0].boundsMax};
+		CameraSetup setup;
+		setup.target = bounds.Center();
+		setup.eye = setup.target + glm::vec3(0.3f, 0.4f, -0.6f) * glm::length(bounds.Extent());
+		const Camera camera = CreateCamera(setup, width, height);
+		std::vector<HitRecord> expected(width * height);
+		std::vector<bool> expectedFound(width * height);
+
+		uint64_t triangleCount = 0;
+		for (const Instance& instance : layout.second.GetInstances())
+		{
+			triangleCount += layout.second.GetBottomLevels()[instance.meshIndex].GetStats().triangleCount;
+		}
+
+		const char* names[] = {"instanced", "sah", "all"};
+		for (int choice = 0; choice < 3; choice++)
+		{
+			if (choice == 2 && triangleCount > maxMergeAllTriangles)
+			{
+				std::printf("%-8s %-10s %10s %8s %8s %10s %8s %10s %10s %8s\n", layout.first.c_str(), names[choice],
+				            "-", "-", "-", "-", "-", "-", "-", "-");
+				continue;
+			}
+			Scene scene = layout.second;
+			InstanceMergeStats stats;
+			if (choice == 0)
+			{
+				stats.instancedCost = stats.mergedCost = ComputeSceneSahCost(scene, settings.instanceCost);
+			}
+			else
+			{
+				stats = MergeStaticInstances(scene, choice == 1 ? settings : mergeAllSettings);
+			}
+			animate(scene);
+
+			uint32_t hits = 0, differing = 0;
+			const auto start = Clock::now();
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const uint32_t pixel = y * width + x;
+					HitRecord hit;
+					const bool found =
+					    scene.Intersect(GenerateCameraRay(camera, glm::uvec2(x, y), glm::uvec2(width, height)), hit);
+					hits += found ? 1 : 0;
+					if (choice == 0)
+					{
+						expected[pixel] = hit;
+						expectedFound[pixel] = found;
+					}
+					// The triangles sharing the edge a ray crosses may report
+					// either of them: only the instance and the distance count
+					else if (found != expectedFound[pixel] ||
+					         (found && (hit.instanceIndex != expected[pixel].instanceIndex ||
+					                    std::fabs(hit.t - expected[pixel].t) > 1e-4f * expected[pixel].t)))
+					{
+						differing++;
+					}
+				}
+			}
+			const double mraysPerSecond = width * height / SecondsSince(start) * 1e-6;
+
+			std::printf("%-8s %-10s %10zu %8u %8.2f %10.2f %8.1f %10.2f %10u %8u\n", layout.first.c_str(),
+			            names[choice], scene.GetTopLevel().GetInstanceOrder().size(), stats.mergedMeshCount,
+			            memorySize(scene) / double(1 << 20), stats.mergedCost, stats.seconds * 1000.0,
+			            mraysPerSecond, hits, differing);
+		}
+	}
+	std::printf("(top level: instances in the top-level hierarchy, merged: merged meshes, SAH: expected traversal "
+	            "cost with %.0f per instance transition, Mrays/s: closest hit on one thread, pixels: hits differing "
+	            "from the instanced scene)\n",
+	            settings.instanceCost);
+	return EXIT_SUCCESS;
+}
+
+// -bench refit [-instances 10000] [-moving 2500] [-frames 300] [-inflation 1.5] [-age 60] [-threads 0] [-rays 2000]
+// Rebuild policies of the top level over a grid of cubes, a quarter of which
+// travel back and forth along random directions, across the whole grid, so
+// that refitted nodes stretch over ever larger boxes: refitting forever,
+// rebuilding every frame, rebuilding once the SAH cost grows by the given
+// factor over that of the last build, synchronously or on the scheduler, and
+// rebuilding after a given number of refits. Reports the updates and
+// rebuilds, the update time, the mean and final SAH cost of the top level,
+// the closest-hit throughput of the rays traced every frame on the scheduler,
+// as DispatchRays does, and the SAH cost over the frames. The trace time of
+// the frames that start an asynchronous rebuild is reported apart: it should
+// match that of the others, the build running on a thread of its own
+int BenchRefit(const std::vector<std::string>& args)
+{
+	const uint32_t instanceCount = std::max(GetOption(args, "instances", 10000u), 1u);
+	const uint32_t movingCount = std::min(GetOption(args, "moving", 2500u), instanceCount);
+	const uint32_t frameCount = std::max(GetOption(args, "frames", 300u), 1u);
+	const float inflation = GetOption(args, "inflation", 1.5f);
+	const uint32_t age = std::max(GetOption(args, "age", 60u), 1u);
+	const uint32_t rayCount = GetOption(args, "rays", 2000u);
+	BvhBuildSettings settings;
+	settings.threadCount = GetOption(args, "threads", 0u);
+
+	std::vector<Bvh> bottomLevels(1);
+	AddToBvh(bottomLevels[0], CreateCubeMesh());
+	bottomLevels[0].Build();
+	const std::vector<InstanceGroup> groups;
+
+	// Cubes of size 0.5 on a grid with a spacing of 1. The moving ones are
+	// spread over the grid, each with its own direction and phase
+	const uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(double(instanceCount))));
+	std::vector<glm::mat4> transforms(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		const glm::vec3 position(float(i % side), float(i / side % side), float(i / (side * side)));
+		transforms[i] = glm::translate(glm::mat4(1.f), position) * glm::scale(glm::mat4(1.f), glm::vec3(0.5f));
+	}
+	const uint32_t movingStride = instanceCount / std::max(movingCount, 1u);
+	std::vector<glm::vec3> directions(movingCount);
+	std::vector<float> phases(movingCount);
+	std::mt19937 rng(1);
+	std::normal_distribution<float> normal;
+	std::uniform_real_distribution<float> uniform(0.f, 6.3f);
+	for (uint32_t m = 0; m < movingCount; m++)
+	{
+		directions[m] = 0.5f * side * glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)) + 1e-6f);
+		phases[m] = uniform(rng);
+	}
+	auto animate = [&](TopLevelBvh& topLevel, uint32_t frame) {
+		for (uint32_t m = 0; m < movingCount; m++)
+		{
+			const uint32_t i = m * movingStride;
+			const glm::vec3 offset = directions[m] * std::sin(phases[m] + frame / 30.f);
+			topLevel.SetInstanceTransform(i, glm::translate(glm::mat4(1.f), offset) * transforms[i]);
+		}
+	};
+
+	Aabb bounds;
+	bounds.min = glm::vec3(-0.5f * side);
+	bounds.max = glm::vec3(1.5f * side);
+	const std::vector<RayDesc> rays = GenerateRays(bounds, rayCount, 1);
+
+	struct PolicyCase
+	{
+		const char* name;
+		RebuildPolicy policy;
+		bool buildEveryFrame;
+	};
+	const PolicyCase cases[] = {
+		{"refit", {}, false},
+		{"rebuild", {}, true},
+		{"sah", {inflation, 0, false}, false},
+		{"sah-async", {inflation, 0, true}, false},
+		{"age", {0.f, age, false}, false},
+	};
+	const uint32_t sampleStride = std::max(frameCount / 10, 1u);
+	std::vector<std::vector<float>> curves;
+
+	std::printf("%u instances, %u moving, %u frames, %u threads\n", instanceCount, movingCount, frameCount,
+	            TaskScheduler::Get(settings.threadCount).GetThreadCount());
+	std::printf("%-10s %7s %8s %7s %9s %9s %8s %8s %9s %9s %9s\n", "policy", "refits", "rebuilds", "async", "avg ms",
+	            "max ms", "mean SAH", "SAH", "Mrays/s", "trace ms", "start ms");
+	for (const PolicyCase& policyCase : cases)
+	{
+		TopLevelBvh topLevel;
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			topLevel.AddInstance(0, transforms[i], i, 0);
+		}
+		topLevel.SetRebuildPolicy(policyCase.policy);
+		topLevel.Update(bottomLevels, groups, settings);
+
+		double updateSeconds = 0.0, maxSeconds = 0.0, traceSeconds = 0.0, startSeconds = 0.0, sahSum = 0.0;
+		uint32_t startCount = 0;
+		std::atomic<uint32_t> hits{0};
+		curves.emplace_back();
+		for (uint32_t frame = 1; frame <= frameCount; frame++)
+		{
+			animate(topLevel, frame);
+			const bool wasRebuilding = topLevel.IsRebuilding();
+			auto start = Clock::now();
+			if (policyCase.buildEveryFrame)
+				topLevel.Build(bottomLevels, groups, settings);
+			else
+				topLevel.Update(bottomLevels, groups, settings);
+			const double seconds = SecondsSince(start);
+			updateSeconds += seconds;
+			maxSeconds = std::max(maxSeconds, seconds);
+			sahSum += topLevel.GetStats().sahCost;
+			if (frame % sampleStride == 0)
+				curves.back().push_back(topLevel.GetStats().sahCost);
+
+			// Traced while an asynchronous rebuild started by this update runs
+			start = Clock::now();
+			ParallelFor(rayCount, 64,
+			            [&](uint32_t begin, uint32_t end) {
+				            uint32_t chunkHits = 0;
+				            for (uint32_t i = begin; i < end; i++)
+				            {
+					            HitRecord hit;
+					            chunkHits += topLevel.Intersect(rays[i], bottomLevels, groups, hit) ? 1 : 0;
+				            }
+				            hits += chunkHits;
+			            },
+			            settings.threadCount);
+			const double frameTraceSeconds = SecondsSince(start);
+			traceSeconds += frameTraceSeconds;
+			if (!wasRebuilding && topLevel.IsRebuilding())
+			{
+				startSeconds += frameTraceSeconds;
+				startCount++;
+			}
+		}
+
+		const TopLevelBvhStats& stats = topLevel.GetStats();
+		std::printf("%-10s %7u %8u %7u %9.3f %9.3f %8.2f %8.2f %9.2f %9.3f ", policyCase.name, stats.refitCount,
+		            stats.buildCount - 1, stats.asyncRebuildCount, updateSeconds / frameCount * 1000.0,
+		            maxSeconds * 1000.0, sahSum / frameCount, stats.sahCost,
+		            double(rayCount) * frameCount / traceSeconds * 1e-6, traceSeconds / frameCount * 1000.0);
+		if (startCount > 0)
+			std::printf("%9.3f\n", startSeconds / startCount * 1000.0);
+		else
+			std::printf("%9s\n", "-");
+	}
+
+	std::printf("\nSAH cost of the top level by frame\n%-10s", "frame");
+	for (size_t sample = 0; sample < curves[0].size(); sample++)
+	{
+		std::printf(" %7u", uint32_t(sample + 1) * sampleStride);
+	}
+	std::printf("\n");
+	for (size_t c = 0; c < curves.size(); c++)
+	{
+		std::printf("%-10s", cases[c].name);
+		for (float sahCost : curves[c])
+		{
+			std::printf(" %7.2f", sahCost);
+		}
+		std::printf("\n");
+	}
+	std::printf("(rebuilds: after the first build, async: rebuilds swapped in from their thread, Mrays/s: closest "
+	            "hit on the scheduler through both levels, start ms: trace time of the frames starting an asynchronous "
+	            "rebuild)\n");
+	return EXIT_SUCCESS;
+}
+
+// -bench tiles [-width 1280] [-height 720] [-levels 3] [-tile 8,16,32,64]
+// [-threads 0] [-repeat 3]
+// Full frames of the sample with a Menger sponge in place of the cube, with
+// the tiles issued in scanline, Morton and Hilbert order: best wall time on
+// -threads threads (0 for all), then the L1 and last-level cache read misses
+// per ray of a frame traced on the calling thread alone
+int BenchTiles(const std::vector<std::string>& args)
+{
+	const uint32_t width = std::max(GetOption(args, "width", 1280u), 1u);
+	const uint32_t height = std::max(GetOption(args, "height", 720u), 1u);
+	const uint32_t level = GetOption(args, "levels", 3u);
+	const std::vector<uint32_t> tileSizes = GetListOption(args, "tile", {8, 16, 32, 64});
+	const uint32_t threadCount = GetOption(args, "threads", 0u);
+	const uint32_t repeat = std::max(GetOption(args, "repeat", 3u), 1u);
+
+	const BenchmarkMesh mesh = CreateMengerMesh(level);
+	const Scene scene = CreateBenchmarkScene(&mesh);
+	const Camera camera = CreateHelloTriangleCamera(width, height);
+	const Pipeline pipeline = CreateHelloTrianglePipeline();
+	Image output(width, height);
+	CacheCounters counters;
+
+	std::printf("%s, %ux%u, %u threads\n", mesh.name.c_str(), width, height,
+	            TaskScheduler::Get(threadCount).GetThreadCount());
+	std::printf("%6s %-9s %10s %10s %12s %12s\n", "tile", "order", "ms", "Mrays/s", "L1 miss/ray", "LLC miss/ray");
+	for (uint32_t tileSize : tileSizes)
+	{
+		for (TileOrder order : {TileOrder::Scanline, TileOrder::Morton, TileOrder::Hilbert})
+		{
+			DispatchSettings settings;
+			settings.tileSize = tileSize;
+			settings.tileOrder = order;
+			settings.threadCount = threadCount;
+			DispatchStats best;
+			best.seconds = 1e30;
+			for (uint32_t r = 0; r < repeat; r++)
+			{
+				const DispatchStats stats = DispatchRays(pipeline, scene, camera, output, settings);
+				if (stats.seconds < best.seconds)
+					best = stats;
+			}
+
+			settings.threadCount = 1;
+			counters.Start();
+			const DispatchStats stats = DispatchRays(pipeline, scene, camera, output, settings);
+			const CacheMisses misses = counters.Stop();
+			char l1[16] = "n/a", lastLevel[16] = "n/a";
+			if (counters.IsAvailable())
+			{
+				std::snprintf(l1, sizeof(l1), "%.2f", double(misses.l1) / stats.rayCount);
+				std::snprintf(lastLevel, sizeof(lastLevel), "%.3f", double(misses.lastLevel) / stats.rayCount);
+			}
+			std::printf("%6u %-9s %10.2f %10.2f %12s %12s\n", tileSize, GetTileOrderName(order), best.seconds * 1000.0,
+			            best.RaysPerSecond() * 1e-6, l1, lastLevel);
+		}
+	}
+	if (!counters.IsAvailable())
+		std::printf("(cache counters are not available on this system)\n");
+	return EXIT_SUCCESS;
+}
+
+struct Benchmark
+{
+	const char* name;
+	int (*run)(const std::vector<std::string>& args);
+	const char* description;
+};
+
+const Benchmark kBenchmarks[] = {
+	{"bvh", BenchBvh, "binned SAH BVH build statistics and query throughput"},
+	{"wide", BenchWideBvh, "BVH4/BVH8 SIMD traversal against the binary BVH"},
+	{"quantized", BenchQuantizedBvh, "full-precision against 8-bit quantized wide BVH nodes: memory and speed"},
+	{"triangles", BenchTriangles, "scalar and SIMD watertight ray-triangle kernels, in ns per test"},
+	{"packets", BenchPackets, "8x8 and 16x16 primary ray packets against single rays"},
+	{"shadows", BenchShadows, "shadow ray flags and masks, and sorted deferred occlusion streams"},
+	{"lbvh", BenchLbvh, "parallel Morton-code LBVH build against the binned SAH build, with thread scaling"},
+	{"sbvh", BenchSbvh, "spatial-split SBVH against object splits on large overlapping triangles"},
+	{"tasks", BenchTasks, "work-stealing scheduler scaling from 1 to 64 threads, tasks of 1 us to 1 ms"},
+	{"bvhcache", BenchBvhCache, "persistent BVH cache: key hashing, save and mapped load against a build"},
+	{"scenefile", BenchSceneFile, "binary scene file: write, map, and streams read in place against copied"},
+	{"import", BenchImport, "parallel OBJ and binary PLY import with vertex welding: throughput and peak memory"},
+	{"menger", BenchMenger, "original against parallel Menger sponge generation, with internal faces culled"},
+	{"nested", BenchNested, "Menger sponges as nested instance groups against the flattened mesh"},
+	{"procedural", BenchProcedural, "analytic procedural primitives against their tessellation"},
+	{"implicit", BenchImplicit, "implicit Menger sponges traced through their grids against their meshes"},
+	{"meshopt", BenchMeshOptimizer, "vertex welding and cache-optimized index buffers: memory, ACMR and speed"},
+	{"vertices", BenchVertices, "quantized positions and RGBA8 or palette colors: memory, accuracy and speed"},
+	{"quads", BenchQuads, "quad leaves pairing coplanar triangles against triangle leaves: size, tests and speed"},
+	{"merge", BenchMerge, "static instances merged into shared bottom levels where the SAH favours it"},
+	{"refit", BenchRefit, "top-level rebuild policies under large motion: refit, rebuild, SAH inflation and age"},
+	{"tiles", BenchTiles, "scanline, Morton and Hilbert tile orders: frame time and cache misses per ray"},
+	{"tlas", BenchTopLevel, "top-level refit of a few animated instances against a full rebuild"},
+};
+
+} // namespace
+
+int RunBenchmark(const std::vector<std::string>& args)
+{
+	const std::string name = GetOption(args, "bench", std::string());
+	for (const Benchmark& benchmark : kBenchmarks)
+	{
+		if (name == benchmark.name)
+			return benchmark.run(args);
+	}
+
+	std::printf("available benchmarks (-bench <name>):\n");
+	for (const Benchmark& benchmark : kBenchmarks)
+	{
+		std::printf("  %-12s %s\n", benchmark.name, benchmark.description);
+	}
+	return name.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,16 @@
+#pragma once
+
+// Benchmarks of the CPU raytracing components, selected with -bench <name>.
+// Each benchmark prints its results as a table on the standard output.
+
+#include <string>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Run the benchmark named by the -bench option, or list the benchmarks if
+/// the name is unknown. Returns the process exit code
+int RunBenchmark(const std::vector<std::string>& args);
+
+} // namespace cpu_rt
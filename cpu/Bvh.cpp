@@ -0,0 +1,619 @@
+#include "Bvh.h"
+#include "Lbvh.h"
+#include "Parallel.h"
+#include "QuadLeaves.h"
+#include "Sbvh.h"
+
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+struct BuildTask
+{
+	uint32_t nodeIndex;
+	uint32_t begin;
+	uint32_t end;
+	uint32_t depth;
+	Aabb bounds;
+	Aabb centroidBounds;
+};
+
+struct Bin
+{
+	Aabb bounds;
+	uint32_t count = 0;
+};
+
+} // namespace
+
+void Bvh::AddVertexBuffer(const void* vertexBuffer, uint32_t vertexCount, uint32_t vertexSizeInBytes,
+                          const uint32_t* indexBuffer, uint32_t indexCount, bool isOpaque)
+{
+	if (vertexSizeInBytes < 3 * sizeof(float))
+	{
+		throw std::logic_error("Vertex stride is too small to hold a position");
+	}
+	if (IsProcedural())
+	{
+		throw std::logic_error("A hierarchy cannot hold both triangles and procedural primitives");
+	}
+	Unmap();
+
+	const uint8_t* vertices = static_cast<const uint8_t*>(vertexBuffer);
+	auto position = [&](uint32_t index) {
+		if (index >= vertexCount)
+		{
+			throw std::out_of_range("Index buffer references a vertex out of the vertex buffer");
+		}
+		float p[3];
+		std::memcpy(p, vertices + size_t(index) * vertexSizeInBytes, sizeof(p));
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	const uint32_t triangleCount = (indexBuffer ? indexCount : vertexCount) / 3;
+	m_triangles.reserve(m_triangles.size() + triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		BvhTriangle triangle;
+		if (indexBuffer)
+		{
+			triangle.v0 = position(indexBuffer[3 * i + 0]);
+			triangle.v1 = position(indexBuffer[3 * i + 1]);
+			triangle.v2 = position(indexBuffer[3 * i + 2]);
+		}
+		else
+		{
+			triangle.v0 = position(3 * i + 0);
+			triangle.v1 = position(3 * i + 1);
+			triangle.v2 = position(3 * i + 2);
+		}
+		triangle.primitiveIndex = i;
+		triangle.geometryIndex = static_cast<uint32_t>(m_geometryOpaque.size());
+		m_triangles.push_back(triangle);
+	}
+	m_geometryOpaque.push_back(isOpaque);
+}
+
+void Bvh::AddProceduralGeometry(const ProceduralPrimitive* primitives, uint32_t primitiveCount, bool isOpaque)
+{
+	if (!GetTriangles().empty() || HasQuads())
+	{
+		throw std::logic_error("A hierarchy cannot hold both triangles and procedural primitives");
+	}
+	m_procedurals.reserve(m_procedurals.size() + primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		ProceduralPrimitive primitive = primitives[i];
+		primitive.primitiveIndex = i;
+		primitive.geometryIndex = static_cast<uint32_t>(m_geometryOpaque.size());
+		m_procedurals.push_back(primitive);
+	}
+	m_geometryOpaque.push_back(isOpaque);
+}
+
+void Bvh::Build(const BvhBuildSettings& settings)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	Unmap();
+
+	// Procedural primitives bring their own bounds, and are never split
+	if (IsProcedural())
+	{
+		const uint32_t primitiveCount = static_cast<uint32_t>(m_procedurals.size());
+		std::vector<Aabb> primitiveBounds(primitiveCount);
+		for (uint32_t i = 0; i < primitiveCount; i++)
+		{
+			primitiveBounds[i] = m_procedurals[i].bounds;
+		}
+		std::vector<uint32_t> order;
+		m_stats = BvhStats();
+		m_stats.triangleCount = m_stats.referenceCount = primitiveCount;
+		BuildBvhNodes(primitiveBounds, settings, m_nodes, order, m_stats);
+		std::vector<ProceduralPrimitive> ordered(primitiveCount);
+		for (uint32_t i = 0; i < primitiveCount; i++)
+		{
+			ordered[i] = m_procedurals[order[i]];
+		}
+		m_procedurals.swap(ordered);
+		m_stats.sahCost = ComputeSahCost(m_nodes, settings.traversalCost, settings.intersectionCost);
+		m_stats.memoryInBytes = m_nodes.size() * sizeof(BvhNode) + m_procedurals.size() * sizeof(ProceduralPrimitive);
+		m_stats.buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
+
+	// A previous build with quad leaves holds the triangles in its quads, and
+	// one with spatial splits left some triangles duplicated: keep one copy of
+	// each, back in input order
+	if (HasQuads())
+	{
+		UnpairQuads(m_quads, m_triangles);
+		std::vector<BvhQuad>().swap(m_quads);
+	}
+	if (m_stats.referenceCount > m_stats.triangleCount || m_stats.quadCount > 0)
+	{
+		std::sort(m_triangles.begin(), m_triangles.end(), [](const BvhTriangle& a, const BvhTriangle& b) {
+			return a.geometryIndex != b.geometryIndex ? a.geometryIndex < b.geometryIndex
+			                                          : a.primitiveIndex < b.primitiveIndex;
+		});
+		m_triangles.erase(std::unique(m_triangles.begin(), m_triangles.end(),
+		                              [](const BvhTriangle& a, const BvhTriangle& b) {
+			                              return a.geometryIndex == b.geometryIndex &&
+			                                     a.primitiveIndex == b.primitiveIndex;
+		                              }),
+		                  m_triangles.end());
+	}
+
+	const uint32_t triangleCount = static_cast<uint32_t>(m_triangles.size());
+	m_stats = BvhStats();
+	m_stats.triangleCount = triangleCount;
+
+	static const uint32_t kGrainSize = 4096;
+	if (settings.quadLeaves)
+	{
+		PairTriangles(m_triangles, m_quads);
+		std::vector<BvhTriangle>().swap(m_triangles);
+		const uint32_t quadCount = static_cast<uint32_t>(m_quads.size());
+		std::vector<Aabb> quadBounds(quadCount);
+		ParallelFor(quadCount, kGrainSize,
+		            [&](uint32_t begin, uint32_t end) {
+			            for (uint32_t i = begin; i < end; i++)
+			            {
+				            const BvhQuad& q = m_quads[i];
+				            quadBounds[i].Extend(q.v0);
+				            quadBounds[i].Extend(q.v1);
+				            quadBounds[i].Extend(q.v2);
+				            quadBounds[i].Extend(q.v3);
+			            }
+		            },
+		            settings.threadCount);
+
+		std::vector<uint32_t> order;
+		BuildBvhNodes(quadBounds, settings, m_nodes, order, m_stats);
+		std::vector<BvhQuad> ordered(quadCount);
+		for (uint32_t i = 0; i < quadCount; i++)
+		{
+			ordered[i] = m_quads[order[i]];
+		}
+		m_quads.swap(ordered);
+		m_stats.referenceCount = triangleCount;
+		m_stats.quadCount = quadCount;
+		m_stats.sahCost = ComputeSahCost(m_nodes, settings.traversalCost, settings.intersectionCost);
+		m_stats.memoryInBytes = m_nodes.size() * sizeof(BvhNode) + m_quads.size() * sizeof(BvhQuad);
+		m_stats.buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
+	std::vector<Aabb> triangleBounds(triangleCount);
+	ParallelFor(triangleCount, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            const BvhTriangle& t = m_triangles[i];
+			            triangleBounds[i].Extend(t.v0);
+			            triangleBounds[i].Extend(t.v1);
+			            triangleBounds[i].Extend(t.v2);
+		            }
+	            },
+	            settings.threadCount);
+
+	// The builder orders references to the triangles, the triangles themselves
+	// are reordered once at the end
+	std::vector<uint32_t> references;
+	if (settings.algorithm == BvhBuildAlgorithm::SpatialSplitSah)
+		BuildSbvhNodes(m_triangles, triangleBounds, settings, m_nodes, references, m_stats);
+	else
+		BuildBvhNodes(triangleBounds, settings, m_nodes, references, m_stats);
+	const uint32_t referenceCount = static_cast<uint32_t>(references.size());
+
+	std::vector<BvhTriangle> ordered(referenceCount);
+	ParallelFor(referenceCount, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            ordered[i] = m_triangles[references[i]];
+		            }
+	            },
+	            settings.threadCount);
+	m_triangles.swap(ordered);
+	m_stats.referenceCount = referenceCount;
+
+	m_stats.sahCost = ComputeSahCost(m_nodes, settings.traversalCost, settings.intersectionCost);
+	m_stats.memoryInBytes = m_nodes.size() * sizeof(BvhNode) + m_triangles.size() * sizeof(BvhTriangle);
+	m_stats.buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Bvh::Unmap()
+{
+	if (!m_mapping)
+		return;
+	m_nodes.assign(m_mappedNodes.begin(), m_mappedNodes.end());
+	m_triangles.assign(m_mappedTriangles.begin(), m_mappedTriangles.end());
+	m_mapping.reset();
+	m_mappedNodes = ArrayView<BvhNode>();
+	m_mappedTriangles = ArrayView<BvhTriangle>();
+}
+
+Aabb Bvh::GetBounds() const
+{
+	const ArrayView<BvhNode> nodes = GetNodes();
+	Aabb bounds;
+	if (!nodes.empty())
+	{
+		bounds.min = nodes[0].boundsMin;
+		bounds.max = nodes[0].boundsMax;
+	}
+	return bounds;
+}
+
+bool Bvh::Intersect(const RayDesc& ray, TriangleHit& hit, uint32_t rayFlags) const
+{
+	if (rayFlags & RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH)
+		return Traverse<true>(ray, 0, &hit, rayFlags);
+	return Traverse<false>(ray, 0, &hit, rayFlags);
+}
+
+bool Bvh::Occluded(const RayDesc& ray, TriangleHit* hit, uint32_t rayFlags) const
+{
+	return Traverse<true>(ray, 0, hit, rayFlags);
+}
+
+bool Bvh::IntersectSubtree(const RayDesc& ray, uint32_t nodeIndex, TriangleHit& hit, uint32_t rayFlags) const
+{
+	if (rayFlags & RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH)
+		return Traverse<true>(ray, nodeIndex, &hit, rayFlags);
+	return Traverse<false>(ray, nodeIndex, &hit, rayFlags);
+}
+
+template <bool AnyHit>
+bool Bvh::Traverse(const RayDesc& rayDesc, uint32_t rootIndex, TriangleHit* hit, uint32_t rayFlags) const
+{
+	const ArrayView<BvhNode> nodes = GetNodes();
+	const ArrayView<BvhTriangle> triangles = GetTriangles();
+	const bool procedural = IsProcedural();
+	const bool quads = HasQuads();
+	if (nodes.empty())
+		return false;
+
+	const TraversalRay ray(rayDesc);
+	float tClosest = ray.tMax;
+	bool found = false;
+
+	struct StackEntry
+	{
+		uint32_t nodeIndex;
+		float tEntry;
+	};
+	StackEntry stack[kBvhMaxDepth + 1];
+	uint32_t stackSize = 0;
+
+	float tEntry;
+	if (!IntersectAabb(ray, nodes[rootIndex].boundsMin, nodes[rootIndex].boundsMax, tClosest, tEntry))
+		return false;
+	stack[stackSize++] = {rootIndex, tEntry};
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		// The node may have been pushed before a closer hit was found
+		if (entry.tEntry > tClosest)
+			continue;
+		const BvhNode& node = nodes[entry.nodeIndex];
+
+		if (node.IsLeaf() && procedural)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const ProceduralPrimitive& primitive = m_procedurals[i];
+				float t;
+				Attributes attrib;
+				if (IntersectProcedural(primitive, ray.origin, ray.direction, ray.tMin, tClosest, t, attrib))
+				{
+					if (IsOpacityCulled(rayFlags, m_geometryOpaque[primitive.geometryIndex]))
+						continue;
+					if (hit)
+						*hit = {t, attrib, primitive.primitiveIndex, primitive.geometryIndex};
+					if (AnyHit)
+						return true;
+					tClosest = t;
+					found = true;
+				}
+			}
+			continue;
+		}
+		if (node.IsLeaf() && quads)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const BvhQuad& quad = m_quads[i];
+				float t;
+				Attributes attrib;
+				const int which = IntersectQuad(ray.origin, ray.direction, ray.tMin, tClosest, quad, t, attrib);
+				if (which < 0)
+					continue;
+				// The other triangle of the quad has the same facing and opacity,
+				// so a culled hit leaves none in the quad
+				if (rayFlags & kTriangleFilterRayFlags)
+				{
+					glm::vec3 v0, v1, v2;
+					GetQuadTriangle(quad, which, v0, v1, v2);
+					if (IsTriangleCulled(rayFlags, ray.direction, v0, v1, v2, m_geometryOpaque[quad.geometryIndex]))
+						continue;
+				}
+				if (hit)
+					*hit = {t, attrib, quad.primitiveIndex[which], quad.geometryIndex};
+				if (AnyHit)
+					return true;
+				tClosest = t;
+				found = true;
+			}
+			continue;
+		}
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const BvhTriangle& triangle = triangles[i];
+				float t;
+				Attributes attrib;
+				if (IntersectTriangle(ray.origin, ray.direction, ray.tMin, tClosest, triangle.v0, triangle.v1, triangle.v2, t, attrib))
+				{
+					// Culling is resolved on the hits only, so that rays without
+					// culling flags pay a single test per hit
+					if ((rayFlags & kTriangleFilterRayFlags) &&
+					    IsTriangleCulled(rayFlags, ray.direction, triangle.v0, triangle.v1, triangle.v2,
+					                     m_geometryOpaque[triangle.geometryIndex]))
+						continue;
+					if (hit)
+						*hit = {t, attrib, triangle.primitiveIndex, triangle.geometryIndex};
+					if (AnyHit)
+						return true;
+					tClosest = t;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the closest child first by pushing it last
+		const BvhNode& left = nodes[node.leftOrFirst];
+		const BvhNode& right = nodes[node.leftOrFirst + 1];
+		float tLeft, tRight;
+		const bool hitLeft = IntersectAabb(ray, left.boundsMin, left.boundsMax, tClosest, tLeft);
+		const bool hitRight = IntersectAabb(ray, right.boundsMin, right.boundsMax, tClosest, tRight);
+		if (hitLeft && hitRight)
+		{
+			if (tLeft <= tRight)
+			{
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+			}
+			else
+			{
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+			}
+		}
+		else if (hitLeft)
+		{
+			stack[stackSize++] = {node.leftOrFirst, tLeft};
+		}
+		else if (hitRight)
+		{
+			stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+		}
+	}
+	return found;
+}
+
+void BuildBvhNodes(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings, std::vector<BvhNode>& nodes,
+                   std::vector<uint32_t>& primitiveOrder, BvhStats& stats)
+{
+	if (settings.algorithm == BvhBuildAlgorithm::Lbvh)
+	{
+		BuildLbvhNodes(primitiveBounds, settings, nodes, primitiveOrder, stats);
+		return;
+	}
+
+	const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+	const uint32_t binCount = std::max(settings.binCount, 2u);
+	const uint32_t maxLeafSize = std::max(settings.maxLeafSize, 1u);
+	const uint32_t leafBlockSize = std::max(settings.leafBlockSize, 1u);
+	auto blockCount = [&](uint32_t count) { return static_cast<float>((count + leafBlockSize - 1) / leafBlockSize); };
+
+	nodes.clear();
+	primitiveOrder.clear();
+	stats.nodeCount = 0;
+	stats.leafCount = 0;
+	stats.maxDepth = 0;
+	if (primitiveCount == 0)
+		return;
+
+	std::vector<glm::vec3> centroids(primitiveCount);
+	BuildTask root = {0, 0, primitiveCount, 1, Aabb(), Aabb()};
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		centroids[i] = primitiveBounds[i].Center();
+		root.bounds.Extend(primitiveBounds[i]);
+		root.centroidBounds.Extend(centroids[i]);
+	}
+
+	primitiveOrder.resize(primitiveCount);
+	std::iota(primitiveOrder.begin(), primitiveOrder.end(), 0u);
+
+	// A binary tree with at least one primitive per leaf has at most 2n-1 nodes
+	nodes.reserve(2 * size_t(primitiveCount) - 1);
+	nodes.push_back(BvhNode());
+
+	std::vector<BuildTask> tasks = {root};
+	std::vector<Bin> bins[3] = {std::vector<Bin>(binCount), std::vector<Bin>(binCount), std::vector<Bin>(binCount)};
+	std::vector<Aabb> rightBounds(binCount);
+	std::vector<uint32_t> rightCounts(binCount);
+
+	while (!tasks.empty())
+	{
+		const BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		BvhNode& node = nodes[task.nodeIndex];
+		node.boundsMin = task.bounds.min;
+		node.boundsMax = task.bounds.max;
+		stats.maxDepth = std::max(stats.maxDepth, task.depth);
+
+		const uint32_t count = task.end - task.begin;
+
+		// Bin the centroids along the 3 axes in a single pass
+		const glm::vec3 extent = task.centroidBounds.Extent();
+		const glm::vec3 origin = task.centroidBounds.min;
+		glm::vec3 scale;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			scale[axis] = extent[axis] > 0.f ? binCount / extent[axis] : 0.f;
+			std::fill(bins[axis].begin(), bins[axis].end(), Bin());
+		}
+		auto binIndex = [&](const glm::vec3& centroid, int axis) {
+			return std::min(binCount - 1, static_cast<uint32_t>((centroid[axis] - origin[axis]) * scale[axis]));
+		};
+		if (count > 1)
+		{
+			for (uint32_t i = task.begin; i < task.end; i++)
+			{
+				const uint32_t r = primitiveOrder[i];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					Bin& bin = bins[axis][binIndex(centroids[r], axis)];
+					bin.bounds.Extend(primitiveBounds[r]);
+					bin.count++;
+				}
+			}
+		}
+
+		// Find the best split: sweep from the right to accumulate the
+		// right-hand side of each split, then from the left to evaluate the
+		// costs
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+		for (int axis = 0; axis < 3 && count > 1; axis++)
+		{
+			if (extent[axis] <= 0.f)
+				continue;
+			Aabb accumulated;
+			uint32_t accumulatedCount = 0;
+			for (uint32_t b = binCount - 1; b > 0; b--)
+			{
+				accumulated.Extend(bins[axis][b].bounds);
+				accumulatedCount += bins[axis][b].count;
+				rightBounds[b] = accumulated;
+				rightCounts[b] = accumulatedCount;
+			}
+			accumulated = Aabb();
+			accumulatedCount = 0;
+			for (uint32_t b = 0; b < binCount - 1; b++)
+			{
+				accumulated.Extend(bins[axis][b].bounds);
+				accumulatedCount += bins[axis][b].count;
+				if (accumulatedCount == 0 || rightCounts[b + 1] == 0)
+					continue;
+				const float cost = accumulated.HalfArea() * blockCount(accumulatedCount) +
+				                   rightBounds[b + 1].HalfArea() * blockCount(rightCounts[b + 1]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		// Compare the best split with making a leaf, both relative to the
+		// area of the node
+		const float nodeArea = task.bounds.HalfArea();
+		const float leafCost = settings.intersectionCost * blockCount(count);
+		const float splitCost = bestAxis < 0 ? FLT_MAX
+		                                     : settings.traversalCost + settings.intersectionCost * bestCost / std::max(nodeArea, FLT_MIN);
+		if (count == 1 || task.depth >= kBvhMaxDepth || (count <= maxLeafSize && leafCost <= splitCost))
+		{
+			node.leftOrFirst = task.begin;
+			node.count = count;
+			stats.leafCount++;
+			continue;
+		}
+
+		BuildTask left = {static_cast<uint32_t>(nodes.size()), task.begin, 0, task.depth + 1, Aabb(), Aabb()};
+		BuildTask right = {left.nodeIndex + 1, 0, task.end, task.depth + 1, Aabb(), Aabb()};
+		if (bestAxis >= 0)
+		{
+			// Partition the primitives, accumulating the bounds of both sides
+			uint32_t i = task.begin, j = task.end;
+			while (i < j)
+			{
+				const uint32_t r = primitiveOrder[i];
+				if (binIndex(centroids[r], bestAxis) <= bestBin)
+				{
+					left.bounds.Extend(primitiveBounds[r]);
+					left.centroidBounds.Extend(centroids[r]);
+					i++;
+				}
+				else
+				{
+					right.bounds.Extend(primitiveBounds[r]);
+					right.centroidBounds.Extend(centroids[r]);
+					std::swap(primitiveOrder[i], primitiveOrder[--j]);
+				}
+			}
+			left.end = right.begin = i;
+		}
+		else
+		{
+			// All the centroids are at the same position: split in the middle
+			// of the range to keep the leaves small
+			left.end = right.begin = task.begin + count / 2;
+			for (uint32_t i = task.begin; i < task.end; i++)
+			{
+				BuildTask& side = i < left.end ? left : right;
+				side.bounds.Extend(primitiveBounds[primitiveOrder[i]]);
+				side.centroidBounds.Extend(centroids[primitiveOrder[i]]);
+			}
+		}
+
+		node.leftOrFirst = left.nodeIndex;
+		node.count = 0;
+		nodes.push_back(BvhNode());
+		nodes.push_back(BvhNode());
+		tasks.push_back(left);
+		tasks.push_back(right);
+	}
+
+	nodes.shrink_to_fit();
+	stats.nodeCount = static_cast<uint32_t>(nodes.size());
+}
+
+float ComputeSahCost(const std::vector<BvhNode>& nodes, float traversalCost, float intersectionCost)
+{
+	if (nodes.empty())
+		return 0.f;
+
+	auto halfArea = [](const BvhNode& node) {
+		Aabb box;
+		box.min = node.boundsMin;
+		box.max = node.boundsMax;
+		return box.HalfArea();
+	};
+
+	const float rootArea = std::max(halfArea(nodes[0]), FLT_MIN);
+	double cost = 0.0;
+	for (const BvhNode& node : nodes)
+	{
+		const double relativeArea = halfArea(node) / rootArea;
+		cost += relativeArea * (node.IsLeaf() ? intersectionCost * node.count : traversalCost);
+	}
+	return static_cast<float>(cost);
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,235 @@
+#pragma once
+
+// Bounding volume hierarchy over triangles, the CPU counterpart of a
+// bottom-level acceleration structure. The input mirrors
+// BottomLevelASGenerator::AddVertexBuffer: strided vertex buffers whose first
+// 3 floats are the position, optionally indexed with 32-bit indices. The
+// hierarchy is built top-down with the binned surface area heuristic (SAH),
+// or in parallel along a Morton curve for fast rebuilds (see Lbvh.h), or with
+// spatial splits for scenes of large overlapping triangles (see Sbvh.h). As a
+// bottom-level structure of DXR holds triangles or procedural primitives but
+// not both, a hierarchy may instead hold analytic shapes (see Procedural.h).
+// The triangles of planar meshes may also be paired into quads, which halve
+// the primitives of the leaves (see QuadLeaves.h).
+
+#include "MappedFile.h"
+#include "Procedural.h"
+
+#include <memory>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Depth limit of the hierarchies, which bounds the traversal stacks. Nodes
+/// at this depth become leaves regardless of their size
+static const uint32_t kBvhMaxDepth = 64;
+
+enum class BvhBuildAlgorithm
+{
+	/// Top-down binned SAH: the fastest hierarchies to trace
+	BinnedSah,
+	/// Linear BVH: much faster to build in parallel, slower to trace
+	Lbvh,
+	/// Binned SAH with spatial splits (SBVH), which duplicate the references
+	/// of large triangles within spatialSplitBudget. Only for triangles:
+	/// hierarchies over boxes, such as the top level, use object splits
+	SpatialSplitSah,
+};
+
+struct BvhBuildSettings
+{
+	BvhBuildAlgorithm algorithm = BvhBuildAlgorithm::BinnedSah;
+	/// Number of bins per axis used to evaluate the split candidates
+	uint32_t binCount = 16;
+	/// Maximum number of triangles in a leaf
+	uint32_t maxLeafSize = 4;
+	/// Number of triangles tested at once by the leaves, such as the width of
+	/// the triangle blocks of the wide hierarchies. The SAH charges one
+	/// intersection per started block, which favors leaves that fill them
+	uint32_t leafBlockSize = 1;
+	/// Relative costs of a node traversal step and of a triangle test, used by
+	/// the SAH
+	float traversalCost = 1.f;
+	float intersectionCost = 1.f;
+	/// Size of the Morton codes of the linear builder: 30 or 63 bits. The
+	/// longer codes separate more primitives in large or uneven scenes
+	uint32_t mortonBits = 30;
+	/// Restructure the treelets of the linear hierarchy to lower its SAH cost
+	bool optimizeTreelets = false;
+	/// Number of threads of the parallel passes, 0 for one per hardware thread
+	uint32_t threadCount = 0;
+	/// Extra triangle references the spatial splits may add, relative to the
+	/// number of triangles
+	float spatialSplitBudget = 0.3f;
+	/// Spatial splits are evaluated where the children of the best object
+	/// split overlap by more than this fraction of the scene surface area
+	float spatialSplitOverlap = 1e-5f;
+	/// Pair the coplanar triangles sharing an edge into quads, which the
+	/// leaves hold and test in place of the triangles. Quads cannot be
+	/// clipped, so SpatialSplitSah builds them with object splits only
+	bool quadLeaves = false;
+};
+
+struct BvhStats
+{
+	uint32_t triangleCount = 0;
+	/// Number of triangles in the leaves, above triangleCount when spatial
+	/// splits duplicate triangles
+	uint32_t referenceCount = 0;
+	/// Number of quads in the leaves, each holding one or two triangles, when
+	/// built with quad leaves
+	uint32_t quadCount = 0;
+	uint32_t nodeCount = 0;
+	uint32_t leafCount = 0;
+	uint32_t maxDepth = 0;
+	/// Expected cost of a ray traversal, relative to the root surface area
+	float sahCost = 0.f;
+	/// Memory used by the nodes and the triangles
+	size_t memoryInBytes = 0;
+	double buildSeconds = 0.0;
+};
+
+/// 32-byte node. Leaves have a non-zero count of triangles starting at
+/// leftOrFirst, inner nodes store their children at leftOrFirst and
+/// leftOrFirst + 1
+struct BvhNode
+{
+	glm::vec3 boundsMin;
+	uint32_t leftOrFirst;
+	glm::vec3 boundsMax;
+	uint32_t count;
+
+	bool IsLeaf() const { return count > 0; }
+};
+
+/// Triangle stored in the leaves, with the indices identifying it in the input
+struct BvhTriangle
+{
+	glm::vec3 v0, v1, v2;
+	/// Index of the triangle in its geometry, returned by PrimitiveIndex()
+	uint32_t primitiveIndex;
+	/// Index of the vertex buffer the triangle comes from, as GeometryIndex()
+	uint32_t geometryIndex;
+};
+
+/// Pair of coplanar triangles sharing an edge, (v0, v1, v3) and (v2, v3, v1),
+/// tested at once by the leaves. Each is a rotation of the input triangle, so
+/// that it keeps its facing, and the hits are reported in the corner order of
+/// the input. A triangle left without a pair takes the first place alone
+struct BvhQuad
+{
+	glm::vec3 v0, v1, v2, v3;
+	/// Index of each triangle in its geometry, kNoQuadTriangle for the second
+	/// triangle of a lone one
+	uint32_t primitiveIndex[2];
+	uint32_t geometryIndex;
+	/// Input corner at the first corner of each triangle
+	uint8_t rotation[2];
+	/// v0 + v2 == v1 + v3 exactly: both triangles are found by a single
+	/// ray-parallelogram test
+	bool parallelogram;
+};
+
+static const uint32_t kNoQuadTriangle = ~0u;
+
+/// Hit of a triangle, or of a procedural primitive with the attributes of
+/// IntersectProcedural
+struct TriangleHit
+{
+	float t;
+	Attributes attrib;
+	uint32_t primitiveIndex;
+	uint32_t geometryIndex;
+};
+
+class Bvh
+{
+public:
+	/// Add a vertex buffer, and optionally its index buffer. The positions are
+	/// copied, so the buffers do not need to outlive the call
+	void AddVertexBuffer(const void* vertexBuffer, /// Start of the first vertex
+	                     uint32_t vertexCount,     /// Number of vertices
+	                     uint32_t vertexSizeInBytes, /// Stride between vertices
+	                     const uint32_t* indexBuffer = nullptr, /// Optional index buffer
+	                     uint32_t indexCount = 0,  /// Number of indices, 0 if not indexed
+	                     bool isOpaque = true      /// Opacity of the geometry, as seen by the
+	                                               /// CULL_OPAQUE and CULL_NON_OPAQUE ray flags
+	);
+
+	/// Add procedural primitives, numbered in the order of the array. Throws
+	/// std::logic_error if the hierarchy already holds triangles, and
+	/// AddVertexBuffer does if it holds procedural primitives
+	void AddProceduralGeometry(const ProceduralPrimitive* primitives, uint32_t primitiveCount, bool isOpaque = true);
+
+	/// Build the hierarchy over all the triangles or primitives added so far
+	void Build(const BvhBuildSettings& settings = {});
+
+	/// Closest intersection in ]TMin, TMax[, or the first one found with
+	/// RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH. The culling ray flags are
+	/// honoured, the other flags are ignored. As in DXR, the facing flags do
+	/// not apply to procedural primitives
+	bool Intersect(const RayDesc& ray, TriangleHit& hit, uint32_t rayFlags = RAY_FLAG_NONE) const;
+	/// Return true as soon as any intersection is found in ]TMin, TMax[, and
+	/// optionally that intersection
+	bool Occluded(const RayDesc& ray, TriangleHit* hit = nullptr, uint32_t rayFlags = RAY_FLAG_NONE) const;
+	/// Closest intersection with the triangles below a node, for traversals
+	/// that reach the node by other means (such as ray packets)
+	bool IntersectSubtree(const RayDesc& ray, uint32_t nodeIndex, TriangleHit& hit,
+	                      uint32_t rayFlags = RAY_FLAG_NONE) const;
+
+	Aabb GetBounds() const;
+	const BvhStats& GetStats() const { return m_stats; }
+	ArrayView<BvhNode> GetNodes() const { return m_mapping ? m_mappedNodes : ArrayView<BvhNode>(m_nodes); }
+	/// Triangles in leaf order. Spatial splits reference some of them from
+	/// several leaves, and then store them once per reference. Empty when the
+	/// leaves hold quads
+	ArrayView<BvhTriangle> GetTriangles() const
+	{
+		return m_mapping ? m_mappedTriangles : ArrayView<BvhTriangle>(m_triangles);
+	}
+	/// True if the hierarchy holds procedural primitives instead of triangles
+	bool IsProcedural() const { return !m_procedurals.empty(); }
+	/// Procedural primitives in leaf order, in place of the triangles
+	ArrayView<ProceduralPrimitive> GetProceduralPrimitives() const { return m_procedurals; }
+	/// True if the triangles were built into quads (see BvhBuildSettings)
+	bool HasQuads() const { return !m_quads.empty(); }
+	/// Quads in leaf order, in place of the triangles
+	ArrayView<BvhQuad> GetQuads() const { return m_quads; }
+
+private:
+	friend class BvhCache;
+
+	template <bool AnyHit>
+	bool Traverse(const RayDesc& ray, uint32_t rootIndex, TriangleHit* hit, uint32_t rayFlags) const;
+	/// Copy the nodes and triangles of a hierarchy loaded from a BvhCache, so
+	/// that it can be changed
+	void Unmap();
+
+	/// Opacity of each geometry, indexed by BvhTriangle::geometryIndex
+	std::vector<bool> m_geometryOpaque;
+	std::vector<BvhNode> m_nodes;
+	std::vector<BvhTriangle> m_triangles;
+	std::vector<ProceduralPrimitive> m_procedurals;
+	std::vector<BvhQuad> m_quads;
+	/// File of a hierarchy loaded from a BvhCache, whose nodes and triangles
+	/// are used in place of m_nodes and m_triangles. Copies share the file
+	std::shared_ptr<const MappedFile> m_mapping;
+	ArrayView<BvhNode> m_mappedNodes;
+	ArrayView<BvhTriangle> m_mappedTriangles;
+	BvhStats m_stats;
+};
+
+/// Build the nodes of a hierarchy over primitives given by their bounds, with
+/// the algorithm of the settings. Leaves reference ranges of primitiveOrder,
+/// which receives the primitive indices in leaf order. Fills the node, leaf
+/// and depth counts of stats. Boxes cannot be clipped, so SpatialSplitSah
+/// builds with object splits only
+void BuildBvhNodes(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings, std::vector<BvhNode>& nodes,
+                   std::vector<uint32_t>& primitiveOrder, BvhStats& stats);
+
+/// Expected traversal cost of a hierarchy under the SAH, relative to the root
+/// surface area
+float ComputeSahCost(const std::vector<BvhNode>& nodes, float traversalCost, float intersectionCost);
+
+} // namespace cpu_rt
@@ -0,0 +1,339 @@
+#include "BvhCache.h"
+#include "Parallel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+static const char kMagic[8] = {'C', 'P', 'U', 'R', 'T', 'B', 'V', 'H'};
+/// Version of the file format, to increase whenever the layout or the meaning
+/// of the records change
+static const uint32_t kFormatVersion = 1;
+/// Alignment of the arrays in the files, a cache line
+static const uint64_t kArrayAlignment = 64;
+/// Vertices and indices hashed by each task. The chunks do not depend on the
+/// number of threads, so neither do the keys
+static const uint32_t kHashChunkSize = 1 << 16;
+
+struct BvhCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	/// Sizes of the records, which change with the compiler or the platform
+	uint32_t nodeSize;
+	uint32_t triangleSize;
+	uint32_t geometryCount;
+	uint64_t key;
+	uint64_t nodeOffset;
+	uint64_t nodeCount;
+	uint64_t triangleOffset;
+	uint64_t triangleCount;
+	/// One byte per geometry, 1 if opaque
+	uint64_t geometryOffset;
+	/// Statistics of the build that wrote the file
+	uint32_t uniqueTriangleCount;
+	uint32_t leafCount;
+	uint32_t maxDepth;
+	float sahCost;
+	double buildSeconds;
+};
+
+uint64_t HashMix(uint64_t hash, uint64_t value)
+{
+	hash ^= value * 0x9E3779B97F4A7C15ull;
+	hash = (hash << 27) | (hash >> 37);
+	return hash * 0xC2B2AE3D27D4EB4Full + 0x165667B19E3779F9ull;
+}
+
+uint64_t HashFinalize(uint64_t hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+uint64_t FloatBits(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/// Hash of count items, combining the hashes of fixed chunks computed in
+/// parallel by hashChunk(begin, end)
+uint64_t HashChunks(uint32_t count, const std::function<uint64_t(uint32_t begin, uint32_t end)>& hashChunk)
+{
+	const uint32_t chunkCount = (count + kHashChunkSize - 1) / kHashChunkSize;
+	std::vector<uint64_t> chunkHashes(chunkCount);
+	ParallelFor(chunkCount, 1,
+	            [&](uint32_t chunk, uint32_t) {
+		            const uint32_t begin = chunk * kHashChunkSize;
+		            chunkHashes[chunk] = hashChunk(begin, std::min(begin + kHashChunkSize, count));
+	            });
+	uint64_t hash = count;
+	for (uint64_t chunkHash : chunkHashes)
+	{
+		hash = HashMix(hash, chunkHash);
+	}
+	return hash;
+}
+
+uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + kArrayAlignment - 1) / kArrayAlignment * kArrayAlignment;
+}
+
+/// True if the nodes form a tree rooted at the first one, no deeper than the
+/// traversal stacks allow, whose leaves reference the triangles in range, and
+/// if the triangles reference existing geometries. The traversals trust all
+/// of these, and a corrupt file must not send them out of bounds
+bool IsValidHierarchy(ArrayView<BvhNode> nodes, ArrayView<BvhTriangle> triangles, size_t geometryCount)
+{
+	if (nodes.empty())
+		return triangles.empty();
+
+	struct StackEntry
+	{
+		uint32_t nodeIndex;
+		uint32_t depth;
+	};
+	std::vector<StackEntry> stack = {{0, 0}};
+	// Each node must be reached once, which also rules out cycles
+	std::vector<bool> visited(nodes.size(), false);
+	while (!stack.empty())
+	{
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+		if (entry.depth > kBvhMaxDepth || visited[entry.nodeIndex])
+			return false;
+		visited[entry.nodeIndex] = true;
+
+		const BvhNode& node = nodes[entry.nodeIndex];
+		if (node.IsLeaf())
+		{
+			if (uint64_t(node.leftOrFirst) + node.count > triangles.size())
+				return false;
+			continue;
+		}
+		if (uint64_t(node.leftOrFirst) + 1 >= nodes.size())
+			return false;
+		stack.push_back({node.leftOrFirst, entry.depth + 1});
+		stack.push_back({node.leftOrFirst + 1, entry.depth + 1});
+	}
+
+	for (const BvhTriangle& triangle : triangles)
+	{
+		if (triangle.geometryIndex >= geometryCount)
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
+BvhCacheKey::BvhCacheKey(const BvhBuildSettings& settings) : m_hash(kFormatVersion)
+{
+	m_hash = HashMix(m_hash, static_cast<uint64_t>(settings.algorithm));
+	m_hash = HashMix(m_hash, settings.binCount);
+	m_hash = HashMix(m_hash, settings.maxLeafSize);
+	m_hash = HashMix(m_hash, settings.leafBlockSize);
+	m_hash = HashMix(m_hash, FloatBits(settings.traversalCost));
+	m_hash = HashMix(m_hash, FloatBits(settings.intersectionCost));
+	m_hash = HashMix(m_hash, settings.mortonBits);
+	m_hash = HashMix(m_hash, settings.optimizeTreelets ? 1 : 0);
+	m_hash = HashMix(m_hash, FloatBits(settings.spatialSplitBudget));
+	m_hash = HashMix(m_hash, FloatBits(settings.spatialSplitOverlap));
+	m_hash = HashMix(m_hash, settings.quadLeaves ? 1 : 0);
+}
+
+void BvhCacheKey::AddVertexBuffer(const void* vertexBuffer, uint32_t vertexCount, uint32_t vertexSizeInBytes,
+                                  const uint32_t* indexBuffer, uint32_t indexCount, bool isOpaque)
+{
+	const uint8_t* vertices = static_cast<const uint8_t*>(vertexBuffer);
+	const uint64_t vertexHash = HashChunks(vertexCount, [&](uint32_t begin, uint32_t end) {
+		uint64_t hash = begin;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t p[3];
+			std::memcpy(p, vertices + size_t(i) * vertexSizeInBytes, sizeof(p));
+			hash = HashMix(hash, p[0] | (uint64_t(p[1]) << 32));
+			hash = HashMix(hash, p[2]);
+		}
+		return hash;
+	});
+	const uint64_t indexHash = HashChunks(indexBuffer ? indexCount : 0, [&](uint32_t begin, uint32_t end) {
+		uint64_t hash = begin;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			hash = HashMix(hash, indexBuffer[i]);
+		}
+		return hash;
+	});
+
+	m_hash = HashMix(m_hash, vertexHash);
+	m_hash = HashMix(m_hash, indexBuffer ? indexHash : ~0ull);
+	m_hash = HashMix(m_hash, isOpaque ? 1 : 0);
+}
+
+BvhCache::BvhCache(const std::string& directory) : m_directory(directory)
+{
+	if (!MakeDirectory(directory))
+	{
+		throw std::runtime_error("Cannot create the BVH cache directory " + directory);
+	}
+}
+
+std::string BvhCache::GetFileName(const BvhCacheKey& key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(HashFinalize(key.GetHash())));
+	return m_directory + "/" + name;
+}
+
+bool BvhCache::Load(const BvhCacheKey& key, Bvh& bvh) const
+{
+	std::shared_ptr<const MappedFile> file;
+	try
+	{
+		file = std::make_shared<MappedFile>(GetFileName(key));
+	}
+	catch (const std::runtime_error&)
+	{
+		return false;
+	}
+
+	BvhCacheHeader header;
+	if (file->GetSize() < sizeof(header))
+		return false;
+	std::memcpy(&header, file->GetData(), sizeof(header));
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion ||
+	    header.nodeSize != sizeof(BvhNode) || header.triangleSize != sizeof(BvhTriangle) ||
+	    header.key != key.GetHash() || header.maxDepth > kBvhMaxDepth)
+		return false;
+
+	ArrayView<BvhNode> nodes;
+	ArrayView<BvhTriangle> triangles;
+	ArrayView<uint8_t> geometryOpaque;
+	try
+	{
+		nodes = file->GetArray<BvhNode>(header.nodeOffset, header.nodeCount);
+		triangles = file->GetArray<BvhTriangle>(header.triangleOffset, header.triangleCount);
+		geometryOpaque = file->GetArray<uint8_t>(header.geometryOffset, header.geometryCount);
+	}
+	catch (const std::runtime_error&)
+	{
+		return false;
+	}
+	if (!IsValidHierarchy(nodes, triangles, geometryOpaque.size()))
+		return false;
+
+	// Release the storage of the previous content, which the mapping replaces
+	std::vector<BvhNode>().swap(bvh.m_nodes);
+	std::vector<BvhTriangle>().swap(bvh.m_triangles);
+	std::vector<ProceduralPrimitive>().swap(bvh.m_procedurals);
+	std::vector<BvhQuad>().swap(bvh.m_quads);
+	bvh.m_geometryOpaque.assign(geometryOpaque.begin(), geometryOpaque.end());
+	bvh.m_mapping = file;
+	bvh.m_mappedNodes = nodes;
+	bvh.m_mappedTriangles = triangles;
+
+	BvhStats& stats = bvh.m_stats;
+	stats = BvhStats();
+	stats.triangleCount = header.uniqueTriangleCount;
+	stats.referenceCount = static_cast<uint32_t>(header.triangleCount);
+	stats.nodeCount = static_cast<uint32_t>(header.nodeCount);
+	stats.leafCount = header.leafCount;
+	stats.maxDepth = header.maxDepth;
+	stats.sahCost = header.sahCost;
+	stats.memoryInBytes = nodes.size() * sizeof(BvhNode) + triangles.size() * sizeof(BvhTriangle);
+	stats.buildSeconds = header.buildSeconds;
+	return true;
+}
+
+bool BvhCache::Save(const BvhCacheKey& key, const Bvh& bvh) const
+{
+	// The files store triangles, and procedural primitives are quick to build
+	if (bvh.IsProcedural() || bvh.HasQuads())
+		return false;
+	const ArrayView<BvhNode> nodes = bvh.GetNodes();
+	const ArrayView<BvhTriangle> triangles = bvh.GetTriangles();
+	const std::vector<uint8_t> geometryOpaque(bvh.m_geometryOpaque.begin(), bvh.m_geometryOpaque.end());
+	const BvhStats& stats = bvh.GetStats();
+
+	BvhCacheHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kFormatVersion;
+	header.nodeSize = sizeof(BvhNode);
+	header.triangleSize = sizeof(BvhTriangle);
+	header.geometryCount = static_cast<uint32_t>(geometryOpaque.size());
+	header.key = key.GetHash();
+	header.nodeOffset = AlignOffset(sizeof(header));
+	header.nodeCount = nodes.size();
+	header.triangleOffset = AlignOffset(header.nodeOffset + nodes.size() * sizeof(BvhNode));
+	header.triangleCount = triangles.size();
+	header.geometryOffset = AlignOffset(header.triangleOffset + triangles.size() * sizeof(BvhTriangle));
+	header.uniqueTriangleCount = stats.triangleCount;
+	header.leafCount = stats.leafCount;
+	header.maxDepth = stats.maxDepth;
+	header.sahCost = stats.sahCost;
+	header.buildSeconds = stats.buildSeconds;
+
+	// Name the temporary file after the writer, so that concurrent writers of
+	// the same hierarchy do not mix their files
+	const std::string fileName = GetFileName(key);
+	const std::string temporaryName =
+	    fileName + "." +
+	    std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+	                   static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count())) +
+	    ".tmp";
+	{
+		std::ofstream file(temporaryName, std::ios::binary);
+		if (!file.good())
+			return false;
+		auto writeAt = [&file](uint64_t offset, const void* data, size_t size) {
+			static const char kPadding[kArrayAlignment] = {};
+			const uint64_t position = static_cast<uint64_t>(file.tellp());
+			file.write(kPadding, static_cast<std::streamsize>(offset - position));
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		writeAt(0, &header, sizeof(header));
+		writeAt(header.nodeOffset, nodes.data(), nodes.size() * sizeof(BvhNode));
+		writeAt(header.triangleOffset, triangles.data(), triangles.size() * sizeof(BvhTriangle));
+		writeAt(header.geometryOffset, geometryOpaque.data(), geometryOpaque.size());
+		if (!file.good())
+		{
+			file.close();
+			std::remove(temporaryName.c_str());
+			return false;
+		}
+	}
+
+	// Renaming does not replace an existing file everywhere: the one in place
+	// holds the same hierarchy, unless it is from another build
+	if (std::rename(temporaryName.c_str(), fileName.c_str()) != 0)
+	{
+		std::remove(fileName.c_str());
+		if (std::rename(temporaryName.c_str(), fileName.c_str()) != 0)
+		{
+			std::remove(temporaryName.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,62 @@
+#pragma once
+
+// Content-addressed cache of built bottom-level hierarchies on disk. A key
+// hashes the vertex positions and indices given to a Bvh with the settings of
+// its build, and names the file the hierarchy is saved to. The files store
+// the nodes and triangles in the memory layout of Bvh, at aligned offsets, so
+// that loading a hierarchy maps its file and uses it in place: no parsing, no
+// copy and no rebuild, only a pass checking the indices of the nodes and
+// triangles, which the traversals trust. The layout is that of the build
+// which wrote the file, which its header records along with a format
+// version, so that other files are ignored and rebuilt.
+
+#include "Bvh.h"
+
+#include <string>
+
+namespace cpu_rt
+{
+
+/// Hash of the inputs of a bottom-level build
+class BvhCacheKey
+{
+public:
+	/// Start a key with the settings that change the hierarchy: the thread
+	/// count does not, as the builders are deterministic
+	explicit BvhCacheKey(const BvhBuildSettings& settings = {});
+
+	/// Hash a vertex buffer and its optional index buffer, with the parameters
+	/// of the Bvh::AddVertexBuffer call to come. Only the positions are hashed.
+	/// Large buffers are hashed in parallel
+	void AddVertexBuffer(const void* vertexBuffer, uint32_t vertexCount, uint32_t vertexSizeInBytes,
+	                     const uint32_t* indexBuffer = nullptr, uint32_t indexCount = 0, bool isOpaque = true);
+
+	uint64_t GetHash() const { return m_hash; }
+
+private:
+	uint64_t m_hash;
+};
+
+class BvhCache
+{
+public:
+	/// Cache in a directory, created if needed. Throws std::runtime_error if it
+	/// cannot be created
+	explicit BvhCache(const std::string& directory);
+
+	/// Map the hierarchy saved under the key in place of the content of bvh.
+	/// Returns false, leaving bvh unchanged, if there is none or if its file
+	/// is invalid or comes from another build
+	bool Load(const BvhCacheKey& key, Bvh& bvh) const;
+	/// Save a built hierarchy under the key. The file is written aside then
+	/// renamed, so that readers never see part of it. Returns false if it
+	/// cannot be written, the cache being only an optimization
+	bool Save(const BvhCacheKey& key, const Bvh& bvh) const;
+
+	std::string GetFileName(const BvhCacheKey& key) const;
+
+private:
+	std::string m_directory;
+};
+
+} // namespace cpu_rt
@@ -0,0 +1,102 @@
+#include "CacheCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <initializer_list>
+#endif
+
+namespace cpu_rt
+{
+
+#ifdef __linux__
+
+namespace
+{
+
+/// Open a disabled counter of read misses of a cache, in user mode on the
+/// calling thread. Returns -1 if the event is not supported
+int OpenReadMissCounter(uint64_t cache)
+{
+	perf_event_attr attributes;
+	std::memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = PERF_TYPE_HW_CACHE;
+	attributes.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attributes.disabled = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+uint64_t ReadCounter(int counter)
+{
+	uint64_t value = 0;
+	if (read(counter, &value, sizeof(value)) != sizeof(value))
+		return 0;
+	return value;
+}
+
+} // namespace
+
+CacheCounters::CacheCounters()
+    : m_l1(OpenReadMissCounter(PERF_COUNT_HW_CACHE_L1D)), m_lastLevel(OpenReadMissCounter(PERF_COUNT_HW_CACHE_LL))
+{
+}
+
+CacheCounters::~CacheCounters()
+{
+	if (m_l1 >= 0)
+		close(m_l1);
+	if (m_lastLevel >= 0)
+		close(m_lastLevel);
+}
+
+void CacheCounters::Start()
+{
+	if (!IsAvailable())
+		return;
+	for (int counter : {m_l1, m_lastLevel})
+	{
+		ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+CacheMisses CacheCounters::Stop()
+{
+	if (!IsAvailable())
+		return {0, 0};
+	for (int counter : {m_l1, m_lastLevel})
+	{
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+	}
+	return {ReadCounter(m_l1), ReadCounter(m_lastLevel)};
+}
+
+#else
+
+CacheCounters::CacheCounters()
+{
+}
+
+CacheCounters::~CacheCounters()
+{
+}
+
+void CacheCounters::Start()
+{
+}
+
+CacheMisses CacheCounters::Stop()
+{
+	return {0, 0};
+}
+
+#endif
+
+} // namespace cpu_rt
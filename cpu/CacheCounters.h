@@ -0,0 +1,42 @@
+#pragma once
+
+// Hardware cache miss counters of the calling thread, for the benchmarks.
+// They are read from the Linux perf events: the first-level data cache read
+// misses, which are the accesses to the L2, and the last-level cache read
+// misses, which go to memory. Elsewhere, or when the kernel or the virtual
+// machine does not expose the counters, IsAvailable returns false.
+
+#include <cstdint>
+
+namespace cpu_rt
+{
+
+struct CacheMisses
+{
+	uint64_t l1;
+	uint64_t lastLevel;
+};
+
+class CacheCounters
+{
+public:
+	CacheCounters();
+	~CacheCounters();
+
+	CacheCounters(const CacheCounters&) = delete;
+	CacheCounters& operator=(const CacheCounters&) = delete;
+
+	bool IsAvailable() const { return m_l1 >= 0 && m_lastLevel >= 0; }
+
+	/// Reset the counters and start counting
+	void Start();
+	/// Stop counting and return the misses since Start, or zeros if the
+	/// counters are not available
+	CacheMisses Stop();
+
+private:
+	int m_l1 = -1;
+	int m_lastLevel = -1;
+};
+
+} // namespace cpu_rt
@@ -0,0 +1,69 @@
+#include "CommandLine.h"
+
+#include <cstdlib>
+#include <sstream>
+
+namespace cpu_rt
+{
+
+bool IsOption(const std::string& arg, const char* name)
+{
+	return arg.size() > 1 && (arg[0] == '-' || arg[0] == '/') && arg.compare(1, std::string::npos, name) == 0;
+}
+
+bool HasOption(const std::vector<std::string>& args, const char* name)
+{
+	for (size_t i = 1; i < args.size(); i++)
+	{
+		if (IsOption(args[i], name))
+			return true;
+	}
+	return false;
+}
+
+std::string GetOption(const std::vector<std::string>& args, const char* name, const std::string& defaultValue)
+{
+	for (size_t i = 1; i + 1 < args.size(); i++)
+	{
+		if (IsOption(args[i], name))
+			return args[i + 1];
+	}
+	return defaultValue;
+}
+
+uint32_t GetOption(const std::vector<std::string>& args, const char* name, uint32_t defaultValue)
+{
+	const std::string value = GetOption(args, name, std::string());
+	return value.empty() ? defaultValue : static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+}
+
+float GetOption(const std::vector<std::string>& args, const char* name, float defaultValue)
+{
+	const std::string value = GetOption(args, name, std::string());
+	return value.empty() ? defaultValue : std::strtof(value.c_str(), nullptr);
+}
+
+std::vector<uint32_t> GetListOption(const std::vector<std::string>& args, const char* name,
+                                    const std::vector<uint32_t>& defaultValue)
+{
+	const std::string value = GetOption(args, name, std::string());
+	if (value.empty())
+		return defaultValue;
+
+	std::vector<uint32_t> list;
+	std::istringstream stream(value);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		const size_t dash = item.find('-');
+		const uint32_t first = static_cast<uint32_t>(std::strtoul(item.c_str(), nullptr, 10));
+		const uint32_t last = dash == std::string::npos ? first : static_cast<uint32_t>(std::strtoul(item.c_str() + dash + 1, nullptr, 10));
+		for (uint32_t i = first; i <= last; i++)
+		{
+			list.push_back(i);
+		}
+	}
+	return list;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,28 @@
+#pragma once
+
+// Helpers to read the options of the headless renderer and of the benchmarks.
+// Options are accepted with either a '-' or a '/' prefix, as the -warp option
+// of the sample, and take their value from the next argument.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Return true if arg is the option of the given name, without its prefix
+bool IsOption(const std::string& arg, const char* name);
+/// Return true if the option is present, with or without value
+bool HasOption(const std::vector<std::string>& args, const char* name);
+/// Value of a string option, or the default if the option is absent
+std::string GetOption(const std::vector<std::string>& args, const char* name, const std::string& defaultValue);
+/// Value of an unsigned integer option, or the default if the option is absent
+uint32_t GetOption(const std::vector<std::string>& args, const char* name, uint32_t defaultValue);
+/// Value of a number option, or the default if the option is absent
+float GetOption(const std::vector<std::string>& args, const char* name, float defaultValue);
+/// Value of a list option such as "3,4,5" or "3-5", or the default if absent
+std::vector<uint32_t> GetListOption(const std::vector<std::string>& args, const char* name,
+                                    const std::vector<uint32_t>& defaultValue);
+
+} // namespace cpu_rt
@@ -0,0 +1,80 @@
+#pragma once
+
+// CPU counterparts of the types shared by the HLSL raytracing shaders
+// (res/shaders/Common.hlsl) and of the DXR built-in RayDesc. This header and
+// everything else under cpu/ only depends on the standard library and glm, so
+// the headless renderer also builds on machines without D3D12.
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace cpu_rt
+{
+
+/// Vertex layout of the application vertex buffers, identical in size and
+/// member offsets to D3D12HelloTriangle::Vertex and STriVertex in Hit.hlsl
+struct Vertex
+{
+	float position[3];
+	float color[4];
+};
+static_assert(sizeof(Vertex) == 28, "cpu_rt::Vertex must match the GPU vertex stride");
+
+/// Hit information, aka ray payload. Carries a shading color and hit distance,
+/// the distance being negative on a miss
+struct HitInfo
+{
+	glm::vec4 colorAndDistance;
+};
+
+/// Payload of the shadow rays
+struct ShadowHitInfo
+{
+	bool isHit;
+};
+
+/// Attributes output by the intersection, here the barycentric coordinates.
+/// Procedural primitives also report the object-space unit normal of the
+/// surface that was hit, which triangles leave unset: their normal follows
+/// from their vertices
+struct Attributes
+{
+	glm::vec2 bary;
+	glm::vec3 normal;
+};
+
+/// Ray description, as passed to TraceRay
+struct RayDesc
+{
+	glm::vec3 Origin;
+	float TMin;
+	glm::vec3 Direction;
+	float TMax;
+};
+
+/// Ray flags of TraceRay, with the values of the HLSL RAY_FLAG enumeration
+enum RayFlags : uint32_t
+{
+	RAY_FLAG_NONE = 0x00,
+	RAY_FLAG_FORCE_OPAQUE = 0x01,
+	RAY_FLAG_FORCE_NON_OPAQUE = 0x02,
+	RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH = 0x04,
+	RAY_FLAG_SKIP_CLOSEST_HIT_SHADER = 0x08,
+	RAY_FLAG_CULL_BACK_FACING_TRIANGLES = 0x10,
+	RAY_FLAG_CULL_FRONT_FACING_TRIANGLES = 0x20,
+	RAY_FLAG_CULL_OPAQUE = 0x40,
+	RAY_FLAG_CULL_NON_OPAQUE = 0x80,
+};
+
+/// Instance flags, with the values of D3D12_RAYTRACING_INSTANCE_FLAGS
+enum InstanceFlags : uint32_t
+{
+	INSTANCE_FLAG_NONE = 0x0,
+	INSTANCE_FLAG_TRIANGLE_CULL_DISABLE = 0x1,
+	INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE = 0x2,
+	INSTANCE_FLAG_FORCE_OPAQUE = 0x4,
+	INSTANCE_FLAG_FORCE_NON_OPAQUE = 0x8,
+};
+
+} // namespace cpu_rt
@@ -0,0 +1,288 @@
+#pragma once
+
+// Geometric primitives shared by the CPU acceleration structures: axis-aligned
+// boxes, the ray representation used during traversal, and the ray-triangle
+// test.
+
+#include "Common.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace cpu_rt
+{
+
+/// Axis-aligned bounding box, empty when min > max
+struct Aabb
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void Extend(const glm::vec3& p)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	void Extend(const Aabb& b)
+	{
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+	bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+	glm::vec3 Center() const { return 0.5f * (min + max); }
+	glm::vec3 Extent() const { return max - min; }
+	/// Surface area, 0 for empty boxes
+	float HalfArea() const
+	{
+		if (IsEmpty())
+			return 0.f;
+		const glm::vec3 e = Extent();
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+};
+
+/// Bounds of a box after an affine transform, expanding each axis by the
+/// absolute contributions of the matrix columns (Arvo's method)
+inline Aabb TransformAabb(const Aabb& box, const glm::mat4& transform)
+{
+	if (box.IsEmpty())
+		return box;
+	Aabb result;
+	result.min = result.max = glm::vec3(transform[3]);
+	for (int column = 0; column < 3; column++)
+	{
+		const glm::vec3 axis(transform[column]);
+		const glm::vec3 a = axis * box.min[column];
+		const glm::vec3 b = axis * box.max[column];
+		result.min += glm::min(a, b);
+		result.max += glm::max(a, b);
+	}
+	return result;
+}
+
+/// Interleave the low 10 bits of x, y and z into a 30-bit Morton code
+inline uint32_t EncodeMorton30(uint32_t x, uint32_t y, uint32_t z)
+{
+	auto expand = [](uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	};
+	return (expand(x & 0x3FF) << 2) | (expand(y & 0x3FF) << 1) | expand(z & 0x3FF);
+}
+
+/// 30-bit Morton code of a point, quantized on a 1024^3 grid over the bounds
+inline uint32_t EncodeMorton30(const glm::vec3& p, const Aabb& bounds)
+{
+	const glm::vec3 extent = glm::max(bounds.Extent(), glm::vec3(FLT_MIN));
+	const glm::vec3 cell = glm::clamp((p - bounds.min) / extent * 1024.f, 0.f, 1023.f);
+	return EncodeMorton30(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+}
+
+/// Interleave the low 21 bits of x, y and z into a 63-bit Morton code
+inline uint64_t EncodeMorton63(uint32_t x, uint32_t y, uint32_t z)
+{
+	auto expand = [](uint64_t v) {
+		v = (v | (v << 32)) & 0x001F00000000FFFFull;
+		v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+		v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+		v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+		v = (v | (v << 2)) & 0x1249249249249249ull;
+		return v;
+	};
+	return (expand(x & 0x1FFFFF) << 2) | (expand(y & 0x1FFFFF) << 1) | expand(z & 0x1FFFFF);
+}
+
+/// 63-bit Morton code of a point, quantized on a 2097152^3 grid over the
+/// bounds
+inline uint64_t EncodeMorton63(const glm::vec3& p, const Aabb& bounds)
+{
+	const glm::vec3 extent = glm::max(bounds.Extent(), glm::vec3(FLT_MIN));
+	const glm::vec3 cell = glm::clamp((p - bounds.min) / extent * 2097152.f, 0.f, 2097151.f);
+	return EncodeMorton63(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+}
+
+/// Ray prepared for traversal, with the reciprocal direction used by the slab
+/// tests. Null direction components are replaced by a tiny value of the same
+/// sign so that the slab distances stay finite or infinite, never NaN
+struct TraversalRay
+{
+	glm::vec3 origin;
+	float tMin;
+	glm::vec3 direction;
+	float tMax;
+	glm::vec3 invDirection;
+
+	TraversalRay() = default;
+	explicit TraversalRay(const RayDesc& ray)
+	    : origin(ray.Origin), tMin(ray.TMin), direction(ray.Direction), tMax(ray.TMax)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			const float d = std::fabs(direction[i]) < 1e-20f ? std::copysign(1e-20f, direction[i]) : direction[i];
+			invDirection[i] = 1.f / d;
+		}
+	}
+};
+
+/// Slab test, returning the entry distance in tEntry
+inline bool IntersectAabb(const TraversalRay& ray, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax,
+                          float& tEntry)
+{
+	const glm::vec3 t0 = (boxMin - ray.origin) * ray.invDirection;
+	const glm::vec3 t1 = (boxMax - ray.origin) * ray.invDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, ray.tMin));
+	const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	return tEntry <= tExit;
+}
+
+/// Moller-Trumbore ray-triangle test, without backface culling. Returns the
+/// distance and barycentrics of hits in ]tMin, tMax[, following the DXR
+/// convention: bary.x weights v1 and bary.y weights v2
+inline bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax,
+                              const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& t,
+                              Attributes& attrib)
+{
+	const glm::vec3 e1 = v1 - v0;
+	const glm::vec3 e2 = v2 - v0;
+	const glm::vec3 p = glm::cross(direction, e2);
+	const float det = glm::dot(e1, p);
+	if (det == 0.f)
+		return false;
+	const float invDet = 1.f / det;
+
+	const glm::vec3 s = origin - v0;
+	const float u = glm::dot(s, p) * invDet;
+	if (u < 0.f || u > 1.f)
+		return false;
+
+	const glm::vec3 q = glm::cross(s, e1);
+	const float v = glm::dot(direction, q) * invDet;
+	if (v < 0.f || u + v > 1.f)
+		return false;
+
+	const float d = glm::dot(e2, q) * invDet;
+	if (d <= tMin || d >= tMax)
+		return false;
+
+	t = d;
+	attrib.bary = glm::vec2(u, v);
+	return true;
+}
+
+/// Ray prepared for the watertight ray-triangle test of Woop, Benthin and Wald
+/// (JCGT 2013): the axes are permuted so that the ray goes along +z, and the
+/// shear coefficients map the direction onto the z axis
+struct WatertightRay
+{
+	glm::vec3 origin;
+	int kx, ky, kz;
+	float shearX, shearY, shearZ;
+
+	explicit WatertightRay(const glm::vec3& rayOrigin, const glm::vec3& direction) : origin(rayOrigin)
+	{
+		const glm::vec3 absDirection = glm::abs(direction);
+		kz = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2)
+		                                     : (absDirection.y > absDirection.z ? 1 : 2);
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+		// Keep the winding of the triangles
+		if (direction[kz] < 0.f)
+			std::swap(kx, ky);
+		shearX = direction[kx] / direction[kz];
+		shearY = direction[ky] / direction[kz];
+		shearZ = 1.f / direction[kz];
+	}
+};
+
+/// Watertight ray-triangle test: rays through a shared edge or vertex hit at
+/// least one of the triangles. Same conventions as IntersectTriangle. The
+/// edge functions are evaluated again in double precision when one of them is
+/// exactly 0, as the float result cannot decide on which side the ray passes
+inline bool IntersectTriangleWatertight(const WatertightRay& ray, float tMin, float tMax, const glm::vec3& v0,
+                                        const glm::vec3& v1, const glm::vec3& v2, float& t, Attributes& attrib)
+{
+	const glm::vec3 a = v0 - ray.origin;
+	const glm::vec3 b = v1 - ray.origin;
+	const glm::vec3 c = v2 - ray.origin;
+	const float ax = a[ray.kx] - ray.shearX * a[ray.kz];
+	const float ay = a[ray.ky] - ray.shearY * a[ray.kz];
+	const float bx = b[ray.kx] - ray.shearX * b[ray.kz];
+	const float by = b[ray.ky] - ray.shearY * b[ray.kz];
+	const float cx = c[ray.kx] - ray.shearX * c[ray.kz];
+	const float cy = c[ray.ky] - ray.shearY * c[ray.kz];
+
+	// Edge functions, weighting v0, v1 and v2
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+	if (u == 0.f || v == 0.f || w == 0.f)
+	{
+		u = static_cast<float>(double(cx) * double(by) - double(cy) * double(bx));
+		v = static_cast<float>(double(ax) * double(cy) - double(ay) * double(cx));
+		w = static_cast<float>(double(bx) * double(ay) - double(by) * double(ax));
+	}
+	if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f))
+		return false;
+	const float det = u + v + w;
+	if (det == 0.f)
+		return false;
+
+	const float scaledT = ray.shearZ * (u * a[ray.kz] + v * b[ray.kz] + w * c[ray.kz]);
+	const float invDet = 1.f / det;
+	const float d = scaledT * invDet;
+	if (d <= tMin || d >= tMax)
+		return false;
+
+	t = d;
+	attrib.bary = glm::vec2(v * invDet, w * invDet);
+	return true;
+}
+
+/// DXR facing rule: a triangle is front-facing if its vertices appear
+/// clockwise from the ray origin, in a left-handed coordinate system
+inline bool IsFrontFacing(const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+	return glm::dot(direction, glm::cross(v1 - v0, v2 - v0)) < 0.f;
+}
+
+/// Flags that make the triangle tests reject some of the hits
+static const uint32_t kTriangleFilterRayFlags = RAY_FLAG_CULL_BACK_FACING_TRIANGLES |
+                                                RAY_FLAG_CULL_FRONT_FACING_TRIANGLES | RAY_FLAG_CULL_OPAQUE |
+                                                RAY_FLAG_CULL_NON_OPAQUE;
+
+/// True if a hit must be ignored because of the opacity culling flags of the
+/// ray. isOpaque is the opacity of the geometry, which the FORCE_OPAQUE and
+/// FORCE_NON_OPAQUE flags override
+inline bool IsOpacityCulled(uint32_t rayFlags, bool isOpaque)
+{
+	if (!(rayFlags & (RAY_FLAG_CULL_OPAQUE | RAY_FLAG_CULL_NON_OPAQUE)))
+		return false;
+	const bool opaque = (rayFlags & RAY_FLAG_FORCE_OPAQUE) ? true
+	                    : (rayFlags & RAY_FLAG_FORCE_NON_OPAQUE) ? false
+	                                                             : isOpaque;
+	return (rayFlags & (opaque ? RAY_FLAG_CULL_OPAQUE : RAY_FLAG_CULL_NON_OPAQUE)) != 0;
+}
+
+/// True if a triangle hit must be ignored because of the culling flags of the
+/// ray, as IsOpacityCulled and by facing
+inline bool IsTriangleCulled(uint32_t rayFlags, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1,
+                             const glm::vec3& v2, bool isOpaque)
+{
+	if (IsOpacityCulled(rayFlags, isOpaque))
+		return true;
+	if (rayFlags & (RAY_FLAG_CULL_BACK_FACING_TRIANGLES | RAY_FLAG_CULL_FRONT_FACING_TRIANGLES))
+	{
+		const bool front = IsFrontFacing(direction, v0, v1, v2);
+		if (rayFlags & (front ? RAY_FLAG_CULL_FRONT_FACING_TRIANGLES : RAY_FLAG_CULL_BACK_FACING_TRIANGLES))
+			return true;
+	}
+	return false;
+}
+
+} // namespace cpu_rt
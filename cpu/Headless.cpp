@@ -0,0 +1,191 @@
+#include "Headless.h"
+#include "Benchmarks.h"
+#include "CommandLine.h"
+#include "MeshImport.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+struct HeadlessOptions
+{
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	uint32_t frames = 1;
+	DispatchSettings dispatch;
+	std::string output = "gOutput.ppm";
+	/// Directory of the BVH cache, empty to build the hierarchies every time
+	std::string bvhCache;
+	/// Scene file to render, empty for the animated sample scene
+	std::string scene;
+	/// Render the sample scene with a procedural box and quad
+	bool procedural = false;
+	/// When the top level is rebuilt rather than refitted, and whether the
+	/// rebuild counters are printed
+	RebuildPolicy rebuildPolicy;
+	bool printRebuilds = false;
+};
+
+HeadlessOptions ParseOptions(const std::vector<std::string>& args)
+{
+	HeadlessOptions options;
+	options.width = GetOption(args, "width", options.width);
+	options.height = GetOption(args, "height", options.height);
+	options.frames = GetOption(args, "frames", options.frames);
+	options.dispatch.tileSize = GetOption(args, "tile", options.dispatch.tileSize);
+	options.dispatch.tileOrder =
+	    ParseTileOrder(GetOption(args, "tileOrder", GetTileOrderName(options.dispatch.tileOrder)));
+	options.dispatch.threadCount = GetOption(args, "threads", options.dispatch.threadCount);
+	options.dispatch.packetSize = GetOption(args, "packet", options.dispatch.packetSize);
+	options.dispatch.deferOcclusionRays = HasOption(args, "deferShadows");
+	options.output = GetOption(args, "o", options.output);
+	options.bvhCache = GetOption(args, "bvhCache", options.bvhCache);
+	options.scene = GetOption(args, "scene", options.scene);
+	options.procedural = HasOption(args, "procedural");
+	options.rebuildPolicy.maxSahInflation = GetOption(args, "rebuild", 0.f);
+	options.rebuildPolicy.maxRefits = GetOption(args, "rebuildAge", 0u);
+	options.rebuildPolicy.asynchronous = HasOption(args, "asyncRebuild");
+	options.printRebuilds = HasOption(args, "rebuild") || HasOption(args, "rebuildAge");
+	if (options.width == 0 || options.height == 0 || options.frames == 0)
+	{
+		throw std::runtime_error("Image size and frame count must be non-zero");
+	}
+	return options;
+}
+
+int Render(const std::vector<std::string>& args)
+{
+	const HeadlessOptions options = ParseOptions(args);
+
+	std::unique_ptr<BvhCache> bvhCache(options.bvhCache.empty() ? nullptr : new BvhCache(options.bvhCache));
+	// The meshes of a scene file keep it mapped for the lifetime of the scene
+	std::unique_ptr<SceneFile> sceneFile(options.scene.empty() ? nullptr : new SceneFile(options.scene));
+	Scene scene = sceneFile              ? LoadScene(*sceneFile, bvhCache.get())
+	              : options.procedural ? CreateProceduralHelloTriangleScene()
+	                                   : CreateHelloTriangleScene(bvhCache.get());
+	const Camera camera =
+	    CreateCamera(sceneFile ? sceneFile->GetCamera() : CameraSetup(), options.width, options.height);
+	scene.SetRebuildPolicy(options.rebuildPolicy);
+	const Pipeline pipeline = CreateHelloTrianglePipeline();
+	Image output(options.width, options.height);
+
+	DispatchStats total;
+	for (uint32_t frame = 0; frame < options.frames; frame++)
+	{
+		// OnUpdate advances the animation before each frame is rendered. Scene
+		// files are static
+		if (!sceneFile)
+			AnimateHelloTriangleScene(scene, frame + 1);
+		const DispatchStats stats = DispatchRays(pipeline, scene, camera, output, options.dispatch);
+		std::printf("frame %u: %.2f ms, %llu rays, %.2f Mrays/s\n", frame, stats.seconds * 1000.0,
+		            static_cast<unsigned long long>(stats.rayCount), stats.RaysPerSecond() * 1e-6);
+		total.rayCount += stats.rayCount;
+		total.seconds += stats.seconds;
+	}
+	std::printf("%ux%u, %u frame(s): %llu rays in %.3f s, %.2f Mrays/s\n", options.width, options.height,
+	            options.frames, static_cast<unsigned long long>(total.rayCount), total.seconds,
+	            total.RaysPerSecond() * 1e-6);
+	if (options.printRebuilds)
+	{
+		const TopLevelBvhStats& stats = scene.GetTopLevel().GetStats();
+		std::printf("top level: %u refits, %u builds (%u by the policy, %u asynchronous), SAH %.2f (%.2fx built)\n",
+		            stats.refitCount, stats.buildCount, stats.policyRebuildCount, stats.asyncRebuildCount,
+		            stats.sahCost, stats.builtSahCost > 0.f ? stats.sahCost / stats.builtSahCost : 1.f);
+	}
+
+	output.WritePpm(options.output);
+	std::printf("wrote %s\n", options.output.c_str());
+	return EXIT_SUCCESS;
+}
+
+/// Write the scene file given by -convert: the sample scene, or the mesh
+/// given by -import with a camera looking at it from the same direction
+int Convert(const std::vector<std::string>& args)
+{
+	const std::string fileName = GetOption(args, "convert", std::string());
+	const std::string meshFileName = GetOption(args, "import", std::string());
+	if (fileName.empty())
+	{
+		throw std::runtime_error("-convert requires an output file name");
+	}
+	if (meshFileName.empty())
+	{
+		const Scene scene = CreateHelloTriangleScene();
+		SaveScene(fileName, scene, CameraSetup());
+		std::printf("wrote %s: %zu meshes, %zu instances\n", fileName.c_str(), scene.GetMeshes().size(),
+		            scene.GetInstances().size());
+		return EXIT_SUCCESS;
+	}
+
+	MeshImportStats stats;
+	const Mesh mesh = ImportMesh(meshFileName, &stats, GetOption(args, "threads", 0u));
+	std::printf("imported %s: %u vertices (%u before welding), %u triangles in %.2f + %.2f s, peak memory %.1f MB\n",
+	            meshFileName.c_str(), stats.vertexCount, stats.fileVertexCount, stats.triangleCount,
+	            stats.parseSeconds, stats.weldSeconds, stats.peakMemoryBytes / double(1 << 20));
+
+	Aabb bounds;
+	for (const Vertex& vertex : mesh.vertices)
+	{
+		bounds.Extend(glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+	}
+	// The sample views a unit cube from (1.5, 1.5, 1.5)
+	const glm::vec3 extent = bounds.Extent();
+	const float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+	CameraSetup camera;
+	camera.target = bounds.Center();
+	camera.eye = bounds.Center() + glm::vec3(1.5f * size);
+	camera.nearZ *= size;
+	camera.farZ *= size;
+
+	SceneFileWriter writer(fileName);
+	const uint32_t meshIndex = writer.AddMesh(mesh.GetVertices(), mesh.GetIndices());
+	writer.AddInstance(meshIndex, glm::mat4(1.f), 0, 0, kVisibleInstanceMask | kShadowCasterInstanceMask);
+	writer.SetCamera(camera);
+	writer.Close();
+	std::printf("wrote %s\n", fileName.c_str());
+	return EXIT_SUCCESS;
+}
+
+} // namespace
+
+bool IsHeadlessRequested(const std::vector<std::string>& args)
+{
+	return HasOption(args, "cpu") || HasOption(args, "bench") || HasOption(args, "convert");
+}
+
+int RunHeadless(const std::vector<std::string>& args)
+{
+	try
+	{
+		if (HasOption(args, "bench"))
+			return RunBenchmark(args);
+		if (HasOption(args, "convert"))
+			return Convert(args);
+		return Render(args);
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "error: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+}
+
+} // namespace cpu_rt
+
+#ifndef _WIN32
+int main(int argc, char* argv[])
+{
+	return cpu_rt::RunHeadless(std::vector<std::string>(argv, argv + argc));
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+// Command-line front end of the CPU renderer. On Windows it is reached by
+// passing -cpu (or -bench <name>, or -convert <file>) to the sample
+// executable, elsewhere cpu/ builds into a standalone program.
+
+#include <string>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Return true if the command line requests the headless CPU renderer, one
+/// of its benchmarks or the scene converter
+bool IsHeadlessRequested(const std::vector<std::string>& args);
+
+/// Render the sample scene (or the scene file given by -scene) on the CPU and
+/// write the output image to disk, run the benchmark named by -bench, or
+/// write the sample scene, or the OBJ or PLY mesh given by -import, to the
+/// scene file given by -convert. args[0] is the program name.
+/// Returns the process exit code
+int RunHeadless(const std::vector<std::string>& args);
+
+} // namespace cpu_rt
@@ -0,0 +1,191 @@
+#include "InstanceGroup.h"
+
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+void InstanceGroup::AddMesh(uint32_t meshIndex, const glm::mat4& transform)
+{
+	m_children.push_back({meshIndex, kNoInstanceGroup, transform, glm::inverse(transform)});
+	m_needsBuild = true;
+}
+
+void InstanceGroup::AddGroup(uint32_t groupIndex, const glm::mat4& transform)
+{
+	m_children.push_back({0, groupIndex, transform, glm::inverse(transform)});
+	m_needsBuild = true;
+}
+
+void InstanceGroup::Build(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+                          const BvhBuildSettings& settings)
+{
+	// As in the top level, children without bounds cannot be hit and are left
+	// out of the hierarchy
+	std::vector<Aabb> bounds;
+	std::vector<uint32_t> boundedChildren;
+	bounds.reserve(m_children.size());
+	boundedChildren.reserve(m_children.size());
+	m_bounds = Aabb();
+	for (uint32_t i = 0; i < m_children.size(); i++)
+	{
+		const InstanceGroupChild& child = m_children[i];
+		const Aabb childBounds =
+		    TransformAabb(GetGeometryBounds(child.meshIndex, child.groupIndex, bottomLevels, groups), child.transform);
+		if (child.groupIndex != kNoInstanceGroup && groups[child.groupIndex].NeedsBuild())
+		{
+			throw std::logic_error("Instance group references a group that has not been built");
+		}
+		if (childBounds.IsEmpty())
+			continue;
+		bounds.push_back(childBounds);
+		boundedChildren.push_back(i);
+		m_bounds.Extend(childBounds);
+	}
+
+	BvhStats stats;
+	BuildBvhNodes(bounds, settings, m_nodes, m_childOrder, stats);
+	for (uint32_t& childIndex : m_childOrder)
+	{
+		childIndex = boundedChildren[childIndex];
+	}
+	m_needsBuild = false;
+}
+
+bool InstanceGroup::Intersect(const RayDesc& ray, const std::vector<Bvh>& bottomLevels,
+                              const std::vector<InstanceGroup>& groups, TriangleHit& hit, uint32_t rayFlags) const
+{
+	if (rayFlags & RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH)
+		return Traverse<true>(ray, bottomLevels, groups, &hit, rayFlags);
+	return Traverse<false>(ray, bottomLevels, groups, &hit, rayFlags);
+}
+
+bool InstanceGroup::Occluded(const RayDesc& ray, const std::vector<Bvh>& bottomLevels,
+                             const std::vector<InstanceGroup>& groups, TriangleHit* hit, uint32_t rayFlags) const
+{
+	return Traverse<true>(ray, bottomLevels, groups, hit, rayFlags);
+}
+
+size_t InstanceGroup::GetMemorySize() const
+{
+	return m_children.size() * sizeof(InstanceGroupChild) + m_nodes.size() * sizeof(BvhNode) +
+	       m_childOrder.size() * sizeof(uint32_t);
+}
+
+template <bool AnyHit>
+bool InstanceGroup::Traverse(const RayDesc& rayDesc, const std::vector<Bvh>& bottomLevels,
+                             const std::vector<InstanceGroup>& groups, TriangleHit* hit, uint32_t rayFlags) const
+{
+	if (m_nodes.empty())
+		return false;
+
+	const TraversalRay ray(rayDesc);
+	RayDesc childRay = rayDesc;
+	bool found = false;
+
+	struct StackEntry
+	{
+		uint32_t nodeIndex;
+		float tEntry;
+	};
+	StackEntry stack[kBvhMaxDepth + 1];
+	uint32_t stackSize = 0;
+
+	float tEntry;
+	if (!IntersectAabb(ray, m_nodes[0].boundsMin, m_nodes[0].boundsMax, childRay.TMax, tEntry))
+		return false;
+	stack[stackSize++] = {0, tEntry};
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.tEntry > childRay.TMax)
+			continue;
+		const BvhNode& node = m_nodes[entry.nodeIndex];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const InstanceGroupChild& child = m_children[m_childOrder[i]];
+				// Unnormalized directions keep the distances of the parent ray
+				childRay.Origin = glm::vec3(child.inverseTransform * glm::vec4(rayDesc.Origin, 1.f));
+				childRay.Direction = glm::mat3(child.inverseTransform) * rayDesc.Direction;
+
+				TriangleHit childHit;
+				if (!IntersectGeometry(child.meshIndex, child.groupIndex, childRay, bottomLevels, groups, AnyHit,
+				                       hit ? &childHit : nullptr, rayFlags))
+					continue;
+				if (hit)
+					*hit = childHit;
+				if (AnyHit)
+					return true;
+				childRay.TMax = childHit.t;
+				found = true;
+			}
+			continue;
+		}
+
+		const BvhNode& left = m_nodes[node.leftOrFirst];
+		const BvhNode& right = m_nodes[node.leftOrFirst + 1];
+		float tLeft, tRight;
+		const bool hitLeft = IntersectAabb(ray, left.boundsMin, left.boundsMax, childRay.TMax, tLeft);
+		const bool hitRight = IntersectAabb(ray, right.boundsMin, right.boundsMax, childRay.TMax, tRight);
+		if (hitLeft && hitRight)
+		{
+			if (tLeft <= tRight)
+			{
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+			}
+			else
+			{
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+			}
+		}
+		else if (hitLeft)
+		{
+			stack[stackSize++] = {node.leftOrFirst, tLeft};
+		}
+		else if (hitRight)
+		{
+			stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+		}
+	}
+	return found;
+}
+
+Aabb GetGeometryBounds(uint32_t meshIndex, uint32_t groupIndex, const std::vector<Bvh>& bottomLevels,
+                       const std::vector<InstanceGroup>& groups)
+{
+	if (groupIndex != kNoInstanceGroup)
+	{
+		if (groupIndex >= groups.size())
+		{
+			throw std::logic_error("Instance references an instance group that does not exist");
+		}
+		return groups[groupIndex].GetBounds();
+	}
+	if (meshIndex >= bottomLevels.size())
+	{
+		throw std::logic_error("Instance references a bottom-level hierarchy that does not exist");
+	}
+	return bottomLevels[meshIndex].GetBounds();
+}
+
+bool IntersectGeometry(uint32_t meshIndex, uint32_t groupIndex, const RayDesc& ray,
+                       const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups, bool anyHit,
+                       TriangleHit* hit, uint32_t rayFlags)
+{
+	if (groupIndex != kNoInstanceGroup)
+	{
+		const InstanceGroup& group = groups[groupIndex];
+		return anyHit ? group.Occluded(ray, bottomLevels, groups, hit, rayFlags)
+		              : group.Intersect(ray, bottomLevels, groups, *hit, rayFlags);
+	}
+	const Bvh& bottomLevel = bottomLevels[meshIndex];
+	return anyHit ? bottomLevel.Occluded(ray, hit, rayFlags) : bottomLevel.Intersect(ray, *hit, rayFlags);
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,94 @@
+#pragma once
+
+// Groups of instances that are themselves instanced, for hierarchies deeper
+// than the top and bottom levels of DXR. Self-similar scenes are then stored
+// once per level of similarity: a level-N Menger sponge is a group of 20
+// scaled copies of level N-1, which takes N groups of 20 children instead of
+// 20^N cubes of triangles. Each group has a hierarchy over the bounds of its
+// children, which are meshes or groups added before it, so that groups form
+// a graph without cycles. The ray is transformed at each level of the
+// traversal, and a hit is reported as a hit of the top-level instance, as if
+// its groups were flattened into a single mesh.
+
+#include "Bvh.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Group index of the instances and children that reference a mesh
+static const uint32_t kNoInstanceGroup = ~0u;
+
+/// Mesh or group placed in a group
+struct InstanceGroupChild
+{
+	/// Index of the bottom-level hierarchy, unused for groups
+	uint32_t meshIndex;
+	/// Index of the group, or kNoInstanceGroup for meshes
+	uint32_t groupIndex;
+	/// Child to group transform
+	glm::mat4 transform;
+	/// Group to child transform, cached to transform the rays
+	glm::mat4 inverseTransform;
+};
+
+class InstanceGroup
+{
+public:
+	/// Add a mesh to the group. The hierarchy is rebuilt by the next Build
+	void AddMesh(uint32_t meshIndex, const glm::mat4& transform);
+	/// Add a group to the group, which must come before it in the list of
+	/// groups it is built with
+	void AddGroup(uint32_t groupIndex, const glm::mat4& transform);
+
+	/// Build the hierarchy over the children. groups are indexed by
+	/// InstanceGroupChild::groupIndex, and those referenced must be built
+	void Build(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	           const BvhBuildSettings& settings = {});
+	/// True if children were added since the last build
+	bool NeedsBuild() const { return m_needsBuild; }
+
+	/// Closest intersection of an object-space ray in ]TMin, TMax[, or the
+	/// first one found with RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, as
+	/// Bvh::Intersect. The hierarchy must be built
+	bool Intersect(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	               TriangleHit& hit, uint32_t rayFlags = RAY_FLAG_NONE) const;
+	/// Return true as soon as any intersection is found in ]TMin, TMax[, and
+	/// optionally that intersection
+	bool Occluded(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	              TriangleHit* hit = nullptr, uint32_t rayFlags = RAY_FLAG_NONE) const;
+
+	/// Bounds of the children, in the space of the group
+	const Aabb& GetBounds() const { return m_bounds; }
+	const std::vector<InstanceGroupChild>& GetChildren() const { return m_children; }
+	const std::vector<BvhNode>& GetNodes() const { return m_nodes; }
+	/// Memory used by the children and the hierarchy
+	size_t GetMemorySize() const;
+
+private:
+	template <bool AnyHit>
+	bool Traverse(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	              TriangleHit* hit, uint32_t rayFlags) const;
+
+	std::vector<InstanceGroupChild> m_children;
+	/// Leaves reference ranges of m_childOrder
+	std::vector<BvhNode> m_nodes;
+	std::vector<uint32_t> m_childOrder;
+	Aabb m_bounds;
+	bool m_needsBuild = false;
+};
+
+/// Bounds of a mesh or a group in its own space. Throws std::logic_error if
+/// the geometry does not exist
+Aabb GetGeometryBounds(uint32_t meshIndex, uint32_t groupIndex, const std::vector<Bvh>& bottomLevels,
+                       const std::vector<InstanceGroup>& groups);
+
+/// Intersect a mesh or a group with an object-space ray: the closest
+/// intersection, or with anyHit the first one found, which hit receives
+/// when it is not null
+bool IntersectGeometry(uint32_t meshIndex, uint32_t groupIndex, const RayDesc& ray,
+                       const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups, bool anyHit,
+                       TriangleHit* hit, uint32_t rayFlags);
+
+} // namespace cpu_rt
@@ -0,0 +1,264 @@
+#include "InstanceMerging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Merge class of the subtrees holding instances that cannot be merged, or
+/// instances that cannot be merged together
+static const uint64_t kNotMergeable = ~0ull;
+
+/// Instances sharing their mask and flags can be merged together
+uint64_t GetMergeClass(const Instance& instance)
+{
+	return uint64_t(instance.instanceMask) << 32 | instance.flags;
+}
+
+float HalfArea(const BvhNode& node)
+{
+	Aabb box;
+	box.min = node.boundsMin;
+	box.max = node.boundsMax;
+	return box.HalfArea();
+}
+
+/// Cost of an instance reached by a ray, times the area of the node it is
+/// reached from
+float ComputeInstanceCost(const Scene& scene, const Instance& instance, float nodeArea, float instanceCost,
+                          float traversalCost)
+{
+	const Aabb bounds = TransformAabb(
+	    GetGeometryBounds(instance.meshIndex, instance.groupIndex, scene.GetBottomLevels(), scene.GetGroups()),
+	    instance.transform);
+	// Groups are charged the cost of their own hierarchy only
+	const float geometryCost =
+	    instance.groupIndex == kNoInstanceGroup
+	        ? scene.GetBottomLevels()[instance.meshIndex].GetStats().sahCost
+	        : ComputeSahCost(scene.GetGroups()[instance.groupIndex].GetNodes(), traversalCost, instanceCost);
+	return nodeArea * instanceCost + bounds.HalfArea() * geometryCost;
+}
+
+/// Append the instances below a node of the top level
+void CollectInstances(const TopLevelBvh& topLevel, uint32_t nodeIndex, std::vector<uint32_t>& instances)
+{
+	const BvhNode& node = topLevel.GetNodes()[nodeIndex];
+	if (node.IsLeaf())
+	{
+		const std::vector<uint32_t>& order = topLevel.GetInstanceOrder();
+		instances.insert(instances.end(), order.begin() + node.leftOrFirst,
+		                 order.begin() + node.leftOrFirst + node.count);
+		return;
+	}
+	CollectInstances(topLevel, node.leftOrFirst, instances);
+	CollectInstances(topLevel, node.leftOrFirst + 1, instances);
+}
+
+} // namespace
+
+InstanceMergeStats MergeStaticInstances(Scene& scene, const InstanceMergeSettings& settings)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	const BvhBuildSettings& buildSettings = settings.buildSettings;
+	scene.UpdateTopLevel(buildSettings);
+	InstanceMergeStats stats;
+	stats.instanceCount = static_cast<uint32_t>(scene.GetInstances().size());
+	stats.instancedCost = ComputeSceneSahCost(scene, settings.instanceCost, buildSettings.traversalCost);
+
+	std::vector<bool> isDynamic(stats.instanceCount, false);
+	for (uint32_t instanceIndex : settings.dynamicInstances)
+	{
+		isDynamic.at(instanceIndex) = true;
+	}
+	auto isMergeable = [&](uint32_t instanceIndex) {
+		const Instance& instance = scene.GetInstances()[instanceIndex];
+		return !isDynamic[instanceIndex] && instance.groupIndex == kNoInstanceGroup &&
+		       instance.firstMergedSource == kNotMerged &&
+		       !scene.GetBottomLevels()[instance.meshIndex].IsProcedural() &&
+		       glm::determinant(glm::mat3(instance.transform)) > 0.f;
+	};
+
+	// Cheapest cost of each subtree of the top level, times its area, and
+	// whether it is reached by merging its instances. Children are stored
+	// after their parent, so a reverse walk evaluates them first
+	struct Subtree
+	{
+		uint64_t mergeClass;
+		uint32_t instanceCount;
+		uint64_t triangleCount;
+		/// Part of the cost spent in instance transitions and in top-level
+		/// nodes, which merging removes
+		float transitionCost;
+		float cost;
+		bool merge;
+	};
+	const TopLevelBvh& topLevel = scene.GetTopLevel();
+	const std::vector<BvhNode>& nodes = topLevel.GetNodes();
+	const std::vector<uint32_t>& order = topLevel.GetInstanceOrder();
+	std::vector<Subtree> subtrees(nodes.size());
+	std::vector<uint32_t> instances;
+	for (uint32_t nodeIndex = static_cast<uint32_t>(nodes.size()); nodeIndex-- > 0;)
+	{
+		const BvhNode& node = nodes[nodeIndex];
+		const float area = HalfArea(node);
+		Subtree& subtree = subtrees[nodeIndex];
+		if (node.IsLeaf())
+		{
+			subtree = {GetMergeClass(scene.GetInstances()[order[node.leftOrFirst]]), node.count, 0,
+			           area * node.count * settings.instanceCost, 0.f, false};
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const Instance& instance = scene.GetInstances()[order[i]];
+				if (isMergeable(order[i]))
+					stats.staticInstanceCount++;
+				else
+					subtree.mergeClass = kNotMergeable;
+				if (GetMergeClass(instance) != subtree.mergeClass)
+					subtree.mergeClass = kNotMergeable;
+				subtree.cost +=
+				    ComputeInstanceCost(scene, instance, area, settings.instanceCost, buildSettings.traversalCost);
+				if (instance.groupIndex == kNoInstanceGroup)
+					subtree.triangleCount += scene.GetBottomLevels()[instance.meshIndex].GetStats().triangleCount;
+			}
+		}
+		else
+		{
+			const Subtree& left = subtrees[node.leftOrFirst];
+			const Subtree& right = subtrees[node.leftOrFirst + 1];
+			// Merged subtrees grow from the leaves: a node is only evaluated if
+			// the instances of its children were merged
+			const bool childrenMerged =
+			    (left.merge || left.instanceCount == 1) && (right.merge || right.instanceCount == 1);
+			subtree = {left.mergeClass == right.mergeClass && childrenMerged ? left.mergeClass : kNotMergeable,
+			           left.instanceCount + right.instanceCount,
+			           left.triangleCount + right.triangleCount,
+			           area * buildSettings.traversalCost + left.transitionCost + right.transitionCost,
+			           area * buildSettings.traversalCost + left.cost + right.cost,
+			           false};
+		}
+
+		// The merged hierarchy is only built if the transitions it removes are
+		// worth it, as it seldom beats the bottom levels of the instances
+		const float threshold = (1.f - settings.minCostReduction) * subtree.cost;
+		const float joinedCost = subtree.cost - subtree.transitionCost + area * settings.instanceCost;
+		if (subtree.mergeClass == kNotMergeable || subtree.instanceCount < 2 ||
+		    subtree.triangleCount > settings.maxMergedTriangles || joinedCost >= threshold)
+			continue;
+		// Two merged children are joined under the node without building them
+		// again: their merged hierarchies under a new root are one the builder
+		// could have found, so that each triangle is built once per merged
+		// subtree it starts rather than once per level above it
+		if (!node.IsLeaf() && subtrees[node.leftOrFirst].merge && subtrees[node.leftOrFirst + 1].merge)
+		{
+			subtree.transitionCost = area * settings.instanceCost;
+			subtree.cost = joinedCost;
+			subtree.merge = true;
+			continue;
+		}
+		instances.clear();
+		CollectInstances(topLevel, nodeIndex, instances);
+		Bvh merged;
+		AddMergedGeometries(scene, instances, merged);
+		merged.Build(buildSettings);
+		stats.evaluatedCount++;
+		const float mergedCost =
+		    area * settings.instanceCost + merged.GetBounds().HalfArea() * merged.GetStats().sahCost;
+		if (mergedCost < threshold)
+		{
+			subtree.transitionCost = area * settings.instanceCost;
+			subtree.cost = mergedCost;
+			subtree.merge = true;
+		}
+	}
+
+	// Merge the highest subtrees chosen for it
+	std::vector<std::vector<uint32_t>> mergedSets;
+	std::vector<uint32_t> stack;
+	if (!nodes.empty())
+		stack.push_back(0);
+	while (!stack.empty())
+	{
+		const uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+		if (subtrees[nodeIndex].merge)
+		{
+			mergedSets.emplace_back();
+			CollectInstances(topLevel, nodeIndex, mergedSets.back());
+		}
+		else if (!nodes[nodeIndex].IsLeaf())
+		{
+			stack.push_back(nodes[nodeIndex].leftOrFirst);
+			stack.push_back(nodes[nodeIndex].leftOrFirst + 1);
+		}
+	}
+	for (const std::vector<uint32_t>& mergedSet : mergedSets)
+	{
+		scene.MergeInstances(mergedSet, buildSettings);
+		stats.mergedInstanceCount += static_cast<uint32_t>(mergedSet.size());
+	}
+	stats.mergedMeshCount = static_cast<uint32_t>(mergedSets.size());
+
+	scene.UpdateTopLevel(buildSettings);
+	stats.mergedCost = ComputeSceneSahCost(scene, settings.instanceCost, buildSettings.traversalCost);
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return stats;
+}
+
+float ComputeSceneSahCost(const Scene& scene, float instanceCost, float traversalCost)
+{
+	const TopLevelBvh& topLevel = scene.GetTopLevel();
+	const std::vector<BvhNode>& nodes = topLevel.GetNodes();
+	if (nodes.empty())
+		return 0.f;
+
+	double cost = 0.0;
+	for (const BvhNode& node : nodes)
+	{
+		const float area = HalfArea(node);
+		if (!node.IsLeaf())
+		{
+			cost += area * traversalCost;
+			continue;
+		}
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			cost += ComputeInstanceCost(scene, topLevel.GetInstances()[topLevel.GetInstanceOrder()[i]], area,
+			                            instanceCost, traversalCost);
+		}
+	}
+	return static_cast<float>(cost / std::max(HalfArea(nodes[0]), FLT_MIN));
+}
+
+void AddMergedGeometries(const Scene& scene, const std::vector<uint32_t>& instanceIndices, Bvh& bottomLevel)
+{
+	std::vector<glm::vec3> positions;
+	for (uint32_t instanceIndex : instanceIndices)
+	{
+		const Instance& instance = scene.GetInstances().at(instanceIndex);
+		if (instance.groupIndex != kNoInstanceGroup || scene.GetBottomLevels()[instance.meshIndex].IsProcedural())
+		{
+			throw std::logic_error("Only the instances of triangle meshes can be merged");
+		}
+		if (glm::determinant(glm::mat3(instance.transform)) < 0.f)
+		{
+			throw std::logic_error("Mirrored instances cannot be merged, their triangles would change facing");
+		}
+
+		const Mesh& mesh = scene.GetMeshes()[instance.meshIndex];
+		positions.resize(mesh.GetVertexCount());
+		for (uint32_t i = 0; i < positions.size(); i++)
+		{
+			positions[i] = glm::vec3(instance.transform * glm::vec4(mesh.GetPosition(i), 1.f));
+		}
+		const ArrayView<uint32_t> indices = mesh.GetIndices();
+		bottomLevel.AddVertexBuffer(positions.data(), static_cast<uint32_t>(positions.size()), sizeof(glm::vec3),
+		                            indices.empty() ? nullptr : indices.data(), static_cast<uint32_t>(indices.size()));
+	}
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,75 @@
+#pragma once
+
+// Instance merging, a compilation step for scenes of many small static
+// instances. Each instance reached by a ray costs a transform of the ray and
+// a descent from the root of its bottom level, so that such scenes spend
+// much of their traversal on the transitions between the levels. Baking
+// instances into one merged bottom level removes those transitions, and lets
+// the builder separate instances that overlap, at the price of a copy of
+// their triangles. MergeStaticInstances decides where it pays off with the
+// SAH: walking the top level bottom up, the static instances below a node
+// are merged if the cost of their merged hierarchy is lower, by a margin,
+// than the cost of the subtree with its instances and their bottom levels.
+// Instances that move, such as the animated cube of the sample, stay
+// instanced, as do the instances of groups and of procedural primitives, and
+// mirrored instances, whose triangles would flip their facing once baked.
+
+#include "Scene.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+struct InstanceMergeSettings
+{
+	/// Instances that move, which stay instanced
+	std::vector<uint32_t> dynamicInstances;
+	/// Cost of entering an instance, in the units of the costs of the build
+	/// settings: the transform of the ray and the restart of the traversal
+	float instanceCost = 2.f;
+	/// Reduction of the SAH cost of a subtree, relative to its cost with the
+	/// instances, below which they are not merged. Large meshes are barely
+	/// slowed by the transitions, and are not worth a copy
+	float minCostReduction = 0.1f;
+	/// Largest number of triangles of a merged mesh
+	uint32_t maxMergedTriangles = 1 << 18;
+	/// Settings of the merged hierarchies and of the top level, whose costs
+	/// are those of the SAH
+	BvhBuildSettings buildSettings;
+};
+
+struct InstanceMergeStats
+{
+	/// Instances before merging, and those that could be merged
+	uint32_t instanceCount = 0;
+	uint32_t staticInstanceCount = 0;
+	/// Instances baked into merged meshes, and merged meshes added
+	uint32_t mergedInstanceCount = 0;
+	uint32_t mergedMeshCount = 0;
+	/// Merged hierarchies built to evaluate their SAH cost
+	uint32_t evaluatedCount = 0;
+	/// Expected cost of a ray traversal before and after merging (see
+	/// ComputeSceneSahCost)
+	float instancedCost = 0.f;
+	float mergedCost = 0.f;
+	double seconds = 0.0;
+};
+
+/// Merge the static instances of a scene where the SAH favours it, and
+/// update the top level
+InstanceMergeStats MergeStaticInstances(Scene& scene, const InstanceMergeSettings& settings = {});
+
+/// Expected cost of a ray traversal of a scene, relative to the surface area
+/// of the top-level root: the SAH of the top level, where each instance costs
+/// instanceCost plus the SAH cost of its bottom level scaled by the area of
+/// its world bounds. The top level must be up to date
+float ComputeSceneSahCost(const Scene& scene, float instanceCost, float traversalCost = 1.f);
+
+/// Add the triangles of instances of meshes to a hierarchy, in world space,
+/// one geometry per instance in the order of instanceIndices. Throws
+/// std::logic_error for instances of groups or procedural primitives, and for
+/// mirrored instances
+void AddMergedGeometries(const Scene& scene, const std::vector<uint32_t>& instanceIndices, Bvh& bottomLevel);
+
+} // namespace cpu_rt
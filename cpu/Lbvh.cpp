@@ -0,0 +1,632 @@
+#include "Lbvh.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+
+#include <glm/integer.hpp>
+
+#include <atomic>
+#include <memory>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+static const uint32_t kNoParent = ~0u;
+/// Number of subtrees below the root of a restructured treelet
+static const uint32_t kTreeletSize = 7;
+/// Indices processed per task by the parallel passes
+static const uint32_t kGrainSize = 4096;
+
+/// Number of leading zero bits of a non-zero value
+inline int CountLeadingZeros(uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return 31 - static_cast<int>(index);
+#else
+	return __builtin_clz(x);
+#endif
+}
+
+inline int CountLeadingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return 63 - static_cast<int>(index);
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+template <typename Key>
+Key EncodeMorton(const glm::vec3& p, const Aabb& bounds);
+
+template <>
+uint32_t EncodeMorton<uint32_t>(const glm::vec3& p, const Aabb& bounds)
+{
+	return EncodeMorton30(p, bounds);
+}
+
+template <>
+uint64_t EncodeMorton<uint64_t>(const glm::vec3& p, const Aabb& bounds)
+{
+	return EncodeMorton63(p, bounds);
+}
+
+/// What the bottom-up pass knows of the subtree below a slot
+struct Subtree
+{
+	uint32_t primitiveCount;
+	/// SAH cost of the best collapse of the subtree, weighted by area rather
+	/// than relative to it
+	float cost;
+	/// Number of nodes and levels of the subtree once written, after its
+	/// collapse
+	uint32_t nodeCount;
+	uint32_t height;
+};
+
+/// Radix tree over the sorted primitives, stored so that the children of the
+/// inner node splitting after sorted primitive i are at slots 2i + 1 and
+/// 2i + 2, and the root at slot 0. Every split position is used by exactly one
+/// inner node, so the 2n - 1 slots are all used and siblings are adjacent as
+/// in BvhNode. The leaves reference one sorted primitive each. The arrays are
+/// left uninitialized, so that their memory is first touched by the parallel
+/// passes rather than cleared on one thread
+struct RadixTree
+{
+	std::unique_ptr<BvhNode[]> nodes;
+	std::unique_ptr<Subtree[]> subtrees;
+	std::unique_ptr<uint32_t[]> parents;
+	/// Number of children completed, for the bottom-up pass
+	std::unique_ptr<std::atomic<uint32_t>[]> completedChildren;
+	/// Slot of the leaf of each sorted primitive
+	std::unique_ptr<uint32_t[]> leafSlots;
+};
+
+/// Subtrees of a treelet and the best topology of each subset of them
+struct Treelet
+{
+	uint32_t leafCount = 0;
+	uint32_t leafSlots[kTreeletSize];
+	BvhNode leafNodes[kTreeletSize];
+	Subtree leafSubtrees[kTreeletSize];
+	/// Child pairs of the inner nodes of the original topology, reused by the
+	/// new one
+	uint32_t pairs[kTreeletSize - 1];
+	uint32_t pairCount = 0;
+
+	Aabb bounds[1 << kTreeletSize];
+	uint32_t primitiveCounts[1 << kTreeletSize];
+	float costs[1 << kTreeletSize];
+	/// Subset of the left child of the best split of each subset
+	uint8_t splits[1 << kTreeletSize];
+};
+
+/// Subtree written by one task of WriteNodes, at known node and primitive
+/// offsets
+struct WriteTask
+{
+	uint32_t slot;
+	uint32_t nodeIndex;
+	uint32_t depth;
+	/// First node of the descendants and first primitive of the subtree
+	uint32_t firstNode;
+	uint32_t firstPrimitive;
+};
+
+class LbvhBuilder
+{
+public:
+	LbvhBuilder(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings)
+	    : m_primitiveBounds(primitiveBounds), m_settings(settings),
+	      m_primitiveCount(static_cast<uint32_t>(primitiveBounds.size())),
+	      m_threadCount(settings.threadCount ? settings.threadCount : GetDefaultThreadCount()),
+	      m_maxLeafSize(std::max(settings.maxLeafSize, 1u)), m_leafBlockSize(std::max(settings.leafBlockSize, 1u))
+	{
+	}
+
+	/// Sort the primitives by Morton code, then build the radix tree over the
+	/// sorted codes
+	template <typename Key>
+	void SortPrimitives(const Aabb& centroidBounds);
+	/// Compute the bounds and costs of the nodes bottom-up, restructuring the
+	/// treelets on the way if requested
+	void ComputeBounds();
+	/// Write the nodes in depth-first order, collapsing the subtrees that are
+	/// cheaper as leaves
+	void WriteNodes(std::vector<BvhNode>& nodes, std::vector<uint32_t>& primitiveOrder, BvhStats& stats) const;
+
+private:
+	template <typename Key>
+	void BuildRadixTree(const std::vector<Key>& keys);
+
+	float LeafCost(float area, uint32_t count) const
+	{
+		return m_settings.intersectionCost * area * static_cast<float>((count + m_leafBlockSize - 1) / m_leafBlockSize);
+	}
+	float SplitCost(float area, uint32_t leftSlot) const
+	{
+		return m_settings.traversalCost * area + m_tree.subtrees[leftSlot].cost + m_tree.subtrees[leftSlot + 1].cost;
+	}
+	bool IsCollapsed(uint32_t slot) const;
+
+	void CompleteInnerNode(uint32_t slot);
+	/// Node count and height of an inner node, from those of its children
+	void UpdateLayout(uint32_t slot);
+	void OptimizeTreelet(uint32_t rootSlot);
+	void WriteTreeletNode(uint32_t subset, uint32_t slot, uint32_t parentSlot, Treelet& treelet);
+	/// Returns the end of the nodes written
+	uint32_t WriteSubtree(const WriteTask& task, BvhNode* nodes, uint32_t* primitiveOrder, uint32_t& leafCount,
+	                      uint32_t& maxDepth) const;
+
+	const std::vector<Aabb>& m_primitiveBounds;
+	const BvhBuildSettings& m_settings;
+	const uint32_t m_primitiveCount;
+	const uint32_t m_threadCount;
+	const uint32_t m_maxLeafSize;
+	const uint32_t m_leafBlockSize;
+
+	/// Index of the primitive at each position of the Morton order
+	std::vector<uint32_t> m_sortedPrimitives;
+	RadixTree m_tree;
+};
+
+template <typename Key>
+void LbvhBuilder::SortPrimitives(const Aabb& centroidBounds)
+{
+	std::vector<Key> keys(m_primitiveCount);
+	m_sortedPrimitives.resize(m_primitiveCount);
+	ParallelFor(m_primitiveCount, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            keys[i] = EncodeMorton<Key>(m_primitiveBounds[i].Center(), centroidBounds);
+			            m_sortedPrimitives[i] = i;
+		            }
+	            },
+	            m_threadCount);
+	ParallelRadixSortPairs(keys, m_sortedPrimitives, sizeof(Key) == 4 ? 30 : 63, m_threadCount);
+	BuildRadixTree(keys);
+}
+
+template <typename Key>
+void LbvhBuilder::BuildRadixTree(const std::vector<Key>& keys)
+{
+	const size_t slotCount = 2 * size_t(m_primitiveCount) - 1;
+	m_tree.nodes.reset(new BvhNode[slotCount]);
+	m_tree.subtrees.reset(new Subtree[slotCount]);
+	m_tree.parents.reset(new uint32_t[slotCount]);
+	m_tree.completedChildren.reset(new std::atomic<uint32_t>[slotCount]);
+	m_tree.leafSlots.reset(new uint32_t[m_primitiveCount]);
+	m_tree.parents[0] = kNoParent;
+	if (m_primitiveCount == 1)
+	{
+		m_tree.leafSlots[0] = 0;
+		return;
+	}
+
+	// Length of the common prefix of the keys of sorted primitives i and j, or
+	// -1 if j is out of range. Equal keys are told apart by their indices
+	const int64_t count = m_primitiveCount;
+	const int keyBits = static_cast<int>(sizeof(Key) * 8);
+	auto delta = [&](int64_t i, int64_t j) {
+		if (j < 0 || j >= count)
+			return -1;
+		const Key a = keys[static_cast<size_t>(i)];
+		const Key b = keys[static_cast<size_t>(j)];
+		if (a == b)
+			return keyBits + CountLeadingZeros(static_cast<uint32_t>(i ^ j));
+		return CountLeadingZeros(a ^ b);
+	};
+
+	ParallelFor(m_primitiveCount - 1, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (int64_t i = begin; i < end; i++)
+		            {
+			            // Direction of the range of the node, then its other end
+			            const int64_t d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+			            const int minDelta = delta(i, i - d);
+			            int64_t maxLength = 2;
+			            while (delta(i, i + maxLength * d) > minDelta)
+			            {
+				            maxLength *= 2;
+			            }
+			            int64_t length = 0;
+			            for (int64_t step = maxLength / 2; step >= 1; step /= 2)
+			            {
+				            if (delta(i, i + (length + step) * d) > minDelta)
+					            length += step;
+			            }
+			            const int64_t j = i + length * d;
+
+			            // Last primitive sharing more than the common prefix of the
+			            // range with i
+			            const int nodeDelta = delta(i, j);
+			            int64_t split = 0;
+			            int64_t step = length;
+			            do
+			            {
+				            step = (step + 1) / 2;
+				            if (delta(i, i + (split + step) * d) > nodeDelta)
+					            split += step;
+			            } while (step > 1);
+			            const int64_t gamma = i + split * d + std::min<int64_t>(d, 0);
+
+			            // Inner node i is the left child of its parent if its range
+			            // ends at i, as the left children split after their last
+			            // primitive
+			            const int64_t first = std::min(i, j);
+			            const int64_t last = std::max(i, j);
+			            const uint32_t slot = static_cast<uint32_t>(i == 0 ? 0 : (last == i ? 2 * i + 1 : 2 * i));
+			            const uint32_t leftSlot = static_cast<uint32_t>(2 * gamma + 1);
+			            m_tree.nodes[slot].leftOrFirst = leftSlot;
+			            m_tree.nodes[slot].count = 0;
+			            m_tree.completedChildren[slot].store(0, std::memory_order_relaxed);
+			            m_tree.parents[leftSlot] = slot;
+			            m_tree.parents[leftSlot + 1] = slot;
+			            if (first == gamma)
+				            m_tree.leafSlots[gamma] = leftSlot;
+			            if (last == gamma + 1)
+				            m_tree.leafSlots[gamma + 1] = leftSlot + 1;
+		            }
+	            },
+	            m_threadCount);
+}
+
+bool LbvhBuilder::IsCollapsed(uint32_t slot) const
+{
+	const BvhNode& node = m_tree.nodes[slot];
+	const uint32_t count = m_tree.subtrees[slot].primitiveCount;
+	if (node.IsLeaf())
+		return true;
+	if (count > m_maxLeafSize)
+		return false;
+	Aabb bounds;
+	bounds.min = node.boundsMin;
+	bounds.max = node.boundsMax;
+	const float area = bounds.HalfArea();
+	return LeafCost(area, count) <= SplitCost(area, node.leftOrFirst);
+}
+
+void LbvhBuilder::CompleteInnerNode(uint32_t slot)
+{
+	BvhNode& node = m_tree.nodes[slot];
+	const BvhNode& left = m_tree.nodes[node.leftOrFirst];
+	const BvhNode& right = m_tree.nodes[node.leftOrFirst + 1];
+	Aabb bounds;
+	bounds.min = glm::min(left.boundsMin, right.boundsMin);
+	bounds.max = glm::max(left.boundsMax, right.boundsMax);
+	node.boundsMin = bounds.min;
+	node.boundsMax = bounds.max;
+
+	Subtree& subtree = m_tree.subtrees[slot];
+	subtree.primitiveCount =
+	    m_tree.subtrees[node.leftOrFirst].primitiveCount + m_tree.subtrees[node.leftOrFirst + 1].primitiveCount;
+	const float area = bounds.HalfArea();
+	subtree.cost = SplitCost(area, node.leftOrFirst);
+	if (subtree.primitiveCount <= m_maxLeafSize)
+		subtree.cost = std::min(subtree.cost, LeafCost(area, subtree.primitiveCount));
+	UpdateLayout(slot);
+}
+
+void LbvhBuilder::UpdateLayout(uint32_t slot)
+{
+	Subtree& subtree = m_tree.subtrees[slot];
+	if (IsCollapsed(slot))
+	{
+		subtree.nodeCount = 1;
+		subtree.height = 1;
+		return;
+	}
+	const uint32_t left = m_tree.nodes[slot].leftOrFirst;
+	subtree.nodeCount = 1 + m_tree.subtrees[left].nodeCount + m_tree.subtrees[left + 1].nodeCount;
+	subtree.height = 1 + std::max(m_tree.subtrees[left].height, m_tree.subtrees[left + 1].height);
+}
+
+void LbvhBuilder::ComputeBounds()
+{
+	ParallelFor(m_primitiveCount, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            const uint32_t slot = m_tree.leafSlots[i];
+			            const Aabb& bounds = m_primitiveBounds[m_sortedPrimitives[i]];
+			            m_tree.nodes[slot] = {bounds.min, i, bounds.max, 1};
+			            m_tree.subtrees[slot] = {1, LeafCost(bounds.HalfArea(), 1), 1, 1};
+
+			            // The first thread to reach a node stops, the second one
+			            // completes it, seeing the writes of the first one
+			            uint32_t parent = m_tree.parents[slot];
+			            while (parent != kNoParent && m_tree.completedChildren[parent].fetch_add(1, std::memory_order_acq_rel) == 1)
+			            {
+				            CompleteInnerNode(parent);
+				            if (m_settings.optimizeTreelets && m_tree.subtrees[parent].primitiveCount >= kTreeletSize)
+					            OptimizeTreelet(parent);
+				            parent = m_tree.parents[parent];
+			            }
+		            }
+	            },
+	            m_threadCount);
+}
+
+void LbvhBuilder::OptimizeTreelet(uint32_t rootSlot)
+{
+	Treelet treelet;
+
+	// Grow the treelet from the children of the root by expanding the largest
+	// inner subtree, as the large nodes gain the most from a better topology
+	const uint32_t rootChildren = m_tree.nodes[rootSlot].leftOrFirst;
+	treelet.leafSlots[treelet.leafCount++] = rootChildren;
+	treelet.leafSlots[treelet.leafCount++] = rootChildren + 1;
+	treelet.pairs[treelet.pairCount++] = rootChildren;
+	while (treelet.leafCount < kTreeletSize)
+	{
+		int largest = -1;
+		float largestArea = -1.f;
+		for (uint32_t i = 0; i < treelet.leafCount; i++)
+		{
+			const BvhNode& node = m_tree.nodes[treelet.leafSlots[i]];
+			if (node.IsLeaf())
+				continue;
+			Aabb bounds;
+			bounds.min = node.boundsMin;
+			bounds.max = node.boundsMax;
+			if (bounds.HalfArea() > largestArea)
+			{
+				largestArea = bounds.HalfArea();
+				largest = static_cast<int>(i);
+			}
+		}
+		if (largest < 0)
+			break;
+		const uint32_t children = m_tree.nodes[treelet.leafSlots[largest]].leftOrFirst;
+		treelet.leafSlots[largest] = children;
+		treelet.leafSlots[treelet.leafCount++] = children + 1;
+		treelet.pairs[treelet.pairCount++] = children;
+	}
+	if (treelet.leafCount < 3)
+		return;
+
+	for (uint32_t i = 0; i < treelet.leafCount; i++)
+	{
+		treelet.leafNodes[i] = m_tree.nodes[treelet.leafSlots[i]];
+		treelet.leafSubtrees[i] = m_tree.subtrees[treelet.leafSlots[i]];
+	}
+
+	// Best topology of every subset of the subtrees, from the smallest subsets
+	// up, which come first in numeric order
+	const uint32_t fullSet = (1u << treelet.leafCount) - 1;
+	for (uint32_t subset = 1; subset <= fullSet; subset++)
+	{
+		const uint32_t lowestBit = subset & (~subset + 1);
+		if (subset == lowestBit)
+		{
+			const uint32_t leaf = static_cast<uint32_t>(glm::findLSB(subset));
+			treelet.bounds[subset].min = treelet.leafNodes[leaf].boundsMin;
+			treelet.bounds[subset].max = treelet.leafNodes[leaf].boundsMax;
+			treelet.primitiveCounts[subset] = treelet.leafSubtrees[leaf].primitiveCount;
+			treelet.costs[subset] = treelet.leafSubtrees[leaf].cost;
+			continue;
+		}
+		treelet.bounds[subset] = treelet.bounds[subset ^ lowestBit];
+		treelet.bounds[subset].Extend(treelet.bounds[lowestBit]);
+		treelet.primitiveCounts[subset] = treelet.primitiveCounts[subset ^ lowestBit] + treelet.primitiveCounts[lowestBit];
+
+		// Each partition is visited once, with the lowest subtree on the left
+		float bestSplitCost = FLT_MAX;
+		for (uint32_t left = (subset - 1) & subset; left != 0; left = (left - 1) & subset)
+		{
+			if ((left & lowestBit) == 0)
+				continue;
+			const float splitCost = treelet.costs[left] + treelet.costs[subset ^ left];
+			if (splitCost < bestSplitCost)
+			{
+				bestSplitCost = splitCost;
+				treelet.splits[subset] = static_cast<uint8_t>(left);
+			}
+		}
+		const float area = treelet.bounds[subset].HalfArea();
+		float cost = m_settings.traversalCost * area + bestSplitCost;
+		if (treelet.primitiveCounts[subset] <= m_maxLeafSize)
+			cost = std::min(cost, LeafCost(area, treelet.primitiveCounts[subset]));
+		treelet.costs[subset] = cost;
+	}
+
+	// Keep the original topology unless the new one is strictly better, which
+	// also keeps it when they only differ by rounding
+	if (treelet.costs[fullSet] >= m_tree.subtrees[rootSlot].cost * (1.f - 1e-5f))
+		return;
+	treelet.pairCount = 0;
+	WriteTreeletNode(fullSet, rootSlot, m_tree.parents[rootSlot], treelet);
+}
+
+void LbvhBuilder::WriteTreeletNode(uint32_t subset, uint32_t slot, uint32_t parentSlot, Treelet& treelet)
+{
+	m_tree.parents[slot] = parentSlot;
+	if ((subset & (subset - 1)) == 0)
+	{
+		// A subtree moved with its children, which only need their parent slot
+		// updated
+		const uint32_t leaf = static_cast<uint32_t>(glm::findLSB(subset));
+		const BvhNode& node = treelet.leafNodes[leaf];
+		m_tree.nodes[slot] = node;
+		m_tree.subtrees[slot] = treelet.leafSubtrees[leaf];
+		if (!node.IsLeaf())
+		{
+			m_tree.parents[node.leftOrFirst] = slot;
+			m_tree.parents[node.leftOrFirst + 1] = slot;
+		}
+		return;
+	}
+
+	const uint32_t children = treelet.pairs[treelet.pairCount++];
+	const Aabb& bounds = treelet.bounds[subset];
+	m_tree.nodes[slot] = {bounds.min, children, bounds.max, 0};
+	m_tree.subtrees[slot].primitiveCount = treelet.primitiveCounts[subset];
+	m_tree.subtrees[slot].cost = treelet.costs[subset];
+	const uint32_t left = treelet.splits[subset];
+	WriteTreeletNode(left, children, slot, treelet);
+	WriteTreeletNode(subset ^ left, children + 1, slot, treelet);
+	UpdateLayout(slot);
+}
+
+uint32_t LbvhBuilder::WriteSubtree(const WriteTask& task, BvhNode* nodes, uint32_t* primitiveOrder, uint32_t& leafCount,
+                                   uint32_t& maxDepth) const
+{
+	struct Entry
+	{
+		uint32_t slot;
+		uint32_t nodeIndex;
+		uint32_t depth;
+	};
+
+	uint32_t nextNode = task.firstNode;
+	uint32_t nextPrimitive = task.firstPrimitive;
+	std::vector<Entry> entries = {{task.slot, task.nodeIndex, task.depth}};
+	std::vector<uint32_t> collapsed;
+	while (!entries.empty())
+	{
+		const Entry entry = entries.back();
+		entries.pop_back();
+		const BvhNode& source = m_tree.nodes[entry.slot];
+		maxDepth = std::max(maxDepth, entry.depth);
+
+		if (!IsCollapsed(entry.slot) && entry.depth < kBvhMaxDepth)
+		{
+			nodes[entry.nodeIndex] = {source.boundsMin, nextNode, source.boundsMax, 0};
+			entries.push_back({source.leftOrFirst + 1, nextNode + 1, entry.depth + 1});
+			entries.push_back({source.leftOrFirst, nextNode, entry.depth + 1});
+			nextNode += 2;
+			continue;
+		}
+
+		// Gather the primitives of the collapsed subtree into one leaf
+		const uint32_t first = nextPrimitive;
+		collapsed.assign(1, entry.slot);
+		while (!collapsed.empty())
+		{
+			const BvhNode& node = m_tree.nodes[collapsed.back()];
+			collapsed.pop_back();
+			if (node.IsLeaf())
+			{
+				primitiveOrder[nextPrimitive++] = m_sortedPrimitives[node.leftOrFirst];
+				continue;
+			}
+			collapsed.push_back(node.leftOrFirst + 1);
+			collapsed.push_back(node.leftOrFirst);
+		}
+		nodes[entry.nodeIndex] = {source.boundsMin, first, source.boundsMax, nextPrimitive - first};
+		leafCount++;
+	}
+	return nextNode;
+}
+
+void LbvhBuilder::WriteNodes(std::vector<BvhNode>& nodes, std::vector<uint32_t>& primitiveOrder, BvhStats& stats) const
+{
+	primitiveOrder.resize(m_primitiveCount);
+	const Subtree& root = m_tree.subtrees[0];
+	if (root.height > kBvhMaxDepth || m_threadCount == 1)
+	{
+		// Collapsing the subtrees below the depth limit changes the node
+		// counts, so the nodes are written in one pass, as are small trees
+		nodes.resize(root.height > kBvhMaxDepth ? 2 * size_t(m_primitiveCount) - 1 : root.nodeCount);
+		const uint32_t nodeCount =
+		    WriteSubtree({0, 0, 1, 1, 0}, nodes.data(), primitiveOrder.data(), stats.leafCount, stats.maxDepth);
+		nodes.resize(nodeCount);
+		nodes.shrink_to_fit();
+		stats.nodeCount = nodeCount;
+		return;
+	}
+
+	// Split the top of the tree into subtrees, which know their node and
+	// primitive counts and can be written in parallel at known offsets
+	const uint32_t maxTaskSize = std::max(m_primitiveCount / (16 * m_threadCount), kGrainSize);
+	nodes.resize(root.nodeCount);
+	std::vector<WriteTask> tasks;
+	std::vector<WriteTask> pending = {{0, 0, 1, 1, 0}};
+	uint32_t nextNode = 1;
+	uint32_t nextPrimitive = 0;
+	while (!pending.empty())
+	{
+		const WriteTask task = pending.back();
+		pending.pop_back();
+		const Subtree& subtree = m_tree.subtrees[task.slot];
+		if (subtree.primitiveCount <= maxTaskSize || IsCollapsed(task.slot))
+		{
+			tasks.push_back({task.slot, task.nodeIndex, task.depth, nextNode, nextPrimitive});
+			nextNode += subtree.nodeCount - 1;
+			nextPrimitive += subtree.primitiveCount;
+			continue;
+		}
+		const BvhNode& source = m_tree.nodes[task.slot];
+		nodes[task.nodeIndex] = {source.boundsMin, nextNode, source.boundsMax, 0};
+		pending.push_back({source.leftOrFirst + 1, nextNode + 1, task.depth + 1, 0, 0});
+		pending.push_back({source.leftOrFirst, nextNode, task.depth + 1, 0, 0});
+		nextNode += 2;
+	}
+
+	std::vector<uint32_t> leafCounts(tasks.size(), 0);
+	std::vector<uint32_t> maxDepths(tasks.size(), 0);
+	ParallelFor(static_cast<uint32_t>(tasks.size()), 1,
+	            [&](uint32_t begin, uint32_t) {
+		            WriteSubtree(tasks[begin], nodes.data(), primitiveOrder.data(), leafCounts[begin], maxDepths[begin]);
+	            },
+	            m_threadCount);
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		stats.leafCount += leafCounts[i];
+		stats.maxDepth = std::max(stats.maxDepth, maxDepths[i]);
+	}
+	stats.nodeCount = root.nodeCount;
+}
+
+} // namespace
+
+void BuildLbvhNodes(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings,
+                    std::vector<BvhNode>& nodes, std::vector<uint32_t>& primitiveOrder, BvhStats& stats)
+{
+	const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+	nodes.clear();
+	primitiveOrder.clear();
+	stats.nodeCount = 0;
+	stats.leafCount = 0;
+	stats.maxDepth = 0;
+	if (primitiveCount == 0)
+		return;
+
+	// Bounds of the centroids, reduced per task
+	std::vector<Aabb> taskBounds((primitiveCount - 1) / kGrainSize + 1);
+	ParallelFor(primitiveCount, kGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            Aabb& bounds = taskBounds[begin / kGrainSize];
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            bounds.Extend(primitiveBounds[i].Center());
+		            }
+	            },
+	            settings.threadCount);
+	Aabb centroidBounds;
+	for (const Aabb& bounds : taskBounds)
+	{
+		centroidBounds.Extend(bounds);
+	}
+
+	LbvhBuilder builder(primitiveBounds, settings);
+	if (settings.mortonBits > 30)
+		builder.SortPrimitives<uint64_t>(centroidBounds);
+	else
+		builder.SortPrimitives<uint32_t>(centroidBounds);
+	builder.ComputeBounds();
+	builder.WriteNodes(nodes, primitiveOrder, stats);
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,26 @@
+#pragma once
+
+// Linear BVH builder (Karras, "Maximizing Parallelism in the Construction of
+// BVHs, Octrees, and k-d Trees", HPG 2012), selected with
+// BvhBuildAlgorithm::Lbvh. The primitives are sorted along a Morton curve of
+// their centroids, then every inner node of the radix tree over the sorted
+// codes finds its range and split independently, so that all the passes run
+// in parallel. The bounds are computed bottom-up, where the last thread to
+// reach a node completes it. Optionally, the treelets of 7 subtrees below
+// each node are then restructured to their SAH-optimal topology (Karras and
+// Aila, "Fast Parallel Construction of High-Quality Bounding Volume
+// Hierarchies", HPG 2013). Finally the subtrees that are cheaper as leaves
+// under the SAH are collapsed, and the nodes are written in the layout of
+// BuildBvhNodes.
+
+#include "Bvh.h"
+
+namespace cpu_rt
+{
+
+/// Same contract as BuildBvhNodes, with the linear builder. Uses the Morton
+/// code size, treelet and thread settings
+void BuildLbvhNodes(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings,
+                    std::vector<BvhNode>& nodes, std::vector<uint32_t>& primitiveOrder, BvhStats& stats);
+
+} // namespace cpu_rt
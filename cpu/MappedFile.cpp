@@ -0,0 +1,133 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <direct.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace cpu_rt
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& fileName)
+{
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Cannot open " + fileName);
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Cannot read the size of " + fileName);
+	}
+	m_file = file;
+	m_size = static_cast<size_t>(size.QuadPart);
+	// Empty files cannot be mapped, and have no data to map anyway
+	if (m_size == 0)
+		return;
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Cannot map " + fileName);
+	}
+	m_data = static_cast<const uint8_t*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	CloseHandle(m_file);
+}
+
+bool MakeDirectory(const std::string& path)
+{
+	if (_mkdir(path.c_str()) == 0)
+		return true;
+	const DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& fileName)
+{
+	const int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		throw std::runtime_error("Cannot open " + fileName);
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		close(file);
+		throw std::runtime_error("Cannot read the size of " + fileName);
+	}
+	m_size = static_cast<size_t>(status.st_size);
+	if (m_size > 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file, 0);
+		if (data == MAP_FAILED)
+		{
+			close(file);
+			throw std::runtime_error("Cannot map " + fileName);
+		}
+		m_data = static_cast<const uint8_t*>(data);
+	}
+	// The mapping keeps its own reference to the file
+	close(file);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+bool MakeDirectory(const std::string& path)
+{
+	if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST)
+	{
+		struct stat status;
+		return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+	}
+	return false;
+}
+
+#endif
+
+void MappedFile::CheckRange(uint64_t offset, uint64_t count, size_t elementSize, size_t alignment) const
+{
+	if (offset > m_size || count > (m_size - offset) / elementSize || offset % alignment != 0)
+	{
+		throw std::runtime_error("Mapped array out of the file or misaligned");
+	}
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,77 @@
+#pragma once
+
+// Read-only memory mapping of a whole file, for the data loaded from disk in
+// place: the pages are read on first access and shared with the system file
+// cache, so that opening even a large file costs no copy. Also provides the
+// views through which the mapped arrays are read.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Read-only view of a contiguous array, held by a vector or by a mapped
+/// file that must outlive it
+template <typename T>
+class ArrayView
+{
+public:
+	ArrayView() = default;
+	ArrayView(const T* data, size_t size) : m_data(data), m_size(size) {}
+	ArrayView(const std::vector<T>& vector) : m_data(vector.data()), m_size(vector.size()) {}
+
+	const T* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+	const T* m_data = nullptr;
+	size_t m_size = 0;
+};
+
+class MappedFile
+{
+public:
+	/// Map the file. Throws std::runtime_error if it cannot be opened
+	explicit MappedFile(const std::string& fileName);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// Start of the file, aligned to a page
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+	/// View of count elements of type T at offset bytes from the start of the
+	/// file. Throws std::runtime_error if they are not within the file or not
+	/// aligned for T
+	template <typename T>
+	ArrayView<T> GetArray(uint64_t offset, uint64_t count) const
+	{
+		CheckRange(offset, count, sizeof(T), alignof(T));
+		return ArrayView<T>(reinterpret_cast<const T*>(m_data + offset), static_cast<size_t>(count));
+	}
+
+private:
+	void CheckRange(uint64_t offset, uint64_t count, size_t elementSize, size_t alignment) const;
+
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
+
+/// Create a directory if it does not exist yet, its parent must exist.
+/// Returns false if it cannot be created
+bool MakeDirectory(const std::string& path);
+
+} // namespace cpu_rt
@@ -0,0 +1,16 @@
+#pragma once
+
+// Memory used by the process, for the importers and the benchmarks: the peak
+// resident set on Linux and the peak working set on Windows, which both count
+// the pages of the mapped files that were read.
+
+#include <cstdint>
+
+namespace cpu_rt
+{
+
+/// Largest amount of physical memory used by the process so far, in bytes,
+/// or 0 if the system does not report it
+uint64_t GetPeakMemoryUsage();
+
+} // namespace cpu_rt
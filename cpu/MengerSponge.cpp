@@ -0,0 +1,458 @@
+#include "MengerSponge.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+struct Cube
+{
+	glm::vec3 topLeftFront;
+	float size;
+
+	void EnqueueQuad(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const glm::vec3& bottomLeft,
+	                 const glm::vec3& dx, const glm::vec3& dy, bool flip) const
+	{
+		const uint32_t currentIndex = static_cast<uint32_t>(vertices.size());
+		if (flip)
+		{
+			indices.insert(indices.end(), {currentIndex + 0, currentIndex + 2, currentIndex + 1,
+			                               currentIndex + 3, currentIndex + 1, currentIndex + 2});
+		}
+		else
+		{
+			indices.insert(indices.end(), {currentIndex + 0, currentIndex + 1, currentIndex + 2,
+			                               currentIndex + 2, currentIndex + 1, currentIndex + 3});
+		}
+
+		const glm::vec3 p1 = bottomLeft + dx;
+		const glm::vec3 p2 = bottomLeft + dy;
+		const glm::vec3 p3 = bottomLeft + dx + dy;
+		vertices.push_back({{bottomLeft.x, bottomLeft.y, bottomLeft.z}, {1.f, 0.f, 0.f, 1.f}});
+		vertices.push_back({{p1.x, p1.y, p1.z}, {0.5f, 1.f, 0.f, 1.f}});
+		vertices.push_back({{p2.x, p2.y, p2.z}, {0.5f, 0.f, 1.f, 1.f}});
+		vertices.push_back({{p3.x, p3.y, p3.z}, {0.f, 1.f, 0.f, 1.f}});
+	}
+
+	void EnqueueVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const
+	{
+		glm::vec3 current = topLeftFront;
+		EnqueueQuad(vertices, indices, current, {size, 0, 0}, {0, size, 0}, false);
+		EnqueueQuad(vertices, indices, current, {size, 0, 0}, {0, 0, size}, true);
+		EnqueueQuad(vertices, indices, current, {0, size, 0}, {0, 0, size}, false);
+
+		current += glm::vec3(size);
+		EnqueueQuad(vertices, indices, current, {-size, 0, 0}, {0, -size, 0}, true);
+		EnqueueQuad(vertices, indices, current, {-size, 0, 0}, {0, 0, -size}, false);
+		EnqueueQuad(vertices, indices, current, {0, -size, 0}, {0, 0, -size}, true);
+	}
+
+	void Split(std::vector<Cube>& cubes) const
+	{
+		const float subSize = size / 3.f;
+		for (int x = 0; x < 3; x++)
+		{
+			for (int y = 0; y < 3; y++)
+			{
+				if (x == 1 && y == 1)
+					continue;
+				for (int z = 0; z < 3; z++)
+				{
+					if (x == 1 && z == 1)
+						continue;
+					if (y == 1 && z == 1)
+						continue;
+					cubes.push_back({topLeftFront + glm::vec3(float(x), float(y), float(z)) * subSize, subSize});
+				}
+			}
+		}
+	}
+
+	void SplitProb(std::vector<Cube>& cubes, float prob) const
+	{
+		const float subSize = size / 3.f;
+		for (int x = 0; x < 3; x++)
+		{
+			for (int y = 0; y < 3; y++)
+			{
+				for (int z = 0; z < 3; z++)
+				{
+					const float sample = rand() / static_cast<float>(RAND_MAX);
+					if (sample > prob)
+						continue;
+					cubes.push_back({topLeftFront + glm::vec3(float(x), float(y), float(z)) * subSize, subSize});
+				}
+			}
+		}
+	}
+};
+
+/// Highest level of the parallel generator, whose cell coordinates fit in 32
+/// bits, far above what fits in memory
+static const int32_t kMaxParallelLevel = 12;
+/// Level of the blocks of sub-cubes generated by each task
+static const int32_t kBlockLevel = 3;
+
+/// Faces of a cube, in the order of Cube::EnqueueVertices: the corner they
+/// start from (0 for the minimum, 1 for the maximum), the axes of their 2
+/// edges, their winding, and the axis and side of their neighbour
+struct CubeFace
+{
+	int corner;
+	int axisX;
+	int axisY;
+	bool flip;
+	int normalAxis;
+	int normalSign;
+};
+static const CubeFace kCubeFaces[6] = {{0, 0, 1, false, 2, -1}, {0, 0, 2, true, 1, -1}, {0, 1, 2, false, 0, -1},
+                                       {1, 0, 1, true, 2, 1},   {1, 0, 2, false, 1, 1}, {1, 1, 2, true, 0, 1}};
+
+/// Colors of the 4 corners of the quads, as in Cube::EnqueueQuad
+static const float kQuadColors[4][4] = {
+	{1.f, 0.f, 0.f, 1.f}, {0.5f, 1.f, 0.f, 1.f}, {0.5f, 0.f, 1.f, 1.f}, {0.f, 1.f, 0.f, 1.f}};
+
+/// Sub-cubes of a sponge, addressed by their integer coordinates in the grid
+/// of their level, 3^level cells wide
+class SpongeGrid
+{
+public:
+	explicit SpongeGrid(const MengerSpongeSettings& settings) : m_settings(settings)
+	{
+		m_cellCounts[0] = 1;
+		for (int32_t i = 1; i <= settings.level; i++)
+		{
+			m_cellCounts[i] = 3 * m_cellCounts[i - 1];
+		}
+	}
+
+	int32_t GetLevel() const { return m_settings.level; }
+	uint32_t GetCellCount(int32_t level) const { return m_cellCounts[level]; }
+
+	/// Whether the parent of a sub-cube keeps it
+	bool IsKept(int32_t level, uint32_t x, uint32_t y, uint32_t z) const
+	{
+		if (m_settings.probability < 0.f)
+			return (x % 3 == 1) + (y % 3 == 1) + (z % 3 == 1) < 2;
+
+		uint64_t hash = (m_settings.seed + 1) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(level);
+		for (uint32_t coordinate : {x, y, z})
+		{
+			hash = (hash ^ coordinate) * 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 33;
+		}
+		return (hash >> 40) * (1.f / 16777216.f) < m_settings.probability;
+	}
+
+	/// Whether a sub-cube is part of the sponge: it and all its ancestors are
+	/// kept. Coordinates out of the grid are empty
+	bool IsFilled(int32_t level, int64_t x, int64_t y, int64_t z) const
+	{
+		const int64_t cellCount = m_cellCounts[level];
+		if (x < 0 || y < 0 || z < 0 || x >= cellCount || y >= cellCount || z >= cellCount)
+			return false;
+		for (; level > 0; level--, x /= 3, y /= 3, z /= 3)
+		{
+			if (!IsKept(level, static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(z)))
+				return false;
+		}
+		return true;
+	}
+
+	/// Call visitor(x, y, z) for the filled cubes of the last level within a
+	/// filled sub-cube
+	template <typename Visitor>
+	void VisitLeaves(int32_t level, uint32_t x, uint32_t y, uint32_t z, Visitor& visitor) const
+	{
+		if (level == m_settings.level)
+		{
+			visitor(x, y, z);
+			return;
+		}
+		for (uint32_t child = 0; child < 27; child++)
+		{
+			const uint32_t cx = 3 * x + child % 3, cy = 3 * y + child / 3 % 3, cz = 3 * z + child / 9;
+			if (IsKept(level + 1, cx, cy, cz))
+				VisitLeaves(level + 1, cx, cy, cz, visitor);
+		}
+	}
+
+	/// Whether a face of a cube of the last level is visible
+	bool IsFaceVisible(uint32_t x, uint32_t y, uint32_t z, const CubeFace& face) const
+	{
+		if (!m_settings.cullInternalFaces)
+			return true;
+		int64_t neighbour[3] = {x, y, z};
+		neighbour[face.normalAxis] += face.normalSign;
+		return !IsFilled(m_settings.level, neighbour[0], neighbour[1], neighbour[2]);
+	}
+
+private:
+	const MengerSpongeSettings& m_settings;
+	uint32_t m_cellCounts[kMaxParallelLevel + 1];
+};
+
+/// Ray of IntersectMengerSponge in the space of the grid of the sponge, the
+/// unit cube [0,1]^3, in double precision for the cells of high levels
+struct SpongeRay
+{
+	glm::dvec3 origin;
+	glm::dvec3 direction;
+	glm::dvec3 invDirection;
+	double tMin;
+	int32_t level;
+};
+
+struct SpongeHit
+{
+	double t;
+	int axis;
+	/// The ray started inside the cube and hit its far face
+	bool exit;
+};
+
+/// Hit of a filled cell of the given depth, which the ray crosses from tEntry,
+/// through a face across entryAxis, to tExit. The 27 sub-cells are walked in
+/// the order the ray crosses them and the filled ones are entered in turn, so
+/// that the first hit found is the closest
+bool TraverseSpongeCell(const SpongeRay& ray, int32_t depth, const uint64_t cell[3], double cellSize, double tEntry,
+                        double tExit, int entryAxis, SpongeHit& hit)
+{
+	int step[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		step[axis] = std::signbit(ray.direction[axis]) ? -1 : 1;
+	}
+
+	if (depth == ray.level)
+	{
+		if (tEntry > ray.tMin)
+		{
+			hit = {tEntry, entryAxis, false};
+			return true;
+		}
+		hit = {std::numeric_limits<double>::infinity(), 0, true};
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const double boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cellSize;
+			const double tBoundary = (boundary - ray.origin[axis]) * ray.invDirection[axis];
+			if (tBoundary < hit.t)
+				hit = {tBoundary, axis, true};
+		}
+		return hit.t > ray.tMin;
+	}
+
+	const double subSize = cellSize / 3.0;
+	uint64_t first[3];
+	int index[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		first[axis] = 3 * cell[axis];
+		const double position = ray.origin[axis] + tEntry * ray.direction[axis];
+		index[axis] = static_cast<int>(glm::clamp(std::floor(position / subSize - first[axis]), 0.0, 2.0));
+	}
+	for (;;)
+	{
+		int exitAxis = 0;
+		double tNext = std::numeric_limits<double>::infinity();
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const double boundary = (first[axis] + index[axis] + (step[axis] > 0 ? 1 : 0)) * subSize;
+			const double tBoundary = (boundary - ray.origin[axis]) * ray.invDirection[axis];
+			if (tBoundary < tNext)
+			{
+				tNext = tBoundary;
+				exitAxis = axis;
+			}
+		}
+		if ((index[0] == 1) + (index[1] == 1) + (index[2] == 1) < 2)
+		{
+			const uint64_t subCell[3] = {first[0] + index[0], first[1] + index[1], first[2] + index[2]};
+			if (TraverseSpongeCell(ray, depth + 1, subCell, subSize, tEntry, std::min(tNext, tExit), entryAxis, hit))
+				return true;
+		}
+		if (tNext >= tExit)
+			return false;
+		index[exitAxis] += step[exitAxis];
+		if (index[exitAxis] < 0 || index[exitAxis] > 2)
+			return false;
+		tEntry = tNext;
+		entryAxis = exitAxis;
+	}
+}
+
+} // namespace
+
+void GenerateMengerSponge(int32_t level, float probability, std::vector<Vertex>& outputVertices,
+                          std::vector<uint32_t>& outputIndices)
+{
+	std::vector<Cube> previous = {{glm::vec3(-0.5f), 1.f}};
+	std::vector<Cube> next;
+
+	for (int i = 0; i < level; i++)
+	{
+		for (const Cube& c : previous)
+		{
+			if (probability < 0.f)
+				c.Split(next);
+			else
+				c.SplitProb(next, 20.f / 27.f);
+		}
+		previous.swap(next);
+		next.clear();
+	}
+
+	outputVertices.reserve(outputVertices.size() + 24 * previous.size());
+	outputIndices.reserve(outputIndices.size() + 36 * previous.size());
+	for (const Cube& c : previous)
+	{
+		c.EnqueueVertices(outputVertices, outputIndices);
+	}
+}
+
+void GenerateMengerSponge(const MengerSpongeSettings& settings, std::vector<Vertex>& outputVertices,
+                          std::vector<uint32_t>& outputIndices)
+{
+	if (settings.level < 0 || settings.level > kMaxParallelLevel)
+	{
+		throw std::length_error("Menger sponge level " + std::to_string(settings.level) + " is not supported");
+	}
+	const SpongeGrid grid(settings);
+
+	// Each task covers the filled cubes of a block: counted first, so that
+	// the second pass writes the faces of each block at its final place
+	const int32_t blockLevel = std::min(settings.level, kBlockLevel);
+	const uint32_t blocksPerAxis = grid.GetCellCount(blockLevel);
+	const uint32_t blockCount = blocksPerAxis * blocksPerAxis * blocksPerAxis;
+	auto visitBlock = [&](uint32_t block, auto&& visitFace) {
+		const uint32_t x = block % blocksPerAxis, y = block / blocksPerAxis % blocksPerAxis,
+		               z = block / (blocksPerAxis * blocksPerAxis);
+		if (!grid.IsFilled(blockLevel, x, y, z))
+			return;
+		auto visitCube = [&](uint32_t cx, uint32_t cy, uint32_t cz) {
+			for (const CubeFace& face : kCubeFaces)
+			{
+				if (grid.IsFaceVisible(cx, cy, cz, face))
+					visitFace(cx, cy, cz, face);
+			}
+		};
+		grid.VisitLeaves(blockLevel, x, y, z, visitCube);
+	};
+
+	std::vector<uint64_t> faceOffsets(blockCount + 1, 0);
+	ParallelFor(blockCount, 1,
+	            [&](uint32_t block, uint32_t) {
+		            uint64_t faceCount = 0;
+		            visitBlock(block, [&](uint32_t, uint32_t, uint32_t, const CubeFace&) { faceCount++; });
+		            faceOffsets[block + 1] = faceCount;
+	            },
+	            settings.threadCount);
+	for (uint32_t i = 0; i < blockCount; i++)
+	{
+		faceOffsets[i + 1] += faceOffsets[i];
+	}
+
+	const size_t firstVertex = outputVertices.size(), firstIndex = outputIndices.size();
+	const uint64_t faceCount = faceOffsets[blockCount];
+	if (firstVertex + 4 * faceCount > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::length_error("Menger sponge level " + std::to_string(settings.level) +
+		                        " has too many vertices for 32-bit indices");
+	}
+	outputVertices.resize(firstVertex + 4 * faceCount);
+	outputIndices.resize(firstIndex + 6 * faceCount);
+
+	// Grid points are computed from their integer coordinates, so that the
+	// cubes sharing a corner give it the same position
+	const double cellSize = 1.0 / grid.GetCellCount(settings.level);
+	ParallelFor(blockCount, 1,
+	            [&](uint32_t block, uint32_t) {
+		            uint64_t faceIndex = faceOffsets[block];
+		            visitBlock(block, [&](uint32_t x, uint32_t y, uint32_t z, const CubeFace& face) {
+			            const uint32_t vertexIndex = static_cast<uint32_t>(firstVertex + 4 * faceIndex);
+			            Vertex* vertices = &outputVertices[vertexIndex];
+			            uint32_t* indices = &outputIndices[firstIndex + 6 * faceIndex];
+			            faceIndex++;
+
+			            const int32_t sign = face.corner ? -1 : 1;
+			            for (int corner = 0; corner < 4; corner++)
+			            {
+				            int64_t point[3] = {x + face.corner, y + face.corner, z + face.corner};
+				            point[face.axisX] += (corner & 1) ? sign : 0;
+				            point[face.axisY] += (corner & 2) ? sign : 0;
+				            for (int axis = 0; axis < 3; axis++)
+				            {
+					            vertices[corner].position[axis] = static_cast<float>(point[axis] * cellSize - 0.5);
+				            }
+				            std::copy(kQuadColors[corner], kQuadColors[corner] + 4, vertices[corner].color);
+			            }
+			            static const uint32_t kQuadIndices[2][6] = {{0, 1, 2, 2, 1, 3}, {0, 2, 1, 3, 1, 2}};
+			            for (int i = 0; i < 6; i++)
+			            {
+				            indices[i] = vertexIndex + kQuadIndices[face.flip ? 1 : 0][i];
+			            }
+		            });
+	            },
+	            settings.threadCount);
+}
+
+bool IntersectMengerSponge(int32_t level, const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax,
+                           float& t, glm::vec3& normal)
+{
+	if (level < 0 || level > kMaxImplicitMengerLevel)
+	{
+		throw std::length_error("Menger sponge level " + std::to_string(level) + " is not supported");
+	}
+
+	// Null direction components as in TraversalRay, so that no boundary gives NaN
+	SpongeRay ray;
+	ray.origin = glm::dvec3(origin) + 0.5;
+	ray.direction = glm::dvec3(direction);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const double d = ray.direction[axis];
+		ray.invDirection[axis] = 1.0 / (std::fabs(d) < 1e-30 ? std::copysign(1e-30, d) : d);
+	}
+	ray.tMin = tMin;
+	ray.level = level;
+
+	double tEntry = -std::numeric_limits<double>::infinity();
+	double tExit = tMax;
+	int entryAxis = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const double t0 = -ray.origin[axis] * ray.invDirection[axis];
+		const double t1 = (1.0 - ray.origin[axis]) * ray.invDirection[axis];
+		if (std::min(t0, t1) > tEntry)
+		{
+			tEntry = std::min(t0, t1);
+			entryAxis = axis;
+		}
+		tExit = std::min(tExit, std::max(t0, t1));
+	}
+	tEntry = std::max(tEntry, ray.tMin);
+	if (!(tEntry <= tExit))
+		return false;
+
+	static const uint64_t kRootCell[3] = {0, 0, 0};
+	SpongeHit hit;
+	if (!TraverseSpongeCell(ray, 0, kRootCell, 1.0, tEntry, tExit, entryAxis, hit))
+		return false;
+	t = static_cast<float>(hit.t);
+	if (!(t > tMin && t < tMax))
+		return false;
+	normal = glm::vec3(0.f);
+	normal[hit.axis] = std::signbit(direction[hit.axis]) != hit.exit ? 1.f : -1.f;
+	return true;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,64 @@
+#pragma once
+
+// Portable version of nv_helpers_dx12::GenerateMengerSponge (DXRHelper.h),
+// producing the application vertex layout. Each surviving cube is emitted as 6
+// quads of 4 vertices and 6 indices, in the same order as the original. A
+// parallel variant generates the high levels: it enumerates the sub-cubes
+// instead of growing lists level by level, and drops the internal faces. The
+// regular sponge may also be traced without any geometry, down through its
+// nested 3x3x3 grids, to levels far beyond what fits in memory.
+
+#include "Common.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Generate a Menger sponge of the given recursion level, fitting in the unit
+/// cube centered on the origin. As in the original, a non-negative probability
+/// switches to the random subdivision, which keeps each sub-cube with a fixed
+/// 20/27 probability
+void GenerateMengerSponge(int32_t level, float probability, std::vector<Vertex>& outputVertices,
+                          std::vector<uint32_t>& outputIndices);
+
+struct MengerSpongeSettings
+{
+	int32_t level = 3;
+	/// Probability to keep each of the 27 sub-cubes of a cube, or negative for
+	/// the regular sponge, which keeps the 20 off the center axes
+	float probability = -1.f;
+	/// Seed of the random subdivision. A sub-cube is kept according to a hash
+	/// of the seed and of its position, so that the sponge only depends on the
+	/// seed, whatever the number of threads
+	uint32_t seed = 1;
+	/// Skip the faces between two sub-cubes, which are never visible
+	bool cullInternalFaces = true;
+	uint32_t threadCount = 0;
+};
+
+/// Parallel generator of the same sponges, appended to the outputs. Each
+/// visible face is a quad of 4 vertices and 6 indices, as in the original, on
+/// a grid of exact coordinates so that the quads of adjacent sub-cubes share
+/// their corners. The output is counted before it is written, and is the
+/// same for any number of threads. Throws std::length_error if the level is
+/// above 12 or if the vertices exceed 32-bit indices
+void GenerateMengerSponge(const MengerSpongeSettings& settings, std::vector<Vertex>& outputVertices,
+                          std::vector<uint32_t>& outputIndices);
+
+/// Highest level of IntersectMengerSponge, whose cells stay wider than the
+/// rounding of its double precision hit positions
+static const int32_t kMaxImplicitMengerLevel = 30;
+
+/// Closest hit in ]tMin, tMax[ of a ray with the regular sponge of the given
+/// level that GenerateMengerSponge builds, without its triangles: the cells
+/// of each level are walked in the order the ray crosses them, as a 3D DDA,
+/// and only the filled ones are entered. The distance is that of the first
+/// face of the mesh along the ray, and normal is the outward normal of that
+/// face. Rays starting inside a cube of the last level hit it on the way
+/// out. Throws std::length_error if the level is negative or above
+/// kMaxImplicitMengerLevel
+bool IntersectMengerSponge(int32_t level, const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax,
+                           float& t, glm::vec3& normal);
+
+} // namespace cpu_rt
@@ -0,0 +1,806 @@
+#include "MeshImport.h"
+#include "MemoryUsage.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+using Clock = std::chrono::high_resolution_clock;
+
+/// Bytes of OBJ text parsed by each task
+static const size_t kObjChunkSize = 1 << 22;
+/// PLY records decoded by each task
+static const uint32_t kPlyChunkSize = 1 << 16;
+/// Vertices hashed or remapped by each task of the weld
+static const uint32_t kWeldGrainSize = 1 << 16;
+
+static const Vertex kWhiteVertex = {{0.f, 0.f, 0.f}, {1.f, 1.f, 1.f, 1.f}};
+
+double SecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+[[noreturn]] void ThrowMalformed(const std::string& fileName, const uint8_t* data, const char* position)
+{
+	throw std::runtime_error(fileName + " is malformed at byte " +
+	                         std::to_string(position - reinterpret_cast<const char*>(data)));
+}
+
+// Number parsing. strtof is locale-dependent and several times slower than
+// the files can be read, so the importers use their own
+
+bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p))
+		p++;
+	return p;
+}
+
+bool ParseInteger(const char*& p, const char* end, int64_t& value)
+{
+	const char* c = p;
+	const bool negative = c < end && *c == '-';
+	if (c < end && (*c == '-' || *c == '+'))
+		c++;
+	const char* digits = c;
+	uint64_t magnitude = 0;
+	while (c < end && *c >= '0' && *c <= '9' && c - digits < 18)
+	{
+		magnitude = magnitude * 10 + static_cast<uint64_t>(*c++ - '0');
+	}
+	if (c == digits || (c < end && *c >= '0' && *c <= '9'))
+		return false;
+	value = negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+	p = c;
+	return true;
+}
+
+/// Decimal number with optional fraction and exponent. The first 19
+/// significant digits are kept, and scaled in double precision before the
+/// rounding to float
+bool ParseFloat(const char*& p, const char* end, float& value)
+{
+	static const double kPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const char* c = p;
+	const bool negative = c < end && *c == '-';
+	if (c < end && (*c == '-' || *c == '+'))
+		c++;
+
+	uint64_t mantissa = 0;
+	int32_t digitCount = 0, exponent = 0;
+	bool hasDigits = false;
+	for (; c < end && *c >= '0' && *c <= '9'; c++)
+	{
+		hasDigits = true;
+		if (digitCount < 19)
+		{
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*c - '0');
+			digitCount += mantissa ? 1 : 0;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if (c < end && *c == '.')
+	{
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++)
+		{
+			hasDigits = true;
+			if (digitCount < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*c - '0');
+				digitCount += mantissa ? 1 : 0;
+				exponent--;
+			}
+		}
+	}
+	if (!hasDigits)
+		return false;
+	if (c < end && (*c == 'e' || *c == 'E'))
+	{
+		const char* exponentStart = c + 1;
+		int64_t explicitExponent;
+		if (!ParseInteger(exponentStart, end, explicitExponent))
+			return false;
+		exponent += static_cast<int32_t>(std::max<int64_t>(std::min<int64_t>(explicitExponent, 1000), -1000));
+		c = exponentStart;
+	}
+
+	double result = static_cast<double>(mantissa);
+	if (exponent > 0)
+		result = exponent <= 22 ? result * kPowers[exponent] : result * std::pow(10.0, exponent);
+	else if (exponent < 0)
+		result = exponent >= -22 ? result / kPowers[-exponent] : result * std::pow(10.0, exponent);
+	value = static_cast<float>(negative ? -result : result);
+	p = c;
+	return true;
+}
+
+// OBJ
+
+/// Content of a chunk of OBJ text. Faces refer to the vertices of the file
+/// by their absolute index, except those written relative to the last vertex,
+/// which depend on the vertices of the previous chunks
+struct ObjChunk
+{
+	std::vector<Vertex> vertices;
+	/// 3 vertex indices per triangle, 0 for the relative ones
+	std::vector<uint32_t> indices;
+	/// Position in indices and index relative to the first vertex of the chunk
+	/// of the relative references
+	std::vector<std::pair<size_t, int64_t>> relativeIndices;
+};
+
+/// Offset of the first line starting at or after offset
+size_t FindLineStart(const char* text, size_t size, size_t offset)
+{
+	if (offset == 0 || offset >= size)
+		return std::min(offset, size);
+	const void* newLine = std::memchr(text + offset - 1, '\n', size - offset + 1);
+	return newLine ? static_cast<const char*>(newLine) - text + 1 : size;
+}
+
+void ParseObjChunk(const std::string& fileName, const uint8_t* data, const char* begin, const char* end,
+                   ObjChunk& chunk)
+{
+	struct Corner
+	{
+		int64_t index;
+		bool isRelative;
+	};
+	std::vector<Corner> polygon;
+	auto addCorner = [&](const Corner& corner) {
+		if (corner.isRelative)
+			chunk.relativeIndices.emplace_back(chunk.indices.size(), corner.index);
+		chunk.indices.push_back(corner.isRelative ? 0 : static_cast<uint32_t>(corner.index));
+	};
+
+	for (const char* line = begin; line < end;)
+	{
+		const void* newLine = std::memchr(line, '\n', end - line);
+		const char* lineEnd = newLine ? static_cast<const char*>(newLine) : end;
+		const char* p = SkipSpaces(line, lineEnd);
+		const bool isVertex = lineEnd - p > 1 && p[0] == 'v' && IsSpace(p[1]);
+		const bool isFace = lineEnd - p > 1 && p[0] == 'f' && IsSpace(p[1]);
+
+		if (isVertex)
+		{
+			// x y z, optionally followed by w, or by the r g b extension
+			float values[7];
+			uint32_t valueCount = 0;
+			for (p = SkipSpaces(p + 1, lineEnd); p < lineEnd && *p != '#' && valueCount < 7;
+			     p = SkipSpaces(p, lineEnd))
+			{
+				if (!ParseFloat(p, lineEnd, values[valueCount++]))
+					ThrowMalformed(fileName, data, p);
+			}
+			if (valueCount < 3)
+				ThrowMalformed(fileName, data, line);
+			Vertex vertex = kWhiteVertex;
+			std::memcpy(vertex.position, values, sizeof(vertex.position));
+			if (valueCount >= 6)
+				std::memcpy(vertex.color, values + 3, 3 * sizeof(float));
+			chunk.vertices.push_back(vertex);
+		}
+		else if (isFace)
+		{
+			// Corners are v, v/vt, v//vn or v/vt/vn: only v is read
+			polygon.clear();
+			for (p = SkipSpaces(p + 1, lineEnd); p < lineEnd && *p != '#'; p = SkipSpaces(p, lineEnd))
+			{
+				int64_t index;
+				if (!ParseInteger(p, lineEnd, index) || index == 0)
+					ThrowMalformed(fileName, data, p);
+				if (index > 0 && index - 1 > std::numeric_limits<uint32_t>::max())
+					ThrowMalformed(fileName, data, p);
+				polygon.push_back(index > 0 ? Corner{index - 1, false}
+				                            : Corner{static_cast<int64_t>(chunk.vertices.size()) + index, true});
+				while (p < lineEnd && !IsSpace(*p))
+					p++;
+			}
+			if (polygon.size() < 3)
+				ThrowMalformed(fileName, data, line);
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+			{
+				addCorner(polygon[0]);
+				addCorner(polygon[i]);
+				addCorner(polygon[i + 1]);
+			}
+		}
+		line = lineEnd + 1;
+	}
+}
+
+void ImportObj(const std::string& fileName, const MappedFile& file, uint32_t threadCount, Mesh& mesh)
+{
+	const char* text = reinterpret_cast<const char*>(file.GetData());
+	const size_t size = file.GetSize();
+	const uint32_t chunkCount = static_cast<uint32_t>((size + kObjChunkSize - 1) / kObjChunkSize);
+	std::vector<ObjChunk> chunks(chunkCount);
+	ParallelFor(chunkCount, 1,
+	            [&](uint32_t chunk, uint32_t) {
+		            const size_t begin = FindLineStart(text, size, size_t(chunk) * kObjChunkSize);
+		            const size_t end = FindLineStart(text, size, size_t(chunk + 1) * kObjChunkSize);
+		            ParseObjChunk(fileName, file.GetData(), text + begin, text + end, chunks[chunk]);
+	            },
+	            threadCount);
+
+	// Concatenate the chunks, resolving the relative references
+	std::vector<size_t> vertexOffsets(chunkCount + 1, 0), indexOffsets(chunkCount + 1, 0);
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i].vertices.size();
+		indexOffsets[i + 1] = indexOffsets[i] + chunks[i].indices.size();
+	}
+	const size_t vertexCount = vertexOffsets[chunkCount];
+	if (vertexCount > std::numeric_limits<uint32_t>::max() ||
+	    indexOffsets[chunkCount] > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::runtime_error(fileName + " has too many vertices or triangles");
+	}
+	mesh.vertices.resize(vertexCount);
+	mesh.indices.resize(indexOffsets[chunkCount]);
+	ParallelFor(chunkCount, 1,
+	            [&](uint32_t chunkIndex, uint32_t) {
+		            ObjChunk& chunk = chunks[chunkIndex];
+		            for (const std::pair<size_t, int64_t>& relative : chunk.relativeIndices)
+		            {
+			            const int64_t index = static_cast<int64_t>(vertexOffsets[chunkIndex]) + relative.second;
+			            if (index < 0)
+				            throw std::runtime_error(fileName + " references a vertex before the first one");
+			            chunk.indices[relative.first] = static_cast<uint32_t>(index);
+		            }
+		            for (uint32_t index : chunk.indices)
+		            {
+			            if (index >= vertexCount)
+				            throw std::runtime_error(fileName + " references vertex " + std::to_string(index + 1) +
+				                                     " of " + std::to_string(vertexCount));
+		            }
+		            std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+		                      mesh.vertices.begin() + vertexOffsets[chunkIndex]);
+		            std::copy(chunk.indices.begin(), chunk.indices.end(),
+		                      mesh.indices.begin() + indexOffsets[chunkIndex]);
+		            // Release the chunk at once, to keep the peak memory down
+		            chunk = ObjChunk();
+	            },
+	            threadCount);
+}
+
+// PLY
+
+enum class PlyType
+{
+	Int8,
+	UInt8,
+	Int16,
+	UInt16,
+	Int32,
+	UInt32,
+	Float32,
+	Float64,
+};
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type;
+	/// Lists have a count of type countType followed by the values of type
+	bool isList = false;
+	PlyType countType = PlyType::UInt8;
+};
+
+struct PlyElement
+{
+	std::string name;
+	uint64_t count = 0;
+	std::vector<PlyProperty> properties;
+};
+
+uint32_t GetPlyTypeSize(PlyType type)
+{
+	static const uint32_t kSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+	return kSizes[static_cast<int>(type)];
+}
+
+PlyType ParsePlyType(const std::string& fileName, const std::string& name)
+{
+	static const char* const kNames[][2] = {{"char", "int8"},   {"uchar", "uint8"}, {"short", "int16"},
+	                                        {"ushort", "uint16"}, {"int", "int32"},   {"uint", "uint32"},
+	                                        {"float", "float32"}, {"double", "float64"}};
+	for (int i = 0; i < 8; i++)
+	{
+		if (name == kNames[i][0] || name == kNames[i][1])
+			return static_cast<PlyType>(i);
+	}
+	throw std::runtime_error(fileName + " has a property of unknown type " + name);
+}
+
+template <typename T>
+double ReadPlyScalarAs(const uint8_t* bytes)
+{
+	T value;
+	std::memcpy(&value, bytes, sizeof(T));
+	return static_cast<double>(value);
+}
+
+/// Scalar of a binary PLY record, converted to double
+double ReadPlyScalar(const uint8_t* p, PlyType type, bool swapBytes)
+{
+	uint8_t bytes[8];
+	const uint32_t size = GetPlyTypeSize(type);
+	for (uint32_t i = 0; i < size; i++)
+	{
+		bytes[i] = swapBytes ? p[size - 1 - i] : p[i];
+	}
+	switch (type)
+	{
+	case PlyType::Int8:
+		return ReadPlyScalarAs<int8_t>(bytes);
+	case PlyType::UInt8:
+		return ReadPlyScalarAs<uint8_t>(bytes);
+	case PlyType::Int16:
+		return ReadPlyScalarAs<int16_t>(bytes);
+	case PlyType::UInt16:
+		return ReadPlyScalarAs<uint16_t>(bytes);
+	case PlyType::Int32:
+		return ReadPlyScalarAs<int32_t>(bytes);
+	case PlyType::UInt32:
+		return ReadPlyScalarAs<uint32_t>(bytes);
+	case PlyType::Float32:
+		return ReadPlyScalarAs<float>(bytes);
+	case PlyType::Float64:
+		return ReadPlyScalarAs<double>(bytes);
+	}
+	return 0.0;
+}
+
+/// Vertex count of a face list
+uint32_t ReadPlyCount(const uint8_t* p, PlyType type, bool swapBytes)
+{
+	if (type == PlyType::UInt8)
+		return *p;
+	return static_cast<uint32_t>(std::max(ReadPlyScalar(p, type, swapBytes), 0.0));
+}
+
+/// Vertex index of a face list. 32-bit indices in the byte order of the
+/// machine, the usual case, are read directly
+uint32_t ReadPlyIndex(const uint8_t* p, PlyType type, bool swapBytes)
+{
+	if (!swapBytes && (type == PlyType::UInt32 || type == PlyType::Int32))
+	{
+		uint32_t index;
+		std::memcpy(&index, p, sizeof(index));
+		return index;
+	}
+	return static_cast<uint32_t>(ReadPlyScalar(p, type, swapBytes));
+}
+
+/// Size of the record of an element starting at p, lists included
+uint64_t GetPlyRecordSize(const PlyElement& element, const uint8_t* p, const uint8_t* end, bool swapBytes,
+                          const std::string& fileName)
+{
+	uint64_t size = 0;
+	for (const PlyProperty& property : element.properties)
+	{
+		if (!property.isList)
+		{
+			size += GetPlyTypeSize(property.type);
+			continue;
+		}
+		const uint32_t countSize = GetPlyTypeSize(property.countType);
+		if (static_cast<uint64_t>(end - p) < size + countSize)
+			throw std::runtime_error(fileName + " is truncated");
+		const double count = ReadPlyScalar(p + size, property.countType, swapBytes);
+		size += countSize + static_cast<uint64_t>(std::max(count, 0.0)) * GetPlyTypeSize(property.type);
+	}
+	return size;
+}
+
+void ImportPly(const std::string& fileName, const MappedFile& file, uint32_t threadCount, Mesh& mesh)
+{
+	const char* text = reinterpret_cast<const char*>(file.GetData());
+	const size_t size = file.GetSize();
+	static const char kEndHeader[] = "end_header";
+	const char* headerEnd = std::search(text, text + size, kEndHeader, kEndHeader + sizeof(kEndHeader) - 1);
+	const void* dataStart = headerEnd == text + size ? nullptr : std::memchr(headerEnd, '\n', text + size - headerEnd);
+	if (size < 4 || std::memcmp(text, "ply", 3) != 0 || !dataStart)
+	{
+		throw std::runtime_error(fileName + " is not a PLY file");
+	}
+
+	// Header, one keyword per line
+	bool swapBytes = false;
+	std::vector<PlyElement> elements;
+	for (const char* line = text; line < headerEnd;)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', headerEnd - line));
+		lineEnd = lineEnd ? lineEnd : headerEnd;
+		std::vector<std::string> words;
+		for (const char* p = SkipSpaces(line, lineEnd); p < lineEnd; p = SkipSpaces(p, lineEnd))
+		{
+			const char* word = p;
+			while (p < lineEnd && !IsSpace(*p))
+				p++;
+			words.emplace_back(word, p);
+		}
+		line = lineEnd + 1;
+		if (words.empty())
+			continue;
+
+		if (words[0] == "format" && words.size() >= 2)
+		{
+			if (words[1] == "ascii")
+				throw std::runtime_error(fileName + " is an ASCII PLY file, only binary ones are supported");
+			const uint16_t one = 1;
+			const bool isLittleEndian = *reinterpret_cast<const uint8_t*>(&one) == 1;
+			swapBytes = (words[1] == "binary_little_endian") != isLittleEndian;
+		}
+		else if (words[0] == "element" && words.size() >= 3)
+		{
+			PlyElement element;
+			element.name = words[1];
+			const char* count = words[2].c_str();
+			const char* countEnd = count + words[2].size();
+			int64_t value;
+			if (!ParseInteger(count, countEnd, value) || count != countEnd || value < 0)
+				throw std::runtime_error(fileName + " has a malformed element count");
+			element.count = static_cast<uint64_t>(value);
+			elements.push_back(element);
+		}
+		else if (words[0] == "property" && !elements.empty())
+		{
+			PlyProperty property;
+			if (words.size() >= 5 && words[1] == "list")
+			{
+				property.isList = true;
+				property.countType = ParsePlyType(fileName, words[2]);
+				property.type = ParsePlyType(fileName, words[3]);
+				property.name = words[4];
+			}
+			else if (words.size() >= 3)
+			{
+				property.type = ParsePlyType(fileName, words[1]);
+				property.name = words[2];
+			}
+			else
+			{
+				throw std::runtime_error(fileName + " has a malformed property");
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+
+	const uint8_t* data = file.GetData() + (static_cast<const char*>(dataStart) - text + 1);
+	const uint8_t* end = file.GetData() + size;
+	for (const PlyElement& element : elements)
+	{
+		const bool hasLists = std::any_of(element.properties.begin(), element.properties.end(),
+		                                  [](const PlyProperty& property) { return property.isList; });
+		if (element.name == "vertex")
+		{
+			if (hasLists)
+				throw std::runtime_error(fileName + " has lists in its vertices");
+			// Offset and type of x, y, z, red, green, blue and alpha
+			static const char* const kNames[] = {"x", "y", "z", "red", "green", "blue", "alpha"};
+			int64_t offsets[7] = {-1, -1, -1, -1, -1, -1, -1};
+			PlyType types[7] = {};
+			uint64_t stride = 0;
+			for (const PlyProperty& property : element.properties)
+			{
+				for (int i = 0; i < 7; i++)
+				{
+					if (property.name == kNames[i])
+					{
+						offsets[i] = static_cast<int64_t>(stride);
+						types[i] = property.type;
+					}
+				}
+				stride += GetPlyTypeSize(property.type);
+			}
+			if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+				throw std::runtime_error(fileName + " has vertices without positions");
+			if (element.count > std::numeric_limits<uint32_t>::max() ||
+			    static_cast<uint64_t>(end - data) / stride < element.count)
+				throw std::runtime_error(fileName + " is truncated");
+
+			mesh.vertices.resize(static_cast<size_t>(element.count));
+			ParallelFor(static_cast<uint32_t>(element.count), kPlyChunkSize,
+			            [&](uint32_t begin, uint32_t endVertex) {
+				            for (uint32_t i = begin; i < endVertex; i++)
+				            {
+					            const uint8_t* record = data + i * stride;
+					            Vertex& vertex = mesh.vertices[i];
+					            vertex = kWhiteVertex;
+					            for (int c = 0; c < 7; c++)
+					            {
+						            if (offsets[c] < 0)
+							            continue;
+						            double value = ReadPlyScalar(record + offsets[c], types[c], swapBytes);
+						            // Integer colors span the range of their type
+						            if (c >= 3 && types[c] == PlyType::UInt8)
+							            value /= 255.0;
+						            else if (c >= 3 && types[c] == PlyType::UInt16)
+							            value /= 65535.0;
+						            (c < 3 ? vertex.position[c] : vertex.color[c - 3]) = static_cast<float>(value);
+					            }
+				            }
+			            },
+			            threadCount);
+			data += element.count * stride;
+		}
+		else if (element.name == "face")
+		{
+			auto indexProperty = std::find_if(element.properties.begin(), element.properties.end(),
+			                                  [](const PlyProperty& property) {
+				                                  return property.isList && (property.name == "vertex_indices" ||
+				                                                             property.name == "vertex_index");
+			                                  });
+			if (indexProperty == element.properties.end())
+				throw std::runtime_error(fileName + " has faces without vertex indices");
+			uint64_t indexOffset = 0;
+			for (auto property = element.properties.begin(); property != indexProperty; property++)
+			{
+				if (property->isList)
+					throw std::runtime_error(fileName + " has lists before the face vertex indices");
+				indexOffset += GetPlyTypeSize(property->type);
+			}
+
+			// Locate the first face of each chunk and count the triangles
+			const uint32_t chunkCount = static_cast<uint32_t>((element.count + kPlyChunkSize - 1) / kPlyChunkSize);
+			std::vector<const uint8_t*> chunkStarts(chunkCount + 1);
+			std::vector<size_t> indexOffsets(chunkCount + 1, 0);
+			const uint32_t countSize = GetPlyTypeSize(indexProperty->countType);
+			const uint32_t indexSize = GetPlyTypeSize(indexProperty->type);
+			const bool hasIndicesOnly = element.properties.size() == 1;
+			auto getRecordSize = [&](const uint8_t* record, uint32_t cornerCount) {
+				return hasIndicesOnly ? countSize + uint64_t(cornerCount) * indexSize
+				                      : GetPlyRecordSize(element, record, end, swapBytes, fileName);
+			};
+			for (uint64_t face = 0; face < element.count; face++)
+			{
+				if (face % kPlyChunkSize == 0)
+				{
+					chunkStarts[face / kPlyChunkSize] = data;
+					indexOffsets[face / kPlyChunkSize + 1] = indexOffsets[face / kPlyChunkSize];
+				}
+				if (static_cast<uint64_t>(end - data) < indexOffset + countSize)
+					throw std::runtime_error(fileName + " is truncated");
+				const uint32_t cornerCount = ReadPlyCount(data + indexOffset, indexProperty->countType, swapBytes);
+				if (cornerCount >= 3)
+					indexOffsets[face / kPlyChunkSize + 1] += 3 * (cornerCount - 2);
+				const uint64_t recordSize = getRecordSize(data, cornerCount);
+				if (static_cast<uint64_t>(end - data) < recordSize)
+					throw std::runtime_error(fileName + " is truncated");
+				data += recordSize;
+			}
+			chunkStarts[chunkCount] = data;
+			if (indexOffsets[chunkCount] > std::numeric_limits<uint32_t>::max())
+				throw std::runtime_error(fileName + " has too many triangles");
+
+			mesh.indices.resize(indexOffsets[chunkCount]);
+			ParallelFor(chunkCount, 1,
+			            [&](uint32_t chunk, uint32_t) {
+				            const uint8_t* record = chunkStarts[chunk];
+				            uint32_t* output = mesh.indices.data() + indexOffsets[chunk];
+				            while (record < chunkStarts[chunk + 1])
+				            {
+					            const uint8_t* corners = record + indexOffset + countSize;
+					            const uint32_t cornerCount =
+					                ReadPlyCount(record + indexOffset, indexProperty->countType, swapBytes);
+					            auto corner = [&](uint32_t i) {
+						            return ReadPlyIndex(corners + i * indexSize, indexProperty->type, swapBytes);
+					            };
+					            for (uint32_t i = 1; i + 1 < cornerCount; i++)
+					            {
+						            *output++ = corner(0);
+						            *output++ = corner(i);
+						            *output++ = corner(i + 1);
+					            }
+					            record += getRecordSize(record, cornerCount);
+				            }
+			            },
+			            threadCount);
+		}
+		else
+		{
+			for (uint64_t i = 0; i < element.count; i++)
+			{
+				data += GetPlyRecordSize(element, data, end, swapBytes, fileName);
+				if (data > end)
+					throw std::runtime_error(fileName + " is truncated");
+			}
+		}
+	}
+
+	const size_t vertexCount = mesh.vertices.size();
+	ParallelFor(static_cast<uint32_t>(mesh.indices.size()), kWeldGrainSize,
+	            [&](uint32_t begin, uint32_t endIndex) {
+		            for (uint32_t i = begin; i < endIndex; i++)
+		            {
+			            if (mesh.indices[i] >= vertexCount)
+				            throw std::runtime_error(fileName + " references vertex " +
+				                                     std::to_string(mesh.indices[i]) + " of " +
+				                                     std::to_string(vertexCount));
+		            }
+	            },
+	            threadCount);
+}
+
+// Weld
+
+uint64_t HashVertex(const Vertex& vertex)
+{
+	uint32_t words[sizeof(Vertex) / 4];
+	std::memcpy(words, &vertex, sizeof(Vertex));
+	uint64_t hash = 0;
+	for (uint32_t word : words)
+	{
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	return hash ^ (hash >> 32);
+}
+
+bool AreVerticesIdentical(const Vertex& a, const Vertex& b)
+{
+	return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+}
+
+} // namespace
+
+Mesh ImportMesh(const std::string& fileName, MeshImportStats* stats, uint32_t threadCount)
+{
+	const auto start = Clock::now();
+	const MappedFile file(fileName);
+	std::string extension = fileName.substr(std::min(fileName.find_last_of('.'), fileName.size()));
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+	               [](char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); });
+
+	Mesh mesh;
+	if (extension == ".obj")
+		ImportObj(fileName, file, threadCount, mesh);
+	else if (extension == ".ply")
+		ImportPly(fileName, file, threadCount, mesh);
+	else
+		throw std::runtime_error("Unknown mesh format " + fileName + ", expected .obj or .ply");
+	const double parseSeconds = SecondsSince(start);
+	const uint32_t fileVertexCount = static_cast<uint32_t>(mesh.vertices.size());
+
+	const auto weldStart = Clock::now();
+	WeldVertices(mesh.vertices, mesh.indices, threadCount);
+	if (stats)
+	{
+		stats->fileBytes = file.GetSize();
+		stats->fileVertexCount = fileVertexCount;
+		stats->vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		stats->triangleCount = mesh.TriangleCount();
+		stats->parseSeconds = parseSeconds;
+		stats->weldSeconds = SecondsSince(weldStart);
+		stats->peakMemoryBytes = GetPeakMemoryUsage();
+	}
+	return mesh;
+}
+
+uint32_t WeldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t threadCount)
+{
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	if (indices.empty())
+	{
+		indices.resize(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			indices[i] = i;
+		}
+	}
+
+	// Open-addressing table at most half full, of vertex index + 1 (0 for an
+	// empty slot). Each slot ends up with the first occurrence of its vertex,
+	// whatever the order of the insertions
+	if (vertexCount >= 1u << 31)
+	{
+		throw std::length_error("Too many vertices to weld");
+	}
+	uint32_t capacity = 1;
+	while (capacity < 2 * uint64_t(vertexCount))
+		capacity *= 2;
+	const uint32_t mask = capacity - 1;
+	std::vector<std::atomic<uint32_t>> table(capacity);
+	auto findSlot = [&](uint32_t i, uint32_t& stored) -> std::atomic<uint32_t>& {
+		for (uint32_t slot = static_cast<uint32_t>(HashVertex(vertices[i])) & mask;; slot = (slot + 1) & mask)
+		{
+			stored = table[slot].load(std::memory_order_acquire);
+			while (stored == 0 && !table[slot].compare_exchange_weak(stored, i + 1, std::memory_order_acq_rel))
+			{
+			}
+			if (stored == 0 || AreVerticesIdentical(vertices[stored - 1], vertices[i]))
+				return table[slot];
+		}
+	};
+	ParallelFor(vertexCount, kWeldGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            uint32_t stored;
+			            std::atomic<uint32_t>& slot = findSlot(i, stored);
+			            while (stored != 0 && i + 1 < stored &&
+			                   !slot.compare_exchange_weak(stored, i + 1, std::memory_order_acq_rel))
+			            {
+			            }
+		            }
+	            },
+	            threadCount);
+
+	// First occurrence of each vertex, then their new indices, in order
+	std::vector<uint32_t> remap(vertexCount);
+	const uint32_t chunkCount = (vertexCount + kWeldGrainSize - 1) / kWeldGrainSize;
+	std::vector<uint32_t> chunkOffsets(chunkCount + 1, 0);
+	ParallelFor(vertexCount, kWeldGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            uint32_t uniqueCount = 0;
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            uint32_t stored;
+			            findSlot(i, stored);
+			            remap[i] = stored - 1;
+			            uniqueCount += remap[i] == i ? 1 : 0;
+		            }
+		            chunkOffsets[begin / kWeldGrainSize + 1] = uniqueCount;
+	            },
+	            threadCount);
+	std::vector<std::atomic<uint32_t>>().swap(table);
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		chunkOffsets[i + 1] += chunkOffsets[i];
+	}
+	const uint32_t uniqueCount = chunkOffsets[chunkCount];
+	if (uniqueCount == vertexCount)
+		return 0;
+
+	std::vector<Vertex> uniqueVertices(uniqueCount);
+	std::vector<uint32_t> newIndices(vertexCount);
+	ParallelFor(vertexCount, kWeldGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            uint32_t next = chunkOffsets[begin / kWeldGrainSize];
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            if (remap[i] == i)
+			            {
+				            newIndices[i] = next;
+				            uniqueVertices[next++] = vertices[i];
+			            }
+		            }
+	            },
+	            threadCount);
+	// The first occurrences precede the others, so their new index is known
+	ParallelFor(static_cast<uint32_t>(indices.size()), kWeldGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            indices[i] = newIndices[remap[indices[i]]];
+		            }
+	            },
+	            threadCount);
+	vertices.swap(uniqueVertices);
+	return vertexCount - uniqueCount;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,48 @@
+#pragma once
+
+// Importers of Wavefront OBJ and binary PLY meshes into the vertex and index
+// streams consumed by the bottom-level builds (CreateBottomLevelAS and
+// Scene::AddMesh). The file is mapped and parsed in chunks on the task
+// scheduler: the OBJ text is cut at line boundaries, and the PLY records are
+// located by a quick scan of the face lists. The vertices are then welded:
+// those with identical positions and colors are merged through a concurrent
+// hash map into a single indexed vertex, so that meshes exported with
+// per-face vertices come out indexed. Polygons are triangulated as fans.
+//
+// Only positions and vertex colors are read, the Vertex layout having no
+// normals or texture coordinates. Vertices without colors are white. The
+// results do not depend on the number of threads.
+
+#include "Scene.h"
+
+#include <string>
+
+namespace cpu_rt
+{
+
+struct MeshImportStats
+{
+	uint64_t fileBytes = 0;
+	/// Vertices of the file, and left once welded
+	uint32_t fileVertexCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	double parseSeconds = 0.0;
+	double weldSeconds = 0.0;
+	/// Peak memory of the process at the end of the import, in bytes, 0 if
+	/// unknown. Includes the pages of the file that were read
+	uint64_t peakMemoryBytes = 0;
+};
+
+/// Import a .obj or .ply mesh, chosen by the extension, using the scheduler
+/// of threadCount threads (0 for the default count). Throws
+/// std::runtime_error if the file cannot be read, is malformed, or references
+/// vertices it does not contain
+Mesh ImportMesh(const std::string& fileName, MeshImportStats* stats = nullptr, uint32_t threadCount = 0);
+
+/// Merge the bit-identical vertices: vertices receives one of each, in the
+/// order of their first occurrence, and the indices are remapped to them.
+/// Unindexed meshes receive indices. Returns the number of vertices removed
+uint32_t WeldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t threadCount = 0);
+
+} // namespace cpu_rt
@@ -0,0 +1,297 @@
+#include "MeshOptimizer.h"
+#include "MeshImport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Size of the LRU cache of the scores of Forsyth's algorithm, and its
+/// parameters as published
+static const uint32_t kForsythCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.f;
+static const float kValenceBoostPower = 0.5f;
+/// Valences above are scored as this one, their boost being negligible
+static const uint32_t kMaxScoredValence = 64;
+
+/// Lines and size of the vertex cache of ComputeOverfetch
+static const uint32_t kFetchLineSize = 64;
+static const uint32_t kFetchLineCount = 256;
+
+/// Score of a vertex at a position of the cache (-1 if out of it) with a
+/// number of triangles left to emit, from tables of both terms
+class VertexScorer
+{
+public:
+	VertexScorer()
+	{
+		m_cacheScores[0] = 0.f;
+		for (uint32_t position = 0; position < kForsythCacheSize; position++)
+		{
+			// The last triangle gets a fixed score, so that its vertices are not
+			// favoured over the ones just before
+			m_cacheScores[position + 1] =
+			    position < 3 ? kLastTriangleScore
+			                 : std::pow(1.f - (position - 3) / float(kForsythCacheSize - 3), kCacheDecayPower);
+		}
+		m_valenceScores[0] = 0.f;
+		for (uint32_t valence = 1; valence <= kMaxScoredValence; valence++)
+		{
+			m_valenceScores[valence] = kValenceBoostScale * std::pow(float(valence), -kValenceBoostPower);
+		}
+	}
+
+	float operator()(int32_t cachePosition, uint32_t liveTriangleCount) const
+	{
+		if (liveTriangleCount == 0)
+			return -1.f;
+		return m_cacheScores[cachePosition + 1] + m_valenceScores[std::min(liveTriangleCount, kMaxScoredValence)];
+	}
+
+private:
+	float m_cacheScores[kForsythCacheSize + 1];
+	float m_valenceScores[kMaxScoredValence + 1];
+};
+
+void CheckIndices(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	for (uint32_t index : indices)
+	{
+		if (index >= vertexCount)
+		{
+			throw std::logic_error("Index references a vertex that does not exist");
+		}
+	}
+}
+
+} // namespace
+
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                   const MeshOptimizationSettings& settings)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	MeshOptimizationStats stats;
+	stats.inputVertexCount = static_cast<uint32_t>(vertices.size());
+	stats.inputBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t);
+	if (indices.empty())
+	{
+		indices.resize(vertices.size());
+		for (uint32_t i = 0; i < indices.size(); i++)
+		{
+			indices[i] = i;
+		}
+	}
+	CheckIndices(indices, stats.inputVertexCount);
+	stats.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	stats.inputAcmr = ComputeAcmr(indices, stats.inputVertexCount, settings.cacheSize);
+	stats.inputOverfetch = ComputeOverfetch(indices, stats.inputVertexCount, sizeof(Vertex));
+
+	if (settings.weld)
+		WeldVertices(vertices, indices, settings.threadCount);
+	if (settings.optimizeVertexCache)
+		OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()));
+	if (settings.optimizeVertexFetch)
+		OptimizeVertexFetch(vertices, indices);
+
+	stats.vertexCount = static_cast<uint32_t>(vertices.size());
+	stats.bytes = vertices.size() * sizeof(Vertex) + indices.size() * GetIndexSize(stats.vertexCount);
+	stats.acmr = ComputeAcmr(indices, stats.vertexCount, settings.cacheSize);
+	stats.overfetch = ComputeOverfetch(indices, stats.vertexCount, sizeof(Vertex));
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	CheckIndices(indices, vertexCount);
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	const VertexScorer scoreVertex;
+
+	// Triangles of each vertex, the live ones first in its range
+	std::vector<uint32_t> liveCounts(vertexCount, 0);
+	for (uint32_t i = 0; i < 3 * triangleCount; i++)
+	{
+		liveCounts[indices[i]]++;
+	}
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] = offsets[v] + liveCounts[v];
+	}
+	std::vector<uint32_t> adjacency(offsets[vertexCount]);
+	{
+		std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < 3 * triangleCount; i++)
+		{
+			adjacency[cursors[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<int32_t> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = scoreVertex(-1, liveCounts[v]);
+	}
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<uint32_t> output;
+	output.reserve(3 * triangleCount);
+	uint32_t cache[kForsythCacheSize + 3];
+	uint32_t cacheCount = 0;
+	uint32_t nextInputTriangle = 0;
+	int64_t best = -1;
+	for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// No triangle left around the cache: restart from the next one of the
+		// input, as Forsyth suggests instead of a search of the whole mesh
+		if (best < 0)
+		{
+			while (emitted[nextInputTriangle])
+				nextInputTriangle++;
+			best = nextInputTriangle;
+		}
+		const uint32_t triangle = static_cast<uint32_t>(best);
+		emitted[triangle] = true;
+		const uint32_t* corners = &indices[3 * triangle];
+		output.insert(output.end(), corners, corners + 3);
+
+		// The vertices of the triangle move to the front of the cache, and no
+		// longer count it among their live triangles
+		uint32_t newCache[kForsythCacheSize + 3];
+		uint32_t newCount = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const uint32_t v = corners[corner];
+			if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				newCache[newCount++] = v;
+			uint32_t* live = &adjacency[offsets[v]];
+			std::swap(*std::find(live, live + liveCounts[v], triangle), live[liveCounts[v] - 1]);
+			liveCounts[v]--;
+		}
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			if (std::find(corners, corners + 3, cache[i]) == corners + 3)
+				newCache[newCount++] = cache[i];
+		}
+		cacheCount = std::min(newCount, kForsythCacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+		for (uint32_t i = 0; i < newCount; i++)
+		{
+			const uint32_t v = newCache[i];
+			cachePositions[v] = i < cacheCount ? static_cast<int32_t>(i) : -1;
+			vertexScores[v] = scoreVertex(cachePositions[v], liveCounts[v]);
+		}
+
+		// The next triangle is the best one using a vertex of the cache
+		best = -1;
+		float bestScore = -1.f;
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			const uint32_t v = cache[i];
+			for (uint32_t j = offsets[v]; j < offsets[v] + liveCounts[v]; j++)
+			{
+				const uint32_t t = adjacency[j];
+				const float score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] +
+				                    vertexScores[indices[3 * t + 2]];
+				if (score > bestScore)
+				{
+					best = t;
+					bestScore = score;
+				}
+			}
+		}
+	}
+	output.insert(output.end(), indices.begin() + 3 * triangleCount, indices.end());
+	indices.swap(output);
+}
+
+uint32_t OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	CheckIndices(indices, static_cast<uint32_t>(vertices.size()));
+	std::vector<uint32_t> remap(vertices.size(), ~0u);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = static_cast<uint32_t>(ordered.size());
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	const uint32_t droppedCount = static_cast<uint32_t>(vertices.size() - ordered.size());
+	vertices.swap(ordered);
+	return droppedCount;
+}
+
+double ComputeAcmr(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0;
+	// A vertex is in the FIFO while fewer than cacheSize vertices were
+	// transformed after it
+	std::vector<uint64_t> transformTimes(vertexCount, 0);
+	uint64_t transformCount = 0;
+	for (uint32_t index : indices)
+	{
+		if (transformTimes[index] == 0 || transformCount - transformTimes[index] >= cacheSize)
+			transformTimes[index] = ++transformCount;
+	}
+	return static_cast<double>(transformCount) / (indices.size() / 3);
+}
+
+double ComputeOverfetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize)
+{
+	if (vertexCount == 0)
+		return 0.0;
+	std::vector<uint64_t> lines(kFetchLineCount, ~0ull);
+	uint64_t fetchedLineCount = 0;
+	std::vector<bool> used(vertexCount, false);
+	uint32_t usedCount = 0;
+	for (uint32_t index : indices)
+	{
+		if (!used[index])
+		{
+			used[index] = true;
+			usedCount++;
+		}
+		const uint64_t first = uint64_t(index) * vertexSize / kFetchLineSize;
+		const uint64_t last = (uint64_t(index) * vertexSize + vertexSize - 1) / kFetchLineSize;
+		for (uint64_t line = first; line <= last; line++)
+		{
+			if (lines[line % kFetchLineCount] != line)
+			{
+				lines[line % kFetchLineCount] = line;
+				fetchedLineCount++;
+			}
+		}
+	}
+	return static_cast<double>(fetchedLineCount * kFetchLineSize) / (uint64_t(usedCount) * vertexSize);
+}
+
+std::vector<uint16_t> ConvertToShortIndices(const std::vector<uint32_t>& indices)
+{
+	std::vector<uint16_t> shortIndices(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] > 0xFFFF)
+		{
+			throw std::length_error("Index " + std::to_string(indices[i]) + " does not fit in 16 bits");
+		}
+		shortIndices[i] = static_cast<uint16_t>(indices[i]);
+	}
+	return shortIndices;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,84 @@
+#pragma once
+
+// Optimization of the vertex and index streams of a mesh for the raster and
+// raytracing paths. Identical vertices are welded into an indexed mesh, the
+// triangles are reordered for the post-transform vertex cache with Tom
+// Forsyth's linear-speed algorithm, and the vertices are then stored in the
+// order of their first use, so that consecutive triangles fetch neighbouring
+// vertices. Meshes of up to 65536 vertices take 16-bit indices.
+//
+// The triangles of a bottom-level hierarchy keep their own copy of their
+// positions (see BvhTriangle), so the orders only change the memory of the
+// streams and the cost of rasterizing them, and the primitive indices.
+
+#include "Common.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+struct MeshOptimizationSettings
+{
+	bool weld = true;
+	bool optimizeVertexCache = true;
+	bool optimizeVertexFetch = true;
+	/// Size of the FIFO post-transform cache of the statistics
+	uint32_t cacheSize = 16;
+	/// Threads of the weld, 0 for the default count
+	uint32_t threadCount = 0;
+};
+
+struct MeshOptimizationStats
+{
+	/// Vertices of the input, and left once welded and compacted
+	uint32_t inputVertexCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	/// Bytes of the vertex and index streams: with 32-bit indices, or none,
+	/// before, and with the indices of GetIndexSize after
+	size_t inputBytes = 0;
+	size_t bytes = 0;
+	/// Vertices transformed per triangle with the cache of the settings, 3 for
+	/// an unindexed mesh and 0.5 at best
+	double inputAcmr = 0.0;
+	double acmr = 0.0;
+	/// Bytes of vertex cache lines fetched per byte of vertex, 1 at best
+	double inputOverfetch = 0.0;
+	double overfetch = 0.0;
+	double seconds = 0.0;
+};
+
+/// Weld, reorder and compact a mesh as set, unindexed meshes receiving
+/// indices. Throws std::logic_error if an index references a vertex that
+/// does not exist
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                   const MeshOptimizationSettings& settings = {});
+
+/// Reorder the triangles so that they reuse the vertices of the last ones,
+/// with Tom Forsyth's scores over an LRU cache of 32 vertices. Throws
+/// std::logic_error if an index is not below vertexCount
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+/// Store the vertices in the order of their first use by the indices, and
+/// drop those that are not used. Returns the number of vertices dropped
+uint32_t OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+/// Average cache miss ratio: vertices transformed per triangle by a FIFO
+/// post-transform cache of cacheSize vertices
+double ComputeAcmr(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize);
+
+/// Bytes of 64-byte lines fetched per byte of vertex read, through a 16 KB
+/// direct-mapped vertex cache
+double ComputeOverfetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize);
+
+/// Size of the indices of a mesh: 2 up to 65536 vertices, else 4
+inline uint32_t GetIndexSize(uint32_t vertexCount)
+{
+	return vertexCount <= 65536 ? 2 : 4;
+}
+
+/// 16-bit copy of indices. Throws std::length_error if an index does not fit
+std::vector<uint16_t> ConvertToShortIndices(const std::vector<uint32_t>& indices);
+
+} // namespace cpu_rt
@@ -0,0 +1,275 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <map>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Attempts to find a task before an idle worker goes to sleep
+static const uint32_t kSpinCount = 64;
+
+/// Scheduler of the calling thread, if it is one of its workers, and the
+/// index of its deque
+thread_local const TaskScheduler* t_scheduler = nullptr;
+thread_local uint32_t t_queueIndex = 0;
+/// State of the xorshift generator choosing the first victim of the thefts
+thread_local uint32_t t_stealSeed = 0;
+
+} // namespace
+
+uint32_t GetDefaultThreadCount()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+TaskScheduler::TaskScheduler(uint32_t threadCount)
+    : m_threadCount(threadCount ? threadCount : GetDefaultThreadCount()), m_queuedCount(0), m_sleepingCount(0)
+{
+	for (uint32_t i = 0; i < m_threadCount; i++)
+	{
+		m_queues.emplace_back(new TaskQueue());
+	}
+	for (uint32_t i = 0; i + 1 < m_threadCount; i++)
+	{
+		m_workers.emplace_back(&TaskScheduler::WorkerMain, this, i);
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_wakeUp.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+TaskScheduler& TaskScheduler::Get(uint32_t threadCount)
+{
+	static std::mutex mutex;
+	static std::map<uint32_t, std::unique_ptr<TaskScheduler>> schedulers;
+
+	if (threadCount == 0)
+		threadCount = GetDefaultThreadCount();
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<TaskScheduler>& scheduler = schedulers[threadCount];
+	if (!scheduler)
+		scheduler.reset(new TaskScheduler(threadCount));
+	return *scheduler;
+}
+
+uint32_t TaskScheduler::GetQueueIndex() const
+{
+	return t_scheduler == this ? t_queueIndex : m_threadCount - 1;
+}
+
+void TaskScheduler::Push(Task&& task)
+{
+	TaskQueue& queue = *m_queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	m_queuedCount++;
+	// A worker counted as sleeping holds the mutex until it waits, so taking
+	// it ensures that the notification is not lost
+	if (m_sleepingCount > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wakeUp.notify_one();
+	}
+}
+
+bool TaskScheduler::Pop(Task& task)
+{
+	if (m_queuedCount == 0)
+		return false;
+	const uint32_t queueIndex = GetQueueIndex();
+	TaskQueue& queue = *m_queues[queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.size() > queue.front)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			if (queue.tasks.size() == queue.front)
+			{
+				queue.tasks.clear();
+				queue.front = 0;
+			}
+			m_queuedCount--;
+			return true;
+		}
+	}
+	return Steal(queueIndex, task);
+}
+
+bool TaskScheduler::Steal(uint32_t thiefIndex, Task& task)
+{
+	if (m_threadCount == 1)
+		return false;
+	uint32_t& seed = t_stealSeed;
+	if (seed == 0)
+		seed = thiefIndex * 0x9E3779B9u + 1;
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	const uint32_t firstVictim = seed % m_threadCount;
+	for (uint32_t i = 0; i < m_threadCount; i++)
+	{
+		const uint32_t victim = (firstVictim + i) % m_threadCount;
+		if (victim == thiefIndex)
+			continue;
+		TaskQueue& queue = *m_queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.size() > queue.front)
+		{
+			task = std::move(queue.tasks[queue.front++]);
+			if (queue.tasks.size() == queue.front)
+			{
+				queue.tasks.clear();
+				queue.front = 0;
+			}
+			m_queuedCount--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskScheduler::Execute(Task& task)
+{
+	TaskGroup& group = *task.group;
+	try
+	{
+		task.function();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(group.m_errorMutex);
+		if (!group.m_error)
+			group.m_error = std::current_exception();
+	}
+	// The group may be destroyed as soon as its count reaches 0
+	group.m_pendingCount.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TaskScheduler::WorkerMain(uint32_t workerIndex)
+{
+	t_scheduler = this;
+	t_queueIndex = workerIndex;
+
+	uint32_t attempts = 0;
+	for (;;)
+	{
+		Task task;
+		if (Pop(task))
+		{
+			Execute(task);
+			attempts = 0;
+			continue;
+		}
+		if (++attempts < kSpinCount)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		attempts = 0;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		if (m_stopping)
+			return;
+		m_sleepingCount++;
+		m_wakeUp.wait(lock, [this] { return m_stopping || m_queuedCount > 0; });
+		m_sleepingCount--;
+	}
+}
+
+TaskGroup::~TaskGroup()
+{
+	try
+	{
+		Wait();
+	}
+	catch (...)
+	{
+	}
+}
+
+void TaskGroup::Run(std::function<void()> function)
+{
+	m_pendingCount.fetch_add(1, std::memory_order_relaxed);
+	m_scheduler.Push({std::move(function), this});
+}
+
+void TaskGroup::Wait()
+{
+	while (m_pendingCount.load(std::memory_order_acquire) > 0)
+	{
+		TaskScheduler::Task task;
+		if (m_scheduler.Pop(task))
+			TaskScheduler::Execute(task);
+		else
+			std::this_thread::yield();
+	}
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(m_errorMutex);
+		std::swap(error, m_error);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& body,
+                 uint32_t threadCount)
+{
+	if (count == 0)
+		return;
+	grainSize = std::max(grainSize, 1u);
+	const uint32_t chunkCount = (count - 1) / grainSize + 1;
+	auto runChunk = [&](uint32_t chunk) {
+		const uint32_t begin = chunk * grainSize;
+		body(begin, begin + std::min(grainSize, count - begin));
+	};
+
+	if (threadCount == 0)
+		threadCount = GetDefaultThreadCount();
+	if (threadCount == 1 || chunkCount == 1)
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			runChunk(chunk);
+		}
+		return;
+	}
+
+	// Spawn the upper half of the chunks and keep splitting the lower one, so
+	// that every chunk is spawned before a body that throws
+	TaskGroup group(TaskScheduler::Get(threadCount));
+	std::function<void(uint32_t, uint32_t)> split = [&](uint32_t firstChunk, uint32_t endChunk) {
+		while (endChunk - firstChunk > 1)
+		{
+			const uint32_t middle = firstChunk + (endChunk - firstChunk) / 2;
+			group.Run([&split, middle, endChunk]() { split(middle, endChunk); });
+			endChunk = middle;
+		}
+		runChunk(firstChunk);
+	};
+	group.Run([&split, chunkCount]() { split(0, chunkCount); });
+	group.Wait();
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,124 @@
+#pragma once
+
+// Work-stealing task scheduler shared by the builders, the renderer and the
+// scene updates. Each thread of a scheduler owns a deque of tasks: it pushes
+// and pops the tasks it spawns at the back, while idle threads steal from the
+// front of the others, so that the oldest, and usually largest, tasks move
+// between threads. Threads that are not part of the scheduler, such as the
+// one calling DispatchRays, submit to a shared deque and take part in the
+// work while they wait for their tasks.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Number of threads used when 0 is requested: one per hardware thread
+uint32_t GetDefaultThreadCount();
+
+class TaskGroup;
+
+class TaskScheduler
+{
+public:
+	/// Start threadCount - 1 worker threads (0 for the default count): the
+	/// thread waiting for the tasks is the last one
+	explicit TaskScheduler(uint32_t threadCount = 0);
+	/// Stop the workers. Tasks must not be pending
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	/// Scheduler shared by all the callers that request the same number of
+	/// threads (0 for the default count), started on first use
+	static TaskScheduler& Get(uint32_t threadCount = 0);
+
+	uint32_t GetThreadCount() const { return m_threadCount; }
+
+private:
+	friend class TaskGroup;
+
+	struct Task
+	{
+		std::function<void()> function;
+		TaskGroup* group;
+	};
+
+	/// Deque of a worker, or of the external threads for the last one. Each
+	/// is allocated on its own to keep their locks apart
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::vector<Task> tasks;
+		/// Index of the first task not stolen yet: the thieves take from the
+		/// front without moving the others
+		size_t front = 0;
+	};
+
+	void Push(Task&& task);
+	/// Pop a task of the calling thread, or steal one from another thread
+	bool Pop(Task& task);
+	bool Steal(uint32_t thiefIndex, Task& task);
+	static void Execute(Task& task);
+	void WorkerMain(uint32_t workerIndex);
+	/// Index of the deque of the calling thread
+	uint32_t GetQueueIndex() const;
+
+	const uint32_t m_threadCount;
+	std::vector<std::unique_ptr<TaskQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	/// Tasks pushed and not yet popped, and workers waiting for one
+	std::atomic<uint32_t> m_queuedCount;
+	std::atomic<uint32_t> m_sleepingCount;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeUp;
+	bool m_stopping = false;
+};
+
+/// Fork/join: tasks run on the threads of the scheduler, possibly before Run
+/// returns, and Wait returns once they are all done. A task may run further
+/// groups of its own
+class TaskGroup
+{
+public:
+	explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::Get()) : m_scheduler(scheduler) {}
+	/// Wait for the tasks left, dropping their exceptions
+	~TaskGroup();
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	void Run(std::function<void()> function);
+	/// Run tasks of the scheduler until those of the group are done. An
+	/// exception thrown by a task is rethrown here, after the others complete
+	void Wait();
+
+private:
+	friend class TaskScheduler;
+
+	TaskScheduler& m_scheduler;
+	std::atomic<uint32_t> m_pendingCount{0};
+	std::mutex m_errorMutex;
+	std::exception_ptr m_error;
+};
+
+/// Call body(begin, end) on chunks of at most grainSize indices covering
+/// [0, count), on the scheduler of threadCount threads (0 for the default
+/// count). The range is halved recursively into tasks, so that idle threads
+/// steal the largest halves left. Returns once all the chunks are done. An
+/// exception thrown by the body is rethrown on the calling thread after the
+/// other chunks complete
+void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& body,
+                 uint32_t threadCount = 0);
+
+} // namespace cpu_rt
@@ -0,0 +1,246 @@
+#pragma once
+
+// Analytic primitives of procedural geometry, the CPU counterpart of the
+// D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS geometries and of
+// the intersection shaders of their hit groups: spheres, boxes, planes and
+// quads, each with its bounding box and a closed-form ray test. A single
+// primitive replaces the tessellated version of the shape, without its
+// triangles and with the exact surface. Menger sponges are traced through
+// their nested grids instead, at any level (see MengerSponge.h). As with the
+// AABBs of DXR the bounds are finite, and the hits of a plane are limited to
+// its bounds. ProceduralIntersection in res/shaders/Procedural.hlsl is the GPU
+// version, for all the shapes but the sponges, and reads the primitives in the
+// layout of ProceduralPrimitive.
+
+#include "Geometry.h"
+#include "MengerSponge.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <stdexcept>
+#include <string>
+
+namespace cpu_rt
+{
+
+enum class ProceduralShape : uint32_t
+{
+	Sphere,
+	Box,
+	Plane,
+	Quad,
+	MengerSponge,
+};
+
+struct ProceduralPrimitive
+{
+	ProceduralShape shape;
+	/// Sphere: center and radius. Box and Menger sponge: min and max corners,
+	/// and level of the sponge. Plane: a point and the unit normal. Quad: a
+	/// corner and the two edges leaving it
+	glm::vec3 p0;
+	glm::vec3 p1;
+	glm::vec3 p2;
+	float radius;
+	int32_t level;
+	/// Box of the primitive given to the hierarchy, as D3D12_RAYTRACING_AABB
+	Aabb bounds;
+	/// Index of the primitive in its geometry, returned by PrimitiveIndex(),
+	/// and index of the geometry. Set when the primitive is added to a Bvh
+	uint32_t primitiveIndex;
+	uint32_t geometryIndex;
+};
+static_assert(sizeof(ProceduralPrimitive) == 80,
+              "cpu_rt::ProceduralPrimitive must match SProceduralPrimitive in Procedural.hlsl");
+
+inline ProceduralPrimitive CreateProceduralSphere(const glm::vec3& center, float radius)
+{
+	ProceduralPrimitive primitive = {};
+	primitive.shape = ProceduralShape::Sphere;
+	primitive.p0 = center;
+	primitive.radius = radius;
+	primitive.bounds.min = center - glm::vec3(radius);
+	primitive.bounds.max = center + glm::vec3(radius);
+	return primitive;
+}
+
+inline ProceduralPrimitive CreateProceduralBox(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	ProceduralPrimitive primitive = {};
+	primitive.shape = ProceduralShape::Box;
+	primitive.p0 = boxMin;
+	primitive.p1 = boxMax;
+	primitive.bounds.min = boxMin;
+	primitive.bounds.max = boxMax;
+	return primitive;
+}
+
+/// Regular Menger sponge of the given level, as GenerateMengerSponge builds it
+/// and scaled to the box. Throws std::length_error if the level is negative
+/// or above kMaxImplicitMengerLevel
+inline ProceduralPrimitive CreateProceduralMengerSponge(const glm::vec3& boxMin, const glm::vec3& boxMax,
+                                                        int32_t level)
+{
+	if (level < 0 || level > kMaxImplicitMengerLevel)
+	{
+		throw std::length_error("Menger sponge level " + std::to_string(level) + " is not supported");
+	}
+	ProceduralPrimitive primitive = CreateProceduralBox(boxMin, boxMax);
+	primitive.shape = ProceduralShape::MengerSponge;
+	primitive.level = level;
+	return primitive;
+}
+
+/// Plane through a point, hit within bounds only
+inline ProceduralPrimitive CreateProceduralPlane(const glm::vec3& point, const glm::vec3& normal, const Aabb& bounds)
+{
+	ProceduralPrimitive primitive = {};
+	primitive.shape = ProceduralShape::Plane;
+	primitive.p0 = point;
+	primitive.p1 = glm::normalize(normal);
+	primitive.bounds = bounds;
+	return primitive;
+}
+
+/// Parallelogram of corners corner, corner + edgeU, corner + edgeV and
+/// corner + edgeU + edgeV
+inline ProceduralPrimitive CreateProceduralQuad(const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV)
+{
+	ProceduralPrimitive primitive = {};
+	primitive.shape = ProceduralShape::Quad;
+	primitive.p0 = corner;
+	primitive.p1 = edgeU;
+	primitive.p2 = edgeV;
+	primitive.bounds.Extend(corner);
+	primitive.bounds.Extend(corner + edgeU);
+	primitive.bounds.Extend(corner + edgeV);
+	primitive.bounds.Extend(corner + edgeU + edgeV);
+	return primitive;
+}
+
+/// Closest hit of a ray with a primitive in ]tMin, tMax[, as reported by its
+/// intersection shader. The attributes are the coordinates of the hit on the
+/// surface, in [0,1]: longitude and latitude on spheres, position on the face
+/// of boxes and of the bounds of sponges, position on quads, and 0 on planes.
+/// The normal is the outward normal of spheres and of the faces of boxes and
+/// sponges, the normal of planes, and the normalized cross product of the
+/// edges of quads. Rays starting inside a sphere, a box or a cube of a sponge
+/// hit it on the way out
+inline bool IntersectProcedural(const ProceduralPrimitive& primitive, const glm::vec3& origin,
+                                const glm::vec3& direction, float tMin, float tMax, float& t, Attributes& attrib)
+{
+	switch (primitive.shape)
+	{
+	case ProceduralShape::Sphere:
+	{
+		// The direction is not normalized, so the quadratic keeps its a term
+		const glm::vec3 oc = origin - primitive.p0;
+		const float a = glm::dot(direction, direction);
+		const float b = glm::dot(oc, direction);
+		const float c = glm::dot(oc, oc) - primitive.radius * primitive.radius;
+		const float discriminant = b * b - a * c;
+		if (discriminant < 0.f || a == 0.f)
+			return false;
+		const float root = std::sqrt(discriminant);
+		t = (-b - root) / a;
+		if (!(t > tMin))
+			t = (-b + root) / a;
+		if (!(t > tMin && t < tMax))
+			return false;
+		const glm::vec3 n = (oc + t * direction) / primitive.radius;
+		attrib.bary = glm::vec2(std::atan2(n.z, n.x) * (0.5f / glm::pi<float>()) + 0.5f,
+		                        std::acos(glm::clamp(n.y, -1.f, 1.f)) / glm::pi<float>());
+		attrib.normal = n;
+		return true;
+	}
+	case ProceduralShape::Box:
+	{
+		// Null direction components as in TraversalRay, so that no slab gives NaN
+		glm::vec3 invDirection;
+		for (int i = 0; i < 3; i++)
+		{
+			const float d = std::fabs(direction[i]) < 1e-20f ? std::copysign(1e-20f, direction[i]) : direction[i];
+			invDirection[i] = 1.f / d;
+		}
+		const glm::vec3 t0 = (primitive.p0 - origin) * invDirection;
+		const glm::vec3 t1 = (primitive.p1 - origin) * invDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float tEntry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+		const float tExit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		if (!(tEntry <= tExit))
+			return false;
+		const bool entering = tEntry > tMin;
+		t = entering ? tEntry : tExit;
+		if (!(t > tMin && t < tMax))
+			return false;
+		// Axis of the face that was hit, and position on the face
+		const glm::vec3& planes = entering ? tNear : tFar;
+		const int axis = t == planes.x ? 0 : t == planes.y ? 1 : 2;
+		const glm::vec3 uvw =
+		    (origin + t * direction - primitive.p0) / glm::max(primitive.p1 - primitive.p0, glm::vec3(1e-30f));
+		attrib.bary = glm::clamp(glm::vec2(uvw[(axis + 1) % 3], uvw[(axis + 2) % 3]), 0.f, 1.f);
+		// The ray enters through the face opposing its direction
+		attrib.normal = glm::vec3(0.f);
+		attrib.normal[axis] = (direction[axis] < 0.f) == entering ? 1.f : -1.f;
+		return true;
+	}
+	case ProceduralShape::Plane:
+	{
+		const float denominator = glm::dot(primitive.p1, direction);
+		if (denominator == 0.f)
+			return false;
+		t = glm::dot(primitive.p0 - origin, primitive.p1) / denominator;
+		if (!(t > tMin && t < tMax))
+			return false;
+		// The bounds of a plane are often flat: allow for the rounding of the
+		// hit position across them
+		const glm::vec3 p = origin + t * direction;
+		const glm::vec3 tolerance = 1e-5f * (glm::abs(primitive.bounds.min) + glm::abs(primitive.bounds.max) + 1.f);
+		if (glm::any(glm::lessThan(p, primitive.bounds.min - tolerance)) ||
+		    glm::any(glm::greaterThan(p, primitive.bounds.max + tolerance)))
+			return false;
+		attrib.bary = glm::vec2(0.f);
+		attrib.normal = primitive.p1;
+		return true;
+	}
+	case ProceduralShape::Quad:
+	{
+		const glm::vec3 normal = glm::cross(primitive.p1, primitive.p2);
+		const float denominator = glm::dot(normal, direction);
+		if (denominator == 0.f)
+			return false;
+		t = glm::dot(primitive.p0 - origin, normal) / denominator;
+		if (!(t > tMin && t < tMax))
+			return false;
+		const glm::vec3 p = origin + t * direction - primitive.p0;
+		const glm::vec3 w = normal / glm::dot(normal, normal);
+		const float u = glm::dot(w, glm::cross(p, primitive.p2));
+		const float v = glm::dot(w, glm::cross(primitive.p1, p));
+		if (u < 0.f || u > 1.f || v < 0.f || v > 1.f)
+			return false;
+		attrib.bary = glm::vec2(u, v);
+		attrib.normal = glm::normalize(normal);
+		return true;
+	}
+	case ProceduralShape::MengerSponge:
+	{
+		// Space of the sponge of GenerateMengerSponge, the unit cube centered on
+		// the origin, where distances are those of the primitive
+		const glm::vec3 size = glm::max(primitive.p1 - primitive.p0, glm::vec3(1e-30f));
+		const glm::vec3 center = 0.5f * (primitive.p0 + primitive.p1);
+		if (!IntersectMengerSponge(primitive.level, (origin - center) / size, direction / size, tMin, tMax, t,
+		                           attrib.normal))
+			return false;
+		// The normals of the faces are axis-aligned, so the scaling keeps them
+		const glm::vec3& normal = attrib.normal;
+		const int axis = normal.x != 0.f ? 0 : normal.y != 0.f ? 1 : 2;
+		const glm::vec3 uvw = (origin + t * direction - primitive.p0) / size;
+		attrib.bary = glm::clamp(glm::vec2(uvw[(axis + 1) % 3], uvw[(axis + 2) % 3]), 0.f, 1.f);
+		return true;
+	}
+	}
+	return false;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,178 @@
+#include "QuadLeaves.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Smallest cosine between the normals of the triangles of a quad, about 0.1
+/// degree: the triangles of the generated meshes are exactly coplanar, and
+/// the quads of scanned meshes stay within the rounding of their vertices
+static const float kCoplanarCosine = 0.999999f;
+
+/// Edge of a triangle, from one corner to the next in winding order
+struct DirectedEdge
+{
+	glm::vec3 from;
+	glm::vec3 to;
+	uint32_t geometryIndex;
+
+	bool operator==(const DirectedEdge& other) const
+	{
+		return from == other.from && to == other.to && geometryIndex == other.geometryIndex;
+	}
+};
+
+struct DirectedEdgeHash
+{
+	size_t operator()(const DirectedEdge& edge) const
+	{
+		// +0.f turns -0 into 0, which compare equal
+		const float coordinates[6] = {edge.from.x + 0.f, edge.from.y + 0.f, edge.from.z + 0.f,
+		                              edge.to.x + 0.f,   edge.to.y + 0.f,   edge.to.z + 0.f};
+		uint32_t bits[6];
+		std::memcpy(bits, coordinates, sizeof(bits));
+		uint64_t hash = edge.geometryIndex;
+		for (uint32_t b : bits)
+		{
+			hash = (hash ^ b) * 0x100000001B3ull;
+		}
+		return static_cast<size_t>(hash ^ (hash >> 32));
+	}
+};
+
+bool ArePairable(const BvhTriangle& a, const BvhTriangle& b)
+{
+	const glm::vec3 normalA = glm::cross(a.v1 - a.v0, a.v2 - a.v0);
+	const glm::vec3 normalB = glm::cross(b.v1 - b.v0, b.v2 - b.v0);
+	const float lengths = glm::length(normalA) * glm::length(normalB);
+	return lengths > 0.f && glm::dot(normalA, normalB) >= kCoplanarCosine * lengths;
+}
+
+void GetCorners(const BvhTriangle& triangle, glm::vec3 corners[3])
+{
+	corners[0] = triangle.v0;
+	corners[1] = triangle.v1;
+	corners[2] = triangle.v2;
+}
+
+} // namespace
+
+void PairTriangles(const std::vector<BvhTriangle>& triangles, std::vector<BvhQuad>& quads)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+	// Partner of each triangle, and first corner of the edge they share
+	std::vector<uint32_t> partners(triangleCount, kNoQuadTriangle);
+	std::vector<uint8_t> sharedEdges(triangleCount, 0);
+	// Edges of the triangles without a partner yet, as 3 * triangle + corner.
+	// A partner runs along the shared edge in the opposite direction
+	std::unordered_map<DirectedEdge, uint32_t, DirectedEdgeHash> openEdges;
+	openEdges.reserve(3 * size_t(triangleCount));
+
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const BvhTriangle& triangle = triangles[i];
+		glm::vec3 corners[3];
+		GetCorners(triangle, corners);
+		for (uint32_t e = 0; e < 3 && partners[i] == kNoQuadTriangle; e++)
+		{
+			const auto found = openEdges.find({corners[(e + 1) % 3], corners[e], triangle.geometryIndex});
+			if (found == openEdges.end())
+				continue;
+			const uint32_t j = found->second / 3;
+			if (!ArePairable(triangles[j], triangle))
+				continue;
+			partners[i] = j;
+			partners[j] = i;
+			sharedEdges[i] = static_cast<uint8_t>(e);
+			sharedEdges[j] = static_cast<uint8_t>(found->second % 3);
+			glm::vec3 partnerCorners[3];
+			GetCorners(triangles[j], partnerCorners);
+			for (uint32_t f = 0; f < 3; f++)
+			{
+				const auto edge =
+				    openEdges.find({partnerCorners[f], partnerCorners[(f + 1) % 3], triangle.geometryIndex});
+				if (edge != openEdges.end() && edge->second == 3 * j + f)
+					openEdges.erase(edge);
+			}
+		}
+		if (partners[i] != kNoQuadTriangle)
+			continue;
+		for (uint32_t e = 0; e < 3; e++)
+		{
+			openEdges.emplace(DirectedEdge{corners[e], corners[(e + 1) % 3], triangle.geometryIndex}, 3 * i + e);
+		}
+	}
+
+	const size_t pairedCount = triangleCount - std::count(partners.begin(), partners.end(), kNoQuadTriangle);
+	quads.clear();
+	quads.reserve(triangleCount - pairedCount / 2);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const uint32_t partner = partners[i];
+		if (partner < i)
+			continue;
+		// The first triangle starts at the corner opposite the shared edge, and
+		// the second triangle too, so that the edge is the diagonal v1-v3
+		const BvhTriangle& triangle = triangles[i];
+		glm::vec3 corners[3];
+		GetCorners(triangle, corners);
+		const uint32_t rotation = partner == kNoQuadTriangle ? 0 : (sharedEdges[i] + 2) % 3;
+		BvhQuad quad;
+		quad.v0 = corners[rotation];
+		quad.v1 = corners[(rotation + 1) % 3];
+		quad.v3 = corners[(rotation + 2) % 3];
+		quad.primitiveIndex[0] = triangle.primitiveIndex;
+		quad.geometryIndex = triangle.geometryIndex;
+		quad.rotation[0] = static_cast<uint8_t>(rotation);
+		if (partner == kNoQuadTriangle)
+		{
+			quad.v2 = quad.v1;
+			quad.primitiveIndex[1] = kNoQuadTriangle;
+			quad.rotation[1] = 0;
+			quad.parallelogram = false;
+		}
+		else
+		{
+			glm::vec3 partnerCorners[3];
+			GetCorners(triangles[partner], partnerCorners);
+			const uint32_t partnerRotation = (sharedEdges[partner] + 2) % 3;
+			quad.v2 = partnerCorners[partnerRotation];
+			quad.primitiveIndex[1] = triangles[partner].primitiveIndex;
+			quad.rotation[1] = static_cast<uint8_t>(partnerRotation);
+			// Sums of 2 floats are exact in double precision
+			quad.parallelogram =
+			    glm::dvec3(quad.v0) + glm::dvec3(quad.v2) == glm::dvec3(quad.v1) + glm::dvec3(quad.v3);
+		}
+		quads.push_back(quad);
+	}
+}
+
+void UnpairQuads(const std::vector<BvhQuad>& quads, std::vector<BvhTriangle>& triangles)
+{
+	for (const BvhQuad& quad : quads)
+	{
+		for (uint32_t which = 0; which < 2; which++)
+		{
+			if (quad.primitiveIndex[which] == kNoQuadTriangle)
+				continue;
+			glm::vec3 tested[3];
+			GetQuadTriangle(quad, which, tested[0], tested[1], tested[2]);
+			const uint32_t rotation = quad.rotation[which];
+			BvhTriangle triangle;
+			triangle.v0 = tested[(3 - rotation) % 3];
+			triangle.v1 = tested[(4 - rotation) % 3];
+			triangle.v2 = tested[(5 - rotation) % 3];
+			triangle.primitiveIndex = quad.primitiveIndex[which];
+			triangle.geometryIndex = quad.geometryIndex;
+			triangles.push_back(triangle);
+		}
+	}
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,98 @@
+#pragma once
+
+// Quad leaves for planar meshes. The faces of the cube and of the plane, and
+// every face of the Menger sponges, are quads split into two triangles, which
+// the leaves test one by one. Built with BvhBuildSettings::quadLeaves, a
+// hierarchy pairs the coplanar triangles sharing an edge, with consistent
+// windings, into the BvhQuad primitives of its leaves: half as many leaf
+// primitives, and fewer nodes. A quad whose corners form an exact
+// parallelogram, such as the axis-aligned faces of the sponges, is tested
+// with a single Moller-Trumbore test over the parallelogram, whose
+// coordinates tell which triangle was hit. Other quads test their two
+// triangles in turn. Either way the hits report the primitive index and the
+// barycentrics of the input triangle.
+
+#include "Bvh.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Pair the coplanar triangles of a geometry that share an edge, greedily in
+/// input order, and replace quads with the pairs and the triangles left
+/// alone, in the order of their first triangle. Degenerate triangles and
+/// neighbours of opposite windings stay alone
+void PairTriangles(const std::vector<BvhTriangle>& triangles, std::vector<BvhQuad>& quads);
+
+/// Append the triangles of quads, with the corners in input order
+void UnpairQuads(const std::vector<BvhQuad>& quads, std::vector<BvhTriangle>& triangles);
+
+/// Corners of a triangle of a quad, in the order tested by the leaves
+inline void GetQuadTriangle(const BvhQuad& quad, uint32_t which, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2)
+{
+	v0 = which == 0 ? quad.v0 : quad.v2;
+	v1 = which == 0 ? quad.v1 : quad.v3;
+	v2 = which == 0 ? quad.v3 : quad.v1;
+}
+
+/// Closest hit of a ray with the triangles of a quad in ]tMin, tMax[. Returns
+/// the triangle hit (0 or 1), or -1, with the barycentrics of the input
+/// triangle. Hits of the first triangle of a parallelogram are exactly those
+/// of IntersectTriangle
+inline int IntersectQuad(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax,
+                         const BvhQuad& quad, float& t, Attributes& attrib)
+{
+	int which = -1;
+	glm::vec3 weights;
+	if (quad.parallelogram)
+	{
+		// IntersectTriangle over (v0, v1, v3), with the bounds of the
+		// parallelogram: beyond the diagonal, the hit is in (v2, v3, v1)
+		const glm::vec3 e1 = quad.v1 - quad.v0;
+		const glm::vec3 e2 = quad.v3 - quad.v0;
+		const glm::vec3 p = glm::cross(direction, e2);
+		const float det = glm::dot(e1, p);
+		if (det == 0.f)
+			return -1;
+		const float invDet = 1.f / det;
+		const glm::vec3 s = origin - quad.v0;
+		const float u = glm::dot(s, p) * invDet;
+		if (u < 0.f || u > 1.f)
+			return -1;
+		const glm::vec3 q = glm::cross(s, e1);
+		const float v = glm::dot(direction, q) * invDet;
+		if (v < 0.f || v > 1.f)
+			return -1;
+		const float d = glm::dot(e2, q) * invDet;
+		if (d <= tMin || d >= tMax)
+			return -1;
+		t = d;
+		which = u + v <= 1.f ? 0 : 1;
+		weights = which == 0 ? glm::vec3(1.f - u - v, u, v) : glm::vec3(u + v - 1.f, 1.f - u, 1.f - v);
+	}
+	else
+	{
+		Attributes triangleAttrib;
+		if (IntersectTriangle(origin, direction, tMin, tMax, quad.v0, quad.v1, quad.v3, t, triangleAttrib))
+		{
+			which = 0;
+			tMax = t;
+			weights = glm::vec3(1.f - triangleAttrib.bary.x - triangleAttrib.bary.y, triangleAttrib.bary);
+		}
+		if (quad.primitiveIndex[1] != kNoQuadTriangle &&
+		    IntersectTriangle(origin, direction, tMin, tMax, quad.v2, quad.v3, quad.v1, t, triangleAttrib))
+		{
+			which = 1;
+			weights = glm::vec3(1.f - triangleAttrib.bary.x - triangleAttrib.bary.y, triangleAttrib.bary);
+		}
+		if (which < 0)
+			return -1;
+	}
+	// Input corner c is corner (c - rotation) of the tested triangle
+	const uint32_t rotation = quad.rotation[which];
+	attrib.bary = glm::vec2(weights[(4 - rotation) % 3], weights[(5 - rotation) % 3]);
+	return which;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,129 @@
+#pragma once
+
+// Least significant digit radix sort of key/value pairs, used to order rays
+// and primitives by Morton code.
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Sort the pairs by increasing key, stable for equal keys. Only the low
+/// keyBits bits of the keys are compared, 8 bits per pass
+template <typename Key>
+void RadixSortPairs(std::vector<Key>& keys, std::vector<uint32_t>& values, uint32_t keyBits = sizeof(Key) * 8)
+{
+	const size_t count = keys.size();
+	std::vector<Key> keysTemp(count);
+	std::vector<uint32_t> valuesTemp(count);
+
+	for (uint32_t shift = 0; shift < keyBits; shift += 8)
+	{
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			offsets[(keys[i] >> shift) & 0xFF]++;
+		}
+		// Skip the passes where all the keys share the digit
+		if (offsets[(keys.empty() ? 0 : keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t sum = 0;
+		for (size_t& offset : offsets)
+		{
+			const size_t digitCount = offset;
+			offset = sum;
+			sum += digitCount;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			const size_t destination = offsets[(keys[i] >> shift) & 0xFF]++;
+			keysTemp[destination] = keys[i];
+			valuesTemp[destination] = values[i];
+		}
+		keys.swap(keysTemp);
+		values.swap(valuesTemp);
+	}
+}
+
+/// Parallel version of RadixSortPairs, with the same result. Each pass counts
+/// the digits of contiguous chunks of the pairs in parallel, then scatters the
+/// chunks in parallel at the offsets given by the prefix sum of the counts,
+/// which keeps the sort stable
+template <typename Key>
+void ParallelRadixSortPairs(std::vector<Key>& keys, std::vector<uint32_t>& values, uint32_t keyBits = sizeof(Key) * 8,
+                            uint32_t threadCount = 0)
+{
+	static const uint32_t kMinChunkSize = 1 << 16;
+	const uint32_t count = static_cast<uint32_t>(keys.size());
+	if (threadCount == 0)
+		threadCount = GetDefaultThreadCount();
+	const uint32_t chunkCount = std::min(4 * threadCount, count / kMinChunkSize);
+	if (chunkCount <= 1)
+	{
+		RadixSortPairs(keys, values, keyBits);
+		return;
+	}
+	const uint32_t chunkSize = (count - 1) / chunkCount + 1;
+
+	std::vector<Key> keysTemp(count);
+	std::vector<uint32_t> valuesTemp(count);
+	std::vector<uint32_t> offsets(size_t(chunkCount) * 256);
+
+	for (uint32_t shift = 0; shift < keyBits; shift += 8)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0u);
+		ParallelFor(chunkCount, 1,
+		            [&](uint32_t firstChunk, uint32_t) {
+			            uint32_t* chunkOffsets = &offsets[size_t(firstChunk) * 256];
+			            const uint32_t end = std::min(count, (firstChunk + 1) * chunkSize);
+			            for (uint32_t i = firstChunk * chunkSize; i < end; i++)
+			            {
+				            chunkOffsets[(keys[i] >> shift) & 0xFF]++;
+			            }
+		            },
+		            threadCount);
+
+		// Digit-major prefix sum, so that the pairs of a digit keep the order
+		// of their chunks
+		const uint32_t firstDigit = (keys[0] >> shift) & 0xFF;
+		uint32_t firstDigitCount = 0;
+		uint32_t sum = 0;
+		for (uint32_t digit = 0; digit < 256; digit++)
+		{
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t& offset = offsets[size_t(chunk) * 256 + digit];
+				const uint32_t digitCount = offset;
+				if (digit == firstDigit)
+					firstDigitCount += digitCount;
+				offset = sum;
+				sum += digitCount;
+			}
+		}
+		// Skip the passes where all the keys share the digit
+		if (firstDigitCount == count)
+			continue;
+
+		ParallelFor(chunkCount, 1,
+		            [&](uint32_t firstChunk, uint32_t) {
+			            uint32_t* chunkOffsets = &offsets[size_t(firstChunk) * 256];
+			            const uint32_t end = std::min(count, (firstChunk + 1) * chunkSize);
+			            for (uint32_t i = firstChunk * chunkSize; i < end; i++)
+			            {
+				            const uint32_t destination = chunkOffsets[(keys[i] >> shift) & 0xFF]++;
+				            keysTemp[destination] = keys[i];
+				            valuesTemp[destination] = values[i];
+			            }
+		            },
+		            threadCount);
+		keys.swap(keysTemp);
+		values.swap(valuesTemp);
+	}
+}
+
+} // namespace cpu_rt
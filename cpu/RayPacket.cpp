@@ -0,0 +1,299 @@
+#include "RayPacket.h"
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Rays of a packet expressed in the space of one level of the hierarchy:
+/// world space for the top level, object space for the bottom levels. The
+/// reciprocal directions are bounded by intervals over the range of rays the
+/// frame was prepared for
+struct PacketFrame
+{
+	glm::vec3 origin;
+	glm::vec3 directions[RayPacket::kMaxSize];
+	glm::vec3 invDirections[RayPacket::kMaxSize];
+	glm::vec3 invMin;
+	glm::vec3 invMax;
+	glm::vec3 meanDirection;
+	/// True if the directions share their sign on every axis, which the
+	/// interval test requires
+	bool coherent;
+
+	void Prepare(uint32_t first, uint32_t last)
+	{
+		invMin = glm::vec3(FLT_MAX);
+		invMax = glm::vec3(-FLT_MAX);
+		meanDirection = glm::vec3(0.f);
+		for (uint32_t i = first; i < last; i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const float d = directions[i][axis];
+				invDirections[i][axis] = 1.f / (std::fabs(d) < 1e-20f ? std::copysign(1e-20f, d) : d);
+			}
+			invMin = glm::min(invMin, invDirections[i]);
+			invMax = glm::max(invMax, invDirections[i]);
+			meanDirection += directions[i];
+		}
+		coherent = true;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			coherent = coherent && (invMin[axis] > 0.f || invMax[axis] < 0.f);
+		}
+	}
+};
+
+bool RayHitsBox(const PacketFrame& frame, const RayPacket& packet, uint32_t i, const BvhNode& node)
+{
+	const glm::vec3 t0 = (node.boundsMin - frame.origin) * frame.invDirections[i];
+	const glm::vec3 t1 = (node.boundsMax - frame.origin) * frame.invDirections[i];
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, packet.tMin));
+	const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, packet.tMax[i]));
+	return tEntry <= tExit;
+}
+
+/// Interval arithmetic test: true if no ray whose reciprocal direction lies in
+/// the intervals of the frame can hit the box before tMax
+bool PacketMissesBox(const PacketFrame& frame, const BvhNode& node, float tMin, float tMax)
+{
+	if (!frame.coherent)
+		return false;
+	float tEntry = tMin, tExit = tMax;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const bool positive = frame.invMin[axis] > 0.f;
+		const float nearOffset = (positive ? node.boundsMin[axis] : node.boundsMax[axis]) - frame.origin[axis];
+		const float farOffset = (positive ? node.boundsMax[axis] : node.boundsMin[axis]) - frame.origin[axis];
+		tEntry = std::max(tEntry, std::min(nearOffset * frame.invMin[axis], nearOffset * frame.invMax[axis]));
+		tExit = std::min(tExit, std::max(farOffset * frame.invMin[axis], farOffset * frame.invMax[axis]));
+	}
+	return tEntry > tExit;
+}
+
+float MaxDistance(const RayPacket& packet)
+{
+	float tMax = packet.tMin;
+	for (uint32_t i = 0; i < packet.size; i++)
+	{
+		tMax = std::max(tMax, packet.tMax[i]);
+	}
+	return tMax;
+}
+
+void RecordHit(RayPacket& packet, uint32_t i, const TriangleHit& hit, const TopLevelBvh& topLevel,
+               uint32_t instanceIndex)
+{
+	packet.tMax[i] = hit.t;
+	packet.found[i] = true;
+	packet.hits[i] = {hit.t, hit.attrib, hit.primitiveIndex, topLevel.GetHitInstance(instanceIndex, hit.geometryIndex)};
+}
+
+/// Ranged traversal of a binary hierarchy by the rays [first, last) of a
+/// packet. Each node narrows the range to the first and last rays that hit its
+/// box, and is skipped if the first ray misses it and the interval test rejects
+/// the whole range. Leaves are handed to visitLeaf(node, first, last), and
+/// ranges of at most fallbackThreshold rays to fallBack(nodeIndex, first, last)
+template <typename LeafVisitor, typename Fallback>
+void TraversePacket(const ArrayView<BvhNode>& nodes, const PacketFrame& frame, RayPacket& packet, uint32_t first,
+                    uint32_t last, uint32_t fallbackThreshold, PacketStats& stats, LeafVisitor&& visitLeaf,
+                    Fallback&& fallBack)
+{
+	struct StackEntry
+	{
+		uint32_t nodeIndex;
+		uint32_t first;
+		uint32_t last;
+	};
+	StackEntry stack[kBvhMaxDepth + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = {0, first, last};
+	float tMax = MaxDistance(packet);
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		const BvhNode& node = nodes[entry.nodeIndex];
+
+		if (!RayHitsBox(frame, packet, entry.first, node))
+		{
+			if (PacketMissesBox(frame, node, packet.tMin, tMax))
+			{
+				stats.culledNodes++;
+				continue;
+			}
+			while (entry.first < entry.last && !RayHitsBox(frame, packet, entry.first, node))
+			{
+				entry.first++;
+			}
+			if (entry.first == entry.last)
+			{
+				stats.culledNodes++;
+				continue;
+			}
+		}
+		while (entry.last - 1 > entry.first && !RayHitsBox(frame, packet, entry.last - 1, node))
+		{
+			entry.last--;
+		}
+		stats.nodeVisits++;
+
+		if (entry.last - entry.first <= fallbackThreshold)
+		{
+			stats.singleRayFallbacks += entry.last - entry.first;
+			fallBack(entry.nodeIndex, entry.first, entry.last);
+			tMax = MaxDistance(packet);
+			continue;
+		}
+		if (node.IsLeaf())
+		{
+			if (visitLeaf(node, entry.first, entry.last))
+				tMax = MaxDistance(packet);
+			continue;
+		}
+
+		// Push the far child first, as seen along the mean direction
+		const BvhNode& left = nodes[node.leftOrFirst];
+		const BvhNode& right = nodes[node.leftOrFirst + 1];
+		const glm::vec3 separation = (right.boundsMin + right.boundsMax) - (left.boundsMin + left.boundsMax);
+		const bool leftFirst = glm::dot(separation, frame.meanDirection) >= 0.f;
+		stack[stackSize++] = {node.leftOrFirst + (leftFirst ? 1 : 0), entry.first, entry.last};
+		stack[stackSize++] = {node.leftOrFirst + (leftFirst ? 0 : 1), entry.first, entry.last};
+	}
+}
+
+} // namespace
+
+void IntersectPacket(const Scene& scene, RayPacket& packet, const PacketSettings& settings, PacketStats* stats)
+{
+	PacketStats localStats;
+	PacketStats& s = stats ? *stats : localStats;
+	s.packetCount++;
+
+	for (uint32_t i = 0; i < packet.size; i++)
+	{
+		packet.found[i] = false;
+	}
+	const TopLevelBvh& topLevel = scene.GetTopLevel();
+	if (packet.size == 0 || topLevel.GetNodes().empty())
+		return;
+
+	const std::vector<Bvh>& bottomLevels = scene.GetBottomLevels();
+	const std::vector<uint32_t>& instanceOrder = topLevel.GetInstanceOrder();
+
+	PacketFrame worldFrame;
+	worldFrame.origin = packet.origin;
+	std::copy(packet.directions, packet.directions + packet.size, worldFrame.directions);
+	worldFrame.Prepare(0, packet.size);
+
+	// Object-space frame, reused for each instance
+	PacketFrame objectFrame;
+
+	auto intersectInstance = [&](uint32_t instanceIndex, uint32_t first, uint32_t last) {
+		const Instance& instance = scene.GetInstances()[instanceIndex];
+
+		// As in TopLevelBvh, the directions are not normalized so that the
+		// object-space distances are the world-space ones
+		const glm::mat3 linear(instance.inverseTransform);
+		objectFrame.origin = glm::vec3(instance.inverseTransform * glm::vec4(packet.origin, 1.f));
+		for (uint32_t i = first; i < last; i++)
+		{
+			objectFrame.directions[i] = linear * packet.directions[i];
+		}
+
+		// The rays diverge in the nested transforms of the groups, which are
+		// traced one ray at a time, as are procedural primitives and quads,
+		// which have no triangles for the leaves of the packet traversal
+		if (instance.groupIndex != kNoInstanceGroup || bottomLevels[instance.meshIndex].IsProcedural() ||
+		    bottomLevels[instance.meshIndex].HasQuads())
+		{
+			s.singleRayFallbacks += last - first;
+			for (uint32_t i = first; i < last; i++)
+			{
+				RayDesc ray;
+				ray.Origin = objectFrame.origin;
+				ray.Direction = objectFrame.directions[i];
+				ray.TMin = packet.tMin;
+				ray.TMax = packet.tMax[i];
+				TriangleHit hit;
+				if (IntersectGeometry(instance.meshIndex, instance.groupIndex, ray, bottomLevels, scene.GetGroups(),
+				                      false, &hit, RAY_FLAG_NONE))
+					RecordHit(packet, i, hit, topLevel, instanceIndex);
+			}
+			return;
+		}
+		const Bvh& bottomLevel = bottomLevels[instance.meshIndex];
+		objectFrame.Prepare(first, last);
+
+		auto traceSingle = [&](uint32_t nodeIndex, uint32_t i) {
+			RayDesc ray;
+			ray.Origin = objectFrame.origin;
+			ray.Direction = objectFrame.directions[i];
+			ray.TMin = packet.tMin;
+			ray.TMax = packet.tMax[i];
+			TriangleHit hit;
+			if (bottomLevel.IntersectSubtree(ray, nodeIndex, hit))
+				RecordHit(packet, i, hit, topLevel, instanceIndex);
+		};
+
+		// Directions of mixed signs would make the interval test useless
+		if (!objectFrame.coherent || last - first <= settings.fallbackThreshold)
+		{
+			s.singleRayFallbacks += last - first;
+			for (uint32_t i = first; i < last; i++)
+			{
+				traceSingle(0, i);
+			}
+			return;
+		}
+
+		const ArrayView<BvhTriangle> triangles = bottomLevel.GetTriangles();
+		TraversePacket(
+		    bottomLevel.GetNodes(), objectFrame, packet, first, last, settings.fallbackThreshold, s,
+		    [&](const BvhNode& leaf, uint32_t leafFirst, uint32_t leafLast) {
+			    bool anyHit = false;
+			    for (uint32_t t = leaf.leftOrFirst; t < leaf.leftOrFirst + leaf.count; t++)
+			    {
+				    const BvhTriangle& triangle = triangles[t];
+				    for (uint32_t i = leafFirst; i < leafLast; i++)
+				    {
+					    TriangleHit hit;
+					    if (IntersectTriangle(objectFrame.origin, objectFrame.directions[i], packet.tMin, packet.tMax[i],
+					                          triangle.v0, triangle.v1, triangle.v2, hit.t, hit.attrib))
+					    {
+						    hit.primitiveIndex = triangle.primitiveIndex;
+						    hit.geometryIndex = triangle.geometryIndex;
+						    RecordHit(packet, i, hit, topLevel, instanceIndex);
+						    anyHit = true;
+					    }
+				    }
+			    }
+			    return anyHit;
+		    },
+		    [&](uint32_t nodeIndex, uint32_t rangeFirst, uint32_t rangeLast) {
+			    for (uint32_t i = rangeFirst; i < rangeLast; i++)
+			    {
+				    traceSingle(nodeIndex, i);
+			    }
+		    });
+	};
+
+	// The top level is traversed by the whole packet down to the instances,
+	// where the rays are transformed to the object space of each instance
+	auto visitInstances = [&](const BvhNode& leaf, uint32_t first, uint32_t last) {
+		for (uint32_t i = leaf.leftOrFirst; i < leaf.leftOrFirst + leaf.count; i++)
+		{
+			if (scene.GetInstances()[instanceOrder[i]].instanceMask & packet.instanceInclusionMask)
+				intersectInstance(instanceOrder[i], first, last);
+		}
+		return true;
+	};
+	TraversePacket(topLevel.GetNodes(), worldFrame, packet, 0, packet.size, 0, s, visitInstances,
+	               [](uint32_t, uint32_t, uint32_t) {});
+}
+
+} // namespace cpu_rt
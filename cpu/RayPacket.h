@@ -0,0 +1,57 @@
+#pragma once
+
+// Coherent packets of rays sharing an origin, such as the primary rays of a
+// block of pixels, traced together through both levels of the scene. A whole
+// packet skips a node when the interval bounds of its directions prove that
+// no ray can hit the node box, so one box test replaces one per ray. Each node
+// also narrows the range of rays that are still active; when only a few rays
+// remain, or when the directions of the packet do not share their signs, the
+// rays fall back to single-ray traversal.
+
+#include "Scene.h"
+
+namespace cpu_rt
+{
+
+/// Rays sharing an origin and a TMin, stored as structures of arrays
+struct RayPacket
+{
+	static const uint32_t kMaxSize = 256;
+
+	uint32_t size = 0;
+	glm::vec3 origin;
+	float tMin = 0.f;
+	/// Shared by all the rays, which are traced with RAY_FLAG_NONE
+	uint32_t instanceInclusionMask = 0xFF;
+	glm::vec3 directions[kMaxSize];
+	/// Initial TMax of each ray, shortened by the hits during the traversal
+	float tMax[kMaxSize];
+
+	// Closest hit of each ray, valid if found is set
+	bool found[kMaxSize];
+	HitRecord hits[kMaxSize];
+};
+
+struct PacketStats
+{
+	uint64_t packetCount = 0;
+	/// Node visits made by whole packets, and box tests they saved compared to
+	/// visiting the nodes with each active ray
+	uint64_t nodeVisits = 0;
+	uint64_t culledNodes = 0;
+	/// Rays traced on their own below a node, after the packet diverged
+	uint64_t singleRayFallbacks = 0;
+};
+
+struct PacketSettings
+{
+	/// A node range with at most this many active rays continues with
+	/// single-ray traversal
+	uint32_t fallbackThreshold = 4;
+};
+
+/// Find the closest hit of every ray of the packet, as Scene::Intersect would
+void IntersectPacket(const Scene& scene, RayPacket& packet, const PacketSettings& settings = {},
+                     PacketStats* stats = nullptr);
+
+} // namespace cpu_rt
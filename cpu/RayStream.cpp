@@ -0,0 +1,87 @@
+#include "RayStream.h"
+#include "RadixSort.h"
+
+#include <numeric>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+void OcclusionRayStream::Clear()
+{
+	m_rays.clear();
+	m_rayFlags.clear();
+	m_rayMasks.clear();
+	m_occluded.clear();
+	m_hits.clear();
+	m_cursor = 0;
+	m_traced = false;
+}
+
+void OcclusionRayStream::Add(const RayDesc& ray, uint32_t rayFlags, uint32_t instanceInclusionMask)
+{
+	m_rays.push_back(ray);
+	m_rayFlags.push_back(rayFlags);
+	m_rayMasks.push_back(static_cast<uint8_t>(instanceInclusionMask));
+}
+
+void OcclusionRayStream::Trace(const Scene& scene, const RayStreamSettings& settings)
+{
+	const uint32_t rayCount = GetSize();
+	m_occluded.assign(rayCount, 0);
+	m_hits.resize(rayCount);
+
+	std::vector<uint32_t> order;
+	if (settings.sort)
+	{
+		order = ComputeCoherentRayOrder(m_rays);
+	}
+	else
+	{
+		order.resize(rayCount);
+		std::iota(order.begin(), order.end(), 0u);
+	}
+
+	for (uint32_t i : order)
+	{
+		m_occluded[i] = scene.Occluded(m_rays[i], &m_hits[i], m_rayFlags[i], m_rayMasks[i]) ? 1 : 0;
+	}
+	m_cursor = 0;
+	m_traced = true;
+}
+
+bool OcclusionRayStream::NextResult(HitRecord& hit)
+{
+	const uint32_t i = m_cursor++;
+	if (i >= m_occluded.size())
+	{
+		throw std::logic_error("More occlusion results requested than rays added to the stream");
+	}
+	hit = m_hits[i];
+	return m_occluded[i] != 0;
+}
+
+std::vector<uint32_t> ComputeCoherentRayOrder(const std::vector<RayDesc>& rays)
+{
+	Aabb bounds;
+	for (const RayDesc& ray : rays)
+	{
+		bounds.Extend(ray.Origin);
+	}
+
+	// 30-bit keys: the octant in the top 3 bits, then a 27-bit Morton code of
+	// the origin (9 bits per axis)
+	std::vector<uint32_t> keys(rays.size());
+	std::vector<uint32_t> order(rays.size());
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		const glm::vec3& d = rays[i].Direction;
+		const uint32_t octant = (d.x < 0.f ? 4u : 0u) | (d.y < 0.f ? 2u : 0u) | (d.z < 0.f ? 1u : 0u);
+		keys[i] = (octant << 27) | (EncodeMorton30(rays[i].Origin, bounds) >> 3);
+		order[i] = static_cast<uint32_t>(i);
+	}
+	RadixSortPairs(keys, order, 30);
+	return order;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,58 @@
+#pragma once
+
+// Deferred occlusion rays. Instead of tracing each shadow ray inline while
+// shading, the rays are collected into a stream, sorted so that rays with
+// nearby origins and the same direction octant are traced one after the
+// other, and traced in one batch with any-hit queries. The results are then
+// read back in the order the rays were added.
+
+#include "Scene.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+struct RayStreamSettings
+{
+	/// Sort the rays by direction octant, then by Morton code of their origin
+	bool sort = true;
+};
+
+class OcclusionRayStream
+{
+public:
+	/// Remove all the rays and results
+	void Clear();
+	/// Append a ray, whose result will be the next one read after Trace
+	void Add(const RayDesc& ray, uint32_t rayFlags = RAY_FLAG_NONE, uint32_t instanceInclusionMask = 0xFF);
+	uint32_t GetSize() const { return static_cast<uint32_t>(m_rays.size()); }
+
+	/// Trace all the rays with any-hit queries, then rewind the results
+	void Trace(const Scene& scene, const RayStreamSettings& settings = {});
+	/// True once the rays are traced and until the stream is cleared
+	bool IsTraced() const { return m_traced; }
+
+	/// Read the result of the next ray in the order of Add. Returns true if the
+	/// ray is occluded, with the first intersection found in hit
+	bool NextResult(HitRecord& hit);
+
+	/// Occlusion of each ray, in the order of Add
+	const std::vector<uint8_t>& GetVisibilityMask() const { return m_occluded; }
+
+private:
+	std::vector<RayDesc> m_rays;
+	/// Flags and inclusion mask of each ray
+	std::vector<uint32_t> m_rayFlags;
+	std::vector<uint8_t> m_rayMasks;
+	std::vector<uint8_t> m_occluded;
+	std::vector<HitRecord> m_hits;
+	uint32_t m_cursor = 0;
+	bool m_traced = false;
+};
+
+/// Order in which a sorted stream traces rays: by direction octant, then by
+/// Morton code of the origin within the bounds of the origins
+std::vector<uint32_t> ComputeCoherentRayOrder(const std::vector<RayDesc>& rays);
+
+} // namespace cpu_rt
@@ -0,0 +1,301 @@
+#include "Renderer.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Interleave the low 16 bits of x and y into a 32-bit Morton code
+uint32_t EncodeMorton2(uint32_t x, uint32_t y)
+{
+	auto expand = [](uint32_t v) {
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FFu;
+		v = (v | (v << 4)) & 0x0F0F0F0Fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	};
+	return (expand(y) << 1) | expand(x);
+}
+
+/// Distance of (x, y) along the Hilbert curve filling a square of the given
+/// power of 2 size
+uint32_t EncodeHilbert(uint32_t size, uint32_t x, uint32_t y)
+{
+	uint32_t d = 0;
+	for (uint32_t s = size / 2; s > 0; s /= 2)
+	{
+		const uint32_t rx = (x & s) ? 1 : 0;
+		const uint32_t ry = (y & s) ? 1 : 0;
+		d += s * s * ((3 * rx) ^ ry);
+		// Rotate the quadrant so that the curve below it starts and ends on the
+		// right sides
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = size - 1 - x;
+				y = size - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+} // namespace
+
+TileOrder ParseTileOrder(const std::string& name)
+{
+	for (TileOrder order : {TileOrder::Scanline, TileOrder::Morton, TileOrder::Hilbert})
+	{
+		if (name == GetTileOrderName(order))
+			return order;
+	}
+	throw std::runtime_error("Unknown tile order " + name + ", expected scanline, morton or hilbert");
+}
+
+const char* GetTileOrderName(TileOrder order)
+{
+	switch (order)
+	{
+	case TileOrder::Morton:
+		return "morton";
+	case TileOrder::Hilbert:
+		return "hilbert";
+	default:
+		return "scanline";
+	}
+}
+
+std::vector<uint32_t> ComputeTileOrder(uint32_t tilesX, uint32_t tilesY, TileOrder order)
+{
+	std::vector<uint32_t> tiles(size_t(tilesX) * tilesY);
+	std::iota(tiles.begin(), tiles.end(), 0u);
+	if (order == TileOrder::Scanline)
+		return tiles;
+
+	// The curves fill the smallest power of 2 square containing the grid, and
+	// skip its cells outside the grid
+	uint32_t size = 1;
+	while (size < std::max(tilesX, tilesY))
+	{
+		size *= 2;
+	}
+	std::vector<uint32_t> keys(tiles.size());
+	for (uint32_t tile = 0; tile < tiles.size(); tile++)
+	{
+		const uint32_t x = tile % tilesX, y = tile / tilesX;
+		keys[tile] = order == TileOrder::Morton ? EncodeMorton2(x, y) : EncodeHilbert(size, x, y);
+	}
+	std::sort(tiles.begin(), tiles.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+	return tiles;
+}
+
+Image::Image(uint32_t width, uint32_t height) : m_width(width), m_height(height), m_pixels(size_t(width) * height, 0)
+{
+}
+
+void Image::WritePpm(const std::string& fileName) const
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.good())
+	{
+		throw std::runtime_error("Cannot open output image " + fileName);
+	}
+	file << "P6\n" << m_width << " " << m_height << "\n255\n";
+
+	std::vector<char> row(size_t(m_width) * 3);
+	for (uint32_t y = 0; y < m_height; y++)
+	{
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			const uint32_t pixel = m_pixels[size_t(y) * m_width + x];
+			row[3 * x + 0] = static_cast<char>(pixel & 0xFF);
+			row[3 * x + 1] = static_cast<char>((pixel >> 8) & 0xFF);
+			row[3 * x + 2] = static_cast<char>((pixel >> 16) & 0xFF);
+		}
+		file.write(row.data(), row.size());
+	}
+}
+
+DispatchStats DispatchRays(const Pipeline& pipeline, const Scene& scene, const Camera& camera, Image& output,
+                           const DispatchSettings& settings)
+{
+	const uint32_t width = output.GetWidth();
+	const uint32_t height = output.GetHeight();
+	const uint32_t tileSize = std::max(settings.tileSize, 1u);
+	const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+	const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+	const uint32_t tileCount = tilesX * tilesY;
+	const std::vector<uint32_t> tileOrder = ComputeTileOrder(tilesX, tilesY, settings.tileOrder);
+
+	TaskScheduler& scheduler = TaskScheduler::Get(settings.threadCount);
+	const uint32_t threadCount = std::min(scheduler.GetThreadCount(), tileCount);
+
+	const uint32_t packetSize = pipeline.primaryRay ? std::min(settings.packetSize, 16u) : 0;
+	static_assert(16 * 16 <= RayPacket::kMaxSize, "Packets of 16x16 rays must fit in a RayPacket");
+
+	std::atomic<uint32_t> nextTile(0);
+	std::vector<uint64_t> rayCounts(threadCount, 0);
+	std::vector<PacketStats> packetStats(threadCount);
+
+	auto worker = [&](uint32_t threadIndex) {
+		uint64_t rayCount = 0;
+		ShaderContext context = {};
+		context.pipeline = &pipeline;
+		context.scene = &scene;
+		context.camera = &camera;
+		context.gOutput = output.GetData();
+		context.DispatchRaysDimensions = glm::uvec2(width, height);
+		context.rayCount = &rayCount;
+
+		std::unique_ptr<RayPacket> packet(packetSize > 0 ? new RayPacket() : nullptr);
+		OcclusionRayStream deferredRays;
+		// Primary hits of the pixels of the current tile, when traced ahead of
+		// the ray generation shaders
+		std::vector<PrimaryHit> tileHits(size_t(tileSize) * tileSize);
+
+		// Trace the primary rays of a block of pixels as a packet. Blocks whose
+		// rays do not share an origin are traced one ray at a time
+		auto traceBlock = [&](uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t tileX, uint32_t tileY,
+		                      uint32_t tileWidth) {
+			packet->size = 0;
+			bool sharedOrigin = true;
+			for (uint32_t y = y0; y < y1; y++)
+			{
+				for (uint32_t x = x0; x < x1; x++)
+				{
+					const RayDesc ray = pipeline.primaryRay(camera, glm::uvec2(x, y), context.DispatchRaysDimensions);
+					if (packet->size == 0)
+					{
+						packet->origin = ray.Origin;
+						packet->tMin = ray.TMin;
+					}
+					sharedOrigin = sharedOrigin && ray.Origin == packet->origin && ray.TMin == packet->tMin;
+					packet->directions[packet->size] = ray.Direction;
+					packet->tMax[packet->size] = ray.TMax;
+					packet->size++;
+				}
+			}
+			if (sharedOrigin)
+			{
+				IntersectPacket(scene, *packet, settings.packet, &packetStats[threadIndex]);
+			}
+			rayCount += packet->size;
+
+			uint32_t i = 0;
+			for (uint32_t y = y0; y < y1; y++)
+			{
+				for (uint32_t x = x0; x < x1; x++, i++)
+				{
+					PrimaryHit& primaryHit = tileHits[(y - tileY) * tileWidth + (x - tileX)];
+					if (sharedOrigin)
+					{
+						primaryHit = {packet->found[i], packet->hits[i]};
+						continue;
+					}
+					RayDesc ray = pipeline.primaryRay(camera, glm::uvec2(x, y), context.DispatchRaysDimensions);
+					primaryHit.found = scene.Intersect(ray, primaryHit.hit);
+				}
+			}
+		};
+
+		// Invoke the ray generation shader of each pixel of a tile, optionally
+		// with the primary hits traced ahead, or recording them
+		auto invokeRayGen = [&](uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, bool usePrimaryHits,
+		                        bool recordPrimaryHits) {
+			for (uint32_t y = y0; y < y1; y++)
+			{
+				for (uint32_t x = x0; x < x1; x++)
+				{
+					PrimaryHit* primaryHit = &tileHits[(y - y0) * (x1 - x0) + (x - x0)];
+					context.DispatchRaysIndex = glm::uvec2(x, y);
+					context.primaryHit = usePrimaryHits ? primaryHit : nullptr;
+					context.recordedPrimaryHit = recordPrimaryHits ? primaryHit : nullptr;
+					pipeline.rayGen(context);
+				}
+			}
+			context.primaryHit = nullptr;
+			context.recordedPrimaryHit = nullptr;
+		};
+
+		for (uint32_t i = nextTile++; i < tileCount; i = nextTile++)
+		{
+			const uint32_t tile = tileOrder[i];
+			const uint32_t x0 = (tile % tilesX) * tileSize;
+			const uint32_t y0 = (tile / tilesX) * tileSize;
+			const uint32_t x1 = std::min(x0 + tileSize, width);
+			const uint32_t y1 = std::min(y0 + tileSize, height);
+
+			bool primaryHitsTraced = false;
+			if (packetSize > 0)
+			{
+				for (uint32_t y = y0; y < y1; y += packetSize)
+				{
+					for (uint32_t x = x0; x < x1; x += packetSize)
+					{
+						traceBlock(x, y, std::min(x + packetSize, x1), std::min(y + packetSize, y1), x0, y0, x1 - x0);
+					}
+				}
+				primaryHitsTraced = true;
+			}
+
+			if (!settings.deferOcclusionRays || pipeline.occlusionRayTypes.empty())
+			{
+				invokeRayGen(x0, y0, x1, y1, primaryHitsTraced, false);
+				continue;
+			}
+
+			// Shade the tile twice: the first pass collects the occlusion rays
+			// (and records the primary hits if needed), which are then traced
+			// together, and the second pass shades with their results
+			deferredRays.Clear();
+			context.deferredRays = &deferredRays;
+			invokeRayGen(x0, y0, x1, y1, primaryHitsTraced, !primaryHitsTraced);
+			deferredRays.Trace(scene, settings.rayStream);
+			rayCount += deferredRays.GetSize();
+			invokeRayGen(x0, y0, x1, y1, true, false);
+			context.deferredRays = nullptr;
+		}
+		rayCounts[threadIndex] = rayCount;
+	};
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	{
+		TaskGroup group(scheduler);
+		for (uint32_t i = 1; i < threadCount; i++)
+		{
+			group.Run([&worker, i]() { worker(i); });
+		}
+		// The calling thread takes its share of the tiles
+		worker(0);
+		group.Wait();
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	DispatchStats stats;
+	stats.seconds = std::chrono::duration<double>(end - start).count();
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		stats.rayCount += rayCounts[i];
+		stats.packets.packetCount += packetStats[i].packetCount;
+		stats.packets.nodeVisits += packetStats[i].nodeVisits;
+		stats.packets.culledNodes += packetStats[i].culledNodes;
+		stats.packets.singleRayFallbacks += packetStats[i].singleRayFallbacks;
+	}
+	return stats;
+}
+
+} // namespace cpu_rt
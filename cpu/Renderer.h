@@ -0,0 +1,97 @@
+#pragma once
+
+// Multithreaded CPU equivalent of ID3D12GraphicsCommandList4::DispatchRays:
+// the launch grid is split into square tiles that tasks of the shared
+// scheduler (see Parallel.h) pull from a shared counter, each pixel invoking
+// the ray generation shader once. The tiles are issued along a space-filling
+// curve, so that the tiles traced at about the same time are close on screen
+// and reuse the same parts of the scene from the caches, while pulling them
+// one at a time balances the cost of the sponge against the sky.
+// Optionally, the primary rays of square blocks of pixels are traced ahead as
+// packets, and the ray generation shaders receive their results. The
+// occlusion rays of a tile can also be deferred, sorted and traced together
+// between two shading passes.
+
+#include "RayPacket.h"
+#include "Shaders.h"
+
+#include <string>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// RGBA8 image, the CPU counterpart of the raytracing output texture
+class Image
+{
+public:
+	Image(uint32_t width, uint32_t height);
+
+	uint32_t GetWidth() const { return m_width; }
+	uint32_t GetHeight() const { return m_height; }
+	uint32_t* GetData() { return m_pixels.data(); }
+	const uint32_t* GetData() const { return m_pixels.data(); }
+
+	/// Write the image as a binary PPM file, dropping the alpha channel
+	void WritePpm(const std::string& fileName) const;
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	std::vector<uint32_t> m_pixels;
+};
+
+/// Order in which the tiles of a dispatch are issued
+enum class TileOrder
+{
+	/// Row by row
+	Scanline,
+	/// Z-order curve over the tile grid
+	Morton,
+	/// Hilbert curve over the tile grid: consecutive tiles are always adjacent
+	Hilbert,
+};
+
+/// Parse "scanline", "morton" or "hilbert"
+TileOrder ParseTileOrder(const std::string& name);
+const char* GetTileOrderName(TileOrder order);
+
+/// Tile indices (y * tilesX + x) of a grid of tiles, in the given order
+std::vector<uint32_t> ComputeTileOrder(uint32_t tilesX, uint32_t tilesY, TileOrder order);
+
+struct DispatchSettings
+{
+	/// Width and height of the tiles, in pixels
+	uint32_t tileSize = 32;
+	TileOrder tileOrder = TileOrder::Hilbert;
+	/// Number of threads of the task scheduler, 0 to use all the hardware
+	/// threads
+	uint32_t threadCount = 0;
+	/// Width and height of the primary ray packets (8 or 16), 0 to trace the
+	/// primary rays one by one. Requires Pipeline::primaryRay
+	uint32_t packetSize = 0;
+	PacketSettings packet;
+	/// Defer the occlusion rays of Pipeline::occlusionRayTypes and trace them
+	/// as one stream per tile
+	bool deferOcclusionRays = false;
+	RayStreamSettings rayStream;
+};
+
+struct DispatchStats
+{
+	/// Total number of rays traced, primary and secondary
+	uint64_t rayCount = 0;
+	/// Wall-clock duration of the dispatch
+	double seconds = 0.0;
+	/// Packet traversal statistics, when packets are enabled
+	PacketStats packets;
+
+	double RaysPerSecond() const { return seconds > 0.0 ? rayCount / seconds : 0.0; }
+};
+
+/// Invoke the ray generation shader of the pipeline for each pixel of the
+/// output image, and wait for completion
+DispatchStats DispatchRays(const Pipeline& pipeline, const Scene& scene, const Camera& camera, Image& output,
+                           const DispatchSettings& settings = {});
+
+} // namespace cpu_rt
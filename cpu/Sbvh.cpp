@@ -0,0 +1,460 @@
+#include "Sbvh.h"
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Part of a triangle referenced by a node, with the bounds of that part
+struct Reference
+{
+	Aabb bounds;
+	uint32_t primitive;
+};
+
+struct SbvhTask
+{
+	uint32_t nodeIndex;
+	uint32_t depth;
+	Aabb bounds;
+	std::vector<Reference> references;
+};
+
+struct ObjectBin
+{
+	Aabb bounds;
+	uint32_t count = 0;
+};
+
+/// Spatial bins count the references starting and ending in them, and bound
+/// the parts of the references they contain
+struct SpatialBin
+{
+	Aabb bounds;
+	uint32_t entries = 0;
+	uint32_t exits = 0;
+};
+
+/// Best split of a node along one of its axes, with the bounds and counts of
+/// both sides. Spatial splits cut at the plane after bin, object splits
+/// separate the centroids up to bin from the others
+struct Split
+{
+	float cost = FLT_MAX;
+	int axis = -1;
+	uint32_t bin = 0;
+	Aabb leftBounds;
+	Aabb rightBounds;
+	uint32_t leftCount = 0;
+	uint32_t rightCount = 0;
+};
+
+Aabb Intersection(const Aabb& a, const Aabb& b)
+{
+	Aabb result;
+	result.min = glm::max(a.min, b.min);
+	result.max = glm::min(a.max, b.max);
+	return result;
+}
+
+/// Uniform bins over an interval of one axis
+struct BinGrid
+{
+	glm::vec3 origin;
+	glm::vec3 extent;
+	glm::vec3 scale;
+	uint32_t binCount;
+
+	BinGrid(const Aabb& bounds, uint32_t count) : origin(bounds.min), extent(bounds.Extent()), binCount(count)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			scale[axis] = extent[axis] > 0.f ? binCount / extent[axis] : 0.f;
+		}
+	}
+	uint32_t Bin(float x, int axis) const
+	{
+		const float bin = (x - origin[axis]) * scale[axis];
+		return bin <= 0.f ? 0 : std::min(binCount - 1, static_cast<uint32_t>(bin));
+	}
+	/// Position of the plane between bin and bin + 1
+	float Plane(uint32_t bin, int axis) const { return origin[axis] + extent[axis] * (bin + 1) / binCount; }
+};
+
+class SbvhBuilder
+{
+public:
+	SbvhBuilder(const std::vector<BvhTriangle>& triangles, const BvhBuildSettings& settings)
+	    : m_triangles(triangles), m_settings(settings), m_binCount(std::max(settings.binCount, 2u)),
+	      m_maxLeafSize(std::max(settings.maxLeafSize, 1u)), m_leafBlockSize(std::max(settings.leafBlockSize, 1u)),
+	      m_maxReferences(static_cast<size_t>(triangles.size() * (1.0 + std::max(settings.spatialSplitBudget, 0.f))))
+	{
+	}
+
+	void Build(const std::vector<Aabb>& triangleBounds, std::vector<BvhNode>& nodes, std::vector<uint32_t>& primitiveOrder,
+	           BvhStats& stats);
+
+private:
+	float BlockCount(uint32_t count) const { return static_cast<float>((count + m_leafBlockSize - 1) / m_leafBlockSize); }
+	float SideCost(const Aabb& bounds, uint32_t count) const { return bounds.HalfArea() * BlockCount(count); }
+
+	Split FindObjectSplit(const std::vector<Reference>& references, const BinGrid& grid);
+	Split FindSpatialSplit(const std::vector<Reference>& references, const BinGrid& grid);
+	void PartitionObjects(const std::vector<Reference>& references, const BinGrid& grid, const Split& split,
+	                      SbvhTask& left, SbvhTask& right) const;
+	void PartitionSpace(const std::vector<Reference>& references, const BinGrid& grid, Split split, SbvhTask& left,
+	                    SbvhTask& right) const;
+
+	const std::vector<BvhTriangle>& m_triangles;
+	const BvhBuildSettings& m_settings;
+	const uint32_t m_binCount;
+	const uint32_t m_maxLeafSize;
+	const uint32_t m_leafBlockSize;
+	const size_t m_maxReferences;
+	size_t m_referenceCount = 0;
+
+	std::vector<ObjectBin> m_objectBins;
+	std::vector<SpatialBin> m_spatialBins;
+	std::vector<Aabb> m_rightBounds;
+	std::vector<uint32_t> m_rightCounts;
+};
+
+Split SbvhBuilder::FindObjectSplit(const std::vector<Reference>& references, const BinGrid& grid)
+{
+	Split best;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (grid.extent[axis] <= 0.f)
+			continue;
+		m_objectBins.assign(m_binCount, ObjectBin());
+		for (const Reference& reference : references)
+		{
+			ObjectBin& bin = m_objectBins[grid.Bin(reference.bounds.Center()[axis], axis)];
+			bin.bounds.Extend(reference.bounds);
+			bin.count++;
+		}
+
+		// Sweep from the right to accumulate the right-hand side of each split,
+		// then from the left to evaluate the costs
+		Aabb accumulated;
+		uint32_t accumulatedCount = 0;
+		for (uint32_t b = m_binCount - 1; b > 0; b--)
+		{
+			accumulated.Extend(m_objectBins[b].bounds);
+			accumulatedCount += m_objectBins[b].count;
+			m_rightBounds[b] = accumulated;
+			m_rightCounts[b] = accumulatedCount;
+		}
+		accumulated = Aabb();
+		accumulatedCount = 0;
+		for (uint32_t b = 0; b < m_binCount - 1; b++)
+		{
+			accumulated.Extend(m_objectBins[b].bounds);
+			accumulatedCount += m_objectBins[b].count;
+			if (accumulatedCount == 0 || m_rightCounts[b + 1] == 0)
+				continue;
+			const float cost = SideCost(accumulated, accumulatedCount) + SideCost(m_rightBounds[b + 1], m_rightCounts[b + 1]);
+			if (cost < best.cost)
+			{
+				best = {cost, axis, b, accumulated, m_rightBounds[b + 1], accumulatedCount, m_rightCounts[b + 1]};
+			}
+		}
+	}
+	return best;
+}
+
+Split SbvhBuilder::FindSpatialSplit(const std::vector<Reference>& references, const BinGrid& grid)
+{
+	Split best;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (grid.extent[axis] <= 0.f)
+			continue;
+		m_spatialBins.assign(m_binCount, SpatialBin());
+		for (const Reference& reference : references)
+		{
+			const uint32_t first = grid.Bin(reference.bounds.min[axis], axis);
+			const uint32_t last = grid.Bin(reference.bounds.max[axis], axis);
+			// Clip the reference bin by bin, from its first bin to its last
+			Aabb remaining = reference.bounds;
+			for (uint32_t b = first; b < last; b++)
+			{
+				Aabb left, right;
+				SplitTriangleBounds(m_triangles[reference.primitive], remaining, axis, grid.Plane(b, axis), left, right);
+				m_spatialBins[b].bounds.Extend(left);
+				remaining = right;
+			}
+			m_spatialBins[last].bounds.Extend(remaining);
+			m_spatialBins[first].entries++;
+			m_spatialBins[last].exits++;
+		}
+
+		Aabb accumulated;
+		uint32_t accumulatedCount = 0;
+		for (uint32_t b = m_binCount - 1; b > 0; b--)
+		{
+			accumulated.Extend(m_spatialBins[b].bounds);
+			accumulatedCount += m_spatialBins[b].exits;
+			m_rightBounds[b] = accumulated;
+			m_rightCounts[b] = accumulatedCount;
+		}
+		accumulated = Aabb();
+		accumulatedCount = 0;
+		for (uint32_t b = 0; b < m_binCount - 1; b++)
+		{
+			accumulated.Extend(m_spatialBins[b].bounds);
+			accumulatedCount += m_spatialBins[b].entries;
+			if (accumulatedCount == 0 || m_rightCounts[b + 1] == 0)
+				continue;
+			const float cost = SideCost(accumulated, accumulatedCount) + SideCost(m_rightBounds[b + 1], m_rightCounts[b + 1]);
+			if (cost < best.cost)
+			{
+				best = {cost, axis, b, accumulated, m_rightBounds[b + 1], accumulatedCount, m_rightCounts[b + 1]};
+			}
+		}
+	}
+	return best;
+}
+
+void SbvhBuilder::PartitionObjects(const std::vector<Reference>& references, const BinGrid& grid, const Split& split,
+                                   SbvhTask& left, SbvhTask& right) const
+{
+	left.references.reserve(split.leftCount);
+	right.references.reserve(split.rightCount);
+	for (const Reference& reference : references)
+	{
+		SbvhTask& side = grid.Bin(reference.bounds.Center()[split.axis], split.axis) <= split.bin ? left : right;
+		side.references.push_back(reference);
+		side.bounds.Extend(reference.bounds);
+	}
+}
+
+void SbvhBuilder::PartitionSpace(const std::vector<Reference>& references, const BinGrid& grid, Split split,
+                                 SbvhTask& left, SbvhTask& right) const
+{
+	const int axis = split.axis;
+	const float position = grid.Plane(split.bin, axis);
+	left.references.reserve(split.leftCount);
+	right.references.reserve(split.rightCount);
+	for (const Reference& reference : references)
+	{
+		const uint32_t first = grid.Bin(reference.bounds.min[axis], axis);
+		const uint32_t last = grid.Bin(reference.bounds.max[axis], axis);
+		if (last <= split.bin)
+		{
+			left.references.push_back(reference);
+			left.bounds.Extend(reference.bounds);
+			continue;
+		}
+		if (first > split.bin)
+		{
+			right.references.push_back(reference);
+			right.bounds.Extend(reference.bounds);
+			continue;
+		}
+
+		// Keep the whole reference on one side when that is cheaper than
+		// referencing it from both
+		Aabb leftWhole = split.leftBounds;
+		leftWhole.Extend(reference.bounds);
+		Aabb rightWhole = split.rightBounds;
+		rightWhole.Extend(reference.bounds);
+		const float splitCost = SideCost(split.leftBounds, split.leftCount) + SideCost(split.rightBounds, split.rightCount);
+		const float leftCost = SideCost(leftWhole, split.leftCount) + SideCost(split.rightBounds, split.rightCount - 1);
+		const float rightCost = SideCost(split.leftBounds, split.leftCount - 1) + SideCost(rightWhole, split.rightCount);
+		if (leftCost < splitCost && leftCost <= rightCost)
+		{
+			left.references.push_back(reference);
+			left.bounds.Extend(reference.bounds);
+			split.leftBounds = leftWhole;
+			split.rightCount--;
+			continue;
+		}
+		if (rightCost < splitCost)
+		{
+			right.references.push_back(reference);
+			right.bounds.Extend(reference.bounds);
+			split.rightBounds = rightWhole;
+			split.leftCount--;
+			continue;
+		}
+
+		Aabb leftPart, rightPart;
+		SplitTriangleBounds(m_triangles[reference.primitive], reference.bounds, axis, position, leftPart, rightPart);
+		// A triangle that only touches the plane has no part on one side
+		if (!leftPart.IsEmpty())
+		{
+			left.references.push_back({leftPart, reference.primitive});
+			left.bounds.Extend(leftPart);
+		}
+		if (!rightPart.IsEmpty())
+		{
+			right.references.push_back({rightPart, reference.primitive});
+			right.bounds.Extend(rightPart);
+		}
+	}
+}
+
+void SbvhBuilder::Build(const std::vector<Aabb>& triangleBounds, std::vector<BvhNode>& nodes,
+                        std::vector<uint32_t>& primitiveOrder, BvhStats& stats)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(m_triangles.size());
+	m_rightBounds.resize(m_binCount);
+	m_rightCounts.resize(m_binCount);
+
+	SbvhTask root = {0, 1, Aabb(), {}};
+	root.references.resize(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		root.references[i] = {triangleBounds[i], i};
+		root.bounds.Extend(triangleBounds[i]);
+	}
+	m_referenceCount = triangleCount;
+	// Spatial splits are only worth their references where the children of
+	// the best object split overlap by a fraction of the whole scene
+	const float minOverlap = std::max(m_settings.spatialSplitOverlap, 0.f) * root.bounds.HalfArea();
+
+	nodes.push_back(BvhNode());
+	primitiveOrder.reserve(m_maxReferences);
+	std::vector<SbvhTask> tasks;
+	tasks.push_back(std::move(root));
+	while (!tasks.empty())
+	{
+		const SbvhTask task = std::move(tasks.back());
+		tasks.pop_back();
+		stats.maxDepth = std::max(stats.maxDepth, task.depth);
+		const uint32_t count = static_cast<uint32_t>(task.references.size());
+
+		Aabb centroidBounds;
+		for (const Reference& reference : task.references)
+		{
+			centroidBounds.Extend(reference.bounds.Center());
+		}
+		const BinGrid objectGrid(centroidBounds, m_binCount);
+		const BinGrid spatialGrid(task.bounds, m_binCount);
+		Split objectSplit, spatialSplit;
+		if (count > 1)
+		{
+			objectSplit = FindObjectSplit(task.references, objectGrid);
+			const bool overlapping = objectSplit.axis < 0 ||
+			                         Intersection(objectSplit.leftBounds, objectSplit.rightBounds).HalfArea() > minOverlap;
+			if (overlapping && m_referenceCount < m_maxReferences)
+			{
+				spatialSplit = FindSpatialSplit(task.references, spatialGrid);
+				// The references crossing the plane, which the split may
+				// duplicate, must fit in the budget
+				const size_t duplicates = spatialSplit.leftCount + spatialSplit.rightCount - size_t(count);
+				if (spatialSplit.axis >= 0 && m_referenceCount + duplicates > m_maxReferences)
+					spatialSplit = Split();
+			}
+		}
+		const bool useSpatial = spatialSplit.cost < objectSplit.cost;
+		const float bestCost = std::min(objectSplit.cost, spatialSplit.cost);
+
+		// Compare the best split with making a leaf, both relative to the area
+		// of the node
+		const float nodeArea = task.bounds.HalfArea();
+		const float leafCost = m_settings.intersectionCost * BlockCount(count);
+		const float splitCost = bestCost == FLT_MAX ? FLT_MAX
+		                                            : m_settings.traversalCost +
+		                                                  m_settings.intersectionCost * bestCost / std::max(nodeArea, FLT_MIN);
+		if (count == 1 || task.depth >= kBvhMaxDepth || (count <= m_maxLeafSize && leafCost <= splitCost))
+		{
+			nodes[task.nodeIndex] = {task.bounds.min, static_cast<uint32_t>(primitiveOrder.size()), task.bounds.max, count};
+			for (const Reference& reference : task.references)
+			{
+				primitiveOrder.push_back(reference.primitive);
+			}
+			stats.leafCount++;
+			continue;
+		}
+
+		const uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+		SbvhTask left = {leftIndex, task.depth + 1, Aabb(), {}};
+		SbvhTask right = {leftIndex + 1, task.depth + 1, Aabb(), {}};
+		if (useSpatial)
+		{
+			PartitionSpace(task.references, spatialGrid, spatialSplit, left, right);
+		}
+		if (!useSpatial || left.references.empty() || right.references.empty())
+		{
+			left.references.clear();
+			right.references.clear();
+			left.bounds = right.bounds = Aabb();
+			if (objectSplit.axis >= 0)
+			{
+				PartitionObjects(task.references, objectGrid, objectSplit, left, right);
+			}
+			else
+			{
+				// All the centroids are at the same position: split in the
+				// middle of the references to keep the leaves small
+				left.references.assign(task.references.begin(), task.references.begin() + count / 2);
+				right.references.assign(task.references.begin() + count / 2, task.references.end());
+				for (const Reference& reference : left.references)
+					left.bounds.Extend(reference.bounds);
+				for (const Reference& reference : right.references)
+					right.bounds.Extend(reference.bounds);
+			}
+		}
+
+		m_referenceCount += left.references.size() + right.references.size() - count;
+
+		nodes[task.nodeIndex] = {task.bounds.min, leftIndex, task.bounds.max, 0};
+		nodes.push_back(BvhNode());
+		nodes.push_back(BvhNode());
+		tasks.push_back(std::move(left));
+		tasks.push_back(std::move(right));
+	}
+	nodes.shrink_to_fit();
+	stats.nodeCount = static_cast<uint32_t>(nodes.size());
+}
+
+} // namespace
+
+void SplitTriangleBounds(const BvhTriangle& triangle, const Aabb& bounds, int axis, float position, Aabb& left,
+                         Aabb& right)
+{
+	left = right = Aabb();
+	const glm::vec3* vertices[3] = {&triangle.v0, &triangle.v1, &triangle.v2};
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& a = *vertices[i];
+		const glm::vec3& b = *vertices[(i + 1) % 3];
+		if (a[axis] <= position)
+			left.Extend(a);
+		if (a[axis] >= position)
+			right.Extend(a);
+		// Edges crossing the plane add their intersection to both sides
+		if ((a[axis] < position && b[axis] > position) || (a[axis] > position && b[axis] < position))
+		{
+			glm::vec3 p = a + (b - a) * ((position - a[axis]) / (b[axis] - a[axis]));
+			p[axis] = position;
+			left.Extend(p);
+			right.Extend(p);
+		}
+	}
+	left.max[axis] = std::min(left.max[axis], position);
+	right.min[axis] = std::max(right.min[axis], position);
+	left = Intersection(left, bounds);
+	right = Intersection(right, bounds);
+}
+
+void BuildSbvhNodes(const std::vector<BvhTriangle>& triangles, const std::vector<Aabb>& triangleBounds,
+                    const BvhBuildSettings& settings, std::vector<BvhNode>& nodes,
+                    std::vector<uint32_t>& primitiveOrder, BvhStats& stats)
+{
+	nodes.clear();
+	primitiveOrder.clear();
+	stats.nodeCount = 0;
+	stats.leafCount = 0;
+	stats.maxDepth = 0;
+	if (triangles.empty())
+		return;
+
+	SbvhBuilder builder(triangles, settings);
+	builder.Build(triangleBounds, nodes, primitiveOrder, stats);
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,32 @@
+#pragma once
+
+// Split BVH builder (Stich, Friedrich and Dietrich, "Spatial Splits in
+// Bounding Volume Hierarchies", HPG 2009), selected with
+// BvhBuildAlgorithm::SpatialSplitSah. Large triangles, such as the ground
+// plane, make the boxes of object-split nodes overlap over most of the scene.
+// Besides the object splits of the binned SAH, each node then also evaluates
+// spatial splits, which cut the triangles by a plane and reference the
+// triangles crossing it from both children, with the box of the part on each
+// side. Spatial splits are only tried where the children of the best object
+// split overlap, and stop once the references exceed the memory budget of
+// the settings. A reference that crosses the plane is kept whole on one side
+// when that is cheaper under the SAH ("unsplitting").
+
+#include "Bvh.h"
+
+namespace cpu_rt
+{
+
+/// Same contract as BuildBvhNodes, with spatial splits: primitiveOrder may
+/// reference a triangle from several leaves, and receives at most
+/// (1 + settings.spatialSplitBudget) times as many references as triangles
+void BuildSbvhNodes(const std::vector<BvhTriangle>& triangles, const std::vector<Aabb>& triangleBounds,
+                    const BvhBuildSettings& settings, std::vector<BvhNode>& nodes,
+                    std::vector<uint32_t>& primitiveOrder, BvhStats& stats);
+
+/// Bounds of the parts of a triangle on each side of an axis-aligned plane,
+/// within the bounds of a reference to the triangle
+void SplitTriangleBounds(const BvhTriangle& triangle, const Aabb& bounds, int axis, float position, Aabb& left,
+                         Aabb& right);
+
+} // namespace cpu_rt
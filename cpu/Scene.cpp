@@ -0,0 +1,287 @@
+#include "Scene.h"
+#include "InstanceMerging.h"
+#include "MeshOptimizer.h"
+#include "SceneGeometry.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+uint32_t Mesh::TriangleCount() const
+{
+	const ArrayView<uint32_t> meshIndices = GetIndices();
+	return static_cast<uint32_t>((meshIndices.empty() ? GetVertexCount() : meshIndices.size()) / 3);
+}
+
+void Mesh::CompressVertices(VertexColorFormat colorFormat)
+{
+	if (IsCompressed())
+		return;
+	const ArrayView<Vertex> source = GetVertices();
+	compressedVertices = CompressedVertexBuffer(source.data(), static_cast<uint32_t>(source.size()), colorFormat);
+	// The indices of a mapped mesh stay in the file
+	std::vector<Vertex>().swap(vertices);
+	mappedVertices = ArrayView<Vertex>();
+}
+
+void Mesh::GetTriangleIndices(uint32_t primitiveIndex, uint32_t& i0, uint32_t& i1, uint32_t& i2) const
+{
+	const ArrayView<uint32_t> meshIndices = GetIndices();
+	i0 = 3 * primitiveIndex;
+	i1 = i0 + 1;
+	i2 = i0 + 2;
+	if (!meshIndices.empty())
+	{
+		i0 = meshIndices[i0];
+		i1 = meshIndices[i1];
+		i2 = meshIndices[i2];
+	}
+}
+
+void Mesh::GetTriangle(uint32_t primitiveIndex, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const
+{
+	uint32_t i0, i1, i2;
+	GetTriangleIndices(primitiveIndex, i0, i1, i2);
+	v0 = GetPosition(i0);
+	v1 = GetPosition(i1);
+	v2 = GetPosition(i2);
+}
+
+uint32_t Scene::AddMesh(Mesh mesh, const BvhBuildSettings& settings)
+{
+	if (!mesh.procedurals.empty())
+	{
+		Bvh bottomLevel;
+		bottomLevel.AddProceduralGeometry(mesh.procedurals.data(), static_cast<uint32_t>(mesh.procedurals.size()));
+		bottomLevel.Build(settings);
+		m_bottomLevels.push_back(std::move(bottomLevel));
+		m_meshes.push_back(std::move(mesh));
+		return static_cast<uint32_t>(m_meshes.size() - 1);
+	}
+
+	// The hierarchy of compressed vertices is built over their decoded
+	// positions, which the triangles then copy
+	std::vector<glm::vec3> decodedPositions;
+	const void* vertices = mesh.GetVertices().data();
+	uint32_t vertexStride = sizeof(Vertex);
+	if (mesh.IsCompressed())
+	{
+		decodedPositions.resize(mesh.GetVertexCount());
+		for (uint32_t i = 0; i < decodedPositions.size(); i++)
+		{
+			decodedPositions[i] = mesh.GetPosition(i);
+		}
+		vertices = decodedPositions.data();
+		vertexStride = sizeof(glm::vec3);
+	}
+	const uint32_t* indices = mesh.GetIndices().empty() ? nullptr : mesh.GetIndices().data();
+	const uint32_t vertexCount = mesh.GetVertexCount();
+	const uint32_t indexCount = static_cast<uint32_t>(mesh.GetIndices().size());
+	Bvh bottomLevel;
+	BvhCacheKey key(settings);
+	if (m_bvhCache)
+		key.AddVertexBuffer(vertices, vertexCount, vertexStride, indices, indexCount);
+	if (!m_bvhCache || !m_bvhCache->Load(key, bottomLevel))
+	{
+		bottomLevel.AddVertexBuffer(vertices, vertexCount, vertexStride, indices, indexCount);
+		bottomLevel.Build(settings);
+		if (m_bvhCache)
+			m_bvhCache->Save(key, bottomLevel);
+	}
+	m_bottomLevels.push_back(std::move(bottomLevel));
+	m_meshes.push_back(std::move(mesh));
+	return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+void Scene::AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t hitGroupIndex,
+                        uint32_t instanceMask, uint32_t flags)
+{
+	if (meshIndex >= m_meshes.size())
+	{
+		throw std::logic_error("Instance references a mesh that has not been added to the scene");
+	}
+	m_topLevel.AddInstance(meshIndex, transform, instanceID, hitGroupIndex, instanceMask, flags);
+}
+
+uint32_t Scene::AddGroup()
+{
+	m_groups.emplace_back();
+	return static_cast<uint32_t>(m_groups.size() - 1);
+}
+
+void Scene::AddGroupMesh(uint32_t groupIndex, uint32_t meshIndex, const glm::mat4& transform)
+{
+	if (meshIndex >= m_meshes.size())
+	{
+		throw std::logic_error("Instance group references a mesh that has not been added to the scene");
+	}
+	m_groups.at(groupIndex).AddMesh(meshIndex, transform);
+}
+
+void Scene::AddGroupChild(uint32_t groupIndex, uint32_t childGroupIndex, const glm::mat4& transform)
+{
+	if (childGroupIndex >= groupIndex)
+	{
+		throw std::logic_error("Instance groups can only contain the groups added before them");
+	}
+	m_groups.at(groupIndex).AddGroup(childGroupIndex, transform);
+}
+
+void Scene::AddGroupInstance(uint32_t groupIndex, const glm::mat4& transform, uint32_t instanceID,
+                             uint32_t hitGroupIndex, uint32_t instanceMask, uint32_t flags)
+{
+	if (groupIndex >= m_groups.size())
+	{
+		throw std::logic_error("Instance references a group that has not been added to the scene");
+	}
+	m_topLevel.AddGroupInstance(groupIndex, transform, instanceID, hitGroupIndex, instanceMask, flags);
+}
+
+uint32_t Scene::MergeInstances(const std::vector<uint32_t>& instanceIndices, const BvhBuildSettings& settings)
+{
+	Bvh bottomLevel;
+	AddMergedGeometries(*this, instanceIndices, bottomLevel);
+	bottomLevel.Build(settings);
+	m_bottomLevels.push_back(std::move(bottomLevel));
+	m_meshes.emplace_back();
+	const uint32_t meshIndex = static_cast<uint32_t>(m_meshes.size() - 1);
+	m_topLevel.AddMergedInstance(meshIndex, instanceIndices);
+	return meshIndex;
+}
+
+void Scene::SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform)
+{
+	m_topLevel.SetInstanceTransform(instanceIndex, transform);
+}
+
+void Scene::UpdateTopLevel(const BvhBuildSettings& settings)
+{
+	// Children come before their groups, so a group built in this loop is
+	// seen by the groups containing it. Those are rebuilt too, as their
+	// bounds may change, and the instances of the rebuilt groups are refitted
+	std::vector<bool> rebuiltGroups(m_groups.size(), false);
+	bool anyRebuilt = false;
+	for (uint32_t groupIndex = 0; groupIndex < m_groups.size(); groupIndex++)
+	{
+		InstanceGroup& group = m_groups[groupIndex];
+		bool rebuild = group.NeedsBuild();
+		for (const InstanceGroupChild& child : group.GetChildren())
+		{
+			rebuild = rebuild || (child.groupIndex != kNoInstanceGroup && rebuiltGroups[child.groupIndex]);
+		}
+		if (!rebuild)
+			continue;
+		group.Build(m_bottomLevels, m_groups, settings);
+		rebuiltGroups[groupIndex] = true;
+		anyRebuilt = true;
+	}
+	if (anyRebuilt)
+	{
+		const std::vector<Instance>& instances = m_topLevel.GetInstances();
+		for (uint32_t instanceIndex = 0; instanceIndex < instances.size(); instanceIndex++)
+		{
+			const uint32_t groupIndex = instances[instanceIndex].groupIndex;
+			if (groupIndex != kNoInstanceGroup && rebuiltGroups[groupIndex])
+				m_topLevel.MarkGeometryChanged(instanceIndex);
+		}
+	}
+	m_topLevel.Update(m_bottomLevels, m_groups, settings);
+}
+
+void Scene::SetRebuildPolicy(const RebuildPolicy& policy)
+{
+	m_topLevel.SetRebuildPolicy(policy);
+}
+
+bool Scene::Intersect(const RayDesc& ray, HitRecord& hit, uint32_t rayFlags, uint32_t instanceInclusionMask) const
+{
+	return m_topLevel.Intersect(ray, m_bottomLevels, m_groups, hit, rayFlags, instanceInclusionMask);
+}
+
+bool Scene::Occluded(const RayDesc& ray, HitRecord* hit, uint32_t rayFlags, uint32_t instanceInclusionMask) const
+{
+	return m_topLevel.Occluded(ray, m_bottomLevels, m_groups, hit, rayFlags, instanceInclusionMask);
+}
+
+Scene CreateHelloTriangleScene(const BvhCache* bvhCache)
+{
+	Scene scene;
+	scene.SetBvhCache(bvhCache);
+	// Welded and reordered as the buffers of CreateCubeVB and CreatePlaneVB
+	Mesh cube;
+	cube.vertices.assign(std::begin(kCubeVertices), std::end(kCubeVertices));
+	OptimizeMesh(cube.vertices, cube.indices);
+	Mesh plane;
+	plane.vertices.assign(std::begin(kPlaneVertices), std::end(kPlaneVertices));
+	OptimizeMesh(plane.vertices, plane.indices);
+
+	const uint32_t cubeMesh = scene.AddMesh(std::move(cube));
+	const uint32_t planeMesh = scene.AddMesh(std::move(plane));
+
+	// Same order, instance IDs and hit group offsets as CreateTopLevelAS. The
+	// plane receives shadows but casts none, so shadow rays skip it
+	scene.AddInstance(cubeMesh, glm::mat4(1.f), 0, 0, kVisibleInstanceMask | kShadowCasterInstanceMask);
+	scene.AddInstance(planeMesh, glm::mat4(1.f), 1, 2, kVisibleInstanceMask);
+	scene.UpdateTopLevel();
+	return scene;
+}
+
+Scene CreateProceduralHelloTriangleScene()
+{
+	Scene scene;
+	Mesh cube;
+	cube.procedurals.push_back(CreateProceduralCube());
+	Mesh plane;
+	plane.procedurals.push_back(CreateProceduralGroundPlane());
+
+	const uint32_t cubeMesh = scene.AddMesh(std::move(cube));
+	const uint32_t planeMesh = scene.AddMesh(std::move(plane));
+	scene.AddInstance(cubeMesh, glm::mat4(1.f), 0, 0, kVisibleInstanceMask | kShadowCasterInstanceMask);
+	scene.AddInstance(planeMesh, glm::mat4(1.f), 1, 2, kVisibleInstanceMask);
+	scene.UpdateTopLevel();
+	return scene;
+}
+
+void AnimateHelloTriangleScene(Scene& scene, uint32_t time)
+{
+	// Column-vector equivalent of the row-vector XMMatrixRotationAxis * XMMatrixTranslation
+	const glm::mat4 rotation = glm::rotate(glm::mat4(1.f), static_cast<float>(time) / 50.0f, glm::vec3(0.f, 1.f, 0.f));
+	const glm::mat4 translation = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.1f * std::cos(time / 20.f), 0.f));
+	scene.SetInstanceTransform(0, translation * rotation);
+	scene.UpdateTopLevel();
+}
+
+Camera CreateCamera(const CameraSetup& setup, uint32_t width, uint32_t height)
+{
+	Camera camera;
+	camera.view = glm::lookAt(setup.eye, setup.target, setup.up);
+
+	// Shader-side view of XMMatrixPerspectiveFovRH: right-handed, depth in [0,1]
+	const float fovAngleY = setup.fovY * glm::pi<float>() / 180.0f;
+	const float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+	const float nearZ = setup.nearZ, farZ = setup.farZ;
+	const float yScale = 1.f / std::tan(0.5f * fovAngleY);
+	const float range = farZ / (nearZ - farZ);
+	camera.projection = glm::mat4(0.f);
+	camera.projection[0][0] = yScale / aspectRatio;
+	camera.projection[1][1] = yScale;
+	camera.projection[2][2] = range;
+	camera.projection[2][3] = -1.f;
+	camera.projection[3][2] = range * nearZ;
+
+	camera.viewI = glm::inverse(camera.view);
+	camera.projectionI = glm::inverse(camera.projection);
+	return camera;
+}
+
+Camera CreateHelloTriangleCamera(uint32_t width, uint32_t height)
+{
+	return CreateCamera(CameraSetup(), width, height);
+}
+
+} // namespace cpu_rt
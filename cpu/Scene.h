@@ -0,0 +1,184 @@
+#pragma once
+
+// CPU-side description of the scene built by
+// D3D12HelloTriangle::CreateAccelerationStructures: a set of triangle meshes
+// (the bottom-level geometry) referenced by transformed instances (the
+// top-level structure), plus the camera matrices of the CameraParams buffer.
+// Instances may also reference groups of instances, which nest the
+// self-similar parts of a scene (see InstanceGroup.h).
+
+#include "BvhCache.h"
+#include "TopLevelBvh.h"
+#include "VertexCompression.h"
+
+#include <memory>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Triangle mesh, optionally indexed. Triangles are numbered in the order of
+/// the index buffer (or of the vertex buffer if not indexed), which gives the
+/// value returned by PrimitiveIndex() in the shaders. A mesh may instead hold
+/// procedural primitives, numbered in their order, and no triangles. The
+/// vertices may be compressed, the positions of the triangles then being the
+/// decoded ones
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<ProceduralPrimitive> procedurals;
+	/// Scene file holding the vertex and index streams in place of the vectors,
+	/// which are then empty (see SceneFile)
+	std::shared_ptr<const MappedFile> mapping;
+	ArrayView<Vertex> mappedVertices;
+	ArrayView<uint32_t> mappedIndices;
+	/// Vertices in place of the vertex vector and of the mapped vertices, which
+	/// are then empty, once CompressVertices was called
+	CompressedVertexBuffer compressedVertices;
+
+	/// Vertex and index streams, from the vectors or from the mapped file. The
+	/// vertex stream is empty if the vertices are compressed
+	ArrayView<Vertex> GetVertices() const { return mapping ? mappedVertices : ArrayView<Vertex>(vertices); }
+	ArrayView<uint32_t> GetIndices() const { return mapping ? mappedIndices : ArrayView<uint32_t>(indices); }
+	bool IsCompressed() const { return compressedVertices.GetVertexCount() != 0; }
+	/// Replace the vertices with their compressed version. Throws
+	/// std::length_error if the palette format is asked for too many colors
+	void CompressVertices(VertexColorFormat colorFormat);
+	uint32_t GetVertexCount() const
+	{
+		return IsCompressed() ? compressedVertices.GetVertexCount() : static_cast<uint32_t>(GetVertices().size());
+	}
+	/// Position and color of a vertex, decoded if the vertices are compressed
+	glm::vec3 GetPosition(uint32_t index) const
+	{
+		if (IsCompressed())
+			return compressedVertices.GetPosition(index);
+		const float* position = GetVertices()[index].position;
+		return glm::vec3(position[0], position[1], position[2]);
+	}
+	glm::vec4 GetColor(uint32_t index) const
+	{
+		if (IsCompressed())
+			return compressedVertices.GetColor(index);
+		const float* color = GetVertices()[index].color;
+		return glm::vec4(color[0], color[1], color[2], color[3]);
+	}
+	uint32_t TriangleCount() const;
+	/// Fetch the vertex indices of a triangle
+	void GetTriangleIndices(uint32_t primitiveIndex, uint32_t& i0, uint32_t& i1, uint32_t& i2) const;
+	/// Fetch the object-space positions of a triangle
+	void GetTriangle(uint32_t primitiveIndex, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const;
+};
+
+/// Camera matrices, laid out as the CameraParams constant buffer of RayGen.hlsl
+struct Camera
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewI;
+	glm::mat4 projectionI;
+};
+
+/// Placement and lens of the camera, from which CreateCamera derives the
+/// matrices for an image size. The defaults are those of the sample
+struct CameraSetup
+{
+	glm::vec3 eye = glm::vec3(1.5f, 1.5f, 1.5f);
+	glm::vec3 target = glm::vec3(0.f);
+	glm::vec3 up = glm::vec3(0.f, 1.f, 0.f);
+	/// Vertical field of view, in degrees
+	float fovY = 45.f;
+	float nearZ = 0.1f;
+	float farZ = 1000.f;
+};
+
+class Scene
+{
+public:
+	/// Load the bottom-level hierarchies of the meshes added from now on from a
+	/// cache, and save those it does not have yet. The cache must outlive the
+	/// calls to AddMesh, nullptr to always build
+	void SetBvhCache(const BvhCache* bvhCache) { m_bvhCache = bvhCache; }
+	/// Add a mesh to the scene, build its bottom-level hierarchy (or load it
+	/// from the cache, for triangles) and return its index
+	uint32_t AddMesh(Mesh mesh, const BvhBuildSettings& settings = {});
+	/// Add an instance of a mesh. The instance index is the order in which the
+	/// instances are added
+	void AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t hitGroupIndex,
+	                 uint32_t instanceMask = 0xFF, uint32_t flags = INSTANCE_FLAG_NONE);
+	/// Add an empty group of instances and return its index. Groups are filled
+	/// by AddGroupMesh and AddGroupChild, and built by the next UpdateTopLevel
+	uint32_t AddGroup();
+	/// Place a mesh in a group
+	void AddGroupMesh(uint32_t groupIndex, uint32_t meshIndex, const glm::mat4& transform);
+	/// Place a group in another one, of a higher index, so that groups nest
+	/// without cycles
+	void AddGroupChild(uint32_t groupIndex, uint32_t childGroupIndex, const glm::mat4& transform);
+	/// Add an instance of a group, numbered along with the instances of meshes
+	void AddGroupInstance(uint32_t groupIndex, const glm::mat4& transform, uint32_t instanceID,
+	                      uint32_t hitGroupIndex, uint32_t instanceMask = 0xFF, uint32_t flags = INSTANCE_FLAG_NONE);
+	/// Bake instances of triangle meshes into a new mesh holding their
+	/// triangles in world space, one geometry per instance, and add its merged
+	/// instance (see TopLevelBvh::AddMergedInstance and InstanceMerging.h).
+	/// The instances keep their index, which the hits report, but can no
+	/// longer move. Returns the index of the merged mesh, which has a
+	/// bottom-level hierarchy and no vertices
+	uint32_t MergeInstances(const std::vector<uint32_t>& instanceIndices, const BvhBuildSettings& settings = {});
+	/// Change the transform of an existing instance
+	void SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform);
+	/// Rebuild or refit the top-level hierarchy after instances were added or
+	/// moved, the counterpart of CreateTopLevelAS, after building the groups
+	/// that changed. Must be called before tracing rays
+	void UpdateTopLevel(const BvhBuildSettings& settings = {});
+	/// Choose when the updates rebuild the top level instead of refitting it
+	/// (see TopLevelBvh::SetRebuildPolicy)
+	void SetRebuildPolicy(const RebuildPolicy& policy);
+
+	const std::vector<Mesh>& GetMeshes() const { return m_meshes; }
+	const std::vector<Bvh>& GetBottomLevels() const { return m_bottomLevels; }
+	const std::vector<InstanceGroup>& GetGroups() const { return m_groups; }
+	const std::vector<Instance>& GetInstances() const { return m_topLevel.GetInstances(); }
+	const TopLevelBvh& GetTopLevel() const { return m_topLevel; }
+
+	/// Find the closest intersection of a world-space ray with the scene, in
+	/// the ]TMin, TMax[ interval, as TraceRay would with the same flags and
+	/// mask. Triangles are double-sided unless culled by the flags
+	bool Intersect(const RayDesc& ray, HitRecord& hit, uint32_t rayFlags = RAY_FLAG_NONE,
+	               uint32_t instanceInclusionMask = 0xFF) const;
+	/// Return true if anything is hit in ]TMin, TMax[, and optionally the
+	/// first intersection found, which is not necessarily the closest
+	bool Occluded(const RayDesc& ray, HitRecord* hit = nullptr, uint32_t rayFlags = RAY_FLAG_NONE,
+	              uint32_t instanceInclusionMask = 0xFF) const;
+
+private:
+	std::vector<Mesh> m_meshes;
+	/// Bottom-level hierarchy of each mesh
+	std::vector<Bvh> m_bottomLevels;
+	std::vector<InstanceGroup> m_groups;
+	TopLevelBvh m_topLevel;
+	const BvhCache* m_bvhCache = nullptr;
+};
+
+/// Instance masks of the sample scene: every instance is visible to the
+/// primary rays, and only the cube casts shadows
+static const uint32_t kVisibleInstanceMask = 0x01;
+static const uint32_t kShadowCasterInstanceMask = 0x02;
+
+/// Build the cube and plane instances created by
+/// D3D12HelloTriangle::CreateAccelerationStructures, with 2 hit groups per
+/// instance, optionally loading the bottom levels from a cache
+Scene CreateHelloTriangleScene(const BvhCache* bvhCache = nullptr);
+/// Same scene with the cube and the plane as one procedural primitive each,
+/// a box and a quad, instead of their triangles
+Scene CreateProceduralHelloTriangleScene();
+/// Apply the animation of D3D12HelloTriangle::OnUpdate for the given frame,
+/// and refit the top-level hierarchy
+void AnimateHelloTriangleScene(Scene& scene, uint32_t time);
+/// Build the matrices of UpdateCameraBuffer for a camera and an image size
+Camera CreateCamera(const CameraSetup& setup, uint32_t width, uint32_t height);
+/// Build the camera set up in D3D12HelloTriangle::OnInit and
+/// UpdateCameraBuffer, for a given image size
+Camera CreateHelloTriangleCamera(uint32_t width, uint32_t height);
+
+} // namespace cpu_rt
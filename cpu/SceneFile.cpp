@@ -0,0 +1,255 @@
+#include "SceneFile.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+static const char kMagic[8] = {'C', 'P', 'U', 'R', 'T', 'S', 'C', 'N'};
+/// Version of the file format, to increase whenever the layout or the meaning
+/// of the records change
+static const uint32_t kFormatVersion = 1;
+/// Alignment of the arrays in the files, a cache line
+static const uint64_t kArrayAlignment = 64;
+
+struct SceneFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	/// Size of the vertex records, the stride of the vertex streams
+	uint32_t vertexSize;
+	uint32_t meshCount;
+	uint32_t instanceCount;
+	uint64_t meshOffset;
+	uint64_t instanceOffset;
+	float eye[3];
+	float target[3];
+	float up[3];
+	float fovY;
+	float nearZ;
+	float farZ;
+};
+
+} // namespace
+
+SceneFileWriter::SceneFileWriter(const std::string& fileName)
+    : m_fileName(fileName), m_file(fileName, std::ios::binary | std::ios::trunc)
+{
+	if (!m_file.good())
+	{
+		throw std::runtime_error("Cannot create " + fileName);
+	}
+	// Zeros until Close writes the header, so that an unfinished file is
+	// rejected by the readers
+	const SceneFileHeader header = {};
+	Write(&header, sizeof(header));
+}
+
+uint64_t SceneFileWriter::Align()
+{
+	static const char kPadding[kArrayAlignment] = {};
+	Write(kPadding, static_cast<size_t>((kArrayAlignment - m_offset % kArrayAlignment) % kArrayAlignment));
+	return m_offset;
+}
+
+void SceneFileWriter::Write(const void* data, size_t size)
+{
+	m_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	if (!m_file.good())
+	{
+		throw std::runtime_error("Cannot write " + m_fileName);
+	}
+	m_offset += size;
+}
+
+uint32_t SceneFileWriter::AddMesh(const ArrayView<Vertex>& vertices, const ArrayView<uint32_t>& indices)
+{
+	SceneFileMesh mesh;
+	mesh.vertexOffset = Align();
+	mesh.vertexCount = vertices.size();
+	Write(vertices.data(), vertices.size() * sizeof(Vertex));
+	mesh.indexOffset = Align();
+	mesh.indexCount = indices.size();
+	Write(indices.data(), indices.size() * sizeof(uint32_t));
+	m_meshes.push_back(mesh);
+	return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+void SceneFileWriter::AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID,
+                                  uint32_t hitGroupIndex, uint32_t instanceMask, uint32_t flags)
+{
+	if (meshIndex >= m_meshes.size())
+	{
+		throw std::logic_error("Instance references a mesh that has not been added to the scene");
+	}
+	SceneFileInstance instance;
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			instance.transform[row][column] = transform[column][row];
+		}
+	}
+	instance.meshIndex = meshIndex;
+	instance.instanceID = instanceID;
+	instance.hitGroupIndex = hitGroupIndex;
+	instance.instanceMask = instanceMask;
+	instance.flags = flags;
+	m_instances.push_back(instance);
+}
+
+void SceneFileWriter::Close()
+{
+	SceneFileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kFormatVersion;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(m_meshes.size());
+	header.instanceCount = static_cast<uint32_t>(m_instances.size());
+	header.meshOffset = Align();
+	Write(m_meshes.data(), m_meshes.size() * sizeof(SceneFileMesh));
+	header.instanceOffset = Align();
+	Write(m_instances.data(), m_instances.size() * sizeof(SceneFileInstance));
+	for (int i = 0; i < 3; i++)
+	{
+		header.eye[i] = m_camera.eye[i];
+		header.target[i] = m_camera.target[i];
+		header.up[i] = m_camera.up[i];
+	}
+	header.fovY = m_camera.fovY;
+	header.nearZ = m_camera.nearZ;
+	header.farZ = m_camera.farZ;
+
+	m_file.seekp(0);
+	Write(&header, sizeof(header));
+	m_file.close();
+	if (m_file.fail())
+	{
+		throw std::runtime_error("Cannot write " + m_fileName);
+	}
+}
+
+void SaveScene(const std::string& fileName, const Scene& scene, const CameraSetup& camera)
+{
+	if (!scene.GetGroups().empty())
+	{
+		throw std::runtime_error("Scene files cannot store instance groups");
+	}
+	if (!scene.GetTopLevel().GetMergedSources().empty())
+	{
+		throw std::runtime_error("Scene files cannot store merged instances");
+	}
+	for (const Mesh& mesh : scene.GetMeshes())
+	{
+		if (!mesh.procedurals.empty())
+		{
+			throw std::runtime_error("Scene files cannot store procedural primitives");
+		}
+		if (mesh.IsCompressed())
+		{
+			throw std::runtime_error("Scene files cannot store compressed vertices");
+		}
+	}
+	SceneFileWriter writer(fileName);
+	for (const Mesh& mesh : scene.GetMeshes())
+	{
+		writer.AddMesh(mesh.GetVertices(), mesh.GetIndices());
+	}
+	for (const Instance& instance : scene.GetInstances())
+	{
+		writer.AddInstance(instance.meshIndex, instance.transform, instance.instanceID, instance.hitGroupIndex,
+		                   instance.instanceMask, instance.flags);
+	}
+	writer.SetCamera(camera);
+	writer.Close();
+}
+
+SceneFile::SceneFile(const std::string& fileName) : m_mapping(std::make_shared<MappedFile>(fileName))
+{
+	SceneFileHeader header;
+	if (m_mapping->GetSize() < sizeof(header))
+	{
+		throw std::runtime_error(fileName + " is not a scene file");
+	}
+	std::memcpy(&header, m_mapping->GetData(), sizeof(header));
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+	{
+		throw std::runtime_error(fileName + " is not a scene file");
+	}
+	if (header.version != kFormatVersion || header.vertexSize != sizeof(Vertex))
+	{
+		throw std::runtime_error(fileName + " is a scene file of another version");
+	}
+
+	m_meshes = m_mapping->GetArray<SceneFileMesh>(header.meshOffset, header.meshCount);
+	m_instances = m_mapping->GetArray<SceneFileInstance>(header.instanceOffset, header.instanceCount);
+	// Check the streams now, so that GetMesh cannot fail and the meshes it
+	// returns only index their own vertices
+	for (const SceneFileMesh& mesh : m_meshes)
+	{
+		m_mapping->GetArray<Vertex>(mesh.vertexOffset, mesh.vertexCount);
+		const ArrayView<uint32_t> indices = m_mapping->GetArray<uint32_t>(mesh.indexOffset, mesh.indexCount);
+		for (uint32_t index : indices)
+		{
+			if (index >= mesh.vertexCount)
+			{
+				throw std::runtime_error(fileName + " has an index beyond the vertices of its mesh");
+			}
+		}
+	}
+	for (const SceneFileInstance& instance : m_instances)
+	{
+		if (instance.meshIndex >= header.meshCount)
+		{
+			throw std::runtime_error(fileName + " has an instance of a mesh it does not contain");
+		}
+	}
+
+	m_camera.eye = glm::vec3(header.eye[0], header.eye[1], header.eye[2]);
+	m_camera.target = glm::vec3(header.target[0], header.target[1], header.target[2]);
+	m_camera.up = glm::vec3(header.up[0], header.up[1], header.up[2]);
+	m_camera.fovY = header.fovY;
+	m_camera.nearZ = header.nearZ;
+	m_camera.farZ = header.farZ;
+}
+
+Mesh SceneFile::GetMesh(uint32_t meshIndex) const
+{
+	const SceneFileMesh& record = m_meshes[meshIndex];
+	Mesh mesh;
+	mesh.mapping = m_mapping;
+	mesh.mappedVertices = m_mapping->GetArray<Vertex>(record.vertexOffset, record.vertexCount);
+	mesh.mappedIndices = m_mapping->GetArray<uint32_t>(record.indexOffset, record.indexCount);
+	return mesh;
+}
+
+Scene LoadScene(const SceneFile& file, const BvhCache* bvhCache, const BvhBuildSettings& settings)
+{
+	Scene scene;
+	scene.SetBvhCache(bvhCache);
+	for (uint32_t i = 0; i < file.GetMeshCount(); i++)
+	{
+		scene.AddMesh(file.GetMesh(i), settings);
+	}
+	for (const SceneFileInstance& instance : file.GetInstances())
+	{
+		glm::mat4 transform(1.f);
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				transform[column][row] = instance.transform[row][column];
+			}
+		}
+		scene.AddInstance(instance.meshIndex, transform, instance.instanceID, instance.hitGroupIndex,
+		                  instance.instanceMask, instance.flags);
+	}
+	scene.UpdateTopLevel(settings);
+	return scene;
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,107 @@
+#pragma once
+
+// Binary scene container, the on-disk counterpart of Scene: the vertex and
+// index streams of the meshes, the instances with their transforms, hit group
+// offsets and masks, and the camera. The streams are stored in the layout of
+// the application vertex buffers at aligned offsets, so that a loaded file is
+// mapped and its meshes read their vertices in place, with no parsing and no
+// copy; only the instance table and the camera are decoded. The meshes are
+// written as they are added, before the tables that end the file, so that a
+// converter never holds more than one mesh in memory.
+
+#include "Scene.h"
+
+#include <fstream>
+#include <string>
+
+namespace cpu_rt
+{
+
+/// Mesh record of a scene file: offsets in bytes from the start of the file,
+/// and counts of elements. Meshes without indices have an index count of 0
+struct SceneFileMesh
+{
+	uint64_t vertexOffset;
+	uint64_t vertexCount;
+	uint64_t indexOffset;
+	uint64_t indexCount;
+};
+
+/// Instance record of a scene file
+struct SceneFileInstance
+{
+	/// Object to world transform, 3 rows of 4 as in D3D12_RAYTRACING_INSTANCE_DESC
+	float transform[3][4];
+	uint32_t meshIndex;
+	uint32_t instanceID;
+	uint32_t hitGroupIndex;
+	uint32_t instanceMask;
+	uint32_t flags;
+};
+
+class SceneFileWriter
+{
+public:
+	/// Create the file. Throws std::runtime_error if it cannot be created
+	explicit SceneFileWriter(const std::string& fileName);
+
+	/// Write the streams of a mesh, indices being optional, and return its
+	/// index. Throws std::runtime_error if the file cannot be written
+	uint32_t AddMesh(const ArrayView<Vertex>& vertices, const ArrayView<uint32_t>& indices);
+	/// Add an instance of a mesh, in the order of Scene::AddInstance
+	void AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t hitGroupIndex,
+	                 uint32_t instanceMask = 0xFF, uint32_t flags = INSTANCE_FLAG_NONE);
+	void SetCamera(const CameraSetup& camera) { m_camera = camera; }
+	/// Write the tables and the header. The file is not valid before. Throws
+	/// std::runtime_error if it cannot be written
+	void Close();
+
+private:
+	/// Pad the file up to the alignment of the arrays and return the offset
+	uint64_t Align();
+	void Write(const void* data, size_t size);
+
+	std::string m_fileName;
+	std::ofstream m_file;
+	uint64_t m_offset = 0;
+	std::vector<SceneFileMesh> m_meshes;
+	std::vector<SceneFileInstance> m_instances;
+	CameraSetup m_camera;
+};
+
+/// Write the meshes and the instances of a scene with a camera. Throws
+/// std::runtime_error if the file cannot be written or if the scene has
+/// instance groups, procedural primitives, compressed vertices or merged
+/// instances, which the format does not store
+void SaveScene(const std::string& fileName, const Scene& scene, const CameraSetup& camera);
+
+/// Scene file mapped in memory
+class SceneFile
+{
+public:
+	/// Map and check the file. Throws std::runtime_error if it cannot be read,
+	/// is not a scene file of this version, or its tables are out of bounds
+	explicit SceneFile(const std::string& fileName);
+
+	uint32_t GetMeshCount() const { return static_cast<uint32_t>(m_meshes.size()); }
+	/// Mesh whose streams are those of the mapping, which it keeps alive
+	Mesh GetMesh(uint32_t meshIndex) const;
+	/// Offsets and sizes of the streams of a mesh in the file
+	const SceneFileMesh& GetMeshRecord(uint32_t meshIndex) const { return m_meshes[meshIndex]; }
+	ArrayView<SceneFileInstance> GetInstances() const { return m_instances; }
+	const CameraSetup& GetCamera() const { return m_camera; }
+	size_t GetSize() const { return m_mapping->GetSize(); }
+
+private:
+	std::shared_ptr<const MappedFile> m_mapping;
+	ArrayView<SceneFileMesh> m_meshes;
+	ArrayView<SceneFileInstance> m_instances;
+	CameraSetup m_camera;
+};
+
+/// Create the scene of a file: add its meshes, whose bottom-level hierarchies
+/// are built or loaded from the cache, and its instances, then build the top
+/// level
+Scene LoadScene(const SceneFile& file, const BvhCache* bvhCache = nullptr, const BvhBuildSettings& settings = {});
+
+} // namespace cpu_rt
@@ -0,0 +1,81 @@
+#pragma once
+
+// Geometry of the sample scene, shared by the D3D12 vertex buffers
+// (D3D12HelloTriangle::CreateCubeVB/CreatePlaneVB) and the CPU renderer so that
+// both always trace the same triangles, and the procedural primitives that
+// replace them with the -procedural option.
+
+#include "Common.h"
+#include "Procedural.h"
+
+namespace cpu_rt
+{
+
+/// Ground plane, two triangles
+static const Vertex kPlaneVertices[] = {
+	{{-1.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 0
+	{{-1.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 1
+	{{01.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 2
+	{{01.5f, -.8f, 01.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 2
+	{{-1.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}, // 1
+	{{01.5f, -.8f, -1.5f}, {0.0f, 0.8f, 0.9f, 1.0f}}  // 4
+};
+
+/// Unit cube centered on the origin, 6 faces of 2 triangles
+static const Vertex kCubeVertices[] = {
+	{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+
+	{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+
+	{{-0.5f,  -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, 0.5f, -0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, 0.5f, -0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, 0.5f,  0.5f},   {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+
+	{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+
+	{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f, -0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+
+	{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f, -0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{0.5f,  0.5f,  0.5f},  {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+	{{-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 0.5f, 1.0f}},
+};
+
+/// The cube of kCubeVertices as a single procedural box
+inline ProceduralPrimitive CreateProceduralCube()
+{
+	return CreateProceduralBox(glm::vec3(-0.5f), glm::vec3(0.5f));
+}
+
+/// The plane of kPlaneVertices as a single procedural quad
+inline ProceduralPrimitive CreateProceduralGroundPlane()
+{
+	return CreateProceduralQuad(glm::vec3(-1.5f, -.8f, -1.5f), glm::vec3(3.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 3.f));
+}
+
+} // namespace cpu_rt
@@ -0,0 +1,216 @@
+#include "Shaders.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cpu_rt
+{
+
+void TraceRay(const ShaderContext& caller, uint32_t rayFlags, uint32_t instanceInclusionMask,
+              uint32_t rayContributionToHitGroupIndex, uint32_t missShaderIndex, const RayDesc& ray, void* payload)
+{
+	ShaderContext context = caller;
+	context.primaryHit = nullptr;
+	context.recordedPrimaryHit = nullptr;
+
+	const auto& occlusionRayTypes = caller.pipeline->occlusionRayTypes;
+	const bool deferred = caller.deferredRays &&
+	                      std::any_of(occlusionRayTypes.begin(), occlusionRayTypes.end(), [&](const RayType& type) {
+		                      return type.rayContributionToHitGroupIndex == rayContributionToHitGroupIndex &&
+		                             type.missShaderIndex == missShaderIndex;
+	                      });
+
+	HitRecord hit;
+	bool found;
+	if (caller.primaryHit)
+	{
+		found = caller.primaryHit->found;
+		hit = caller.primaryHit->hit;
+	}
+	else if (deferred)
+	{
+		if (!caller.deferredRays->IsTraced())
+		{
+			caller.deferredRays->Add(ray, rayFlags, instanceInclusionMask);
+			return;
+		}
+		found = caller.deferredRays->NextResult(hit);
+	}
+	else
+	{
+		++*caller.rayCount;
+		found = caller.scene->Intersect(ray, hit, rayFlags, instanceInclusionMask);
+	}
+	if (caller.recordedPrimaryHit)
+	{
+		*caller.recordedPrimaryHit = {found, hit};
+	}
+
+	if (!found)
+	{
+		context.pipeline->missShaders.at(missShaderIndex)(context, payload);
+		return;
+	}
+	if (rayFlags & RAY_FLAG_SKIP_CLOSEST_HIT_SHADER)
+		return;
+
+	const Instance& instance = caller.scene->GetInstances()[hit.instanceIndex];
+	// MultiplierForGeometryContributionToHitGroupIndex is 0 in all the
+	// TraceRay calls of the sample, so the geometry index does not contribute
+	const uint32_t hitGroupIndex = instance.hitGroupIndex + rayContributionToHitGroupIndex;
+	if (hitGroupIndex >= caller.pipeline->hitGroups.size())
+		return;
+
+	context.WorldRayOrigin = ray.Origin;
+	context.WorldRayDirection = ray.Direction;
+	context.RayTCurrent = hit.t;
+	context.PrimitiveIndex = hit.primitiveIndex;
+	context.InstanceIndex = hit.instanceIndex;
+	context.InstanceID = instance.instanceID;
+	context.pipeline->hitGroups[hitGroupIndex].closestHit(context, payload, hit.attrib);
+}
+
+// RayGen.hlsl
+RayDesc GenerateCameraRay(const Camera& camera, const glm::uvec2& launchIndex, const glm::uvec2& launchDimensions)
+{
+	const glm::vec2 dims = glm::vec2(launchDimensions);
+	const glm::vec2 d = (((glm::vec2(launchIndex) + 0.5f) / dims) * 2.f - 1.f);
+
+	const glm::vec4 target = camera.projectionI * glm::vec4(d.x, -d.y, 1, 1);
+
+	RayDesc ray;
+	ray.Origin = glm::vec3(camera.viewI * glm::vec4(0, 0, 0, 1));
+	ray.Direction = glm::vec3(camera.viewI * glm::vec4(glm::vec3(target), 0));
+	ray.TMin = 0;
+	ray.TMax = 100000;
+	return ray;
+}
+
+void RayGen(ShaderContext& context)
+{
+	HitInfo payload;
+	payload.colorAndDistance = glm::vec4(0, 0, 0, 0);
+
+	const glm::uvec2 launchIndex = context.DispatchRaysIndex;
+	const RayDesc ray = GenerateCameraRay(*context.camera, launchIndex, context.DispatchRaysDimensions);
+	TraceRay(context, RAY_FLAG_NONE, 0xFF, 0, 0, ray, &payload);
+
+	// gOutput is R8G8B8A8_UNORM: saturate and round each channel
+	const glm::vec3 color = glm::clamp(glm::vec3(payload.colorAndDistance), 0.f, 1.f);
+	const uint32_t r = static_cast<uint32_t>(color.r * 255.f + 0.5f);
+	const uint32_t g = static_cast<uint32_t>(color.g * 255.f + 0.5f);
+	const uint32_t b = static_cast<uint32_t>(color.b * 255.f + 0.5f);
+	context.gOutput[launchIndex.y * context.DispatchRaysDimensions.x + launchIndex.x] =
+	    r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+// Miss.hlsl
+void Miss(ShaderContext& context, void* payload)
+{
+	const float ramp = context.DispatchRaysIndex.y / static_cast<float>(context.DispatchRaysDimensions.y);
+	static_cast<HitInfo*>(payload)->colorAndDistance = glm::vec4(0.0f, 0.2f, 0.7f - 0.3f * ramp, -1.0f);
+}
+
+// Hit.hlsl
+void ClosestHit(ShaderContext& context, void* payload, const Attributes& attrib)
+{
+	const glm::vec3 barycentrics = glm::vec3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
+	glm::vec3 hitColor = glm::vec3(1.f);
+	const Instance& instance = context.scene->GetInstances()[context.InstanceIndex];
+	if (instance.groupIndex == kNoInstanceGroup)
+	{
+		const Mesh& mesh = context.scene->GetMeshes()[instance.meshIndex];
+		if (mesh.procedurals.empty())
+		{
+			uint32_t i0, i1, i2;
+			mesh.GetTriangleIndices(context.PrimitiveIndex, i0, i1, i2);
+			hitColor = glm::vec3(mesh.GetColor(i0)) * barycentrics.x + glm::vec3(mesh.GetColor(i1)) * barycentrics.y +
+			           glm::vec3(mesh.GetColor(i2)) * barycentrics.z;
+		}
+	}
+	static_cast<HitInfo*>(payload)->colorAndDistance = glm::vec4(hitColor, context.RayTCurrent);
+}
+
+void CubeClosestHit(ShaderContext& context, void* payload, const Attributes&)
+{
+	const glm::vec3 hitColor = glm::vec3(1, 0, 0.5);
+	static_cast<HitInfo*>(payload)->colorAndDistance = glm::vec4(hitColor, context.RayTCurrent);
+}
+
+void PlaneClosestHit(ShaderContext& context, void* payload, const Attributes&)
+{
+	const glm::vec3 lightPos = glm::vec3(2, 2, -2);
+
+	// Find the world-space hit position
+	const glm::vec3 worldOrigin = context.WorldRayOrigin + context.RayTCurrent * context.WorldRayDirection;
+	const glm::vec3 lightDir = glm::normalize(lightPos - worldOrigin);
+
+	RayDesc ray;
+	ray.Origin = worldOrigin;
+	ray.Direction = lightDir;
+	ray.TMin = 0.01f;
+	ray.TMax = 100000;
+
+	// The payload is only written by ShadowMiss, as the closest hit shader is
+	// skipped: any hit is enough to shadow the point
+	ShadowHitInfo shadowPayload;
+	shadowPayload.isHit = true;
+
+	// Hit group offset 1 and miss shader 1 select the shadow programs
+	TraceRay(context, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER,
+	         kShadowCasterInstanceMask, 1, 1, ray, &shadowPayload);
+
+	const float factor = shadowPayload.isHit ? 0.3f : 1.0f;
+	static_cast<HitInfo*>(payload)->colorAndDistance = glm::vec4(glm::vec3(0, 0.8, 0.9) * factor, context.RayTCurrent);
+}
+
+void FaceClosestHit(ShaderContext& context, void* payload, const Attributes& attrib)
+{
+	const glm::vec3 lightPos = glm::vec3(2, 2, -2);
+	const glm::vec3 worldOrigin = context.WorldRayOrigin + context.RayTCurrent * context.WorldRayDirection;
+
+	float factor = 1.f;
+	const Instance& instance = context.scene->GetInstances()[context.InstanceIndex];
+	if (instance.groupIndex == kNoInstanceGroup)
+	{
+		const Mesh& mesh = context.scene->GetMeshes()[instance.meshIndex];
+		glm::vec3 normal = attrib.normal;
+		if (mesh.procedurals.empty())
+		{
+			// Front faces are clockwise, as in D3D12
+			glm::vec3 v0, v1, v2;
+			mesh.GetTriangle(context.PrimitiveIndex, v0, v1, v2);
+			normal = glm::cross(v2 - v0, v1 - v0);
+		}
+		normal = glm::normalize(glm::transpose(glm::mat3(instance.inverseTransform)) * normal);
+		if (glm::dot(normal, context.WorldRayDirection) > 0.f)
+			normal = -normal;
+		factor = 0.3f + 0.7f * std::max(glm::dot(normal, glm::normalize(lightPos - worldOrigin)), 0.f);
+	}
+	static_cast<HitInfo*>(payload)->colorAndDistance = glm::vec4(glm::vec3(1, 0, 0.5) * factor, context.RayTCurrent);
+}
+
+// ShadowRay.hlsl
+void ShadowClosestHit(ShaderContext&, void* payload, const Attributes&)
+{
+	static_cast<ShadowHitInfo*>(payload)->isHit = true;
+}
+
+void ShadowMiss(ShaderContext&, void* payload)
+{
+	static_cast<ShadowHitInfo*>(payload)->isHit = false;
+}
+
+Pipeline CreateHelloTrianglePipeline()
+{
+	Pipeline pipeline;
+	pipeline.rayGen = RayGen;
+	pipeline.primaryRay = GenerateCameraRay;
+	// The shadow rays of PlaneClosestHit
+	pipeline.occlusionRayTypes = {{1, 1}};
+	pipeline.missShaders = {Miss, ShadowMiss};
+	pipeline.hitGroups = {{CubeClosestHit}, {ShadowClosestHit}, {PlaneClosestHit}};
+	return pipeline;
+}
+
+} // namespace cpu_rt
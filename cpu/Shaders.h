@@ -0,0 +1,138 @@
+#pragma once
+
+// C++ ports of the raytracing shaders of res/shaders, and the minimal pipeline
+// needed to invoke them: a shader table laid out as the one built by
+// D3D12HelloTriangle::CreateShaderBindingTable, and a TraceRay function
+// resolving hit groups and miss shaders the same way DXR does.
+
+#include "RayStream.h"
+#include "Scene.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+struct Pipeline;
+
+/// Closest hit of a ray traced ahead of the shader that requests it
+struct PrimaryHit
+{
+	bool found;
+	HitRecord hit;
+};
+
+/// Resources and system values visible to a shader invocation, the latter
+/// mirroring the DXR intrinsics of the same name
+struct ShaderContext
+{
+	const Pipeline* pipeline;
+	const Scene* scene;
+	const Camera* camera;
+	/// Output image (u0), written by the ray generation shader as RGBA8
+	uint32_t* gOutput;
+
+	glm::uvec2 DispatchRaysIndex;
+	glm::uvec2 DispatchRaysDimensions;
+
+	// Only valid in closest hit shaders
+	glm::vec3 WorldRayOrigin;
+	glm::vec3 WorldRayDirection;
+	float RayTCurrent;
+	uint32_t PrimitiveIndex;
+	uint32_t InstanceIndex;
+	uint32_t InstanceID;
+
+	/// Number of rays traced by the invocation and its children, used for the
+	/// throughput statistics. Rays traced ahead by DispatchRays are counted there
+	uint64_t* rayCount;
+
+	/// Result of the TraceRay call of the ray generation shader when
+	/// DispatchRays traced its ray ahead, null otherwise
+	const PrimaryHit* primaryHit;
+	/// If set, receives the result of the TraceRay call of the ray generation
+	/// shader
+	PrimaryHit* recordedPrimaryHit;
+	/// If set, rays of the occlusion ray types of the pipeline are deferred to
+	/// this stream: before it is traced, TraceRay appends them and returns
+	/// without invoking any shader; once traced, TraceRay reads their results
+	/// back in the same order and invokes the shaders
+	OcclusionRayStream* deferredRays;
+};
+
+/// Payloads are untyped, as in DXR the shaders of a given ray type agree on
+/// the payload structure
+using ClosestHitShader = void (*)(ShaderContext& context, void* payload, const Attributes& attrib);
+using MissShader = void (*)(ShaderContext& context, void* payload);
+using RayGenShader = void (*)(ShaderContext& context);
+/// Ray traced by the ray generation shader for a launch index
+using PrimaryRayFunction = RayDesc (*)(const Camera& camera, const glm::uvec2& launchIndex,
+                                       const glm::uvec2& launchDimensions);
+
+/// Hit groups have no intersection entry: the traversals run
+/// IntersectProcedural, the port of ProceduralIntersection, on every procedural
+/// primitive, as all the procedural hit groups of the sample share it
+struct HitGroup
+{
+	ClosestHitShader closestHit;
+};
+
+/// Ray type of a TraceRay call, identified by its shader table offsets
+struct RayType
+{
+	uint32_t rayContributionToHitGroupIndex;
+	uint32_t missShaderIndex;
+};
+
+/// Shader table, with the same sections and ordering as the SBT
+struct Pipeline
+{
+	RayGenShader rayGen;
+	/// Optional: the ray traced by rayGen, if it can be computed without
+	/// invoking the shader and is traced with RAY_FLAG_NONE and an instance
+	/// inclusion mask of 0xFF. Allows DispatchRays to trace primary rays in
+	/// packets
+	PrimaryRayFunction primaryRay = nullptr;
+	/// Optional: ray types whose shaders only depend on whether something was
+	/// hit, such as shadow rays. DispatchRays may defer them and trace them as
+	/// sorted streams of any-hit queries
+	std::vector<RayType> occlusionRayTypes;
+	std::vector<MissShader> missShaders;
+	std::vector<HitGroup> hitGroups;
+};
+
+/// Trace a ray in the scene and invoke the closest hit or miss shader selected
+/// by the instance hit group offset, the ray contribution and the miss index.
+/// A hit group index beyond the end of the table behaves as a null shader
+/// record: no shader is invoked and the payload is left untouched. rayFlags
+/// combine RayFlags, and only the instances whose mask shares a bit with
+/// instanceInclusionMask can be hit
+void TraceRay(const ShaderContext& caller, uint32_t rayFlags, uint32_t instanceInclusionMask,
+              uint32_t rayContributionToHitGroupIndex, uint32_t missShaderIndex, const RayDesc& ray, void* payload);
+
+/// Camera ray of RayGen for a pixel
+RayDesc GenerateCameraRay(const Camera& camera, const glm::uvec2& launchIndex, const glm::uvec2& launchDimensions);
+
+// Ports of the shaders used by the sample
+void RayGen(ShaderContext& context);
+void Miss(ShaderContext& context, void* payload);
+/// Interpolated vertex color, decoded if the vertices of the mesh are
+/// compressed. The sample does not use it: the primitives of procedural
+/// meshes and of instance groups are white
+void ClosestHit(ShaderContext& context, void* payload, const Attributes& attrib);
+void CubeClosestHit(ShaderContext& context, void* payload, const Attributes& attrib);
+void PlaneClosestHit(ShaderContext& context, void* payload, const Attributes& attrib);
+/// Color of the cube lit by the normal of the face that was hit, turned toward
+/// the ray: the normal of the triangle for meshes and the one reported by the
+/// intersection for procedural primitives, so that a mesh and its procedural
+/// version shade the same. The faces of instance groups are not lit
+void FaceClosestHit(ShaderContext& context, void* payload, const Attributes& attrib);
+void ShadowClosestHit(ShaderContext& context, void* payload, const Attributes& attrib);
+void ShadowMiss(ShaderContext& context, void* payload);
+
+/// Shader table of CreateShaderBindingTable: RayGen, then the Miss and
+/// ShadowMiss programs, then the CubeHitGroup, ShadowHitGroup and
+/// PlaneHitGroup hit groups
+Pipeline CreateHelloTrianglePipeline();
+
+} // namespace cpu_rt
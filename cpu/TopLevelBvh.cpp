@@ -0,0 +1,623 @@
+#include "TopLevelBvh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+static const uint32_t kInvalidIndex = ~0u;
+/// Instances transformed by each task of the updates
+static const uint32_t kInstanceGrainSize = 256;
+/// Updates whose quality is kept in the history
+static const size_t kMaxQualitySamples = 4096;
+
+/// Ray flags seen by the bottom level of an instance: the instance flags
+/// disable or flip the facing culling, and force the opacity unless the ray
+/// already does
+uint32_t ApplyInstanceFlags(uint32_t rayFlags, uint32_t instanceFlags)
+{
+	const uint32_t facingFlags = RAY_FLAG_CULL_BACK_FACING_TRIANGLES | RAY_FLAG_CULL_FRONT_FACING_TRIANGLES;
+	if (instanceFlags & INSTANCE_FLAG_TRIANGLE_CULL_DISABLE)
+	{
+		rayFlags &= ~facingFlags;
+	}
+	else if (instanceFlags & INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE)
+	{
+		// Swap the back and front culling flags when only one is set
+		const uint32_t culledFacing = rayFlags & facingFlags;
+		if (culledFacing == RAY_FLAG_CULL_BACK_FACING_TRIANGLES || culledFacing == RAY_FLAG_CULL_FRONT_FACING_TRIANGLES)
+			rayFlags ^= facingFlags;
+	}
+
+	if (!(rayFlags & (RAY_FLAG_FORCE_OPAQUE | RAY_FLAG_FORCE_NON_OPAQUE)))
+	{
+		if (instanceFlags & INSTANCE_FLAG_FORCE_OPAQUE)
+			rayFlags |= RAY_FLAG_FORCE_OPAQUE;
+		else if (instanceFlags & INSTANCE_FLAG_FORCE_NON_OPAQUE)
+			rayFlags |= RAY_FLAG_FORCE_NON_OPAQUE;
+	}
+	return rayFlags;
+}
+
+float HalfArea(const BvhNode& node)
+{
+	Aabb box;
+	box.min = node.boundsMin;
+	box.max = node.boundsMax;
+	return box.HalfArea();
+}
+
+/// Cost of a node under the SAH, before weighting by its surface area
+double GetNodeCost(const BvhNode& node, float traversalCost, float intersectionCost)
+{
+	return node.IsLeaf() ? double(intersectionCost) * node.count : traversalCost;
+}
+
+/// Build the nodes over the bounds of some of the instances, and the tables
+/// the refits walk. Only reads its inputs, so that it can run on another
+/// thread than the updates. Returns the costs of the nodes weighted by their
+/// surface area
+double BuildTopLevelNodes(const std::vector<Aabb>& instanceBounds, const std::vector<uint32_t>& boundedInstances,
+                          const std::vector<uint8_t>& instanceMasks, const BvhBuildSettings& settings,
+                          std::vector<BvhNode>& nodes, std::vector<uint32_t>& instanceOrder,
+                          std::vector<uint8_t>& nodeMasks, std::vector<uint32_t>& parents,
+                          std::vector<uint32_t>& instanceLeaves)
+{
+	std::vector<Aabb> bounds;
+	bounds.reserve(boundedInstances.size());
+	for (uint32_t instanceIndex : boundedInstances)
+	{
+		bounds.push_back(instanceBounds[instanceIndex]);
+	}
+
+	BvhStats stats;
+	BuildBvhNodes(bounds, settings, nodes, instanceOrder, stats);
+	for (uint32_t& instanceIndex : instanceOrder)
+	{
+		instanceIndex = boundedInstances[instanceIndex];
+	}
+
+	parents.assign(nodes.size(), kInvalidIndex);
+	instanceLeaves.assign(instanceBounds.size(), kInvalidIndex);
+	nodeMasks.assign(nodes.size(), 0);
+	double sahSum = 0.0;
+	// Children are stored after their parent, so a reverse walk visits them
+	// first and the masks propagate in one pass
+	for (uint32_t nodeIndex = static_cast<uint32_t>(nodes.size()); nodeIndex-- > 0;)
+	{
+		const BvhNode& node = nodes[nodeIndex];
+		sahSum += HalfArea(node) * GetNodeCost(node, settings.traversalCost, settings.intersectionCost);
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				instanceLeaves[instanceOrder[i]] = nodeIndex;
+				nodeMasks[nodeIndex] |= instanceMasks[instanceOrder[i]];
+			}
+		}
+		else
+		{
+			parents[node.leftOrFirst] = nodeIndex;
+			parents[node.leftOrFirst + 1] = nodeIndex;
+			nodeMasks[nodeIndex] = nodeMasks[node.leftOrFirst] | nodeMasks[node.leftOrFirst + 1];
+		}
+	}
+	return sahSum;
+}
+
+} // namespace
+
+/// Rebuild running on a thread of its own over a copy of the instance bounds,
+/// into nodes of its own. The scheduler is left alone: a task of its shared
+/// deque could be taken by any TaskGroup::Wait of the thread that updates the
+/// hierarchy, such as that of the next DispatchRays, which would then run the
+/// whole build before tracing its frame
+struct TopLevelRebuild
+{
+	explicit TopLevelRebuild(uint32_t instanceCount) : moved(instanceCount, false) {}
+	/// Wait for the build before the rest goes
+	~TopLevelRebuild()
+	{
+		if (thread.joinable())
+			thread.join();
+	}
+
+	std::vector<Aabb> instanceBounds;
+	std::vector<uint32_t> boundedInstances;
+	std::vector<uint8_t> instanceMasks;
+	BvhBuildSettings settings;
+
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> instanceOrder;
+	std::vector<uint8_t> nodeMasks;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> instanceLeaves;
+	double sahSum = 0.0;
+	std::exception_ptr error;
+	std::atomic<bool> done{false};
+
+	/// Instances moved since the bounds were copied, which the new nodes do
+	/// not bound yet
+	std::vector<uint32_t> movedInstances;
+	std::vector<bool> moved;
+
+	std::thread thread;
+};
+
+TopLevelBvh::PendingRebuild::PendingRebuild() = default;
+
+TopLevelBvh::PendingRebuild::PendingRebuild(const PendingRebuild&) {}
+
+TopLevelBvh::PendingRebuild& TopLevelBvh::PendingRebuild::operator=(const PendingRebuild&)
+{
+	state.reset();
+	return *this;
+}
+
+TopLevelBvh::PendingRebuild::~PendingRebuild() = default;
+
+uint32_t TopLevelBvh::AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID,
+                                  uint32_t hitGroupIndex, uint32_t instanceMask, uint32_t flags)
+{
+	m_instances.push_back({meshIndex, transform, glm::inverse(transform), instanceID, hitGroupIndex,
+	                       instanceMask & 0xFF, flags, kNoInstanceGroup, kNotMerged, kNotMerged});
+	m_needsBuild = true;
+	return static_cast<uint32_t>(m_instances.size() - 1);
+}
+
+uint32_t TopLevelBvh::AddGroupInstance(uint32_t groupIndex, const glm::mat4& transform, uint32_t instanceID,
+                                       uint32_t hitGroupIndex, uint32_t instanceMask, uint32_t flags)
+{
+	m_instances.push_back({0, transform, glm::inverse(transform), instanceID, hitGroupIndex, instanceMask & 0xFF,
+	                       flags, groupIndex, kNotMerged, kNotMerged});
+	m_needsBuild = true;
+	return static_cast<uint32_t>(m_instances.size() - 1);
+}
+
+uint32_t TopLevelBvh::AddMergedInstance(uint32_t meshIndex, const std::vector<uint32_t>& sourceInstances)
+{
+	if (sourceInstances.empty())
+	{
+		throw std::logic_error("Merged instances need at least one source instance");
+	}
+	const Instance& first = m_instances.at(sourceInstances[0]);
+	for (uint32_t sourceIndex : sourceInstances)
+	{
+		const Instance& source = m_instances.at(sourceIndex);
+		if (source.groupIndex != kNoInstanceGroup || source.firstMergedSource != kNotMerged)
+		{
+			throw std::logic_error("Only the instances of meshes can be merged");
+		}
+		if (source.mergedInstance != kNotMerged)
+		{
+			throw std::logic_error("Instance is already merged");
+		}
+		if (source.instanceMask != first.instanceMask || source.flags != first.flags)
+		{
+			throw std::logic_error("Merged instances must share their mask and flags");
+		}
+	}
+
+	const uint32_t mergedIndex = static_cast<uint32_t>(m_instances.size());
+	for (uint32_t sourceIndex : sourceInstances)
+	{
+		m_instances[sourceIndex].mergedInstance = mergedIndex;
+	}
+	// The instance ID and hit group are those of the sources, as reported by
+	// the hits
+	m_instances.push_back({meshIndex, glm::mat4(1.f), glm::mat4(1.f), first.instanceID, first.hitGroupIndex,
+	                       first.instanceMask, first.flags, kNoInstanceGroup, kNotMerged,
+	                       static_cast<uint32_t>(m_mergedSources.size())});
+	m_mergedSources.insert(m_mergedSources.end(), sourceInstances.begin(), sourceInstances.end());
+	m_needsBuild = true;
+	return mergedIndex;
+}
+
+void TopLevelBvh::SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform)
+{
+	Instance& instance = m_instances.at(instanceIndex);
+	if (instance.mergedInstance != kNotMerged)
+	{
+		throw std::logic_error("Instances baked into a merged instance cannot move");
+	}
+	instance.transform = transform;
+	instance.inverseTransform = glm::inverse(transform);
+	MarkDirty(instanceIndex);
+}
+
+void TopLevelBvh::MarkGeometryChanged(uint32_t instanceIndex)
+{
+	if (instanceIndex >= m_instances.size())
+	{
+		throw std::logic_error("Instance index out of range");
+	}
+	// An instance left out of the hierarchy for its empty bounds has no leaf
+	// to refit: it may only enter the hierarchy by a build
+	if (!m_needsBuild && m_instanceLeaves[instanceIndex] == kInvalidIndex)
+	{
+		m_needsBuild = true;
+		return;
+	}
+	MarkDirty(instanceIndex);
+}
+
+void TopLevelBvh::MarkDirty(uint32_t instanceIndex)
+{
+	if (m_needsBuild || m_isDirty[instanceIndex])
+		return;
+	m_isDirty[instanceIndex] = true;
+	m_dirtyInstances.push_back(instanceIndex);
+	TopLevelRebuild* rebuild = m_pendingRebuild.state.get();
+	if (rebuild && !rebuild->moved[instanceIndex])
+	{
+		rebuild->moved[instanceIndex] = true;
+		rebuild->movedInstances.push_back(instanceIndex);
+	}
+}
+
+void TopLevelBvh::Update(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+                         const BvhBuildSettings& settings)
+{
+	if (m_needsBuild)
+	{
+		Build(bottomLevels, groups, settings);
+		return;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	const bool swapped = m_pendingRebuild.state && m_pendingRebuild.state->done;
+	if (swapped)
+		SwapRebuild();
+	if (m_dirtyInstances.empty() && !swapped)
+		return;
+
+	// The policy judges the hierarchy as left by the last update. An asynchronous
+	// rebuild starts from the bounds of this one, after the refit
+	const bool rebuild = !swapped && !IsRebuilding() && ShouldRebuild();
+	if (rebuild)
+		m_stats.policyRebuildCount++;
+	if (rebuild && !m_policy.asynchronous)
+	{
+		Build(bottomLevels, groups, settings);
+		return;
+	}
+	if (!m_dirtyInstances.empty())
+		Refit(bottomLevels, groups, settings);
+	if (rebuild)
+		StartRebuild(settings);
+	RecordQuality(swapped);
+	m_stats.lastUpdateSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void TopLevelBvh::Build(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+                        const BvhBuildSettings& settings)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	m_pendingRebuild.state.reset();
+	const uint32_t instanceCount = static_cast<uint32_t>(m_instances.size());
+
+	m_instanceBounds.resize(instanceCount);
+	ParallelFor(instanceCount, kInstanceGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            const Instance& instance = m_instances[i];
+			            m_instanceBounds[i] = TransformAabb(
+			                GetGeometryBounds(instance.meshIndex, instance.groupIndex, bottomLevels, groups),
+			                instance.transform);
+		            }
+	            },
+	            settings.threadCount);
+
+	std::vector<uint8_t> instanceMasks(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		instanceMasks[i] = static_cast<uint8_t>(m_instances[i].instanceMask);
+	}
+	m_sahSum = BuildTopLevelNodes(m_instanceBounds, GetBoundedInstances(), instanceMasks, settings, m_nodes,
+	                              m_instanceOrder, m_nodeMasks, m_parents, m_instanceLeaves);
+	m_traversalCost = settings.traversalCost;
+	m_intersectionCost = settings.intersectionCost;
+
+	m_dirtyInstances.clear();
+	m_isDirty.assign(instanceCount, false);
+	m_needsBuild = false;
+
+	m_stats.instanceCount = instanceCount;
+	m_stats.nodeCount = static_cast<uint32_t>(m_nodes.size());
+	m_stats.buildCount++;
+	m_stats.refitsSinceBuild = 0;
+	m_stats.sahCost = m_nodes.empty() ? 0.f : static_cast<float>(m_sahSum / std::max(HalfArea(m_nodes[0]), FLT_MIN));
+	m_stats.builtSahCost = m_stats.sahCost;
+	m_stats.refittedInstances = instanceCount;
+	m_stats.refittedNodes = m_stats.nodeCount;
+	RecordQuality(true);
+	m_stats.lastUpdateSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+std::vector<uint32_t> TopLevelBvh::GetBoundedInstances() const
+{
+	// Instances of empty meshes or groups cannot be hit and are left out of
+	// the hierarchy, as their bounds have no centroid, and so are the
+	// instances baked into merged ones
+	std::vector<uint32_t> boundedInstances;
+	boundedInstances.reserve(m_instances.size());
+	for (uint32_t i = 0; i < m_instances.size(); i++)
+	{
+		if (!m_instanceBounds[i].IsEmpty() && m_instances[i].mergedInstance == kNotMerged)
+			boundedInstances.push_back(i);
+	}
+	return boundedInstances;
+}
+
+void TopLevelBvh::StartRebuild(const BvhBuildSettings& settings)
+{
+	const uint32_t instanceCount = static_cast<uint32_t>(m_instances.size());
+	m_pendingRebuild.state.reset(new TopLevelRebuild(instanceCount));
+	TopLevelRebuild& rebuild = *m_pendingRebuild.state;
+	rebuild.instanceBounds = m_instanceBounds;
+	rebuild.boundedInstances = GetBoundedInstances();
+	rebuild.instanceMasks.resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		rebuild.instanceMasks[i] = static_cast<uint8_t>(m_instances[i].instanceMask);
+	}
+	// Built on the rebuild thread alone, so that none of its tasks reach the
+	// scheduler
+	rebuild.settings = settings;
+	rebuild.settings.threadCount = 1;
+
+	rebuild.thread = std::thread([&rebuild] {
+		try
+		{
+			rebuild.sahSum = BuildTopLevelNodes(rebuild.instanceBounds, rebuild.boundedInstances,
+			                                    rebuild.instanceMasks, rebuild.settings, rebuild.nodes,
+			                                    rebuild.instanceOrder, rebuild.nodeMasks, rebuild.parents,
+			                                    rebuild.instanceLeaves);
+		}
+		catch (...)
+		{
+			rebuild.error = std::current_exception();
+		}
+		rebuild.done = true;
+	});
+}
+
+void TopLevelBvh::SwapRebuild()
+{
+	const std::unique_ptr<TopLevelRebuild> rebuild = std::move(m_pendingRebuild.state);
+	rebuild->thread.join();
+	if (rebuild->error)
+		std::rethrow_exception(rebuild->error);
+	m_nodes.swap(rebuild->nodes);
+	m_instanceOrder.swap(rebuild->instanceOrder);
+	m_nodeMasks.swap(rebuild->nodeMasks);
+	m_parents.swap(rebuild->parents);
+	m_instanceLeaves.swap(rebuild->instanceLeaves);
+	m_sahSum = rebuild->sahSum;
+	m_traversalCost = rebuild->settings.traversalCost;
+	m_intersectionCost = rebuild->settings.intersectionCost;
+
+	m_stats.nodeCount = static_cast<uint32_t>(m_nodes.size());
+	m_stats.buildCount++;
+	m_stats.asyncRebuildCount++;
+	m_stats.refitsSinceBuild = 0;
+	m_stats.sahCost = m_nodes.empty() ? 0.f : static_cast<float>(m_sahSum / std::max(HalfArea(m_nodes[0]), FLT_MIN));
+	m_stats.builtSahCost = m_stats.sahCost;
+
+	// The new nodes bound the instances where they were when the rebuild
+	// started: those moved since are refitted into them
+	for (uint32_t instanceIndex : rebuild->movedInstances)
+	{
+		if (m_isDirty[instanceIndex])
+			continue;
+		m_isDirty[instanceIndex] = true;
+		m_dirtyInstances.push_back(instanceIndex);
+	}
+}
+
+bool TopLevelBvh::ShouldRebuild() const
+{
+	return (m_policy.maxSahInflation > 0.f && m_stats.sahCost > m_policy.maxSahInflation * m_stats.builtSahCost) ||
+	       (m_policy.maxRefits > 0 && m_stats.refitsSinceBuild >= m_policy.maxRefits);
+}
+
+void TopLevelBvh::RecordQuality(bool rebuilt)
+{
+	if (m_qualityHistory.size() == kMaxQualitySamples)
+		m_qualityHistory.pop_front();
+	const float inflation = m_stats.builtSahCost > 0.f ? m_stats.sahCost / m_stats.builtSahCost : 1.f;
+	m_qualityHistory.push_back({m_stats.sahCost, inflation, rebuilt});
+}
+
+void TopLevelBvh::Refit(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+                        const BvhBuildSettings& settings)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	uint32_t refittedNodes = 0;
+
+	// Transform the bounds of the instances in parallel, then refit their
+	// paths to the root in turn, as they share their upper nodes
+	ParallelFor(static_cast<uint32_t>(m_dirtyInstances.size()), kInstanceGrainSize,
+	            [&](uint32_t begin, uint32_t end) {
+		            for (uint32_t i = begin; i < end; i++)
+		            {
+			            const Instance& instance = m_instances[m_dirtyInstances[i]];
+			            m_instanceBounds[m_dirtyInstances[i]] = TransformAabb(
+			                GetGeometryBounds(instance.meshIndex, instance.groupIndex, bottomLevels, groups),
+			                instance.transform);
+		            }
+	            },
+	            settings.threadCount);
+
+	for (uint32_t instanceIndex : m_dirtyInstances)
+	{
+		m_isDirty[instanceIndex] = false;
+
+		// Walk up from the leaf of the instance, and stop as soon as a node
+		// keeps its bounds: the ancestors are then already up to date
+		for (uint32_t nodeIndex = m_instanceLeaves[instanceIndex]; nodeIndex != kInvalidIndex;
+		     nodeIndex = m_parents[nodeIndex])
+		{
+			BvhNode& node = m_nodes[nodeIndex];
+			const Aabb bounds = ComputeNodeBounds(node);
+			refittedNodes++;
+			if (bounds.min == node.boundsMin && bounds.max == node.boundsMax)
+				break;
+			m_sahSum += (bounds.HalfArea() - HalfArea(node)) * GetNodeCost(node, m_traversalCost, m_intersectionCost);
+			node.boundsMin = bounds.min;
+			node.boundsMax = bounds.max;
+		}
+	}
+
+	m_stats.refitCount++;
+	m_stats.refitsSinceBuild++;
+	m_stats.sahCost = m_nodes.empty() ? 0.f : static_cast<float>(m_sahSum / std::max(HalfArea(m_nodes[0]), FLT_MIN));
+	m_stats.refittedInstances = static_cast<uint32_t>(m_dirtyInstances.size());
+	m_stats.refittedNodes = refittedNodes;
+	m_dirtyInstances.clear();
+	m_stats.lastUpdateSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+Aabb TopLevelBvh::ComputeNodeBounds(const BvhNode& node) const
+{
+	Aabb bounds;
+	if (node.IsLeaf())
+	{
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			bounds.Extend(m_instanceBounds[m_instanceOrder[i]]);
+		}
+	}
+	else
+	{
+		for (uint32_t child = node.leftOrFirst; child < node.leftOrFirst + 2; child++)
+		{
+			bounds.Extend(m_nodes[child].boundsMin);
+			bounds.Extend(m_nodes[child].boundsMax);
+		}
+	}
+	return bounds;
+}
+
+bool TopLevelBvh::Intersect(const RayDesc& ray, const std::vector<Bvh>& bottomLevels,
+                            const std::vector<InstanceGroup>& groups, HitRecord& hit, uint32_t rayFlags,
+                            uint32_t instanceInclusionMask) const
+{
+	if (rayFlags & RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH)
+		return Traverse<true>(ray, bottomLevels, groups, &hit, rayFlags, instanceInclusionMask);
+	return Traverse<false>(ray, bottomLevels, groups, &hit, rayFlags, instanceInclusionMask);
+}
+
+bool TopLevelBvh::Occluded(const RayDesc& ray, const std::vector<Bvh>& bottomLevels,
+                           const std::vector<InstanceGroup>& groups, HitRecord* hit, uint32_t rayFlags,
+                           uint32_t instanceInclusionMask) const
+{
+	return Traverse<true>(ray, bottomLevels, groups, hit, rayFlags, instanceInclusionMask);
+}
+
+template <bool AnyHit>
+bool TopLevelBvh::Traverse(const RayDesc& rayDesc, const std::vector<Bvh>& bottomLevels,
+                           const std::vector<InstanceGroup>& groups, HitRecord* hit, uint32_t rayFlags,
+                           uint32_t instanceInclusionMask) const
+{
+	if (m_nodes.empty() || !(m_nodeMasks[0] & instanceInclusionMask))
+		return false;
+
+	const TraversalRay ray(rayDesc);
+	RayDesc objectRay = rayDesc;
+	bool found = false;
+
+	struct StackEntry
+	{
+		uint32_t nodeIndex;
+		float tEntry;
+	};
+	StackEntry stack[kBvhMaxDepth + 1];
+	uint32_t stackSize = 0;
+
+	float tEntry;
+	if (!IntersectAabb(ray, m_nodes[0].boundsMin, m_nodes[0].boundsMax, objectRay.TMax, tEntry))
+		return false;
+	stack[stackSize++] = {0, tEntry};
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.tEntry > objectRay.TMax)
+			continue;
+		const BvhNode& node = m_nodes[entry.nodeIndex];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const uint32_t instanceIndex = m_instanceOrder[i];
+				const Instance& instance = m_instances[instanceIndex];
+				if (!(instance.instanceMask & instanceInclusionMask))
+					continue;
+				const uint32_t instanceRayFlags = ApplyInstanceFlags(rayFlags, instance.flags);
+
+				// The direction is not normalized after the transform, so that
+				// the distances along the object-space ray are the world-space ones
+				objectRay.Origin = glm::vec3(instance.inverseTransform * glm::vec4(rayDesc.Origin, 1.f));
+				objectRay.Direction = glm::mat3(instance.inverseTransform) * rayDesc.Direction;
+
+				TriangleHit triangleHit;
+				if (!IntersectGeometry(instance.meshIndex, instance.groupIndex, objectRay, bottomLevels, groups, AnyHit,
+				                       hit ? &triangleHit : nullptr, instanceRayFlags))
+					continue;
+				if (hit)
+					*hit = {triangleHit.t, triangleHit.attrib, triangleHit.primitiveIndex,
+					        GetHitInstance(instanceIndex, triangleHit.geometryIndex)};
+				if (AnyHit)
+					return true;
+				objectRay.TMax = triangleHit.t;
+				found = true;
+			}
+			continue;
+		}
+
+		const BvhNode& left = m_nodes[node.leftOrFirst];
+		const BvhNode& right = m_nodes[node.leftOrFirst + 1];
+		float tLeft, tRight;
+		const bool hitLeft = (m_nodeMasks[node.leftOrFirst] & instanceInclusionMask) &&
+		                     IntersectAabb(ray, left.boundsMin, left.boundsMax, objectRay.TMax, tLeft);
+		const bool hitRight = (m_nodeMasks[node.leftOrFirst + 1] & instanceInclusionMask) &&
+		                      IntersectAabb(ray, right.boundsMin, right.boundsMax, objectRay.TMax, tRight);
+		if (hitLeft && hitRight)
+		{
+			if (tLeft <= tRight)
+			{
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+			}
+			else
+			{
+				stack[stackSize++] = {node.leftOrFirst, tLeft};
+				stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+			}
+		}
+		else if (hitLeft)
+		{
+			stack[stackSize++] = {node.leftOrFirst, tLeft};
+		}
+		else if (hitRight)
+		{
+			stack[stackSize++] = {node.leftOrFirst + 1, tRight};
+		}
+	}
+	return found;
+}
+
+} // namespace cpu_rt
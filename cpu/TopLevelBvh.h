@@ -0,0 +1,259 @@
+#pragma once
+
+// Hierarchy over instances of bottom-level hierarchies, the CPU counterpart of
+// a top-level acceleration structure. Instances are added as with
+// TopLevelASGenerator::AddInstance. Unlike CreateTopLevelAS(instances, true),
+// which rewrites every instance descriptor on each update, only the instances
+// whose transform changed since the last update are refitted, along with the
+// path from their leaf to the root. Refits keep the topology of the last
+// build, whose boxes grow as the instances move away from where it placed
+// them, so a RebuildPolicy tracks the SAH cost of the hierarchy and rebuilds
+// it once it decays, optionally on a thread of its own while the refitted
+// hierarchy is still traced. Static instances may be baked into the
+// merged instance of a mesh holding their triangles (see InstanceMerging.h),
+// which stands for them in the hierarchy.
+
+#include "InstanceGroup.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Instance::mergedInstance and Instance::firstMergedSource of the instances
+/// that are neither merged nor baked into a merged instance
+static const uint32_t kNotMerged = ~0u;
+
+/// Instance of a bottom-level hierarchy or of an instance group, mirroring
+/// the parameters of TopLevelASGenerator::AddInstance
+struct Instance
+{
+	/// Index of the bottom-level hierarchy, which is also the mesh index in the
+	/// scene. Unused by the instances of groups
+	uint32_t meshIndex;
+	/// Object to world transform
+	glm::mat4 transform;
+	/// World to object transform, cached to transform the rays
+	glm::mat4 inverseTransform;
+	/// Value returned by InstanceID() in the shaders
+	uint32_t instanceID;
+	/// Offset of the instance hit groups in the shader table
+	uint32_t hitGroupIndex;
+	/// 8-bit mask, and-ed with the InstanceInclusionMask of the rays: the
+	/// instance is invisible to the rays for which the result is 0
+	uint32_t instanceMask;
+	/// Combination of InstanceFlags
+	uint32_t flags;
+	/// Index of the instanced group, or kNoInstanceGroup for meshes
+	uint32_t groupIndex;
+	/// Merged instance the instance is baked into, in which case it is left
+	/// out of the hierarchy, or kNotMerged
+	uint32_t mergedInstance;
+	/// For merged instances, offset in TopLevelBvh::GetMergedSources() of the
+	/// instance baked into each geometry of the mesh, or kNotMerged
+	uint32_t firstMergedSource;
+};
+
+/// Result of a ray-scene intersection
+struct HitRecord
+{
+	float t;
+	Attributes attrib;
+	uint32_t primitiveIndex;
+	uint32_t instanceIndex;
+};
+
+/// When TopLevelBvh::Update rebuilds the hierarchy instead of refitting it.
+/// The defaults refit forever, as CreateTopLevelAS(instances, true) does
+struct RebuildPolicy
+{
+	/// Rebuild once the SAH cost exceeds the cost after the last build by this
+	/// factor, 0 for no limit
+	float maxSahInflation = 0.f;
+	/// Rebuild after this many refits, 0 for no limit
+	uint32_t maxRefits = 0;
+	/// Rebuild on a thread of its own while the refitted hierarchy is still
+	/// traced, and swap the new one in at the first update after it is done,
+	/// refitting the instances moved in the meantime
+	bool asynchronous = false;
+};
+
+/// Quality of the hierarchy after an update
+struct TopLevelQualitySample
+{
+	/// SAH cost, relative to the surface area of the root
+	float sahCost;
+	/// Ratio of the SAH cost to the cost after the last build
+	float inflation;
+	/// The update built the hierarchy, or swapped in an asynchronous rebuild
+	bool rebuilt;
+};
+
+struct TopLevelBvhStats
+{
+	uint32_t instanceCount = 0;
+	uint32_t nodeCount = 0;
+	/// Number of full builds and refits since the creation of the hierarchy
+	uint32_t buildCount = 0;
+	uint32_t refitCount = 0;
+	/// Builds triggered by the RebuildPolicy, and those of them that ran
+	/// asynchronously
+	uint32_t policyRebuildCount = 0;
+	uint32_t asyncRebuildCount = 0;
+	/// Refits since the last build
+	uint32_t refitsSinceBuild = 0;
+	/// SAH cost of the hierarchy, relative to the surface area of the root,
+	/// after the last build and now
+	float builtSahCost = 0.f;
+	float sahCost = 0.f;
+	/// Instances and nodes updated by the last refit
+	uint32_t refittedInstances = 0;
+	uint32_t refittedNodes = 0;
+	double lastUpdateSeconds = 0.0;
+};
+
+/// State of an asynchronous rebuild, defined in TopLevelBvh.cpp
+struct TopLevelRebuild;
+
+class TopLevelBvh
+{
+public:
+	/// Add an instance and return its index, which is the order in which the
+	/// instances are added. The hierarchy is rebuilt by the next Update
+	uint32_t AddInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t instanceID, uint32_t hitGroupIndex,
+	                     uint32_t instanceMask = 0xFF, uint32_t flags = INSTANCE_FLAG_NONE);
+	/// Add an instance of a group, whose mask and flags apply to everything in
+	/// it, and return its index
+	uint32_t AddGroupInstance(uint32_t groupIndex, const glm::mat4& transform, uint32_t instanceID,
+	                          uint32_t hitGroupIndex, uint32_t instanceMask = 0xFF, uint32_t flags = INSTANCE_FLAG_NONE);
+	/// Add an instance of a mesh whose geometry g holds the triangles of
+	/// sourceInstances[g] in world space, with an identity transform, and
+	/// return its index. The sources keep their index and are left out of the
+	/// hierarchy: the hits of the merged instance are reported as hits of
+	/// the source of their geometry. The sources must be instances of meshes
+	/// sharing their mask and flags, and cannot move afterwards
+	uint32_t AddMergedInstance(uint32_t meshIndex, const std::vector<uint32_t>& sourceInstances);
+	/// Change the transform of an instance. The hierarchy is refitted by the
+	/// next Update. Throws std::logic_error for the sources of merged instances
+	void SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform);
+	/// Refit an instance whose group was rebuilt, as its bounds may have
+	/// changed, by the next Update. The instances that had empty bounds are
+	/// added to the hierarchy by a rebuild
+	void MarkGeometryChanged(uint32_t instanceIndex);
+
+	/// Bring the hierarchy up to date: rebuild it if instances were added since
+	/// the last build, otherwise refit the instances whose transform changed,
+	/// or rebuild it as the RebuildPolicy asks. bottomLevels are indexed by
+	/// Instance::meshIndex, and the built groups by Instance::groupIndex
+	void Update(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	            const BvhBuildSettings& settings = {});
+	/// Rebuild the hierarchy over all the instances, dropping an asynchronous
+	/// rebuild in progress
+	void Build(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	           const BvhBuildSettings& settings = {});
+	/// True if Update has nothing to do but swap in an asynchronous rebuild
+	bool IsUpToDate() const { return !m_needsBuild && m_dirtyInstances.empty(); }
+	void SetRebuildPolicy(const RebuildPolicy& policy) { m_policy = policy; }
+	const RebuildPolicy& GetRebuildPolicy() const { return m_policy; }
+	/// True while an asynchronous rebuild has not been swapped in
+	bool IsRebuilding() const { return m_pendingRebuild.state != nullptr; }
+
+	/// Closest intersection in ]TMin, TMax[ with the instances whose mask
+	/// shares a bit with instanceInclusionMask, or the first one found with
+	/// RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH. The hierarchy must be up to
+	/// date
+	bool Intersect(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	               HitRecord& hit, uint32_t rayFlags = RAY_FLAG_NONE, uint32_t instanceInclusionMask = 0xFF) const;
+	/// Return true as soon as any intersection is found in ]TMin, TMax[, and
+	/// optionally that intersection
+	bool Occluded(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	              HitRecord* hit = nullptr, uint32_t rayFlags = RAY_FLAG_NONE,
+	              uint32_t instanceInclusionMask = 0xFF) const;
+
+	const std::vector<Instance>& GetInstances() const { return m_instances; }
+	/// Instance reported by a hit of a geometry of an instance: the source
+	/// baked into the geometry for merged instances, the instance otherwise
+	uint32_t GetHitInstance(uint32_t instanceIndex, uint32_t geometryIndex) const
+	{
+		const uint32_t firstSource = m_instances[instanceIndex].firstMergedSource;
+		return firstSource == kNotMerged ? instanceIndex : m_mergedSources[firstSource + geometryIndex];
+	}
+	const std::vector<uint32_t>& GetMergedSources() const { return m_mergedSources; }
+	const std::vector<BvhNode>& GetNodes() const { return m_nodes; }
+	/// Instance indices referenced by the leaves
+	const std::vector<uint32_t>& GetInstanceOrder() const { return m_instanceOrder; }
+	const TopLevelBvhStats& GetStats() const { return m_stats; }
+	/// Quality after each of the last updates that changed the hierarchy,
+	/// oldest first: the curve of its decay under refits
+	const std::deque<TopLevelQualitySample>& GetQualityHistory() const { return m_qualityHistory; }
+
+private:
+	/// Owner of the asynchronous rebuild in progress. Copies of a hierarchy
+	/// start without one, and wait for their own
+	struct PendingRebuild
+	{
+		PendingRebuild();
+		PendingRebuild(const PendingRebuild&);
+		PendingRebuild& operator=(const PendingRebuild&);
+		~PendingRebuild();
+
+		std::unique_ptr<TopLevelRebuild> state;
+	};
+
+	/// Instances in the hierarchy: those with bounds and not merged
+	std::vector<uint32_t> GetBoundedInstances() const;
+	/// Queue an instance for the next refit, and for the one of the
+	/// asynchronous rebuild in progress
+	void MarkDirty(uint32_t instanceIndex);
+	void StartRebuild(const BvhBuildSettings& settings);
+	void SwapRebuild();
+	bool ShouldRebuild() const;
+	void RecordQuality(bool rebuilt);
+
+	void Refit(const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	           const BvhBuildSettings& settings);
+	Aabb ComputeNodeBounds(const BvhNode& node) const;
+
+	template <bool AnyHit>
+	bool Traverse(const RayDesc& ray, const std::vector<Bvh>& bottomLevels, const std::vector<InstanceGroup>& groups,
+	              HitRecord* hit, uint32_t rayFlags, uint32_t instanceInclusionMask) const;
+
+	std::vector<Instance> m_instances;
+	/// Sources of the merged instances, one range per merged instance
+	std::vector<uint32_t> m_mergedSources;
+	/// World-space bounds of each instance
+	std::vector<Aabb> m_instanceBounds;
+
+	/// Leaves reference ranges of m_instanceOrder
+	std::vector<BvhNode> m_nodes;
+	std::vector<uint32_t> m_instanceOrder;
+	/// Union of the masks of the instances below each node, so that subtrees
+	/// invisible to a ray are never visited
+	std::vector<uint8_t> m_nodeMasks;
+	/// Parent of each node, and leaf containing each instance, to walk up the
+	/// hierarchy during refits. Instances with empty bounds are in no leaf
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_instanceLeaves;
+
+	/// Instances whose transform changed since the last update, without
+	/// duplicates
+	std::vector<uint32_t> m_dirtyInstances;
+	std::vector<bool> m_isDirty;
+	bool m_needsBuild = false;
+
+	RebuildPolicy m_policy;
+	PendingRebuild m_pendingRebuild;
+	/// Costs of the nodes weighted by their surface area, kept up to date by
+	/// the refits, with the costs of the last build
+	double m_sahSum = 0.0;
+	float m_traversalCost = 1.f;
+	float m_intersectionCost = 1.f;
+
+	TopLevelBvhStats m_stats;
+	/// Bounded: the oldest sample goes as each new one comes in
+	std::deque<TopLevelQualitySample> m_qualityHistory;
+};
+
+} // namespace cpu_rt
@@ -0,0 +1,247 @@
+#include "TriangleBlock.h"
+
+#include <glm/integer.hpp>
+#include <glm/simd/platform.h>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Results of the tests of the lanes of a block, before the lanes whose edge
+/// functions need double precision are decided
+struct LaneResults
+{
+	uint32_t hitMask;
+	uint32_t ambiguousMask;
+};
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+struct SseLanes
+{
+	using Float = __m128;
+	static Float Set(float x) { return _mm_set1_ps(x); }
+	static Float Load(const float* p) { return _mm_load_ps(p); }
+	static void Store(float* p, Float x) { _mm_storeu_ps(p, x); }
+	static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+	static uint32_t Less(Float a, Float b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+	static uint32_t Equal(Float a, Float b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(a, b))); }
+};
+
+#	if GLM_ARCH & GLM_ARCH_AVX_BIT
+
+struct AvxLanes
+{
+	using Float = __m256;
+	static Float Set(float x) { return _mm256_set1_ps(x); }
+	static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+	static void Store(float* p, Float x) { _mm256_storeu_ps(p, x); }
+	static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	static uint32_t Less(Float a, Float b)
+	{
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)));
+	}
+	static uint32_t Equal(Float a, Float b)
+	{
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)));
+	}
+};
+
+#	endif
+
+/// SIMD version of IntersectTriangleWatertight for the lanes starting at
+/// offset, with the same operations in the same order so that both give the
+/// same results. Writes the distances and barycentrics of all the lanes
+template <typename Lanes, uint32_t Width>
+LaneResults IntersectLanes(const TriangleBlock<Width>& block, const WatertightRay& ray, float tMin, float tMax,
+                           uint32_t offset, float* t, float* bary0, float* bary1)
+{
+	using Float = typename Lanes::Float;
+	const Float shearX = Lanes::Set(ray.shearX);
+	const Float shearY = Lanes::Set(ray.shearY);
+
+	// Vertices relative to the ray origin, sheared so that the ray goes along z
+	Float x[3], y[3], z[3];
+	for (int vertex = 0; vertex < 3; vertex++)
+	{
+		const Float px = Lanes::Sub(Lanes::Load(block.vertices[vertex][ray.kx] + offset), Lanes::Set(ray.origin[ray.kx]));
+		const Float py = Lanes::Sub(Lanes::Load(block.vertices[vertex][ray.ky] + offset), Lanes::Set(ray.origin[ray.ky]));
+		z[vertex] = Lanes::Sub(Lanes::Load(block.vertices[vertex][ray.kz] + offset), Lanes::Set(ray.origin[ray.kz]));
+		x[vertex] = Lanes::Sub(px, Lanes::Mul(shearX, z[vertex]));
+		y[vertex] = Lanes::Sub(py, Lanes::Mul(shearY, z[vertex]));
+	}
+
+	const Float u = Lanes::Sub(Lanes::Mul(x[2], y[1]), Lanes::Mul(y[2], x[1]));
+	const Float v = Lanes::Sub(Lanes::Mul(x[0], y[2]), Lanes::Mul(y[0], x[2]));
+	const Float w = Lanes::Sub(Lanes::Mul(x[1], y[0]), Lanes::Mul(y[1], x[0]));
+
+	const Float zero = Lanes::Set(0.f);
+	const uint32_t negative = Lanes::Less(u, zero) | Lanes::Less(v, zero) | Lanes::Less(w, zero);
+	const uint32_t positive = Lanes::Less(zero, u) | Lanes::Less(zero, v) | Lanes::Less(zero, w);
+	const uint32_t ambiguous = Lanes::Equal(u, zero) | Lanes::Equal(v, zero) | Lanes::Equal(w, zero);
+
+	const Float det = Lanes::Add(Lanes::Add(u, v), w);
+	const Float scaledT = Lanes::Mul(
+	    Lanes::Set(ray.shearZ),
+	    Lanes::Add(Lanes::Add(Lanes::Mul(u, z[0]), Lanes::Mul(v, z[1])), Lanes::Mul(w, z[2])));
+	const Float invDet = Lanes::Div(Lanes::Set(1.f), det);
+	const Float distance = Lanes::Mul(scaledT, invDet);
+
+	// NaN distances of null determinants fail both comparisons
+	const uint32_t inRange = Lanes::Less(Lanes::Set(tMin), distance) & Lanes::Less(distance, Lanes::Set(tMax));
+	Lanes::Store(t + offset, distance);
+	Lanes::Store(bary0 + offset, Lanes::Mul(v, invDet));
+	Lanes::Store(bary1 + offset, Lanes::Mul(w, invDet));
+
+	const uint32_t hits = ~(negative & positive) & ~Lanes::Equal(det, zero) & inRange & ~ambiguous;
+	return {hits << offset, ambiguous << offset};
+}
+
+template <uint32_t Width>
+LaneResults IntersectAllLanes(const TriangleBlock<Width>& block, const WatertightRay& ray, float tMin, float tMax,
+                              float* t, float* bary0, float* bary1);
+
+template <>
+LaneResults IntersectAllLanes<4>(const TriangleBlock<4>& block, const WatertightRay& ray, float tMin, float tMax,
+                                 float* t, float* bary0, float* bary1)
+{
+	return IntersectLanes<SseLanes>(block, ray, tMin, tMax, 0, t, bary0, bary1);
+}
+
+template <>
+LaneResults IntersectAllLanes<8>(const TriangleBlock<8>& block, const WatertightRay& ray, float tMin, float tMax,
+                                 float* t, float* bary0, float* bary1)
+{
+#	if GLM_ARCH & GLM_ARCH_AVX_BIT
+	return IntersectLanes<AvxLanes>(block, ray, tMin, tMax, 0, t, bary0, bary1);
+#	else
+	const LaneResults low = IntersectLanes<SseLanes>(block, ray, tMin, tMax, 0, t, bary0, bary1);
+	const LaneResults high = IntersectLanes<SseLanes>(block, ray, tMin, tMax, 4, t, bary0, bary1);
+	return {low.hitMask | high.hitMask, low.ambiguousMask | high.ambiguousMask};
+#	endif
+}
+
+#else
+
+/// Without SIMD every lane goes through the scalar test
+template <uint32_t Width>
+LaneResults IntersectAllLanes(const TriangleBlock<Width>&, const WatertightRay&, float, float, float*, float*, float*)
+{
+	return {0u, (1u << Width) - 1};
+}
+
+#endif
+
+} // namespace
+
+template <uint32_t Width>
+uint32_t PackTriangleBlocks(const BvhTriangle* triangles, uint32_t triangleCount,
+                            std::vector<TriangleBlock<Width>>& blocks)
+{
+	const uint32_t blockCount = (triangleCount + Width - 1) / Width;
+	for (uint32_t b = 0; b < blockCount; b++)
+	{
+		TriangleBlock<Width> block;
+		const uint32_t first = b * Width;
+		block.count = std::min(Width, triangleCount - first);
+		for (uint32_t lane = 0; lane < Width; lane++)
+		{
+			const BvhTriangle& triangle = triangles[first + (lane < block.count ? lane : 0)];
+			const glm::vec3* vertices[3] = {&triangle.v0, &triangle.v1, &triangle.v2};
+			for (int vertex = 0; vertex < 3; vertex++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					block.vertices[vertex][axis][lane] = (*vertices[vertex])[axis];
+				}
+			}
+			block.primitiveIndices[lane] = triangle.primitiveIndex;
+			block.geometryIndices[lane] = triangle.geometryIndex;
+		}
+		blocks.push_back(block);
+	}
+	return blockCount;
+}
+
+template <uint32_t Width>
+int IntersectTriangleBlock(const TriangleBlock<Width>& block, const WatertightRay& ray, float tMin, float tMax,
+                           float& t, Attributes& attrib)
+{
+	float distances[Width], bary0[Width], bary1[Width];
+	const uint32_t usedLanes = (1u << block.count) - 1;
+	const LaneResults results = IntersectAllLanes<Width>(block, ray, tMin, tMax, distances, bary0, bary1);
+
+	uint32_t hitMask = results.hitMask & usedLanes;
+	uint32_t ambiguousMask = results.ambiguousMask & usedLanes;
+	while (ambiguousMask != 0)
+	{
+		const uint32_t lane = glm::findLSB(ambiguousMask);
+		ambiguousMask &= ambiguousMask - 1;
+		glm::vec3 v0, v1, v2;
+		GetBlockTriangle(block, lane, v0, v1, v2);
+		Attributes laneAttrib;
+		if (IntersectTriangleWatertight(ray, tMin, tMax, v0, v1, v2, distances[lane], laneAttrib))
+		{
+			bary0[lane] = laneAttrib.bary.x;
+			bary1[lane] = laneAttrib.bary.y;
+			hitMask |= 1u << lane;
+		}
+	}
+
+	int closest = -1;
+	while (hitMask != 0)
+	{
+		const uint32_t lane = glm::findLSB(hitMask);
+		hitMask &= hitMask - 1;
+		if (closest < 0 || distances[lane] < distances[closest])
+			closest = static_cast<int>(lane);
+	}
+	if (closest >= 0)
+	{
+		t = distances[closest];
+		attrib.bary = glm::vec2(bary0[closest], bary1[closest]);
+	}
+	return closest;
+}
+
+template <uint32_t Width>
+void GetBlockTriangle(const TriangleBlock<Width>& block, uint32_t lane, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2)
+{
+	glm::vec3* vertices[3] = {&v0, &v1, &v2};
+	for (int vertex = 0; vertex < 3; vertex++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			(*vertices[vertex])[axis] = block.vertices[vertex][axis][lane];
+		}
+	}
+}
+
+const char* GetTriangleBlockInstructionSet(uint32_t width)
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	return width > 4 ? "AVX" : "SSE";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	return width > 4 ? "2x SSE" : "SSE";
+#else
+	(void)width;
+	return "scalar";
+#endif
+}
+
+template uint32_t PackTriangleBlocks<4>(const BvhTriangle*, uint32_t, std::vector<TriangleBlock<4>>&);
+template uint32_t PackTriangleBlocks<8>(const BvhTriangle*, uint32_t, std::vector<TriangleBlock<8>>&);
+template int IntersectTriangleBlock<4>(const TriangleBlock<4>&, const WatertightRay&, float, float, float&, Attributes&);
+template int IntersectTriangleBlock<8>(const TriangleBlock<8>&, const WatertightRay&, float, float, float&, Attributes&);
+template void GetBlockTriangle<4>(const TriangleBlock<4>&, uint32_t, glm::vec3&, glm::vec3&, glm::vec3&);
+template void GetBlockTriangle<8>(const TriangleBlock<8>&, uint32_t, glm::vec3&, glm::vec3&, glm::vec3&);
+
+} // namespace cpu_rt
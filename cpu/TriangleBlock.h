@@ -0,0 +1,52 @@
+#pragma once
+
+// Leaves of the wide hierarchies: groups of up to 4 or 8 triangles stored as
+// structures of arrays, so that one SIMD watertight test intersects a ray with
+// all the triangles of a block. The vertex positions are stored rather than
+// precomputed edges, as the watertight test needs the exact positions shared
+// by neighbouring triangles. The SIMD paths use the instruction sets detected
+// by glm/simd/platform.h, as the wide node tests do.
+
+#include "Bvh.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+template <uint32_t Width>
+struct alignas(16) TriangleBlock
+{
+	/// Vertex positions, indexed by [vertex][axis][lane]
+	float vertices[3][3][Width];
+	/// Indices identifying the triangle of each lane in the input, as in
+	/// BvhTriangle
+	uint32_t primitiveIndices[Width];
+	uint32_t geometryIndices[Width];
+	/// Number of triangles, stored in the first lanes. The other lanes repeat
+	/// the first triangle and are never reported as hit
+	uint32_t count;
+};
+
+/// Append the triangles to blocks, in order, filling each block before
+/// starting the next one. Returns the number of blocks added
+template <uint32_t Width>
+uint32_t PackTriangleBlocks(const BvhTriangle* triangles, uint32_t triangleCount,
+                            std::vector<TriangleBlock<Width>>& blocks);
+
+/// Watertight test of a ray against all the triangles of a block. Returns the
+/// lane of the closest hit in ]tMin, tMax[, or -1 if there is none, along with
+/// the distance and barycentrics of the hit
+template <uint32_t Width>
+int IntersectTriangleBlock(const TriangleBlock<Width>& block, const WatertightRay& ray, float tMin, float tMax,
+                           float& t, Attributes& attrib);
+
+/// Vertex positions of one lane of a block
+template <uint32_t Width>
+void GetBlockTriangle(const TriangleBlock<Width>& block, uint32_t lane, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2);
+
+/// Instruction set of the triangle block tests of this build: "AVX", "SSE" or
+/// "scalar"
+const char* GetTriangleBlockInstructionSet(uint32_t width);
+
+} // namespace cpu_rt
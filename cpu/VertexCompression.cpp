@@ -0,0 +1,99 @@
+#include "VertexCompression.h"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Largest quantized coordinate, mapped to the maximum of the bounds
+static const float kQuantizedMax = 65535.f;
+
+} // namespace
+
+uint32_t PackRgba8(const glm::vec4& color)
+{
+	const glm::vec4 saturated = glm::clamp(color, 0.f, 1.f);
+	uint32_t packed = 0;
+	for (int channel = 0; channel < 4; channel++)
+	{
+		packed |= static_cast<uint32_t>(saturated[channel] * 255.f + 0.5f) << (8 * channel);
+	}
+	return packed;
+}
+
+glm::vec4 UnpackRgba8(uint32_t color)
+{
+	// Dividing rather than multiplying by 1/255 rounds each channel once, so
+	// that the colors of n/255 channels decode exactly
+	return glm::vec4(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, color >> 24) / 255.f;
+}
+
+CompressedVertexBuffer::CompressedVertexBuffer(const Vertex* vertices, uint32_t vertexCount,
+                                               VertexColorFormat colorFormat)
+    : m_colorFormat(colorFormat), m_vertices(vertexCount)
+{
+	Aabb bounds;
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		bounds.Extend(glm::vec3(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]));
+	}
+	if (vertexCount == 0)
+		return;
+	// Flat axes keep a null scale, and every position decodes to the origin
+	const glm::vec3 extent = bounds.max - bounds.min;
+	const glm::vec3 inverseScale =
+	    glm::vec3(glm::greaterThan(extent, glm::vec3(0.f))) * kQuantizedMax / glm::max(extent, glm::vec3(1e-30f));
+	m_origin = bounds.min;
+	m_scale = extent / kQuantizedMax;
+
+	std::unordered_map<uint32_t, uint16_t> paletteIndices;
+	if (colorFormat == VertexColorFormat::Rgba8)
+		m_colors.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const float* position = vertices[i].position;
+		const glm::vec3 quantized = glm::clamp(
+		    (glm::vec3(position[0], position[1], position[2]) - m_origin) * inverseScale + 0.5f, 0.f, kQuantizedMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			m_vertices[i].position[axis] = static_cast<uint16_t>(quantized[axis]);
+		}
+
+		const float* color = vertices[i].color;
+		const uint32_t packed = PackRgba8(glm::vec4(color[0], color[1], color[2], color[3]));
+		if (colorFormat == VertexColorFormat::Rgba8)
+		{
+			m_colors[i] = packed;
+			continue;
+		}
+		auto inserted = paletteIndices.emplace(packed, static_cast<uint16_t>(m_palette.size()));
+		if (inserted.second)
+		{
+			if (m_palette.size() == 65536)
+			{
+				throw std::length_error("More than 65536 colors do not fit in a vertex palette");
+			}
+			m_palette.push_back(packed);
+		}
+		m_vertices[i].colorIndex = inserted.first->second;
+	}
+}
+
+Vertex CompressedVertexBuffer::GetVertex(uint32_t index) const
+{
+	const glm::vec3 position = GetPosition(index);
+	const glm::vec4 color = GetColor(index);
+	return {{position.x, position.y, position.z}, {color.r, color.g, color.b, color.a}};
+}
+
+size_t CompressedVertexBuffer::GetMemorySize() const
+{
+	return m_vertices.size() * sizeof(CompressedVertex) + (m_colors.size() + m_palette.size()) * sizeof(uint32_t);
+}
+
+} // namespace cpu_rt
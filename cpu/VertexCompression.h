@@ -0,0 +1,84 @@
+#pragma once
+
+// Compact vertex streams. Vertex takes 28 bytes, 16 of them for a float
+// color whose channels are 8-bit in practice. A compressed stream quantizes
+// the positions to 16 bits per axis over the bounds of the mesh, and stores
+// the colors either as RGBA8 next to the vertices (12 bytes per vertex) or as
+// 16-bit indices in a palette of the distinct colors of the mesh (8 bytes per
+// vertex). The shaders decode the vertices they fetch, as ClosestHit does in
+// Shaders.cpp, and the bottom-level hierarchies are built over the decoded
+// positions, so that both see the same triangles. The GPU scene keeps its
+// full vertices.
+
+#include "Geometry.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+enum class VertexColorFormat : uint32_t
+{
+	Rgba8,
+	Palette,
+};
+
+/// Position quantized over the bounds of the mesh, and index of the color in
+/// the palette (0 for RGBA8 colors). The layout of DXGI_FORMAT_R16G16B16A16_UINT
+struct CompressedVertex
+{
+	uint16_t position[3];
+	uint16_t colorIndex;
+};
+static_assert(sizeof(CompressedVertex) == 8, "cpu_rt::CompressedVertex must have the layout of R16G16B16A16_UINT");
+
+/// Color as RGBA8, red in the low byte as in DXGI_FORMAT_R8G8B8A8_UNORM. The
+/// channels are saturated and rounded, and decode exactly to the nearest
+/// float of n/255
+uint32_t PackRgba8(const glm::vec4& color);
+glm::vec4 UnpackRgba8(uint32_t color);
+
+class CompressedVertexBuffer
+{
+public:
+	CompressedVertexBuffer() = default;
+	/// Compress vertices. Throws std::length_error if the palette format is
+	/// asked for more than 65536 distinct colors
+	CompressedVertexBuffer(const Vertex* vertices, uint32_t vertexCount, VertexColorFormat colorFormat);
+
+	uint32_t GetVertexCount() const { return static_cast<uint32_t>(m_vertices.size()); }
+	VertexColorFormat GetColorFormat() const { return m_colorFormat; }
+
+	glm::vec3 GetPosition(uint32_t index) const
+	{
+		const uint16_t* position = m_vertices[index].position;
+		return m_origin + glm::vec3(position[0], position[1], position[2]) * m_scale;
+	}
+	glm::vec4 GetColor(uint32_t index) const
+	{
+		return UnpackRgba8(m_colorFormat == VertexColorFormat::Palette ? m_palette[m_vertices[index].colorIndex]
+		                                                               : m_colors[index]);
+	}
+	Vertex GetVertex(uint32_t index) const;
+
+	/// Decoding of the positions: origin + quantized * scale
+	const glm::vec3& GetOrigin() const { return m_origin; }
+	const glm::vec3& GetScale() const { return m_scale; }
+	const std::vector<CompressedVertex>& GetVertices() const { return m_vertices; }
+	/// RGBA8 color of each vertex, empty with a palette
+	const std::vector<uint32_t>& GetColors() const { return m_colors; }
+	/// Distinct RGBA8 colors, empty without a palette
+	const std::vector<uint32_t>& GetPalette() const { return m_palette; }
+	/// Bytes of the vertices, colors and palette
+	size_t GetMemorySize() const;
+
+private:
+	glm::vec3 m_origin = glm::vec3(0.f);
+	glm::vec3 m_scale = glm::vec3(0.f);
+	VertexColorFormat m_colorFormat = VertexColorFormat::Rgba8;
+	std::vector<CompressedVertex> m_vertices;
+	std::vector<uint32_t> m_colors;
+	std::vector<uint32_t> m_palette;
+};
+
+} // namespace cpu_rt
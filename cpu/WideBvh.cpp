@@ -0,0 +1,674 @@
+#include "WideBvh.h"
+
+#include <glm/integer.hpp>
+#include <glm/simd/platform.h>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace cpu_rt
+{
+
+namespace
+{
+
+/// Ray data shared by the slab tests of all the nodes: the origin scaled by
+/// the reciprocal direction, and for each axis whether the near plane of the
+/// boxes is their max plane. Also holds the ray of the triangle block tests
+struct WideRay
+{
+	TraversalRay ray;
+	glm::vec3 scaledOrigin;
+	bool nearIsMax[3];
+	WatertightRay triangleRay;
+
+	explicit WideRay(const RayDesc& rayDesc) : ray(rayDesc), triangleRay(rayDesc.Origin, rayDesc.Direction)
+	{
+		scaledOrigin = ray.origin * ray.invDirection;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			nearIsMax[axis] = ray.invDirection[axis] < 0.f;
+		}
+	}
+};
+
+/// Slab test of a ray against all the children of a node. Returns the mask of
+/// the children hit in [tMin, tMax], and their entry distances in tEntry
+template <uint32_t Width>
+uint32_t IntersectChildren(const WideBvhNode<Width>& node, const WideRay& r, float tMax, float* tEntry);
+
+/// Planes of the quantized child boxes of a node, as seen by a ray: the
+/// distance to the plane of grid coordinate q along an axis is
+/// q * cellScale + cellOffset
+struct QuantizedPlanes
+{
+	float cellScale[3];
+	float cellOffset[3];
+
+	template <uint32_t Width>
+	QuantizedPlanes(const QuantizedWideBvhNode<Width>& node, const WideRay& r)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			cellScale[axis] = ExponentToScale(node.exponents[axis]) * r.ray.invDirection[axis];
+			cellOffset[axis] = (node.origin[axis] - r.ray.origin[axis]) * r.ray.invDirection[axis];
+		}
+	}
+
+	/// Exact power of 2, built from the bits of the float
+	static float ExponentToScale(int8_t exponent)
+	{
+		const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+		float scale;
+		std::memcpy(&scale, &bits, sizeof(scale));
+		return scale;
+	}
+};
+
+static_assert(sizeof(QuantizedWideBvhNode<4>) == 64, "4-wide quantized nodes must fit in 64 bytes");
+static_assert(sizeof(QuantizedWideBvhNode<8>) == 80, "8-wide quantized nodes must fit in 80 bytes");
+
+template <uint32_t Width>
+uint32_t IntersectQuantizedChildrenScalar(const QuantizedWideBvhNode<Width>& node, const WideRay& r, float tMax,
+                                          float* tEntry)
+{
+	const QuantizedPlanes planes(node, r);
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < Width; i++)
+	{
+		float tNear = r.ray.tMin, tFar = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float nearCell = r.nearIsMax[axis] ? node.boundsMax[axis][i] : node.boundsMin[axis][i];
+			const float farCell = r.nearIsMax[axis] ? node.boundsMin[axis][i] : node.boundsMax[axis][i];
+			tNear = std::max(tNear, nearCell * planes.cellScale[axis] + planes.cellOffset[axis]);
+			tFar = std::min(tFar, farCell * planes.cellScale[axis] + planes.cellOffset[axis]);
+		}
+		tEntry[i] = tNear;
+		mask |= (tNear <= tFar ? 1u : 0u) << i;
+	}
+	return mask;
+}
+
+template <uint32_t Width>
+uint32_t IntersectQuantizedChildren(const QuantizedWideBvhNode<Width>& node, const WideRay& r, float tMax,
+                                    float* tEntry);
+
+template <uint32_t Width>
+uint32_t IntersectChildrenScalar(const WideBvhNode<Width>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < Width; i++)
+	{
+		float tNear = r.ray.tMin, tFar = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float nearPlane = r.nearIsMax[axis] ? node.boundsMax[axis][i] : node.boundsMin[axis][i];
+			const float farPlane = r.nearIsMax[axis] ? node.boundsMin[axis][i] : node.boundsMax[axis][i];
+			tNear = std::max(tNear, nearPlane * r.ray.invDirection[axis] - r.scaledOrigin[axis]);
+			tFar = std::min(tFar, farPlane * r.ray.invDirection[axis] - r.scaledOrigin[axis]);
+		}
+		tEntry[i] = tNear;
+		mask |= (tNear <= tFar ? 1u : 0u) << i;
+	}
+	return mask;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+/// SSE slab test of 4 consecutive child slots starting at offset
+template <uint32_t Width>
+uint32_t IntersectChildrenSse(const WideBvhNode<Width>& node, const WideRay& r, float tMax, float* tEntry,
+                              uint32_t offset)
+{
+	__m128 tNear = _mm_set1_ps(r.ray.tMin);
+	__m128 tFar = _mm_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float* nearPlanes = r.nearIsMax[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+		const float* farPlanes = r.nearIsMax[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+		const __m128 invDirection = _mm_set1_ps(r.ray.invDirection[axis]);
+		const __m128 scaledOrigin = _mm_set1_ps(r.scaledOrigin[axis]);
+		tNear = _mm_max_ps(tNear, _mm_sub_ps(_mm_mul_ps(_mm_load_ps(nearPlanes + offset), invDirection), scaledOrigin));
+		tFar = _mm_min_ps(tFar, _mm_sub_ps(_mm_mul_ps(_mm_load_ps(farPlanes + offset), invDirection), scaledOrigin));
+	}
+	_mm_storeu_ps(tEntry + offset, tNear);
+	return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) << offset;
+}
+
+template <>
+uint32_t IntersectChildren<4>(const WideBvhNode<4>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectChildrenSse(node, r, tMax, tEntry, 0);
+}
+
+/// Convert 4 grid coordinates to floats
+inline __m128 LoadCells4(const uint8_t* cells)
+{
+	int32_t packed;
+	std::memcpy(&packed, cells, sizeof(packed));
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero));
+}
+
+/// SSE slab test of 4 consecutive quantized child slots starting at offset
+template <uint32_t Width>
+uint32_t IntersectQuantizedChildrenSse(const QuantizedWideBvhNode<Width>& node, const WideRay& r,
+                                       const QuantizedPlanes& planes, float tMax, float* tEntry, uint32_t offset)
+{
+	__m128 tNear = _mm_set1_ps(r.ray.tMin);
+	__m128 tFar = _mm_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const uint8_t* nearCells = r.nearIsMax[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+		const uint8_t* farCells = r.nearIsMax[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+		const __m128 cellScale = _mm_set1_ps(planes.cellScale[axis]);
+		const __m128 cellOffset = _mm_set1_ps(planes.cellOffset[axis]);
+		tNear = _mm_max_ps(tNear, _mm_add_ps(_mm_mul_ps(LoadCells4(nearCells + offset), cellScale), cellOffset));
+		tFar = _mm_min_ps(tFar, _mm_add_ps(_mm_mul_ps(LoadCells4(farCells + offset), cellScale), cellOffset));
+	}
+	_mm_storeu_ps(tEntry + offset, tNear);
+	return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) << offset;
+}
+
+template <>
+uint32_t IntersectQuantizedChildren<4>(const QuantizedWideBvhNode<4>& node, const WideRay& r, float tMax,
+                                       float* tEntry)
+{
+	return IntersectQuantizedChildrenSse(node, r, QuantizedPlanes(node, r), tMax, tEntry, 0);
+}
+
+#	if GLM_ARCH & GLM_ARCH_AVX_BIT
+
+template <>
+uint32_t IntersectChildren<8>(const WideBvhNode<8>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	__m256 tNear = _mm256_set1_ps(r.ray.tMin);
+	__m256 tFar = _mm256_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float* nearPlanes = r.nearIsMax[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+		const float* farPlanes = r.nearIsMax[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+		const __m256 invDirection = _mm256_set1_ps(r.ray.invDirection[axis]);
+		const __m256 scaledOrigin = _mm256_set1_ps(r.scaledOrigin[axis]);
+		tNear = _mm256_max_ps(tNear, _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(nearPlanes), invDirection), scaledOrigin));
+		tFar = _mm256_min_ps(tFar, _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(farPlanes), invDirection), scaledOrigin));
+	}
+	_mm256_storeu_ps(tEntry, tNear);
+	return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+}
+
+/// Convert 8 grid coordinates to floats
+inline __m256 LoadCells8(const uint8_t* cells)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cells)), zero);
+	const __m128i low = _mm_unpacklo_epi16(words, zero);
+	const __m128i high = _mm_unpackhi_epi16(words, zero);
+	return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+template <>
+uint32_t IntersectQuantizedChildren<8>(const QuantizedWideBvhNode<8>& node, const WideRay& r, float tMax,
+                                       float* tEntry)
+{
+	const QuantizedPlanes planes(node, r);
+	__m256 tNear = _mm256_set1_ps(r.ray.tMin);
+	__m256 tFar = _mm256_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const uint8_t* nearCells = r.nearIsMax[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+		const uint8_t* farCells = r.nearIsMax[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+		const __m256 cellScale = _mm256_set1_ps(planes.cellScale[axis]);
+		const __m256 cellOffset = _mm256_set1_ps(planes.cellOffset[axis]);
+		tNear = _mm256_max_ps(tNear, _mm256_add_ps(_mm256_mul_ps(LoadCells8(nearCells), cellScale), cellOffset));
+		tFar = _mm256_min_ps(tFar, _mm256_add_ps(_mm256_mul_ps(LoadCells8(farCells), cellScale), cellOffset));
+	}
+	_mm256_storeu_ps(tEntry, tNear);
+	return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+}
+
+#	else
+
+template <>
+uint32_t IntersectChildren<8>(const WideBvhNode<8>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectChildrenSse(node, r, tMax, tEntry, 0) | IntersectChildrenSse(node, r, tMax, tEntry, 4);
+}
+
+template <>
+uint32_t IntersectQuantizedChildren<8>(const QuantizedWideBvhNode<8>& node, const WideRay& r, float tMax,
+                                       float* tEntry)
+{
+	const QuantizedPlanes planes(node, r);
+	return IntersectQuantizedChildrenSse(node, r, planes, tMax, tEntry, 0) |
+	       IntersectQuantizedChildrenSse(node, r, planes, tMax, tEntry, 4);
+}
+
+#	endif
+
+#else
+
+template <>
+uint32_t IntersectChildren<4>(const WideBvhNode<4>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectChildrenScalar(node, r, tMax, tEntry);
+}
+
+template <>
+uint32_t IntersectChildren<8>(const WideBvhNode<8>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectChildrenScalar(node, r, tMax, tEntry);
+}
+
+template <>
+uint32_t IntersectQuantizedChildren<4>(const QuantizedWideBvhNode<4>& node, const WideRay& r, float tMax,
+                                       float* tEntry)
+{
+	return IntersectQuantizedChildrenScalar(node, r, tMax, tEntry);
+}
+
+template <>
+uint32_t IntersectQuantizedChildren<8>(const QuantizedWideBvhNode<8>& node, const WideRay& r, float tMax,
+                                       float* tEntry)
+{
+	return IntersectQuantizedChildrenScalar(node, r, tMax, tEntry);
+}
+
+#endif
+
+// Access to the children of both node formats, for the traversal
+
+template <uint32_t Width>
+uint32_t IntersectNodeChildren(const WideBvhNode<Width>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectChildren<Width>(node, r, tMax, tEntry);
+}
+
+template <uint32_t Width>
+uint32_t IntersectNodeChildren(const QuantizedWideBvhNode<Width>& node, const WideRay& r, float tMax, float* tEntry)
+{
+	return IntersectQuantizedChildren<Width>(node, r, tMax, tEntry);
+}
+
+/// Node index (count 0) or triangle block range of the child in a slot.
+/// Returns false for empty slots
+template <uint32_t Width>
+bool GetChild(const WideBvhNode<Width>& node, uint32_t slot, uint32_t& index, uint32_t& count)
+{
+	index = node.children[slot];
+	count = node.counts[slot];
+	return count != kWideBvhEmptySlot;
+}
+
+template <uint32_t Width>
+bool GetChild(const QuantizedWideBvhNode<Width>& node, uint32_t slot, uint32_t& index, uint32_t& count)
+{
+	const uint32_t slotsBefore = (1u << slot) - 1;
+	if ((node.innerMask >> slot) & 1)
+	{
+		index = node.firstChild + glm::bitCount(node.innerMask & slotsBefore);
+		count = 0;
+		return true;
+	}
+	count = node.blockCounts[slot];
+	index = node.firstBlock;
+	for (uint32_t i = 0; i < slot; i++)
+	{
+		index += node.blockCounts[i];
+	}
+	return count > 0;
+}
+
+} // namespace
+
+template <uint32_t Width>
+void WideBvh<Width>::Build(const Bvh& bvh, WideBvhNodeFormat format)
+{
+	m_nodes.clear();
+	m_quantizedNodes.clear();
+	m_blocks.clear();
+	m_bounds = bvh.GetBounds();
+	m_format = format;
+
+	if (bvh.IsProcedural() || bvh.HasQuads())
+	{
+		throw std::logic_error("Wide hierarchies only hold triangles");
+	}
+	const ArrayView<BvhNode> binaryNodes = bvh.GetNodes();
+	if (binaryNodes.empty())
+		return;
+
+	// Each wide node replaces at least Width - 1 binary inner nodes
+	m_nodes.reserve(binaryNodes.size() / (2 * (Width - 1)) + 1);
+	CollapseNode(binaryNodes, bvh.GetTriangles(), 0);
+	m_nodes.shrink_to_fit();
+	m_blocks.shrink_to_fit();
+	if (format == WideBvhNodeFormat::Quantized)
+	{
+		Quantize();
+	}
+}
+
+template <uint32_t Width>
+void WideBvh<Width>::Quantize()
+{
+	std::vector<QuantizedWideBvhNode<Width>> quantizedNodes;
+	std::vector<TriangleBlock<Width>> blocks;
+	quantizedNodes.reserve(m_nodes.size());
+	blocks.reserve(m_blocks.size());
+
+	// Breadth-first conversion, so that the inner children of each node can be
+	// allocated together. The boxes are the exact ones, which the quantized
+	// boxes of the parents contain
+	struct PendingNode
+	{
+		uint32_t index;
+		uint32_t quantizedIndex;
+		Aabb bounds;
+	};
+	std::vector<PendingNode> pending = {{0, 0, m_bounds}};
+	quantizedNodes.emplace_back();
+
+	for (size_t p = 0; p < pending.size(); p++)
+	{
+		const PendingNode current = pending[p];
+		const WideBvhNode<Width>& node = m_nodes[current.index];
+		QuantizedWideBvhNode<Width> quantized = {};
+
+		// Grid of 255 cells covering the box of the node, with the smallest
+		// power of 2 cell size
+		float scales[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float origin = current.bounds.min[axis];
+			const float extent = current.bounds.max[axis] - origin;
+			int exponent = -126;
+			if (extent > 0.f)
+			{
+				std::frexp(extent / 255.f, &exponent);
+				exponent = glm::clamp(exponent, -126, 127);
+				while (exponent < 127 && origin + 255.f * std::ldexp(1.f, exponent) < current.bounds.max[axis])
+				{
+					exponent++;
+				}
+			}
+			quantized.origin[axis] = origin;
+			quantized.exponents[axis] = static_cast<int8_t>(exponent);
+			scales[axis] = std::ldexp(1.f, exponent);
+		}
+
+		quantized.firstChild = static_cast<uint32_t>(quantizedNodes.size());
+		quantized.firstBlock = static_cast<uint32_t>(blocks.size());
+		for (uint32_t i = 0; i < Width; i++)
+		{
+			if (node.counts[i] == kWideBvhEmptySlot)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					quantized.boundsMin[axis][i] = 255;
+					quantized.boundsMax[axis][i] = 0;
+				}
+				continue;
+			}
+
+			// Round outwards, so that the quantized box contains the child
+			Aabb childBounds;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				childBounds.min[axis] = node.boundsMin[axis][i];
+				childBounds.max[axis] = node.boundsMax[axis][i];
+				const float origin = quantized.origin[axis];
+				float low = std::floor((childBounds.min[axis] - origin) / scales[axis]);
+				float high = std::ceil((childBounds.max[axis] - origin) / scales[axis]);
+				low = glm::clamp(low, 0.f, 255.f);
+				high = glm::clamp(high, 0.f, 255.f);
+				while (low > 0.f && origin + low * scales[axis] > childBounds.min[axis])
+				{
+					low -= 1.f;
+				}
+				while (high < 255.f && origin + high * scales[axis] < childBounds.max[axis])
+				{
+					high += 1.f;
+				}
+				quantized.boundsMin[axis][i] = static_cast<uint8_t>(low);
+				quantized.boundsMax[axis][i] = static_cast<uint8_t>(high);
+			}
+
+			if (node.counts[i] == 0)
+			{
+				quantized.innerMask |= static_cast<uint8_t>(1u << i);
+				pending.push_back({node.children[i], static_cast<uint32_t>(quantizedNodes.size()), childBounds});
+				quantizedNodes.emplace_back();
+			}
+			else
+			{
+				if (node.counts[i] > 255)
+				{
+					throw std::logic_error("Leaf has too many triangle blocks for the quantized node format");
+				}
+				quantized.blockCounts[i] = static_cast<uint8_t>(node.counts[i]);
+				blocks.insert(blocks.end(), m_blocks.begin() + node.children[i],
+				              m_blocks.begin() + node.children[i] + node.counts[i]);
+			}
+		}
+		quantizedNodes[current.quantizedIndex] = quantized;
+	}
+
+	m_quantizedNodes.swap(quantizedNodes);
+	m_blocks.swap(blocks);
+	m_nodes.clear();
+	m_nodes.shrink_to_fit();
+}
+
+template <uint32_t Width>
+uint32_t WideBvh<Width>::CollapseNode(const ArrayView<BvhNode>& binaryNodes,
+                                     const ArrayView<BvhTriangle>& triangles, uint32_t binaryIndex)
+{
+	auto halfArea = [&](uint32_t index) {
+		Aabb box;
+		box.min = binaryNodes[index].boundsMin;
+		box.max = binaryNodes[index].boundsMax;
+		return box.HalfArea();
+	};
+
+	// Start from the children of the binary node (or from the node itself if
+	// the whole hierarchy is a single leaf), and open the largest inner child
+	// until the wide node is full
+	uint32_t children[Width];
+	uint32_t childCount = 0;
+	const BvhNode& binaryNode = binaryNodes[binaryIndex];
+	if (binaryNode.IsLeaf())
+	{
+		children[childCount++] = binaryIndex;
+	}
+	else
+	{
+		children[childCount++] = binaryNode.leftOrFirst;
+		children[childCount++] = binaryNode.leftOrFirst + 1;
+	}
+	while (childCount < Width)
+	{
+		int largest = -1;
+		float largestArea = -1.f;
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			if (!binaryNodes[children[i]].IsLeaf() && halfArea(children[i]) > largestArea)
+			{
+				largest = static_cast<int>(i);
+				largestArea = halfArea(children[i]);
+			}
+		}
+		if (largest < 0)
+			break;
+		const uint32_t opened = children[largest];
+		children[largest] = binaryNodes[opened].leftOrFirst;
+		children[childCount++] = binaryNodes[opened].leftOrFirst + 1;
+	}
+
+	const uint32_t wideIndex = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back(WideBvhNode<Width>());
+
+	// Empty slots get a box reduced to a point at infinity, which no ray hits
+	for (uint32_t i = childCount; i < Width; i++)
+	{
+		WideBvhNode<Width>& node = m_nodes[wideIndex];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.boundsMin[axis][i] = FLT_MAX;
+			node.boundsMax[axis][i] = FLT_MAX;
+		}
+		node.children[i] = 0;
+		node.counts[i] = kWideBvhEmptySlot;
+	}
+
+	for (uint32_t i = 0; i < childCount; i++)
+	{
+		const BvhNode& child = binaryNodes[children[i]];
+		// The recursion appends nodes, so the wide node is only referenced
+		// after it returns
+		uint32_t childIndex, blockCount = 0;
+		if (child.IsLeaf())
+		{
+			childIndex = static_cast<uint32_t>(m_blocks.size());
+			blockCount = PackTriangleBlocks(&triangles[child.leftOrFirst], child.count, m_blocks);
+		}
+		else
+		{
+			childIndex = CollapseNode(binaryNodes, triangles, children[i]);
+		}
+		WideBvhNode<Width>& node = m_nodes[wideIndex];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.boundsMin[axis][i] = child.boundsMin[axis];
+			node.boundsMax[axis][i] = child.boundsMax[axis];
+		}
+		node.children[i] = childIndex;
+		node.counts[i] = blockCount;
+	}
+	return wideIndex;
+}
+
+template <uint32_t Width>
+size_t WideBvh<Width>::GetMemoryInBytes() const
+{
+	return m_nodes.size() * sizeof(WideBvhNode<Width>) +
+	       m_quantizedNodes.size() * sizeof(QuantizedWideBvhNode<Width>) +
+	       m_blocks.size() * sizeof(TriangleBlock<Width>);
+}
+
+template <uint32_t Width>
+bool WideBvh<Width>::Intersect(const RayDesc& ray, TriangleHit& hit) const
+{
+	if (m_format == WideBvhNodeFormat::Quantized)
+		return Traverse<false>(m_quantizedNodes, ray, &hit);
+	return Traverse<false>(m_nodes, ray, &hit);
+}
+
+template <uint32_t Width>
+bool WideBvh<Width>::Occluded(const RayDesc& ray) const
+{
+	if (m_format == WideBvhNodeFormat::Quantized)
+		return Traverse<true>(m_quantizedNodes, ray, nullptr);
+	return Traverse<true>(m_nodes, ray, nullptr);
+}
+
+template <uint32_t Width>
+template <bool AnyHit, typename Node>
+bool WideBvh<Width>::Traverse(const std::vector<Node>& nodes, const RayDesc& rayDesc, TriangleHit* hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	const WideRay r(rayDesc);
+	float tClosest = r.ray.tMax;
+	bool found = false;
+
+	// Entries are either inner nodes (count 0) or leaves, which are tested when
+	// popped so that the triangles are visited front to back too
+	struct StackEntry
+	{
+		uint32_t index;
+		uint32_t count;
+		float tEntry;
+	};
+	StackEntry stack[kBvhMaxDepth * (Width - 1) + 1];
+	uint32_t stackSize = 0;
+
+	float tRoot;
+	if (!IntersectAabb(r.ray, m_bounds.min, m_bounds.max, tClosest, tRoot))
+		return false;
+	stack[stackSize++] = {0, 0, tRoot};
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.tEntry > tClosest)
+			continue;
+
+		if (entry.count > 0)
+		{
+			for (uint32_t i = entry.index; i < entry.index + entry.count; i++)
+			{
+				const TriangleBlock<Width>& block = m_blocks[i];
+				float t;
+				Attributes attrib;
+				const int lane = IntersectTriangleBlock(block, r.triangleRay, r.ray.tMin, tClosest, t, attrib);
+				if (lane < 0)
+					continue;
+				if (AnyHit)
+					return true;
+				tClosest = t;
+				*hit = {t, attrib, block.primitiveIndices[lane], block.geometryIndices[lane]};
+				found = true;
+			}
+			continue;
+		}
+
+		const Node& node = nodes[entry.index];
+		float tEntry[Width];
+		uint32_t mask = IntersectNodeChildren(node, r, tClosest, tEntry);
+
+		// Sort the children hit from far to near, so that the nearest is
+		// pushed last and popped first
+		StackEntry hits[Width];
+		uint32_t hitCount = 0;
+		while (mask != 0)
+		{
+			const uint32_t i = glm::findLSB(mask);
+			mask &= mask - 1;
+			uint32_t childIndex, childCount;
+			if (!GetChild(node, i, childIndex, childCount))
+				continue;
+			const StackEntry child = {childIndex, childCount, tEntry[i]};
+			uint32_t j = hitCount++;
+			for (; j > 0 && hits[j - 1].tEntry < child.tEntry; j--)
+			{
+				hits[j] = hits[j - 1];
+			}
+			hits[j] = child;
+		}
+		for (uint32_t i = 0; i < hitCount; i++)
+		{
+			stack[stackSize++] = hits[i];
+		}
+	}
+	return found;
+}
+
+const char* GetWideBvhInstructionSet()
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	return "AVX";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+template class WideBvh<4>;
+template class WideBvh<8>;
+
+} // namespace cpu_rt
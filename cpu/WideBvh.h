@@ -0,0 +1,127 @@
+#pragma once
+
+// Multi-way bounding volume hierarchies (BVH4 and BVH8), collapsed from a
+// binary Bvh. The boxes of the children of a node are stored as structures of
+// arrays, so that one SIMD slab test intersects a ray with all of them: SSE
+// for 4-wide nodes, and AVX for 8-wide nodes when the build enables it (two
+// SSE halves otherwise). The SIMD paths use the instruction sets detected by
+// glm/simd/platform.h, with a scalar fallback. The leaves are triangle blocks
+// of the same width as the nodes, intersected with a SIMD watertight test.
+//
+// The nodes are stored either with full-precision child boxes, or in a
+// compact format where the child boxes are quantized to 8 bits per plane
+// relative to the box of the node, which is chosen when building.
+
+#include "TriangleBlock.h"
+
+#include <vector>
+
+namespace cpu_rt
+{
+
+/// Child slot of a wide node that holds no child
+static const uint32_t kWideBvhEmptySlot = ~0u;
+
+template <uint32_t Width>
+struct alignas(16) WideBvhNode
+{
+	/// Child boxes, indexed by [axis][slot]
+	float boundsMin[3][Width];
+	float boundsMax[3][Width];
+	/// Index of the child node for inner children, index of the first triangle
+	/// block for leaves
+	uint32_t children[Width];
+	/// 0 for inner children, number of triangle blocks for leaves, and
+	/// kWideBvhEmptySlot for empty slots
+	uint32_t counts[Width];
+};
+
+/// Compact node: the child boxes are stored on a grid of 256 cells per axis
+/// over the box of the node, whose cell sizes are powers of two so that the
+/// grid coordinates convert exactly. The children are not referenced one by
+/// one: the inner children are consecutive nodes, and the triangle blocks of
+/// the leaf children are consecutive blocks, both in slot order. 64 bytes for
+/// 4 children and 80 bytes for 8, against 128 and 256 bytes for WideBvhNode
+template <uint32_t Width>
+struct alignas(16) QuantizedWideBvhNode
+{
+	/// Lower corner of the grid
+	float origin[3];
+	/// Cell size of the grid on each axis, as a power of 2
+	int8_t exponents[3];
+	/// Bit i is set if slot i holds an inner node
+	uint8_t innerMask;
+	/// Index of the first inner child node, and of the first triangle block of
+	/// the leaf children
+	uint32_t firstChild;
+	uint32_t firstBlock;
+	/// Child boxes in grid cells, indexed by [axis][slot]. Empty slots get an
+	/// inverted box, which no ray hits
+	uint8_t boundsMin[3][Width];
+	uint8_t boundsMax[3][Width];
+	/// Number of triangle blocks of the leaf children, 0 for inner children and
+	/// empty slots
+	uint8_t blockCounts[Width];
+};
+
+/// Storage of the child boxes of the wide nodes
+enum class WideBvhNodeFormat
+{
+	/// WideBvhNode: 32-bit floats
+	Full,
+	/// QuantizedWideBvhNode: 8-bit grid coordinates
+	Quantized,
+};
+
+template <uint32_t Width>
+class WideBvh
+{
+public:
+	static_assert(Width == 4 || Width == 8, "Wide hierarchies have 4 or 8 children per node");
+
+	/// Collapse a built binary hierarchy, pulling up the children with the
+	/// largest surface area until the nodes are full. The triangles of each
+	/// binary leaf are copied to blocks of Width triangles, so binary leaves of
+	/// up to Width triangles make the best use of the blocks. Throws
+	/// std::logic_error for hierarchies of procedural primitives or of quads
+	void Build(const Bvh& bvh, WideBvhNodeFormat format = WideBvhNodeFormat::Full);
+
+	/// Closest intersection in ]TMin, TMax[
+	bool Intersect(const RayDesc& ray, TriangleHit& hit) const;
+	/// Return true as soon as any intersection is found in ]TMin, TMax[
+	bool Occluded(const RayDesc& ray) const;
+
+	Aabb GetBounds() const { return m_bounds; }
+	WideBvhNodeFormat GetNodeFormat() const { return m_format; }
+	/// Nodes of the Full format, empty for the Quantized format
+	const std::vector<WideBvhNode<Width>>& GetNodes() const { return m_nodes; }
+	/// Nodes of the Quantized format, empty for the Full format
+	const std::vector<QuantizedWideBvhNode<Width>>& GetQuantizedNodes() const { return m_quantizedNodes; }
+	const std::vector<TriangleBlock<Width>>& GetTriangleBlocks() const { return m_blocks; }
+	size_t GetMemoryInBytes() const;
+
+private:
+	uint32_t CollapseNode(const ArrayView<BvhNode>& binaryNodes, const ArrayView<BvhTriangle>& triangles,
+	                      uint32_t binaryIndex);
+	/// Convert the full-precision nodes to the quantized format, reordering the
+	/// nodes and blocks so that the children of each node are consecutive
+	void Quantize();
+
+	template <bool AnyHit, typename Node>
+	bool Traverse(const std::vector<Node>& nodes, const RayDesc& ray, TriangleHit* hit) const;
+
+	Aabb m_bounds;
+	WideBvhNodeFormat m_format = WideBvhNodeFormat::Full;
+	std::vector<WideBvhNode<Width>> m_nodes;
+	std::vector<QuantizedWideBvhNode<Width>> m_quantizedNodes;
+	std::vector<TriangleBlock<Width>> m_blocks;
+};
+
+using Bvh4 = WideBvh<4>;
+using Bvh8 = WideBvh<8>;
+
+/// Instruction set of the child box tests of this build: "AVX", "SSE" or
+/// "scalar"
+const char* GetWideBvhInstructionSet();
+
+} // namespace cpu_rt
@@ -59,16 +59,19 @@ void CubeClosestHit(inout HitInfo payload, Attributes attrib)
     ray.TMax = 100000;
     bool hit = true;
 
-    // Initialize the ray payload
+    // Initialize the ray payload. The closest hit shader is skipped, so only
+    // the miss shader writes it
     ShadowHitInfo shadowPayload;
-    shadowPayload.isHit = false;
+    shadowPayload.isHit = true;
 
     // Trace the ray
     TraceRay(
         // Acceleration structure
         SceneBVH,
-        // Flags can be used to specify the behavior upon hitting a surface
-        RAY_FLAG_NONE,
+        // Flags can be used to specify the behavior upon hitting a surface. Any
+        // hit is enough to shadow the point, so the search ends on the first
+        // one and no closest hit shader is invoked
+        RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER,
         // Instance inclusion mask, which can be used to mask out some geometry to
         // this ray by and-ing the mask with a geometry mask. The 0xFF flag then
         // indicates no geometry will be masked
@@ -0,0 +1,141 @@
+#include "Common.hlsl"
+
+// Intersection shader of the procedural hit groups, tracing the analytic
+// primitives of the AABB geometries: spheres, boxes, planes and quads. It is
+// the GPU version of cpu_rt::IntersectProcedural (cpu/Procedural.h), whose
+// ProceduralPrimitive has the layout of SProceduralPrimitive. The attributes
+// it reports are those of the triangles, so the hit groups keep the closest
+// hit shaders of the triangle meshes
+
+static const uint kShapeSphere = 0;
+static const uint kShapeBox = 1;
+static const uint kShapePlane = 2;
+static const uint kShapeQuad = 3;
+
+static const float kPi = 3.14159265f;
+
+struct SProceduralPrimitive
+{
+	uint shape;
+	// Sphere: center and radius. Box: min and max corners. Plane: a point and
+	// the unit normal. Quad: a corner and the two edges leaving it
+	float3 p0;
+	float3 p1;
+	float3 p2;
+	float radius;
+	int level;
+	// Box given to the acceleration structure
+	float3 boundsMin;
+	float3 boundsMax;
+	uint primitiveIndex;
+	uint geometryIndex;
+};
+
+// Primitives of the geometry, indexed by PrimitiveIndex(). The buffer also
+// holds the boxes of the bottom-level acceleration structure
+StructuredBuffer<SProceduralPrimitive> primitives : register(t0);
+
+// Closest hit in ]tMin, tMax[ of an object-space ray. The attributes are the
+// coordinates of the hit on the surface, in [0,1]: longitude and latitude on
+// spheres, position on the face of boxes, position on quads, and 0 on planes.
+// Rays starting inside a sphere or a box hit it on the way out
+bool IntersectPrimitive(SProceduralPrimitive primitive, float3 origin, float3 direction, float tMin, float tMax,
+                        out float t, out Attributes attrib)
+{
+	t = 0;
+	attrib.bary = float2(0, 0);
+	if (primitive.shape == kShapeSphere)
+	{
+		// The direction is not normalized, so the quadratic keeps its a term
+		float3 oc = origin - primitive.p0;
+		float a = dot(direction, direction);
+		float b = dot(oc, direction);
+		float c = dot(oc, oc) - primitive.radius * primitive.radius;
+		float discriminant = b * b - a * c;
+		if (discriminant < 0 || a == 0)
+			return false;
+		float root = sqrt(discriminant);
+		t = (-b - root) / a;
+		if (!(t > tMin))
+			t = (-b + root) / a;
+		if (!(t > tMin && t < tMax))
+			return false;
+		float3 n = (oc + t * direction) / primitive.radius;
+		attrib.bary = float2(atan2(n.z, n.x) * (0.5f / kPi) + 0.5f, acos(clamp(n.y, -1, 1)) / kPi);
+		return true;
+	}
+	if (primitive.shape == kShapeBox)
+	{
+		// Null direction components are nudged, so that no slab gives NaN
+		float3 invDirection;
+		[unroll] for (int i = 0; i < 3; i++)
+		{
+			float d = abs(direction[i]) < 1e-20f ? (direction[i] < 0 ? -1e-20f : 1e-20f) : direction[i];
+			invDirection[i] = 1 / d;
+		}
+		float3 t0 = (primitive.p0 - origin) * invDirection;
+		float3 t1 = (primitive.p1 - origin) * invDirection;
+		float3 tNear = min(t0, t1);
+		float3 tFar = max(t0, t1);
+		float tEntry = max(max(tNear.x, tNear.y), tNear.z);
+		float tExit = min(min(tFar.x, tFar.y), tFar.z);
+		if (!(tEntry <= tExit))
+			return false;
+		bool entering = tEntry > tMin;
+		t = entering ? tEntry : tExit;
+		if (!(t > tMin && t < tMax))
+			return false;
+		// Axis of the face that was hit, and position on the face
+		float3 planes = entering ? tNear : tFar;
+		int axis = t == planes.x ? 0 : t == planes.y ? 1 : 2;
+		float3 uvw = (origin + t * direction - primitive.p0) / max(primitive.p1 - primitive.p0, 1e-30f);
+		attrib.bary = saturate(float2(uvw[(axis + 1) % 3], uvw[(axis + 2) % 3]));
+		return true;
+	}
+	if (primitive.shape == kShapePlane)
+	{
+		float denominator = dot(primitive.p1, direction);
+		if (denominator == 0)
+			return false;
+		t = dot(primitive.p0 - origin, primitive.p1) / denominator;
+		if (!(t > tMin && t < tMax))
+			return false;
+		// The bounds of a plane are often flat: allow for the rounding of the
+		// hit position across them
+		float3 p = origin + t * direction;
+		float3 tolerance = 1e-5f * (abs(primitive.boundsMin) + abs(primitive.boundsMax) + 1);
+		return all(p >= primitive.boundsMin - tolerance) && all(p <= primitive.boundsMax + tolerance);
+	}
+	if (primitive.shape == kShapeQuad)
+	{
+		float3 normal = cross(primitive.p1, primitive.p2);
+		float denominator = dot(normal, direction);
+		if (denominator == 0)
+			return false;
+		t = dot(primitive.p0 - origin, normal) / denominator;
+		if (!(t > tMin && t < tMax))
+			return false;
+		float3 p = origin + t * direction - primitive.p0;
+		float3 w = normal / dot(normal, normal);
+		float u = dot(w, cross(p, primitive.p2));
+		float v = dot(w, cross(primitive.p1, p));
+		if (u < 0 || u > 1 || v < 0 || v > 1)
+			return false;
+		attrib.bary = float2(u, v);
+		return true;
+	}
+	// Menger sponges are only traced on the CPU
+	return false;
+}
+
+[shader("intersection")]
+void ProceduralIntersection()
+{
+	float t;
+	Attributes attrib;
+	if (IntersectPrimitive(primitives[PrimitiveIndex()], ObjectRayOrigin(), ObjectRayDirection(), RayTMin(),
+	                       RayTCurrent(), t, attrib))
+	{
+		ReportHit(t, 0, attrib);
+	}
+}